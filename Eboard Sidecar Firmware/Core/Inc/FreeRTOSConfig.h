@@ -64,7 +64,7 @@
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 56 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)32768)
+#define configTOTAL_HEAP_SIZE                    ((size_t)1024)
 #define configMAX_TASK_NAME_LEN                  ( 32 )
 #define configUSE_TRACE_FACILITY                 1
 #define configUSE_16_BIT_TICKS                   0
@@ -156,6 +156,32 @@ standard names. */
 
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+/* run time stats count CPU cycles on the DWT cycle counter, see cpu_stats.h */
+#define configGENERATE_RUN_TIME_STATS            1
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+  void cpu_stats_timer_init(void);
+  extern volatile uint32_t cpu_stats_switches[];
+  #include "trace.h"
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS() cpu_stats_timer_init()
+#define portGET_RUN_TIME_COUNTER_VALUE()         (*(volatile uint32_t*)0xE0001004ul) /* DWT->CYCCNT */
+/* runs inside vTaskSwitchContext(); uxTaskNumber is 0 until cpu_stats numbers the thread */
+#define traceTASK_SWITCHED_IN()                  do { \
+    cpu_stats_switches[pxCurrentTCB->uxTaskNumber]++; \
+    trace_put(TRACE_SWITCH_IN, pxCurrentTCB->uxTaskNumber, 0); \
+  } while(0)
+/* RTOS event trace, see trace.h; every one of these runs in a critical section, with the scheduler
+   suspended or in an ISR. Queue numbers come from trace_init(), 0 for semaphores and mutexes */
+#define traceQUEUE_SEND(pxQueue)                 trace_put(TRACE_QUEUE_SEND, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue)        trace_put(TRACE_QUEUE_SEND, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE(pxQueue)              trace_put(TRACE_QUEUE_RECEIVE, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue)     trace_put(TRACE_QUEUE_RECEIVE, (pxQueue)->uxQueueNumber, (pxQueue)->uxMessagesWaiting)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue)  trace_put(TRACE_QUEUE_BLOCK, (pxQueue)->uxQueueNumber, 0)
+#define traceEVENT_GROUP_SET_BITS(xEventGroup, uxBitsToSet) \
+  trace_put(TRACE_FLAGS_SET, ((EventGroup_t*)(xEventGroup))->uxEventGroupNumber, (uxBitsToSet))
+#define traceEVENT_GROUP_WAIT_BITS_BLOCK(xEventGroup, uxBitsToWaitFor) \
+  trace_put(TRACE_FLAGS_BLOCK, ((EventGroup_t*)(xEventGroup))->uxEventGroupNumber, (uxBitsToWaitFor))
+#define traceTASK_DELAY()                        trace_put(TRACE_DELAY, pxCurrentTCB->uxTaskNumber, xTicksToDelay)
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
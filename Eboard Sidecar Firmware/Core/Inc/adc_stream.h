@@ -0,0 +1,42 @@
+#ifndef ADC_STREAM_H
+#define ADC_STREAM_H
+
+#include "stm32f4xx_hal.h"
+#include "stdbool.h"
+
+//raw battery ADC streaming over USB, turned on and off with PROTO_STREAM
+//while it runs, the ADC converts continuously into a circular DMA buffer and each half goes out
+//as one zero-copy USB block behind a PROTO_STREAM header frame (sequence number, tick, sample count)
+//the battery monitor still owns the ADC: it switches modes between its own reads, and keeps converting its own
+//oversamples (injected, synchronised to the lights) while the stream runs, since the stream's go straight through
+//the light drivers' switching edges; each of those bursts holds the stream up for ~125us, 4 times a monitor pass,
+//so the samples aren't quite evenly spaced
+
+#define ADC_STREAM_BLOCK 512 //samples per half buffer (one USB block)
+#define ADC_STREAM_SAMPLE_TIME ADC_SAMPLETIME_480CYCLES
+#define ADC_STREAM_RATE 32520 //Hz, 16MHz ADC clock / (480 + 12) cycles per conversion, between the monitor's bursts
+
+typedef struct {
+	uint32_t blocks; //handed to USB
+	uint32_t dropped; //USB was still busy with the last one
+	uint32_t torn; //DMA started overwriting a block that hadn't gone out yet
+} adc_stream_stats_t;
+
+//create the thread and flags; call before the monitor starts using the ADC
+void adc_stream_init();
+
+//ask for streaming on or off; the monitor makes the switch on its next pass
+void adc_stream_enable(bool enable);
+bool adc_stream_running();
+void adc_stream_get_stats(adc_stream_stats_t* stats);
+
+//=========== monitor side, only call while holding the ADC ===========
+//start or stop the circular DMA to match what was asked for
+void adc_stream_switch(ADC_HandleTypeDef* hadc);
+
+//half (0 or 1) of the buffer just filled, called from the ADC DMA callbacks
+void adc_stream_half_done(uint8_t half);
+
+uint32_t adc_stream_stack_space();
+
+#endif
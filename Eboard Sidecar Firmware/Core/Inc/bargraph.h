@@ -11,6 +11,9 @@ void bargraph_init(osMessageQueueId_t soc_buf_id);
 //draw a particular SOC on the bargraph display
 void bargraph_draw_soc();
 
+//set the LED pins straight away, a bit per LED (defined in pindefs.h, which only bargraph.c includes)
+void bargraph_output(uint16_t states);
+
 //get the free stack space of the relevant drawing thread
 uint32_t bargraph_draw_stack_space();
 uint32_t bargraph_animate_stack_space();
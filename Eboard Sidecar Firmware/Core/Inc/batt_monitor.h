@@ -10,13 +10,30 @@
 #define SANE_VOLTAGE_UPPER_LIMIT 35.0f //any ADC reading above this should throw some sorta error
 #define SANE_VOLTAGE_LOWER_LIMIT 10.0f //any ADC reading below this should throw some sorta error
 
-#define SOC_VOLTAGE_LOW 26.0 //voltage that will trigger the SOC_LOW flag
-#define SOC_VOLTAGE_CRITICAL 24.0 //voltage that will trigger the SOC_CRIT flag
-#define MAV_INIT_VALUE 0.10546875f //initialization value for the moving average buffer (works out to 27V)
+//the SOC_LOW and SOC_CRIT thresholds are CONFIG_SOC_LOW_MV and CONFIG_SOC_CRIT_MV (see config.h)
 
 //called on application start; checks system voltage and returns true if good
+//a sane reading is kept as the first sample of the monitor's moving average
 bool v_sys_check(float min_voltage, ADC_HandleTypeDef *hadc);
 
+//precharge: while the button is held the bus comes up through the precharge resistor, and once it stops rising the
+//ESC's capacitors are charged and power can latch, without waiting out the long press
+#define MONITOR_PRECHARGE_PERIOD 10 //ms between bus readings
+#define MONITOR_PRECHARGE_GROUP 10 //readings averaged together; the slope is between the last two groups
+#define MONITOR_PRECHARGE_FLAT 0.5f //V/s either way that counts as flat; about this times the RC time constant is left
+#define MONITOR_PRECHARGE_SETTLE 3 //readings in a row it has to stay flat
+
+typedef struct {
+	float readings[2 * MONITOR_PRECHARGE_GROUP]; //the last two groups, oldest overwritten
+	uint8_t count; //readings so far, up to the two groups
+	uint8_t pointer;
+	uint8_t flat; //readings in a row the bus has been flat and above the minimum
+} monitor_precharge_t;
+
+//called every pass while precharging; takes a bus reading when one is due (blocks for the read)
+//true once the bus has flattened out above min_voltage; the last sane reading seeds the moving average
+bool monitor_precharged(float min_voltage, ADC_HandleTypeDef *hadc);
+
 //initializes some of the os-related aspects of the monitor
 //returns a pointer to the SOC queue that will be updated by the monitor thread
 osMessageQueueId_t monitor_init();
@@ -30,6 +47,26 @@ bool monitor_soc_crit(bool clear_flag);
 bool monitor_read_fail(bool clear_flag);
 //=================================================================================
 
+//latest moving average voltage and SOC (0 to 1), for status queries
+float monitor_voltage();
+float monitor_soc();
+
 uint32_t monitor_stack_space();
 
+#define MONITOR_ADC_BLOCK 16 //samples per ADC read
+#define MONITOR_ADC_KEPT 8 //the middle half, so up to 4 spiked samples either way are left out entirely
+
+//the monitor's inner loops, public so the benchmarks (bench.h) time the code that actually runs
+//the sum of a block of samples (for the black box), two at a time with the M4's dual halfword multiply-accumulate
+//where the compiler has it (__ARM_FEATURE_DSP), and the portable version everywhere else
+uint32_t monitor_adc_sum(const uint16_t* samples, uint32_t n);
+uint32_t monitor_adc_sum_scalar(const uint16_t* samples, uint32_t n);
+//the sum of the middle MONITOR_ADC_KEPT samples of a MONITOR_ADC_BLOCK block, the rest being the smallest and
+//largest; a selection network built for that block size, so it reorders the samples
+uint32_t monitor_adc_trimmed_sum(uint16_t* samples);
+float monitor_mav_sum(const float* buffer, uint32_t n); //moving average, from the pre-scaled samples
+//the precharge detector on its own, a reading every MONITOR_PRECHARGE_PERIOD; public so Tools/precharge_check.c
+//can run it over recorded curves
+bool monitor_precharge_step(monitor_precharge_t* p, float volts, float min_volts);
+
 #endif /* INC_BAT_MONITOR_H_ */
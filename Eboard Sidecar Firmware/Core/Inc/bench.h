@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//microbenchmarks for the hot routines, one table for both places they run:
+//  on the board, PROTO_BENCH times them with the DWT cycle counter and sends the results over USB
+//  on a host, Tools/bench.c times the same table with its own clock to compare implementations
+//benchmarks with the same job are implementations of the same thing and should agree on the result; the first
+//one of a job is what the firmware runs now, the others are candidates
+//inputs are made up the same way every time, so results can be compared between builds too
+//this header is HAL-free so the host tools can use it
+
+#define BENCH_DEFAULT_REPS 100
+#define BENCH_MAX_REPS 10000
+#define BENCH_CALIBRATE_REPS 16 //for the clock's own overhead
+
+typedef struct {
+	const char* name;
+	const char* job;
+	uint16_t items; //samples, pulses or pin writes per call, for the cost per item
+	void (*setup)(); //make the inputs
+	uint32_t (*run)(); //one call; returns something to check against the other implementations of the job
+} bench_t;
+
+typedef struct {
+	uint32_t min, max; //clock ticks for one call, the clock's own overhead taken off
+	uint64_t total;
+	uint32_t result; //from the last call
+} bench_result_t;
+
+typedef uint32_t (*bench_clock_t)();
+
+uint8_t bench_count();
+const bench_t* bench_get(uint8_t index); //NULL past the end
+
+//setup, then reps timed calls
+//on the board interrupts still land in some calls, so the minimum is the number to trust
+void bench_run(const bench_t* b, uint32_t reps, bench_clock_t clock, bench_result_t* out);
+
+#endif
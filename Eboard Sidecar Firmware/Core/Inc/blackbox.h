@@ -0,0 +1,67 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//black box recorder: a RAM ring that always holds the last few seconds of raw ADC readings,
+//RC pulse widths and state changes
+//recording is a single atomic increment and an 8 byte store, and is safe from any thread or ISR
+//on a trigger the ring freezes and the datalog writer copies it into flash ahead of anything else,
+//then the ring starts recording again
+
+#define BLACKBOX_ENTRIES 1024 //power of 2; ~7s at 100Hz ADC + 50Hz RC
+
+//what an entry holds
+enum {
+	BLACKBOX_ADC = 1, //value: averaged raw ADC reading, arg: 1 if the read failed
+	BLACKBOX_RC, //value: RC pulse width in us
+	BLACKBOX_STATE, //value: from << 8 | to, arg: event (power_fsm)
+	BLACKBOX_STACK, //value: thread whose stack overflowed (stack_watch.h numbering)
+};
+
+//why the ring was frozen
+enum {
+	BLACKBOX_NONE = 0,
+	BLACKBOX_SOC_CRIT,
+	BLACKBOX_READ_FAIL,
+	BLACKBOX_FAULT_SHUTDOWN, //powering off because of one of the above
+	BLACKBOX_STACK_OVERFLOW,
+};
+
+typedef struct {
+	uint32_t tick;
+	uint16_t value;
+	uint8_t kind;
+	uint8_t arg;
+} blackbox_entry_t;
+
+//start recording
+void blackbox_init();
+
+//add an entry (thread or ISR)
+void blackbox_record(uint8_t kind, uint8_t arg, uint16_t value);
+
+//freeze the ring and ask the datalog to commit it (thread or ISR)
+//ignored if it's already frozen and waiting to be written
+void blackbox_trigger(uint8_t reason);
+
+//just freeze it, for places that can't touch the kernel (e.g. the stack overflow hook)
+//the datalog writer picks it up the next time it wakes
+void blackbox_freeze(uint8_t reason);
+
+//============ used by the datalog writer to commit a frozen ring ============
+//reason it froze (BLACKBOX_NONE if it isn't frozen) and when
+uint8_t blackbox_frozen(uint32_t* tick);
+
+//copy out up to max entries, oldest first, starting from the index-th oldest
+//returns how many were copied
+uint16_t blackbox_read(uint16_t index, blackbox_entry_t* out, uint16_t max);
+
+//how many entries the frozen ring holds
+uint16_t blackbox_count();
+
+//done with the frozen ring, start recording again
+void blackbox_release();
+
+#endif
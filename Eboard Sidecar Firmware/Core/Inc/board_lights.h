@@ -6,6 +6,14 @@
 
 extern TIM_HandleTypeDef htim4; //structure to manipulate the timer 4 settings
 
+#define LIGHTS_RC_SAMPLES 5 //how many samples the pulse width debouncer has
+
+//the supervisor's pulse width debouncer, a moving average over the last LIGHTS_RC_SAMPLES pulses
+typedef struct {
+	uint16_t widths[LIGHTS_RC_SAMPLES];
+	uint8_t pointer; //circular buffer
+} lights_rc_filter_t;
+
 //initialize the threads for the headlights and taillights
 void board_lights_init(TIM_HandleTypeDef* h);
 
@@ -15,7 +23,13 @@ void board_lights_shutdown();
 //called on pulse timer overflow
 void board_lights_tim_overflow();
 
+//which lighting routine is running (0 is lights out)
+uint8_t board_lights_mode();
+
 uint32_t lights_super_stack_space();
 uint32_t lights_anim_stack_space();
 
+//add a pulse width (0 for none) and return the filtered width; public so the benchmarks (bench.h) time it
+uint32_t lights_rc_filter(lights_rc_filter_t* f, uint16_t width);
+
 #endif
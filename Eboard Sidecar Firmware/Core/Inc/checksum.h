@@ -0,0 +1,19 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "stdint.h"
+
+//software CRCs shared by the flash log and anything else that needs one
+//no HAL dependencies so these build for the host too
+
+#define CRC16_INIT 0xFFFF
+#define CRC32_INIT 0xFFFFFFFFul
+
+//CRC-16/CCITT-FALSE (poly 0x1021), pass CRC16_INIT to start, or a previous result to continue
+uint16_t crc16_ccitt(uint16_t crc, const void* data, uint32_t len);
+
+//CRC-32 (IEEE, reflected), pass CRC32_INIT to start; the result is NOT inverted
+//so it can be chained -- invert it when you're done if you want the standard value
+uint32_t crc32_update(uint32_t crc, const void* data, uint32_t len);
+
+#endif
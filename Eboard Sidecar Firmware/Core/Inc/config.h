@@ -0,0 +1,83 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "flash_dev.h"
+
+//runtime-tunable parameters, read and written over USB (see usb_cmd.c)
+//values are plain int32s in fixed units so they pack straight into the protocol
+//no HAL dependencies so the host tools can use the table
+//
+//reads are a single array load, fine for hot paths; modules that keep something derived from a
+//value (a float in volts, say) register a watcher and redo it whenever the value changes
+//
+//config_commit() saves a snapshot of every value into flash sectors 1-2 (the linker scripts keep the
+//program out of them); snapshots are appended to one sector until it's full, then the other sector is
+//erased and takes over, so there's always a complete older snapshot to fall back on
+//a parameter's ID is its position in the table, so add new ones at the end; bump CONFIG_STORE_VERSION
+//if the meaning or units of an existing one change (old snapshots are then ignored)
+
+//		name				default		min			max
+#define CONFIG_PARAMS(X) \
+	X(SOC_LOW_MV,			26000,		20000,		33600)		/* moving average that triggers the low SOC warning */ \
+	X(SOC_CRIT_MV,			24000,		20000,		33600)		/* moving average that triggers the critical SOC shutdown */ \
+	X(RC_HIGH_US,			1700,		1000,		2000)		/* RC pulse width that counts as "high" */ \
+	X(RC_LOW_US,			1300,		1000,		2000)		/* RC pulse width that counts as "low" */ \
+	X(PACK_WH,				173,		1,			2000)		/* nominal pack energy, for the ride Wh estimate */ \
+	X(BUTTON_LONG_MS,		3000,		1500,		10000)		/* hold time registered as a long press (past the short press) */ \
+	X(MONITOR_PERIOD_MS,	10,			5,			100)		/* battery monitor loop period */ \
+	X(DIVIDER_NV,			8879370,	5000000,	15000000)	/* battery divider, nV per ADC count */
+
+#define CONFIG_ID(name, def, min, max) CONFIG_##name,
+enum {
+	CONFIG_PARAMS(CONFIG_ID)
+	CONFIG_NUM_PARAMS
+};
+#undef CONFIG_ID
+
+//================ flash store ================
+#define CONFIG_FLASH_BASE 0x08004000ul //sector 1
+#define CONFIG_FIRST_SECTOR 1 //FLASH_SECTOR_1
+#define CONFIG_SECTOR_SIZE (16*1024)
+#define CONFIG_NUM_SECTORS 2
+
+#define CONFIG_STORE_VERSION 1
+#define CONFIG_STORE_MAX_PARAMS 64 //most a snapshot can hold, leaves room for later firmware to add more
+
+//called with the new value after a parameter changes (in the thread that changed it)
+typedef void (*config_watch_t)(uint8_t id, int32_t value);
+#define CONFIG_MAX_WATCHERS 4
+
+typedef struct {
+	uint32_t seq; //snapshot in use, 0 when running on the defaults
+	uint8_t slot; //sector the next snapshot goes into
+	uint32_t used; //bytes of it taken
+	uint32_t commits; //since boot
+	uint32_t failures;
+} config_store_info_t;
+
+//current value of a parameter (0 for an unknown ID)
+int32_t config_get(uint8_t id);
+
+//returns false (and changes nothing) if the ID is unknown or the value is out of range
+//watchers are called before it returns
+bool config_set(uint8_t id, int32_t value);
+
+//allowed range of a parameter, false for an unknown ID
+bool config_limits(uint8_t id, int32_t* min, int32_t* max);
+
+//register for changes; false if the table is full
+bool config_watch(config_watch_t handler);
+
+//pick up the newest good snapshot from flash, call once at boot before anything reads the values
+//IDs it doesn't know about and values outside the current limits keep their defaults
+//returns the snapshot's sequence number, 0 if there wasn't one
+uint32_t config_load(const flash_dev_t* dev);
+
+//save every value as a new snapshot; may erase a sector (~0.5s, the CPU stalls), so not from a hot path
+bool config_commit();
+
+void config_get_store_info(config_store_info_t* info);
+
+#endif
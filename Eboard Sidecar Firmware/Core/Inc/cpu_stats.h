@@ -0,0 +1,58 @@
+#ifndef CPU_STATS_H
+#define CPU_STATS_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//per-thread CPU use from the FreeRTOS run time stats, clocked by the DWT cycle counter (see FreeRTOSConfig.h)
+//every CPU_STATS_PERIOD the cpu_stats thread works out each thread's share of the cycles since the last pass,
+//its context switch count, and the idle share (also averaged over the last CPU_STATS_WINDOW passes)
+//threads are numbered from 1 in the order they were created, the first time they're seen; thread 0 collects anything
+//past CPU_STATS_MAX_THREADS
+//this header is HAL-free so the host tools can use the record layout
+
+#define CPU_STATS_PERIOD 1000 //ms, well inside the 67s the 32-bit cycle counter takes to wrap at 64MHz
+#define CPU_STATS_WINDOW 10 //passes in the rolling idle average
+#define CPU_STATS_LOG_DIVIDER 10 //log a record every this many passes
+#define CPU_STATS_MAX_THREADS 25 //including slot 0
+#define CPU_STATS_RECORD_THREADS 24 //shares carried in a log record (threads 1 and up)
+
+//datalog record (DATALOG_CPU_STATS), a snapshot of the latest pass
+typedef struct __attribute__((packed)) {
+	uint16_t idle; //0.1%
+	uint16_t idle_avg; //0.1%, rolling window
+	uint16_t switches; //context switches in the pass
+	uint8_t share[CPU_STATS_RECORD_THREADS]; //0.5% steps, by thread number
+} cpu_stats_record_t;
+
+typedef struct {
+	const char* name;
+	uint16_t share; //0.1%
+	uint32_t cycles;
+	uint32_t switches;
+} cpu_thread_stats_t;
+
+typedef struct {
+	uint16_t idle; //0.1%
+	uint16_t idle_avg; //0.1%
+	uint32_t switches;
+	uint32_t cycles; //length of the pass
+	uint8_t threads; //numbered so far, not counting slot 0
+} cpu_stats_summary_t;
+
+//context switches into each numbered thread, bumped from traceTASK_SWITCHED_IN
+extern volatile uint32_t cpu_stats_switches[CPU_STATS_MAX_THREADS];
+
+//start the sampling thread
+void cpu_stats_init();
+
+//latest pass; false for a thread number that isn't in use
+bool cpu_stats_thread(uint8_t number, cpu_thread_stats_t* stats);
+void cpu_stats_get_summary(cpu_stats_summary_t* summary);
+
+//run time stats clock, called by the kernel when the scheduler starts
+void cpu_stats_timer_init(void);
+
+uint32_t cpu_stats_stack_space();
+
+#endif
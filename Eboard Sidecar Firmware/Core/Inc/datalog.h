@@ -0,0 +1,88 @@
+#ifndef DATALOG_H
+#define DATALOG_H
+
+#include "stm32f4xx_hal.h"
+#include "stdbool.h"
+#include "flash_log.h"
+#include "telemetry.h"
+#include "log_index.h"
+#include "datalog_records.h"
+
+//ride datalogger, stored with flash_log in the last two sectors of the internal flash
+//the linker scripts stop the program before DATALOG_FLASH_BASE so the two never overlap
+//
+//datalog_write() just drops the record into a queue and never blocks; a low priority writer thread
+//packs records into pages and programs a page at a time
+//erasing a sector stalls the CPU for 1-2s (we run out of the same flash bank), so that only happens once per boot,
+//right after power latches (datalog_ride_started()), and never on the way up
+//
+//so a ride only ever has the sector it started in: at least half of one (a fresh one is erased after the latch
+//otherwise), at most all 511 pages. at 10Hz telemetry plus the CPU stats that's about 7.5 pages a minute
+//(telemetry_bench's synthetic ride, ~86KB an hour encoded, and a record every 10s), so a ride gets at least
+//~28 minutes of telemetry and up to ~62 on a fresh sector. past that, telemetry and the periodic records are
+//turned away (counted in shed) and the last 44 pages are kept for what matters most at the end: a black box
+//dump (~39 pages), state changes, the ride histogram and summary, and the shutdown record
+//those also get the last few queue slots, so a full queue of telemetry can't keep them out
+
+#define DATALOG_FLASH_BASE 0x08040000ul //sector 6
+#define DATALOG_FIRST_SECTOR FLASH_SECTOR_6
+//sizes, record types and layouts are in datalog_records.h
+
+typedef struct {
+	uint32_t records; //made it into a page that was written
+	uint32_t dropped; //queue full, log full, or a failed page write
+	uint32_t shed; //telemetry and periodic records turned away to keep the reserve (see the top)
+	uint32_t pages;
+	uint32_t page_errors;
+	uint32_t blackbox_dumps;
+
+	//telemetry encoder
+	uint32_t telem_samples;
+	uint32_t telem_bytes; //encoded, including the block headers
+	uint64_t telem_cycles; //total time spent encoding
+	uint32_t telem_cycles_max; //worst single sample
+} datalog_stats_t;
+
+//mount the log and start the writer thread; never erases, so it's quick enough for the boot path
+void datalog_init();
+
+//power's latched; if the sector was too full at boot for a whole ride, the writer erases the next one now
+void datalog_ride_started();
+
+//queue a record for writing; never blocks and is safe to call from an ISR
+//returns false (and counts a drop) if the record couldn't be queued
+bool datalog_write(uint8_t type, const void* data, uint8_t len);
+
+//encode a telemetry sample and queue it up once a block fills
+//only call this from one thread (the battery monitor)
+void datalog_telemetry(const telem_sample_t* sample);
+
+//write out whatever is in the part-filled page
+void datalog_flush();
+
+//same, but wait (up to timeout ms) for the page to be written; for the very end of a shutdown
+//returns false if it wasn't written in time or the log isn't mounted
+bool datalog_sync(uint32_t timeout);
+
+//copy the frozen black box ring into the log, ahead of anything still queued (thread or ISR)
+void datalog_commit_blackbox();
+
+void datalog_get_stats(datalog_stats_t* stats);
+
+//ride number of this boot (one more than the last one in the log)
+uint16_t datalog_ride();
+
+//called for every record streamed out by datalog_retrieve()
+typedef void (*datalog_record_cb_t)(uint8_t type, const uint8_t* data, uint8_t len, void* ctx);
+
+//stream out the records logged in a window of a ride (ticks since that ride booted)
+//seeks with the index, so only the pages covering the window get read
+//returns the number of records
+uint32_t datalog_retrieve(uint16_t ride_id, uint32_t from, uint32_t to, datalog_record_cb_t cb, void* ctx);
+
+//the mounted log, for reading it back
+const flash_log_t* datalog_log();
+
+uint32_t datalog_stack_space();
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef DATALOG_RECORDS_H
+#define DATALOG_RECORDS_H
+
+#include "stdint.h"
+#include "log_index.h"
+
+//what the datalog (datalog.h) puts on flash: where the log lives, the record types and the layouts of the
+//records it writes itself; the other modules' records are in their own headers (see the list below)
+//this header is HAL-free so the host tools can use the record layouts
+
+#define DATALOG_SECTOR_SIZE (128*1024)
+#define DATALOG_NUM_SECTORS 2
+
+#define DATALOG_MAX_RECORD 30 //bytes of data in one record
+
+//record types
+enum {
+	DATALOG_FLUSH = 0, //used internally, never written
+	DATALOG_BOOT, //datalog_boot_t
+	DATALOG_STATE, //datalog_state_t
+	DATALOG_TELEMETRY, //block of samples, see telemetry.h
+	DATALOG_PAGE_INFO = LOG_PAGE_INFO, //log_page_info_t, first record of every page (see log_index.h)
+	DATALOG_BLACKBOX_HEAD, //datalog_blackbox_head_t, followed by the entries
+	DATALOG_BLACKBOX, //up to DATALOG_BLACKBOX_PER_RECORD blackbox_entry_t
+	DATALOG_RIDE_SUMMARY, //ride_summary_t, written at shutdown (see ride_stats.h)
+	DATALOG_RIDE_HIST, //ride_hist_t, right before the summary
+	DATALOG_CPU_STATS, //cpu_stats_record_t, every CPU_STATS_LOG_DIVIDER passes (see cpu_stats.h)
+	DATALOG_STACK, //stack_watch_record_t, when a thread's stack peak grows
+	DATALOG_SHUTDOWN, //shutdown_record_t, last record before power drops (see shutdown_record.h)
+};
+
+#define DATALOG_BLACKBOX_PER_RECORD 3
+
+typedef struct __attribute__((packed)) {
+	uint32_t sector_seq; //generation of the sector we're writing into
+	uint32_t erase_count; //of that sector
+	uint16_t free_pages; //left in it at boot
+	uint16_t torn_pages; //repaired at boot (power cut while writing)
+} datalog_boot_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t tick;
+	uint8_t from, to, event; //power_fsm states/events
+} datalog_state_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t tick; //when it was triggered
+	uint16_t count; //entries that follow
+	uint8_t reason; //BLACKBOX_*
+} datalog_blackbox_head_t;
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef DLOG_H
+#define DLOG_H
+
+#include "stm32f4xx_hal.h"
+#include "stdint.h"
+#include "stdbool.h"
+#include "dlog_formats.h"
+
+//deferred binary logging for hot paths, in place of printf
+//a call site stores its message ID, the tick and its raw arguments into a lock-free ring (safe from
+//threads and ISRs alike); the dlog thread ships the records out over USB as PROTO_DLOG frames and
+//Tools/dlog_decode.c does the formatting on the host
+//usage: DLOG2(MONITOR_READ_FAIL, count, raw); the argument count is checked against dlog_formats.h
+
+#define DLOG_WORDS 256 //ring size in 32-bit words, power of 2
+#define DLOG_FLUSH_TIME 20 //ms between trips to USB
+
+//================ call site macros ================
+#define DLOG_CHECK(name, n) _Static_assert(DLOG_ARGS_##name == (n), "wrong argument count for DLOG " #name)
+#define DLOG0(name) do { DLOG_CHECK(name, 0); dlog_put(DLOG_##name, 0, 0, 0, 0, 0); } while(0)
+#define DLOG1(name, a) do { DLOG_CHECK(name, 1); dlog_put(DLOG_##name, 1, DLOG_ARG(a), 0, 0, 0); } while(0)
+#define DLOG2(name, a, b) do { DLOG_CHECK(name, 2); dlog_put(DLOG_##name, 2, DLOG_ARG(a), DLOG_ARG(b), 0, 0); } while(0)
+#define DLOG3(name, a, b, c) do { DLOG_CHECK(name, 3); dlog_put(DLOG_##name, 3, DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), 0); } while(0)
+#define DLOG4(name, a, b, c, d) do { DLOG_CHECK(name, 4); \
+	dlog_put(DLOG_##name, 4, DLOG_ARG(a), DLOG_ARG(b), DLOG_ARG(c), DLOG_ARG(d)); } while(0)
+
+//floats go over as their bit pattern, everything else as an integer
+#define DLOG_ARG(x) _Generic((x), float: dlog_float_bits(x), double: dlog_float_bits((float)(x)), default: (uint32_t)(x))
+
+typedef struct {
+	uint32_t records; //shipped to USB
+	uint32_t dropped; //ring was full
+	uint32_t frames;
+} dlog_stats_t;
+
+//start the thread that ships records out
+void dlog_init();
+void dlog_get_stats(dlog_stats_t* stats);
+uint32_t dlog_stack_space();
+
+//================ the ring (used by the inline writer below) ================
+typedef struct {
+	uint32_t words[DLOG_WORDS];
+	volatile uint32_t head; //words claimed by writers
+	volatile uint32_t tail; //words consumed by the dlog thread
+	volatile uint32_t dropped;
+} dlog_ring_t;
+
+extern dlog_ring_t dlog_ring; //the one the dlog thread ships out
+
+static inline uint32_t dlog_float_bits(float f) {
+	union { float f; uint32_t u; } v = {.f = f};
+	return v.u;
+}
+
+//claim space with a compare-and-swap (so ISRs can log too), fill in the arguments, and publish
+//the header word last; the reader stops at a header that's still zero
+//the ring is a parameter only so the benchmarks can time this on one of their own; inlined, it's a constant
+static inline void dlog_put_ring(dlog_ring_t* r, uint16_t id, uint8_t n, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+	uint32_t h = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	do {
+		if(h + n + 2 - r->tail > DLOG_WORDS) {
+			__atomic_fetch_add(&r->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	} while(!__atomic_compare_exchange_n(&r->head, &h, h + n + 2, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	r->words[(h + 1) & (DLOG_WORDS - 1)] = uwTick;
+	if(n > 0) r->words[(h + 2) & (DLOG_WORDS - 1)] = a0;
+	if(n > 1) r->words[(h + 3) & (DLOG_WORDS - 1)] = a1;
+	if(n > 2) r->words[(h + 4) & (DLOG_WORDS - 1)] = a2;
+	if(n > 3) r->words[(h + 5) & (DLOG_WORDS - 1)] = a3;
+	__atomic_store_n(&r->words[h & (DLOG_WORDS - 1)], DLOG_HEADER(id, n), __ATOMIC_RELEASE);
+}
+
+static inline void dlog_put(uint16_t id, uint8_t n, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) {
+	dlog_put_ring(&dlog_ring, id, n, a0, a1, a2, a3);
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef DLOG_FORMATS_H
+#define DLOG_FORMATS_H
+
+//every deferred log message in the firmware (see dlog.h)
+//the ID is the position in this table and Tools/dlog_decode.c formats with the same strings,
+//so add new messages at the end and rebuild the decoder along with the firmware
+//arguments are 32-bit words: integer conversions, or %f for floats passed in as floats (no strings)
+
+//		name				args	format
+#define DLOG_FORMATS(X) \
+	X(DLOG_DROPPED,			1,		"dlog: %lu messages dropped, ring full") \
+	X(MONITOR_READ_FAIL,	2,		"monitor: bad reading %lu in a row (raw %lu)") \
+	X(MONITOR_SOC_LOW,		1,		"monitor: SOC low at %.2fV") \
+	X(MONITOR_SOC_CRIT,		1,		"monitor: SOC critical at %.2fV") \
+	X(LIGHTS_MODE,			2,		"lights: RC pulse %luus, routine %lu") \
+	X(LIGHTS_TIMEOUT,		0,		"lights: RC signal lost, lights out") \
+	X(ADC_STREAM_ON,		0,		"adc stream: on") \
+	X(ADC_STREAM_OFF,		3,		"adc stream: off, %lu blocks sent, %lu dropped, %lu torn") \
+	X(STACK_HIGH,			3,		"stack watch: thread %lu has used %lu of %lu bytes") \
+	X(MONITOR_PRECHARGED,	1,		"monitor: bus charged at %.2fV")
+
+#define DLOG_ID(name, args, fmt) DLOG_##name,
+enum {
+	DLOG_FORMATS(DLOG_ID)
+	DLOG_NUM_FORMATS
+};
+#undef DLOG_ID
+
+#define DLOG_ARGS(name, args, fmt) DLOG_ARGS_##name = (args),
+enum { DLOG_FORMATS(DLOG_ARGS) };
+#undef DLOG_ARGS
+
+#define DLOG_MAX_ARGS 4
+
+//a record is a header word, the tick, then the arguments; all little endian words on the wire
+#define DLOG_HEADER(id, nargs) (0x80000000ul | ((uint32_t)(id) << 8) | (nargs))
+#define DLOG_HEADER_ID(h) (((h) >> 8) & 0xFFFF)
+#define DLOG_HEADER_NARGS(h) ((h) & 0xFF)
+#define DLOG_HEADER_VALID(h) ((h) & 0x80000000ul)
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef FLASH_DEV_H
+#define FLASH_DEV_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//a NOR flash region split into equal erase sectors
+//the firmware backs this with the STM32's internal flash (datalog.c), the host tools with RAM (Tools/flash_sim.c)
+//offsets are from the start of the region
+//program can only clear bits (1 -> 0), erase sets a whole sector back to 0xFF
+
+typedef struct flash_dev flash_dev_t;
+
+struct flash_dev {
+	void* ctx; //whatever the implementation needs
+	uint32_t sector_size; //bytes
+	uint8_t num_sectors;
+
+	bool (*erase)(const flash_dev_t* dev, uint8_t sector);
+	//offset and len have to be multiples of 4; words are programmed in order
+	bool (*program)(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len);
+	void (*read)(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len);
+};
+
+#endif
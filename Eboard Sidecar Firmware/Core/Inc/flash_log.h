@@ -0,0 +1,95 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include "flash_dev.h"
+
+//append-only log on top of a flash_dev_t
+//
+//every sector starts with a header page {magic, seq, erase count, crc}; the rest are log pages
+//each log page is {len, crc16, seq} + payload, written payload first and seq last
+//so a page only counts once its seq word is programmed -- a power cut leaves at most one torn page,
+//which gets closed off (seq = 0) on the next mount
+//
+//sectors are used in ring order (oldest is erased next) so they all wear evenly
+//erasing stalls the CPU if the region is in the same bank we run from, so the caller decides when it's allowed
+//doesn't touch any HAL or RTOS stuff so it builds for the host too
+
+#define FLASH_LOG_MAX_SECTORS 8
+#define FLASH_LOG_PAGE_SIZE 256
+#define FLASH_LOG_PAGE_HEADER 8
+#define FLASH_LOG_PAGE_PAYLOAD (FLASH_LOG_PAGE_SIZE - FLASH_LOG_PAGE_HEADER)
+
+#define FLASH_LOG_MAGIC 0x474F4C45ul //"ELOG"
+#define FLASH_LOG_ERASED 0xFFFFFFFFul
+#define FLASH_LOG_NO_SECTOR 0xFF
+
+typedef enum {
+	FLASH_LOG_OK,
+	FLASH_LOG_FULL, //active sector is full, needs a rotate
+	FLASH_LOG_EMPTY, //nothing more to read
+	FLASH_LOG_ERROR, //flash op failed or bad arguments
+} flash_log_status_t;
+
+typedef struct {
+	const flash_dev_t* dev;
+	uint16_t pages_per_sector; //including the header page
+	uint8_t active; //sector being written, FLASH_LOG_NO_SECTOR if none yet
+	uint16_t next_page; //next page to write in the active sector
+	uint32_t sector_seq[FLASH_LOG_MAX_SECTORS]; //0 if the sector has no valid header
+	uint32_t erase_count[FLASH_LOG_MAX_SECTORS];
+	uint32_t torn_pages; //repaired by the last mount
+} flash_log_t;
+
+//position of a reader in the log
+typedef struct {
+	uint8_t order; //index into the sectors sorted oldest first
+	uint16_t page;
+} flash_log_cursor_t;
+
+//================== writing ==================
+
+//scan the region and find where to carry on writing
+//if there's no valid sector at all this formats one (only erasing if it isn't already blank)
+flash_log_status_t flash_log_mount(flash_log_t* log, const flash_dev_t* dev);
+
+//write one page; len <= FLASH_LOG_PAGE_PAYLOAD
+flash_log_status_t flash_log_append_page(flash_log_t* log, const void* payload, uint16_t len);
+
+//move on to the oldest (or an invalid) sector and start it fresh
+//if allow_erase is false this only succeeds when that sector is already blank
+flash_log_status_t flash_log_rotate(flash_log_t* log, bool allow_erase);
+
+//log pages left in the active sector
+uint32_t flash_log_free_pages(const flash_log_t* log);
+
+//================== reading ==================
+
+//start at the oldest page in the log
+void flash_log_rewind(const flash_log_t* log, flash_log_cursor_t* cursor);
+
+//read the next good page (torn pages are skipped) and advance
+//payload must hold FLASH_LOG_PAGE_PAYLOAD bytes; seq is optional
+flash_log_status_t flash_log_read_next(const flash_log_t* log, flash_log_cursor_t* cursor, void* payload, uint16_t* len, uint32_t* seq);
+
+//read one page directly; EMPTY if it was never written, ERROR if it's torn or corrupted
+flash_log_status_t flash_log_read_page(const flash_log_t* log, uint8_t sector, uint16_t page, void* payload, uint16_t* len, uint32_t* seq);
+
+//first page in a sector that was never written (binary search, so O(log pages))
+uint16_t flash_log_sector_end(const flash_log_t* log, uint8_t sector);
+
+//the valid sectors in the order they were written, 0 is the oldest; FLASH_LOG_NO_SECTOR past the end
+uint8_t flash_log_sector_by_age(const flash_log_t* log, uint8_t order);
+
+//============= records inside a page =============
+//a page payload is packed with [type][len][data...] records that never span pages
+//type 0 is never written so the rest of a page can be left as padding
+
+#define FLASH_LOG_RECORD_HEADER 2
+
+//append a record to a page buffer, returns false if it doesn't fit
+bool flash_log_record_put(uint8_t* page, uint16_t* used, uint8_t type, const void* data, uint8_t len);
+
+//walk the records in a page; offset starts at 0, returns false at the end
+bool flash_log_record_next(const uint8_t* page, uint16_t page_len, uint16_t* offset, uint8_t* type, const uint8_t** data, uint8_t* len);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef FLASH_STM32_H
+#define FLASH_STM32_H
+
+#include "flash_dev.h"
+
+//flash_dev regions backed by the STM32's internal flash
+//the datalog and the config store write from different threads, so each erase and each word program
+//runs with the scheduler locked -- one can't lock the flash controller out from under the other
+//(the CPU stalls on instruction fetches while the flash is busy anyway, so this costs next to nothing)
+
+extern const flash_dev_t flash_stm32_datalog; //sectors 6-7, see datalog.h
+extern const flash_dev_t flash_stm32_config; //sectors 1-2, see config.h
+
+#endif
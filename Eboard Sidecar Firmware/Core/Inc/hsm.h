@@ -0,0 +1,73 @@
+#ifndef HSM_H
+#define HSM_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//small table-driven hierarchical state machine
+//states, events, guards and actions all live in static const tables
+//doesn't touch any HAL or RTOS stuff so it builds for the host too
+
+#define HSM_MAX_DEPTH 4 //how deeply states can be nested
+
+//state 0 is the implicit root; real states are numbered from 1
+//that way any table entry left out of an initializer reads as "unhandled"
+#define HSM_ROOT 0 //parent of a top-level state
+#define HSM_UNHANDLED 0 //transition target when a state doesn't handle an event (bubbles up to the parent)
+#define HSM_INTERNAL 0xFF //transition target to just run the action without leaving the state
+
+typedef uint8_t hsm_state_t;
+typedef uint8_t hsm_event_t;
+
+typedef struct hsm hsm_t;
+
+typedef void (*hsm_action_t)(void);
+typedef bool (*hsm_guard_t)(const hsm_t* sm);
+//from is HSM_ROOT (and event is num_events) for the initial entry
+typedef void (*hsm_trace_t)(const hsm_t* sm, hsm_state_t from, hsm_state_t to, hsm_event_t event);
+
+typedef struct {
+	const char* name;
+	hsm_state_t parent;
+	hsm_action_t on_entry;
+	hsm_action_t on_exit;
+} hsm_state_def_t;
+
+typedef struct {
+	hsm_state_t target;
+	hsm_guard_t guard; //NULL means always take the transition
+	hsm_action_t action; //run between exiting the old states and entering the new ones
+	hsm_state_t guard_fail_target; //where to go if the guard fails (HSM_UNHANDLED to bubble up instead)
+} hsm_transition_t;
+
+typedef struct {
+	const hsm_state_def_t* states;
+	const hsm_transition_t* transitions; //[num_states][num_events], row-major
+	const char* const* event_names;
+	uint8_t num_states;
+	uint8_t num_events;
+} hsm_def_t;
+
+struct hsm {
+	const hsm_def_t* def;
+	hsm_state_t current; //always a leaf state
+	uint32_t now; //timestamp of the event being dispatched
+	uint32_t entered_at; //timestamp the current state was entered
+	hsm_trace_t trace; //called on every state change (optional)
+};
+
+//enter the initial state (and all of its parents) at time "now"
+void hsm_init(hsm_t* sm, const hsm_def_t* def, hsm_state_t initial, uint32_t now, hsm_trace_t trace);
+
+//run a single event through the machine
+//looks up the current state's row, then its parents' rows if unhandled
+//returns true if a transition (or internal action) was taken
+bool hsm_dispatch(hsm_t* sm, hsm_event_t event, uint32_t now);
+
+//true if the machine is in the state or any child of it
+bool hsm_in_state(const hsm_t* sm, hsm_state_t state);
+
+//how long the machine has been in its current state
+uint32_t hsm_time_in_state(const hsm_t* sm);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include "flash_log.h"
+
+//sparse time index over the flash log
+//
+//every page starts with a page info record {ride, tick, records before it in the sector}
+//ticks restart every boot, so (ride, tick) is the key that only ever goes up through the log
+//the index keeps one entry per sector (first/last key, record count) and seeks by binary searching
+//the sectors and then the pages inside one -- O(log pages) page reads instead of a scan
+//
+//building it only reads a handful of pages per sector (see log_index_build), so it's bounded no matter
+//how full the log is or how the power went out
+//doesn't touch any HAL or RTOS stuff so it builds for the host too
+
+#define LOG_PAGE_INFO 4 //record type of the page info, always the first record in a page (see datalog.h)
+
+typedef struct __attribute__((packed)) {
+	uint16_t ride;
+	uint32_t tick; //when the page was started
+	uint16_t records_before; //records in the sector ahead of this page
+} log_page_info_t;
+
+typedef struct {
+	uint16_t ride;
+	uint32_t tick;
+} log_key_t;
+
+typedef struct {
+	bool used; //has at least one page with a page info
+	log_key_t first, last; //keys of the first and last pages
+	uint32_t records; //not counting the page infos
+	uint16_t end; //first unwritten page
+} log_sector_index_t;
+
+typedef struct {
+	log_sector_index_t sector[FLASH_LOG_MAX_SECTORS];
+} log_index_t;
+
+//rebuild from the flash after mounting
+//per sector: a binary search for the end, then the first and last pages -- O(sectors * log pages) reads
+void log_index_build(log_index_t* idx, const flash_log_t* log);
+
+//keep the index up to date after the writer appends a page
+void log_index_page_written(log_index_t* idx, const flash_log_t* log, const log_page_info_t* info, uint16_t records);
+
+//point the cursor at the page the key falls in (the last one starting at or before it)
+//returns false if the log has nothing indexed
+bool log_index_seek(const log_index_t* idx, const flash_log_t* log, log_key_t key, flash_log_cursor_t* cursor);
+
+//highest ride in the log, returns false if there isn't one
+bool log_index_last_ride(const log_index_t* idx, const flash_log_t* log, uint16_t* ride);
+
+//pull the page info out of the front of a page
+bool log_page_info(const uint8_t* page, uint16_t len, log_page_info_t* info);
+
+//<0, 0, >0 like memcmp
+int log_key_cmp(log_key_t a, log_key_t b);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef MELODY_H
+#define MELODY_H
+
+#include "stdint.h"
+
+//compact, compile-time melody format for the buzzer
+//each note is packed into a single 32 bit word that lives in flash:
+//	upper 16 bits -> timer 2 auto-reload value (0 means rest/silence)
+//	lower 16 bits -> how long to hold the note (ms)
+//all the math below folds down to constants, so a jingle is pure data
+
+//================= timer settings the periods are computed against ===============
+//keep these in sync with MX_TIM2_Init() (64MHz timer clock, prescaler of 64)
+#define BUZZER_TIM_CLOCK_HZ 64000000ul
+#define BUZZER_TIM_PRESCALER 64ul
+#define BUZZER_TICK_HZ (BUZZER_TIM_CLOCK_HZ / (BUZZER_TIM_PRESCALER + 1))
+
+//================= note names (octave 0 frequencies in centi-Hz) =================
+#define NOTE_C	1635
+#define NOTE_CS	1732
+#define NOTE_D	1835
+#define NOTE_DS	1945
+#define NOTE_E	2060
+#define NOTE_F	2183
+#define NOTE_FS	2312
+#define NOTE_G	2450
+#define NOTE_GS	2596
+#define NOTE_A	2750
+#define NOTE_AS	2914
+#define NOTE_B	3087
+
+//timer runs in output toggle mode, so one output period is two timer periods
+#define PITCH_CHZ(note, octave) ((uint32_t)(note) << (octave))
+#define PITCH_PERIOD(chz) ((uint16_t)(((BUZZER_TICK_HZ * 100ul) / (2ul * (chz))) - 1))
+
+//================= note packing ====================
+#define TONE(note, octave, ms) ((((uint32_t)PITCH_PERIOD(PITCH_CHZ(note, octave))) << 16) | (uint16_t)(ms))
+#define REST(ms) ((uint32_t)(uint16_t)(ms))
+
+#define NOTE_PERIOD(packed) ((uint16_t)((packed) >> 16))
+#define NOTE_DURATION(packed) ((uint16_t)((packed) & 0xFFFF))
+
+//a melody is just a table of packed notes and how many times to play it
+typedef struct {
+	const uint32_t* notes;
+	uint16_t length;
+	uint16_t repeat;
+} melody_t;
+
+#define MELODY(note_table, repeats) { \
+	.notes = (note_table), \
+	.length = sizeof(note_table)/sizeof((note_table)[0]), \
+	.repeat = (repeats) \
+}
+
+#endif
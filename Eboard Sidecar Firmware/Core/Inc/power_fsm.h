@@ -0,0 +1,52 @@
+#ifndef POWER_FSM_H
+#define POWER_FSM_H
+
+#include "hsm.h"
+
+//power lifecycle of the board, described as tables for the hsm
+//the table only calls out through the hooks below, so it builds for the host too
+
+#define POWER_FAULT_SHUTDOWN_DELAY 10000 //ms between a critical SOC/monitor failure and cutting power
+
+//================== states ===================
+//PRECHARGE -> POWERED{RUNNING -> SHUTDOWN_PENDING} -> SHUTDOWN
+enum {
+	PWR_PRECHARGE = 1, //0 is the hsm root
+	PWR_POWERED,
+	PWR_RUNNING, //child of POWERED
+	PWR_SHUTDOWN_PENDING, //child of POWERED; critical warning has been given, waiting to shut down
+	PWR_SHUTDOWN,
+	PWR_NUM_STATES
+};
+
+//================== events ===================
+enum {
+	PWR_EV_TICK, //sent every pass through the main loop
+	PWR_EV_BUTTON_BUMPED,
+	PWR_EV_BUTTON_SHORT,
+	PWR_EV_BUTTON_LONG,
+	PWR_EV_BUTTON_RELEASED,
+	PWR_EV_SOC_LOW,
+	PWR_EV_SOC_CRIT,
+	PWR_EV_READ_FAIL,
+	PWR_EV_PRECHARGED, //the bus stopped rising, the ESC is charged
+	PWR_NUM_EVENTS
+};
+
+extern const hsm_def_t power_fsm;
+
+//=========== hooks called from the tables (defined by the application) ===========
+void power_on_precharge(); //start of precharge
+bool power_bus_ok(); //guard: is the bus voltage good enough to latch power
+void power_on_latch(); //latch the power FETs and start everything up
+void power_on_bump(); //short tap of the button
+void power_on_hold(); //button held past the short press time
+void power_on_release(); //button let go
+void power_on_soc_low(); //SOC dropped below the low threshold
+void power_on_fault(); //critical SOC or monitor failure; shutdown is pending
+void power_on_soc_crit(); //transition action: SOC went critical while running
+void power_on_read_fail(); //transition action: the monitor stopped getting good readings while running
+void power_on_fault_timeout(); //transition action: the fault shutdown delay ran out
+void power_on_shutdown(); //cut the power
+
+#endif
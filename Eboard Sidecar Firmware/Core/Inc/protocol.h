@@ -0,0 +1,184 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//framed binary command protocol for the USB link
+//every frame on the wire is 0x00, COBS(payload + CRC16), 0x00 -- the leading delimiter fences off
+//any printf text that shares the link, and the host just discards whatever doesn't pass the CRC
+//payload is [cmd][seq][args...], replies are [cmd | PROTO_REPLY][seq][status][data...]
+//the CRC is crc16_ccitt over the payload, little endian
+//no HAL or RTOS dependencies so the host tools (Tools/proto_fuzz.c) can build it
+
+#define PROTO_MAX_PAYLOAD 128 //cmd, seq and arguments, not counting the CRC
+#define PROTO_MAX_REPLY_DATA (PROTO_MAX_PAYLOAD - 3)
+#define PROTO_MAX_FRAME (PROTO_MAX_PAYLOAD + 2 + (PROTO_MAX_PAYLOAD + 2) / 254 + 1 + 2) //COBS overhead and both delimiters
+#define PROTO_REPLY 0x80
+
+//commands
+enum {
+	PROTO_PING = 1, //echoes the arguments
+	PROTO_STATUS, //proto_status_t
+	PROTO_CONFIG_GET, //[id] -> proto_config_t
+	PROTO_CONFIG_SET, //[id][int32 value] -> proto_config_t
+	PROTO_LOG_READ, //proto_log_read_t -> a PROTO_MORE reply per record ([type][data]), then OK with a uint32 count
+	PROTO_RIDE_SUMMARY, //[uint16 ride, 0xFFFF for the current one] -> ride_summary_t
+	PROTO_STREAM, //[uint8 enable] -> uint32 sample rate; while on, PROTO_MORE replies carrying a
+				  //proto_stream_block_t arrive unasked, each followed by that many raw uint16 samples (not framed)
+	PROTO_DLOG, //not a request; PROTO_MORE replies carrying deferred log records arrive unasked (see dlog.h)
+	PROTO_CONFIG_SAVE, //-> proto_config_save_t; writes every config value to flash (can stall for ~0.5s)
+	PROTO_CPU_STATS, //-> a PROTO_MORE reply per thread (proto_cpu_thread_t), then OK with proto_cpu_summary_t
+	PROTO_STACKS, //-> a PROTO_MORE reply per started thread (proto_stack_t), then OK with proto_stack_summary_t
+	PROTO_TRACE, //[uint8 mode, see trace_format.h] -> proto_trace_t; TRACE_DUMP sends the snapshot as PROTO_MORE
+				 //replies first, while streaming the same PROTO_MORE replies arrive unasked with seq 0
+	PROTO_BENCH, //[uint8 benchmark, 0xFF for all][uint16 reps] (both optional) -> a PROTO_MORE reply per benchmark
+				 //(proto_bench_t), then OK with proto_bench_summary_t; see bench.h. Blocks commands while it runs
+	PROTO_NUM_CMDS
+};
+
+//reply status
+enum {
+	PROTO_OK = 0,
+	PROTO_MORE, //more replies to the same request follow
+	PROTO_BAD_CMD,
+	PROTO_BAD_ARG,
+	PROTO_NOT_FOUND,
+	PROTO_FAILED, //understood, but couldn't be carried out
+};
+
+//============== argument and reply layouts ==============
+typedef struct __attribute__((packed)) {
+	uint32_t tick;
+	uint16_t voltage; //10mV
+	uint16_t soc; //0.1%
+	uint8_t light_mode;
+	uint16_t ride;
+	uint32_t log_records;
+	uint32_t log_dropped;
+	uint32_t tx_dropped; //bytes the USB transmit ring turned away
+	uint32_t rx_bad_frames; //CRC, framing and overflow errors
+} proto_status_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t id;
+	int32_t value, min, max;
+} proto_config_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t seq; //snapshot now in flash (the previous one if the save failed)
+	uint8_t slot;
+	uint16_t used; //bytes of the slot taken
+	uint32_t failures; //since boot
+} proto_config_save_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t number; //see cpu_stats.h
+	uint16_t share; //0.1% of the last pass
+	uint32_t switches; //in the last pass
+	char name[16];
+} proto_cpu_thread_t;
+
+typedef struct __attribute__((packed)) {
+	uint16_t idle, idle_avg; //0.1%
+	uint32_t switches;
+	uint32_t cycles; //length of the last pass
+} proto_cpu_summary_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t number; //see stack_watch.h
+	uint16_t size, peak, suggested; //bytes
+	char name[16];
+} proto_stack_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t threads; //in the table
+	uint8_t overflowed; //thread the overflow hook caught, 0xFF if none
+} proto_stack_summary_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t mode; //now
+	uint16_t cycles_per_event; //measured at boot
+	uint32_t events; //recorded since boot
+	uint32_t lost; //overwritten before they were streamed
+	uint32_t sent; //events in the dump
+} proto_trace_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t number; //in the bench.h table
+	uint16_t items; //per call
+	uint16_t reps;
+	uint32_t min, max, mean; //cycles per call
+	uint32_t result;
+	char name[16];
+	char job[12];
+} proto_bench_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t benchmarks; //in the table
+	uint32_t clock_hz; //cycles per second
+} proto_bench_summary_t;
+
+typedef struct __attribute__((packed)) {
+	uint16_t ride;
+	uint32_t from, to; //ms since that ride's boot
+} proto_log_read_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t seq; //counts every block the ADC filled, so gaps show the ones USB couldn't take
+	uint32_t tick; //when the block finished filling
+	uint16_t samples;
+	uint32_t torn; //blocks the DMA has overwritten while USB was still sending them, since boot
+} proto_stream_block_t;
+
+//================== receive side ==================
+//streaming COBS decoder; bytes can arrive split up any way at all
+typedef struct {
+	uint8_t buf[PROTO_MAX_PAYLOAD + 2]; //decoded payload and CRC
+	uint16_t len;
+	uint8_t code; //code byte of the block being decoded
+	uint8_t left; //bytes left in that block
+	bool dropping; //frame overflowed, skip to the next delimiter
+
+	uint32_t frames; //good ones
+	uint32_t crc_errors;
+	uint32_t framing_errors; //truncated blocks, runts
+	uint32_t overflows;
+} proto_rx_t;
+
+//called with each good frame's payload (CRC stripped), decoded in the receiver's buffer
+typedef void (*proto_frame_cb_t)(const uint8_t* payload, uint16_t len, void* ctx);
+
+void proto_rx_init(proto_rx_t* rx);
+void proto_rx_feed(proto_rx_t* rx, const uint8_t* data, uint32_t len, proto_frame_cb_t cb, void* ctx);
+
+//================== transmit side ==================
+//CRC and COBS encode a payload (up to PROTO_MAX_PAYLOAD) into out (PROTO_MAX_FRAME), returns the frame length
+uint16_t proto_encode(const uint8_t* payload, uint16_t len, uint8_t* out);
+
+//================== command dispatch ==================
+typedef void (*proto_send_t)(const uint8_t* frame, uint16_t len, void* ctx);
+
+typedef struct {
+	uint8_t cmd, seq;
+	proto_send_t send;
+	void* ctx;
+} proto_reply_t;
+
+//handlers parse their arguments straight out of the frame and answer with proto_reply()
+//every request gets exactly one reply that isn't PROTO_MORE
+typedef void (*proto_handler_t)(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+
+typedef struct {
+	uint8_t min_args; //shorter requests get PROTO_BAD_ARG without reaching the handler
+	proto_handler_t handler;
+} proto_command_t;
+
+//look up the command (table is indexed by command, missing entries are PROTO_BAD_CMD) and run it
+void proto_dispatch(const proto_command_t* table, uint8_t num_cmds, const uint8_t* payload, uint16_t len,
+		proto_send_t send, void* ctx);
+
+//encode and send one reply; data is truncated to PROTO_MAX_REPLY_DATA
+void proto_reply(const proto_reply_t* reply, uint8_t status, const void* data, uint16_t len);
+
+#endif
@@ -6,7 +6,7 @@
 #include "cmsis_os.h"
 
 #define BUTTON_SHORT_PRESS_TIME 1000 //ms registered as a short press
-#define BUTTON_LONG_PRESS_TIME 3000 //ms registered as a long press
+//long press time is CONFIG_BUTTON_LONG_MS in the config store
 
 #define BUTTON_RELEASED (1<<0)
 #define BUTTON_BUMPED (1<<1) //button pressed and released before LONG_PRESS_TIME elapses
@@ -15,6 +15,15 @@
 #define BUTTON_FLAGS_ALL 0x0F
 
 
+//the button thread's debounce and press timing, a pass every BUTTON_BOUNCE_TIME
+typedef struct {
+	GPIO_PinState last_state; //pin on the last pass
+	bool last_button; //debounced state, high equates to the button currently being pressed
+	bool short_press, long_press; //tell us if we've set the appropriate event flags yet
+	uint32_t push_time; //timestamp of when the button was pressed
+	bool swallow; //the rest of this hold only reports its release
+} pushbutton_state_t;
+
 //flags to alert other threads about the pushbutton status
 osEventFlagsId_t pushbutton_flags;
 
@@ -32,6 +41,16 @@ bool pushbutton_short_pressed(bool clear_flag);
 bool pushbutton_long_pressed(bool clear_flag);
 //=================================================================================
 
+//debounced state of the button right now
+bool pushbutton_held();
+
+//the hold going on right now won't register as a bump, short or long press (it's the one that powered the board on)
+void pushbutton_swallow_hold();
+
+//one pass of the button thread: the pin now, the tick and the long press time; returns the BUTTON_* flags to set
+//public so the benchmarks (bench.h) time it
+uint32_t pushbutton_step(pushbutton_state_t* s, GPIO_PinState pin, uint32_t now, uint32_t long_ms);
+
 //get the stack space that the various threads are using
 uint32_t pushbutton_stack_space();
 uint32_t led_stack_space();
@@ -0,0 +1,53 @@
+#ifndef RIDE_STATS_H
+#define RIDE_STATS_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//running statistics for the current ride, O(1) per sample
+//voltage moments are Welford-style (numerically stable running mean/variance), the rest are
+//min/max, fixed-size histograms and per-mode timers
+//the summary is queued into the datalog from shutdown() and can be read back for any ride still in the log
+//this header is HAL-free so the host tools can use the record layouts
+
+#define RIDE_LIGHT_MODES 4 //same as the lighting routines in board_lights.c
+#define RIDE_HIST_BINS 12
+#define RIDE_HIST_MIN 24.0f //volts at the bottom of the first bin
+#define RIDE_HIST_WIDTH 0.8f //volts per bin
+#define RIDE_SAG_THRESHOLD 0.3f //volts below the moving average that counts as being under load
+
+//datalog record layouts, each fits in one record
+typedef struct __attribute__((packed)) {
+	uint16_t ride;
+	uint16_t duration; //s
+	uint16_t v_min, v_max, v_mean, v_std; //10mV
+	uint16_t sag_mean, sag_max; //10mV below the moving average, while under load
+	uint16_t mode_time[RIDE_LIGHT_MODES]; //s in each lighting routine
+	uint16_t energy; //0.1Wh
+} ride_summary_t;
+
+typedef struct __attribute__((packed)) {
+	uint16_t ride;
+	uint16_t seconds[RIDE_HIST_BINS]; //time spent in each voltage band
+} ride_hist_t;
+
+//start a fresh ride
+void ride_stats_init(uint16_t ride);
+
+//feed a good battery reading (monitor thread, every pass)
+void ride_stats_voltage(float voltage, float mav);
+
+//the lights changed routine (lights thread)
+void ride_stats_light_mode(uint8_t mode);
+
+//where the ride is at right now (any thread)
+void ride_stats_summary(ride_summary_t* summary, ride_hist_t* hist);
+
+//queue the summary and histogram into the datalog; constant time, call from shutdown()
+void ride_stats_persist();
+
+//read back the summary of an earlier ride from the log, false if it isn't there
+//reads every page of the ride, so it's slow on a long one (a usb_cmd request, not anything timed)
+bool ride_stats_load(uint16_t ride, ride_summary_t* summary);
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef RTOS_OBJECTS_H
+#define RTOS_OBJECTS_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "cmsis_os.h"
+
+//one table for every kernel object in the firmware
+//all of the control blocks, stacks and queue storage are allocated statically in rtos_objects.c
+//and the linker places them together in .bss so the map file lists each one (see Tools/rtos_mem_report.sh)
+//idle and timer task memory is still handed out by cmsis_os2.c (configMINIMAL_STACK_SIZE, configTIMER_TASK_STACK_DEPTH)
+
+//================== threads ==================
+//		object name		stack (bytes, multiple of 8)
+#define RTOS_THREADS(X) \
+	X(state_machine,	2048) \
+	X(button,			256) \
+	X(led,				288) \
+	X(buzzer,			352) \
+	X(monitor,			2048) \
+	X(draw,				256) \
+	X(animator,			512) \
+	X(lights_super,		2048) \
+	X(lights_anim,		2048) \
+	X(datalog,			512) \
+	X(usb_cmd,			1536) \
+	X(adc_stream,		768) \
+	X(dlog,				384) \
+	X(cpu_stats,		512) \
+	X(stack_watch,		384) \
+	X(trace,			768)
+
+//================== event flags ==================
+#define RTOS_EVENT_FLAGS(X) \
+	X(pushbutton) \
+	X(led_action) \
+	X(buzzer_action) \
+	X(monitor_util) \
+	X(animator_run) \
+	X(flash) \
+	X(shutdown_done) \
+	X(usb_cmd) \
+	X(adc_stream)
+
+//================== message queues ==================
+//		object name		depth	item size
+#define RTOS_QUEUES(X) \
+	X(soc_buf,			1,		sizeof(float)) \
+	X(drawbuf,			1,		sizeof(uint16_t)) \
+	X(pulse_buf,		1,		sizeof(uint16_t)) \
+	X(datalog_buf,		16,		32) /* datalog_item_t, checked in datalog.c */
+
+//budget for everything above; checked when compiling rtos_objects.c and again at link time
+//against _Rtos_Static_Budget in the STM32F401RETX_*.ld scripts, keep those in step
+#define RTOS_STATIC_BUDGET (20*1024)
+
+//================== storage declarations ==================
+#define RTOS_DECLARE_THREAD(obj, stack) \
+	extern StaticTask_t rtos_##obj##_tcb; \
+	extern StackType_t rtos_##obj##_stack[(stack)/sizeof(StackType_t)];
+#define RTOS_DECLARE_FLAGS(obj) \
+	extern StaticEventGroup_t rtos_##obj##_cb;
+#define RTOS_DECLARE_QUEUE(obj, depth, size) \
+	extern StaticQueue_t rtos_##obj##_cb; \
+	extern uint8_t rtos_##obj##_mq[(depth)*(size)];
+
+#define RTOS_QUEUE_SHAPE(obj, depth, size) \
+	enum { rtos_##obj##_depth = (depth), rtos_##obj##_size = (size) };
+
+RTOS_THREADS(RTOS_DECLARE_THREAD)
+RTOS_EVENT_FLAGS(RTOS_DECLARE_FLAGS)
+RTOS_QUEUES(RTOS_DECLARE_QUEUE)
+RTOS_QUEUES(RTOS_QUEUE_SHAPE)
+
+#define RTOS_QUEUE_DEPTH(obj) rtos_##obj##_depth
+#define RTOS_QUEUE_ITEM_SIZE(obj) rtos_##obj##_size
+
+//================== attribute helpers ==================
+//use these in place of the usual attribute structs when creating the objects
+#define RTOS_THREAD_ATTR(obj, thread_name, prio) { \
+	.name = (thread_name), \
+	.priority = (osPriority_t)(prio), \
+	.cb_mem = &rtos_##obj##_tcb, \
+	.cb_size = sizeof(rtos_##obj##_tcb), \
+	.stack_mem = rtos_##obj##_stack, \
+	.stack_size = sizeof(rtos_##obj##_stack) \
+}
+
+#define RTOS_FLAGS_ATTR(obj) { \
+	.cb_mem = &rtos_##obj##_cb, \
+	.cb_size = sizeof(rtos_##obj##_cb) \
+}
+
+#define RTOS_QUEUE_ATTR(obj) { \
+	.cb_mem = &rtos_##obj##_cb, \
+	.cb_size = sizeof(rtos_##obj##_cb), \
+	.mq_mem = rtos_##obj##_mq, \
+	.mq_size = sizeof(rtos_##obj##_mq) \
+}
+
+#endif
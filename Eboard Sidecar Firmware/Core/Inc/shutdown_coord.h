@@ -0,0 +1,35 @@
+#ifndef SHUTDOWN_COORD_H
+#define SHUTDOWN_COORD_H
+
+#include "stm32f4xx_hal.h"
+#include "cmsis_os.h"
+#include "shutdown_record.h"
+
+//coordinates a graceful shutdown across all the modules
+//each module registers a handler (usually from its init function) with a deadline
+//on shutdown every handler is kicked off at once, and power drops as soon as they've all
+//called shutdown_done() or the worst-case budget runs out, whichever is first
+
+#define SHUTDOWN_MAX_TIME 1500 //ms, hard cap on how long we'll wait for the slowest handler
+#define SHUTDOWN_LOG_TIMEOUT 20 //ms to get the shutdown record onto flash once everything else is done
+//SHUTDOWN_MAX_HANDLERS and the record it logs (shutdown_record_t) are in shutdown_record.h
+
+typedef void (*shutdown_handler_t)(void);
+
+//create the completion flags; call before any module registers a handler
+void shutdown_coord_init();
+
+//register a handler that has to finish within deadline_ms of the shutdown starting
+//returns the ID to pass to shutdown_done(), or -1 if there's no room
+int8_t shutdown_register(const char* name, shutdown_handler_t handler, uint32_t deadline_ms);
+
+//signal that a module has finished shutting down (safe to call from an ISR)
+//calls made before a shutdown starts are ignored
+void shutdown_done(int8_t id);
+
+//run every handler and wait for them all to finish (or the budget to expire)
+//then log how long each one took (shutdown_record_t) and wait for that page to be written
+//returns how long the handlers took in ms, not counting the log write
+uint32_t shutdown_run();
+
+#endif
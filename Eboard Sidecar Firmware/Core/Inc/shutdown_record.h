@@ -0,0 +1,20 @@
+#ifndef SHUTDOWN_RECORD_H
+#define SHUTDOWN_RECORD_H
+
+#include "stdint.h"
+
+//the record shutdown_run() leaves in the datalog (see shutdown_coord.h)
+//this header is HAL-free so the host tools can use the record layout
+
+#define SHUTDOWN_MAX_HANDLERS 8
+#define SHUTDOWN_TIMED_OUT 0xFFFF //in shutdown_record_t.took, the handler never called shutdown_done()
+
+//datalog record (DATALOG_SHUTDOWN), the last thing written before power drops
+typedef struct __attribute__((packed)) {
+	uint32_t tick; //when the shutdown started
+	uint16_t total; //ms shutdown_run() waited, same as it returns
+	uint8_t handlers; //registered, the entries of took[] that are used
+	uint16_t took[SHUTDOWN_MAX_HANDLERS]; //ms per handler, in the order they registered
+} shutdown_record_t;
+
+#endif
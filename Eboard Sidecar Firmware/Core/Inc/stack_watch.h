@@ -0,0 +1,59 @@
+#ifndef STACK_WATCH_H
+#define STACK_WATCH_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//stack high-water marks for every thread in the RTOS_THREADS table (rtos_objects.h)
+//the kernel fills each stack with a known pattern when the thread starts, so the watch thread just counts how much of
+//it is still untouched; no thread handles needed, and threads that haven't started yet are skipped
+//each time a thread's peak grows it gets a datalog record with a suggested size (peak plus a margin), and
+//a dlog warning once it's past STACK_WARN_PERCENT
+//threads are numbered in table order; the kernel's own idle and timer stacks aren't in the table
+//this header is HAL-free so the host tools can use the record layout
+
+#define STACK_WATCH_PERIOD 5000 //ms between scans
+#define STACK_LOG_STEP 32 //bytes the peak has to grow by before it's logged again
+#define STACK_WARN_PERCENT 90
+#define STACK_MARGIN_PERCENT 25 //on top of the peak for the suggested size
+#define STACK_MIN_SIZE 256 //smallest size it'll suggest
+#define STACK_WATCH_UNKNOWN 0xFF //thread number for a stack that isn't in the table
+
+//datalog record (DATALOG_STACK)
+typedef struct __attribute__((packed)) {
+	uint8_t thread;
+	uint16_t size; //bytes
+	uint16_t peak; //bytes ever used
+	uint16_t suggested;
+	char name[12]; //zero padded, not terminated when the name fills it
+} stack_watch_record_t;
+
+typedef struct {
+	const char* name;
+	bool started;
+	uint16_t size;
+	uint16_t peak;
+	uint16_t suggested;
+} stack_watch_info_t;
+
+//start the watch thread
+void stack_watch_init();
+
+//scan one thread's stack now; false past the end of the table
+bool stack_watch_thread(uint8_t number, stack_watch_info_t* info);
+
+uint8_t stack_watch_count();
+
+//thread number for a task handle (STACK_WATCH_UNKNOWN if it isn't one of ours)
+uint8_t stack_watch_find(void* handle);
+
+//thread the overflow hook caught, STACK_WATCH_UNKNOWN if none (or one outside the table)
+//overflowed is false until the hook has run
+uint8_t stack_watch_overflowed(bool* overflowed);
+
+//called from vApplicationStackOverflowHook(), mid context switch; no kernel calls in here
+void stack_watch_overflow(void* handle);
+
+uint32_t stack_watch_stack_space();
+
+#endif
@@ -9,6 +9,18 @@
 #include "bargraph.h"
 #include "stdbool.h"
 #include "printf_override.h"
+#include "power_fsm.h"
+#include "shutdown_coord.h"
+#include "datalog.h"
+#include "blackbox.h"
+#include "ride_stats.h"
+#include "usb_cmd.h"
+#include "dlog.h"
+#include "config.h"
+#include "flash_stm32.h"
+#include "cpu_stats.h"
+#include "stack_watch.h"
+#include "trace.h"
 
 //extern osThreadId_t StateMachineHandle;
 extern ADC_HandleTypeDef hadc1;
@@ -17,66 +29,113 @@ extern TIM_HandleTypeDef htim3;
 osEventFlagsId_t pb_flags;
 osMessageQueueId_t soc_buf;
 
+#define BUS_MIN_VOLTAGE 20 //only latch power above this
+
 #define ADC_OVERSAMPLES 16
 volatile uint16_t adc_results[ADC_OVERSAMPLES];
 
 void shutdown() {
-	//remember to de-init the filesystem
-	pushbutton_led_off();
-	buzz_shutdown();
-	board_lights_shutdown();
-	osDelay(600);
-	HAL_GPIO_WritePin(FET_DRV_GPIO_Port, FET_DRV_Pin, GPIO_PIN_RESET); //logic rail should be enabled long enough to finish buzz
-	osDelay(400);
+	ride_stats_persist(); //only queues the summary, so it goes out with the datalog's final flush
+
+	//every module registered its own shutdown handler in its init function
+	//this returns once they've all finished (or the worst-case budget ran out)
+	shutdown_run();
+	HAL_GPIO_WritePin(FET_DRV_GPIO_Port, FET_DRV_Pin, GPIO_PIN_RESET);
 	HAL_DeInit();
 	while(true);
 }
 
-//basically our main code goes here
-void doStateMachine(void *argument) {
-	//initialize the pushbutton "module"
-	//and store the pointer to its event flags
-	pb_flags = pushbutton_init();
-	soc_buf = monitor_init();
-	buzzer_init(); //buzz that we've booted and start the buzzer thread
+//============ hooks for the power lifecycle tables (see power_fsm.c) ============
+void power_on_precharge() {
 	pushbutton_led_fade(); //fade the LED button on the precharge animation
+}
 
-	osEventFlagsWait(pb_flags, BUTTON_LONG_PRESSED, osFlagsWaitAny, osWaitForever); //precharge for 3 seconds
-	if(!v_sys_check(20, &hadc1)) shutdown(); //only start the main thread if the voltage is above 20V
+bool power_bus_ok() {
+	return v_sys_check(BUS_MIN_VOLTAGE, &hadc1); //only start the main thread if the voltage is high enough
+}
 
+void power_on_latch() {
 	HAL_GPIO_WritePin(FET_DRV_GPIO_Port, FET_DRV_Pin, GPIO_PIN_SET); //enable the high side FETs to latch power on
 
+	ride_stats_init(datalog_ride()); //before the monitor and lights start feeding it
 	monitor_start(&hadc1); //start the battery monitor
 	bargraph_init(soc_buf); //start the bargraph and pass it the ID of the SOC buffer
 	board_lights_init(&htim3); //start the headlights/taillights thread and a timer for it to use
 
 	buzz_done_init(); //finished all the initialization and fully powered up
 	pushbutton_led_on();
+	pushbutton_swallow_hold(); //the hold that powered us on may still be going, it mustn't count as a press
 	osEventFlagsClear(pb_flags, BUTTON_FLAGS_ALL); //clear all button flags so the board isn't shut down immediately
+	datalog_ride_started(); //last, it may erase a log sector and stall everything for a second or two
+}
+
+void power_on_bump() { bargraph_draw_soc(); }
+void power_on_hold() { pushbutton_led_flash(); }
+void power_on_release() { pushbutton_led_on(); } //light the LED solid when the button is released (in case of flashing)
+void power_on_soc_low() { buzz_warn_low(); }
+void power_on_fault() { buzz_warn_critical(); }
+
+//freeze the black box on the way into a fault, and again right before a fault shutdown
+void power_on_soc_crit() { blackbox_trigger(BLACKBOX_SOC_CRIT); }
+void power_on_read_fail() { blackbox_trigger(BLACKBOX_READ_FAIL); }
+void power_on_fault_timeout() { blackbox_trigger(BLACKBOX_FAULT_SHUTDOWN); }
+void power_on_shutdown() { shutdown(); }
+
+//print every state change out over USB and log it
+void power_trace(const hsm_t* sm, hsm_state_t from, hsm_state_t to, hsm_event_t event) {
+	const char* event_name = event < sm->def->num_events ? sm->def->event_names[event] : "init";
+	printf("[%lu] %s -> %s (%s)\r\n", sm->now, sm->def->states[from].name ? sm->def->states[from].name : "-",
+			sm->def->states[to].name, event_name);
+
+	datalog_state_t record = {.tick = sm->now, .from = from, .to = to, .event = event};
+	datalog_write(DATALOG_STATE, &record, sizeof(record));
+	blackbox_record(BLACKBOX_STATE, event, (from << 8) | to);
+}
 
-	uint32_t shutdown_tick = -1; //basically never shut down unless SOC critical or monitor failure
-	bool shutdown_latched = false; //flag that says we latched a shutdown signal
+//basically our main code goes here
+void doStateMachine(void *argument) {
+	hsm_t power; //lifecycle state machine, all the behavior lives in the power_fsm tables
+
+	shutdown_coord_init(); //before any of the modules register their shutdown handlers
+
+	//saved settings first, everything after this reads them
+	uint32_t config_seq = config_load(&flash_stm32_config);
+	if(config_seq) printf("config: loaded snapshot %lu\r\n", config_seq);
+	else printf("config: no saved snapshot, using defaults\r\n");
+
+	//initialize the pushbutton "module"
+	//and store the pointer to its event flags
+	pb_flags = pushbutton_init();
+	soc_buf = monitor_init();
+	buzzer_init(); //buzz that we've booted and start the buzzer thread
+	datalog_init(); //any sector erase waits for the latch
+	blackbox_init();
+	usb_cmd_init(); //host commands can read the log from here on
+	dlog_init();
+	cpu_stats_init();
+	stack_watch_init();
+	trace_init(); //off until a PROTO_TRACE turns it on
+	hsm_init(&power, &power_fsm, PWR_PRECHARGE, HAL_GetTick(), power_trace);
 
 	while(1) {
-		//do datalogging
-		//handle the remote control input
-		if(pushbutton_bumped(true)) bargraph_draw_soc(); //report SOC on short button press
-		if(pushbutton_short_pressed(true)) pushbutton_led_flash(); //alert the user that a continued hold will shut down the board
-		if(pushbutton_long_pressed(true)) shutdown(); //shutdown the board on long-press
-		if(pushbutton_released(true)) pushbutton_led_on(); //light the LED solid when the button is released (in case of flashing)
-
-		if(monitor_soc_crit(true) && !shutdown_latched) { //splitting this and the following so we can store separate log messages
-			buzz_warn_critical();
-			shutdown_tick = HAL_GetTick() + 10000;
-			shutdown_latched = true;
-		}
-		if(monitor_read_fail(true) && !shutdown_latched) {
-			buzz_warn_critical();
-			shutdown_tick = HAL_GetTick() + 10000;
-			shutdown_latched = true;
-		}
-		if(monitor_soc_low(true)) buzz_warn_low();
-		if(HAL_GetTick() > shutdown_tick) shutdown();
+		uint32_t now = HAL_GetTick();
+
+		//turn the module flags into events for the state machine
+		//order here is the order events get handled in within a single pass
+		if(pushbutton_bumped(true)) hsm_dispatch(&power, PWR_EV_BUTTON_BUMPED, now);
+		if(pushbutton_short_pressed(true)) hsm_dispatch(&power, PWR_EV_BUTTON_SHORT, now);
+		if(pushbutton_long_pressed(true)) hsm_dispatch(&power, PWR_EV_BUTTON_LONG, now);
+		if(pushbutton_released(true)) hsm_dispatch(&power, PWR_EV_BUTTON_RELEASED, now);
+
+		if(monitor_soc_crit(true)) hsm_dispatch(&power, PWR_EV_SOC_CRIT, now);
+		if(monitor_read_fail(true)) hsm_dispatch(&power, PWR_EV_READ_FAIL, now);
+		if(monitor_soc_low(true)) hsm_dispatch(&power, PWR_EV_SOC_LOW, now);
+
+		//the bus is only watched for the end of precharge until power latches
+		if(hsm_in_state(&power, PWR_PRECHARGE) && monitor_precharged(BUS_MIN_VOLTAGE, &hadc1))
+			hsm_dispatch(&power, PWR_EV_PRECHARGED, now);
+
+		hsm_dispatch(&power, PWR_EV_TICK, now);
 
 		//handle the taillight remote change
 	}
@@ -59,6 +59,7 @@ void TIM3_IRQHandler(void);
 void DMA2_Stream0_IRQHandler(void);
 void OTG_FS_IRQHandler(void);
 /* USER CODE BEGIN EFP */
+void ADC_IRQHandler(void);
 
 /* USER CODE END EFP */
 
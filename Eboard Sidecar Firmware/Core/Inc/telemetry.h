@@ -0,0 +1,80 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//compact encoding for the periodic telemetry samples that go into the datalog
+//
+//samples are packed into blocks of up to TELEM_BLOCK_MAX bytes (one datalog record each):
+//  [block seq] [record] [record] ...
+//every record starts with a tag byte saying what follows
+//  keyframe: tag, varint tick, then every field as an absolute value
+//  delta:    tag, then only the fields that changed -- varint dt (only if it differs from the last dt),
+//            zig-zag varint deltas for voltage/SOC, raw bytes for light mode/flags
+//a steady 100Hz sample usually comes out as two bytes (tag + voltage delta)
+//
+//keyframes go out every TELEM_KEYFRAME_INTERVAL samples (and after a dropped block) so the decoder
+//can pick back up after a lost page; it spots the gap from the block seq
+//doesn't touch any HAL or RTOS stuff so the decoder builds for the host too
+
+#define TELEM_BLOCK_MAX 30 //same as DATALOG_MAX_RECORD
+#define TELEM_KEYFRAME_INTERVAL 100 //samples, 10s at the rate the battery monitor logs them
+
+//flag bits
+#define TELEM_FLAG_SOC_LOW		(1<<0)
+#define TELEM_FLAG_SOC_CRIT		(1<<1)
+#define TELEM_FLAG_READ_FAIL	(1<<2) //last ADC read failed or was insane
+#define TELEM_FLAG_BUTTON		(1<<3) //button held down
+
+typedef struct {
+	uint32_t tick; //ms
+	uint16_t voltage; //10mV
+	uint16_t soc; //0.1%
+	uint8_t light_mode;
+	uint8_t flags;
+} telem_sample_t;
+
+typedef struct {
+	telem_sample_t last;
+	uint32_t last_dt;
+	uint16_t since_keyframe;
+	bool need_keyframe;
+	uint8_t block_seq;
+	uint8_t used;
+	uint8_t block[TELEM_BLOCK_MAX];
+} telem_encoder_t;
+
+typedef struct {
+	telem_sample_t last;
+	uint32_t last_dt;
+	bool synced; //false until the first keyframe, and after a gap
+	bool started; //seen any block yet
+	uint8_t next_seq;
+	uint32_t lost_blocks; //gaps in the block sequence
+	uint32_t skipped; //records thrown away while waiting for a keyframe
+} telem_decoder_t;
+
+typedef void (*telem_sample_cb_t)(const telem_sample_t* sample, void* ctx);
+
+//================== encoding ==================
+void telem_encoder_init(telem_encoder_t* enc);
+
+//add a sample; if that finished off a block it's copied into out (TELEM_BLOCK_MAX bytes) and its length is returned
+//returns 0 if the sample just went into the current block
+uint8_t telem_encode(telem_encoder_t* enc, const telem_sample_t* sample, uint8_t* out);
+
+//hand over the part-filled block, returns its length (0 if empty)
+uint8_t telem_flush(telem_encoder_t* enc, uint8_t* out);
+
+//call if a block didn't make it to storage; the next sample goes out as a keyframe
+void telem_encoder_resync(telem_encoder_t* enc);
+
+//================== decoding ==================
+void telem_decoder_init(telem_decoder_t* dec);
+
+//decode one block, calling cb for every sample
+//returns the number of samples, or -1 if the block is malformed
+int telem_decode_block(telem_decoder_t* dec, const uint8_t* block, uint8_t len, telem_sample_cb_t cb, void* ctx);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "stdint.h"
+#include "stdbool.h"
+#include "trace_format.h"
+
+//RTOS event trace: context switches, ISR entry/exit, queue and event flag operations and delays, stamped with the
+//DWT cycle counter into a RAM ring
+//the kernel hooks are the trace macros in FreeRTOSConfig.h, the ISR hooks are in stm32f4xx_it.c
+//in stream mode the trace thread ships the ring out over USB as it fills; in snapshot mode the ring just keeps
+//the latest events until trace_trigger() (black box triggers call it) or a PROTO_TRACE dump
+//Tools/trace_convert.c turns either one into a timeline
+//
+//recording an event is an atomic increment and an 8 byte store, measured at boot (TRACE_BUDGET_CYCLES is the
+//budget, see trace_get_stats()); every hook runs in an ISR or with the scheduler held off, so the trace thread
+//never sees a slot that's been claimed but not written yet
+//only include this from C (FreeRTOSConfig.h pulls it in)
+
+#define TRACE_EVENTS 1024 //ring size, power of 2
+#define TRACE_FLUSH_TIME 10 //ms between trips to USB while streaming
+#define TRACE_BUDGET_CYCLES 32 //per event, warned about at boot if it's over
+#ifndef TRACE_CYCLES //the host build brings its own clock (Tools/host/include/sim_target.h)
+#define TRACE_CYCLES() (*(volatile uint32_t*)0xE0001004ul) //DWT->CYCCNT, started by cpu_stats_timer_init()
+#endif
+
+typedef struct {
+	uint8_t mode; //TRACE_OFF, TRACE_STREAM or TRACE_SNAPSHOT
+	bool frozen; //snapshot was triggered and is waiting for a dump
+	uint16_t cycles_per_event;
+	uint32_t events; //recorded since boot
+	uint32_t lost; //overwritten before they were streamed
+	uint32_t frames;
+} trace_stats_t;
+
+//number the queues and event groups, measure the per-event cost and start the trace thread (mode TRACE_OFF)
+void trace_init();
+
+//TRACE_OFF, TRACE_STREAM or TRACE_SNAPSHOT; starting a mode empties the ring
+void trace_set_mode(uint8_t mode);
+
+//freeze a snapshot (thread or ISR); ignored unless in snapshot mode
+void trace_trigger();
+
+//a user event from thread code
+void trace_mark(uint8_t arg, uint16_t value);
+
+//send the snapshot ring (after the info and name frames), then re-arm the snapshot
+//each call to send is the data of one PROTO_MORE reply; returns the number of events sent
+typedef void (*trace_send_t)(const uint8_t* data, uint16_t len, void* ctx);
+uint32_t trace_dump(trace_send_t send, void* ctx);
+
+void trace_get_stats(trace_stats_t* stats);
+uint32_t trace_stack_space();
+
+//================ the ring (used by the inline writer below) ================
+extern trace_event_t trace_ring[TRACE_EVENTS];
+extern volatile uint32_t trace_head; //events ever claimed
+extern volatile bool trace_recording;
+
+static inline void trace_put(uint8_t kind, uint8_t arg, uint16_t value) {
+	if(!trace_recording) return;
+	uint32_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & (TRACE_EVENTS - 1);
+	trace_ring[slot] = (trace_event_t){.cycles = TRACE_CYCLES(), .kind = kind, .arg = arg, .value = value};
+}
+
+//for the ISR handlers in stm32f4xx_it.c
+#define TRACE_IRQ_ENTER(irqn) trace_put(TRACE_ISR_ENTER, (uint8_t)((irqn) + 16), 0)
+#define TRACE_IRQ_EXIT(irqn) trace_put(TRACE_ISR_EXIT, (uint8_t)((irqn) + 16), 0)
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include "stdint.h"
+
+//wire format of the RTOS event trace (see trace.h), shared with Tools/trace_convert.c
+//everything goes out as PROTO_TRACE replies with status PROTO_MORE; the first data byte says what the frame holds
+
+//an event, 8 bytes in the ring and on the wire
+typedef struct __attribute__((packed)) {
+	uint32_t cycles; //DWT cycle counter, wraps every 67s at 64MHz
+	uint8_t kind;
+	uint8_t arg; //thread, queue, event group or exception number, depending on the kind
+	uint16_t value;
+} trace_event_t;
+
+//event kinds
+enum {
+	TRACE_SWITCH_IN = 1, //arg: thread (cpu_stats numbering, 0 if it hasn't been numbered yet)
+	TRACE_ISR_ENTER, //arg: exception number (IRQn + 16)
+	TRACE_ISR_EXIT, //arg: exception number
+	TRACE_QUEUE_SEND, //arg: queue (RTOS_QUEUES order from 1, 0 for kernel-internal ones), value: items waiting before
+	TRACE_QUEUE_RECEIVE, //arg: queue, value: items waiting before
+	TRACE_QUEUE_BLOCK, //arg: queue; the running thread blocks waiting for an item
+	TRACE_FLAGS_SET, //arg: event group (RTOS_EVENT_FLAGS order from 1), value: bits set
+	TRACE_FLAGS_BLOCK, //arg: event group, value: bits waited for
+	TRACE_DELAY, //arg: thread, value: ticks it's going to sleep for
+	TRACE_MARK, //arg/value: whatever the caller of trace_mark() wants
+};
+
+//frame kinds (first data byte)
+enum {
+	TRACE_FRAME_INFO = 1, //trace_info_t
+	TRACE_FRAME_NAME, //[uint8 what][uint8 number][name, not terminated]
+	TRACE_FRAME_EVENTS, //trace_event_t, as many as fit
+	TRACE_FRAME_LOST, //uint32 events overwritten before they could be sent
+};
+
+//what a name frame names
+enum {
+	TRACE_NAME_THREAD = 1,
+	TRACE_NAME_QUEUE,
+	TRACE_NAME_FLAGS,
+	TRACE_NAME_ISR,
+};
+
+typedef struct __attribute__((packed)) {
+	uint32_t cpu_hz; //to turn cycles into time
+	uint16_t cycles_per_event; //measured at boot
+} trace_info_t;
+
+//PROTO_TRACE modes
+enum {
+	TRACE_OFF = 0,
+	TRACE_STREAM, //send events as they happen
+	TRACE_SNAPSHOT, //keep the last TRACE_EVENTS in the ring until something triggers it
+	TRACE_DUMP, //send what's in the snapshot ring (freezing it first), then carry on in snapshot mode
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef USB_CMD_H
+#define USB_CMD_H
+
+#include "stdint.h"
+
+//answers host commands over the CDC link (framing and command set are in protocol.h)
+
+//start the parser thread; packets that arrived before this wait in the CDC receive slots
+void usb_cmd_init();
+
+//a packet landed in the CDC receive slots (called from the USB interrupt)
+void usb_cmd_rx_notify();
+
+uint32_t usb_cmd_stack_space();
+
+#endif
@@ -0,0 +1,112 @@
+#include "adc_stream.h"
+#include "rtos_objects.h"
+#include "usbd_cdc_if.h"
+#include "protocol.h"
+#include "dlog.h"
+
+//======================= some defines ======================
+#define HALF_READY(half) (1 << (half)) //a half buffer is ready to send
+#define ALL_HALVES (HALF_READY(0) | HALF_READY(1))
+
+//===================== PRIVATE VARIABLES =====================
+static uint16_t samples[2][ADC_STREAM_BLOCK]; //DMA fills these back to back, round and round
+
+static osEventFlagsId_t stream_flags = NULL;
+static osThreadId_t stream_handle = NULL;
+
+static volatile bool wanted = false;
+static volatile bool running = false;
+static volatile uint32_t seq = 0; //counts every half buffer filled, sent or not
+static uint32_t half_seq[2];
+static uint32_t half_tick[2];
+
+static adc_stream_stats_t stats;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void run_stream(void* argument);
+static void send_block(const uint8_t* frame, uint16_t len, void* ctx);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void adc_stream_init() {
+	const osEventFlagsAttr_t stream_flags_attributes = RTOS_FLAGS_ATTR(adc_stream);
+	stream_flags = osEventFlagsNew(&stream_flags_attributes);
+
+	const osThreadAttr_t stream_attributes = RTOS_THREAD_ATTR(adc_stream, "adc_stream", osPriorityHigh);
+	stream_handle = osThreadNew(run_stream, NULL, &stream_attributes);
+}
+
+void adc_stream_enable(bool enable) { wanted = enable; }
+bool adc_stream_running() { return running; }
+void adc_stream_get_stats(adc_stream_stats_t* out) { *out = stats; }
+
+void adc_stream_switch(ADC_HandleTypeDef* hadc) {
+	if(wanted == running) return;
+
+	HAL_ADC_Stop_DMA(hadc);
+	ADC_ChannelConfTypeDef channel = {.Channel = ADC_CHANNEL_10, .Rank = 1}; //same channel as MX_ADC1_Init()
+
+	if(wanted) {
+		//circular DMA, and keep the ADC requesting it after the buffer wraps
+		hadc->DMA_Handle->Init.Mode = DMA_CIRCULAR;
+		HAL_DMA_Init(hadc->DMA_Handle);
+		SET_BIT(hadc->Instance->CR2, ADC_CR2_DDS);
+
+		//stretch the sample time to bring the rate down to something USB can carry
+		channel.SamplingTime = ADC_STREAM_SAMPLE_TIME;
+		HAL_ADC_ConfigChannel(hadc, &channel);
+
+		osEventFlagsClear(stream_flags, ALL_HALVES);
+		running = true; //before the first callback can fire
+		HAL_ADC_Start_DMA(hadc, (uint32_t*)samples, 2 * ADC_STREAM_BLOCK);
+		DLOG0(ADC_STREAM_ON);
+	}
+	else {
+		running = false;
+
+		//just the monitor's own reads on the injected group again; they set the sample time themselves
+		hadc->DMA_Handle->Init.Mode = DMA_NORMAL;
+		HAL_DMA_Init(hadc->DMA_Handle);
+		CLEAR_BIT(hadc->Instance->CR2, ADC_CR2_DDS);
+		DLOG3(ADC_STREAM_OFF, stats.blocks, stats.dropped, stats.torn);
+	}
+}
+
+void adc_stream_half_done(uint8_t half) {
+	//the DMA has moved on to the other half; if that one is still queued for USB it's getting overwritten
+	if(CDC_Block_Busy()) stats.torn++;
+
+	half_seq[half] = seq++;
+	half_tick[half] = HAL_GetTick();
+
+	osEventFlagsSet(stream_flags, HALF_READY(half));
+}
+
+uint32_t adc_stream_stack_space() {return osThreadGetStackSpace(stream_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void run_stream(void* argument) {
+	while(1) {
+		uint32_t ready = osEventFlagsWait(stream_flags, ALL_HALVES, osFlagsWaitAny, osWaitForever);
+		if(ready & (1<<31)) continue;
+
+		//if both are waiting we fell behind; send the older one first
+		uint8_t first = ((ready & ALL_HALVES) == ALL_HALVES && half_seq[1] < half_seq[0]) ? 1 : 0;
+		for(uint8_t i = 0; i < 2; i++) {
+			uint8_t half = first ^ i;
+			if(!(ready & HALF_READY(half))) continue;
+
+			//header frame goes through the ring, the samples straight out of the DMA buffer behind it
+			proto_stream_block_t header = {.seq = half_seq[half], .tick = half_tick[half], .samples = ADC_STREAM_BLOCK,
+					.torn = stats.torn};
+			proto_reply_t reply = {.cmd = PROTO_STREAM, .seq = 0, .send = send_block, .ctx = samples[half]};
+			proto_reply(&reply, PROTO_MORE, &header, sizeof(header));
+		}
+	}
+
+	osThreadExit();
+}
+
+static void send_block(const uint8_t* frame, uint16_t len, void* ctx) {
+	if(CDC_Write_Block(frame, len, (const uint8_t*)ctx, ADC_STREAM_BLOCK * sizeof(uint16_t))) stats.blocks++;
+	else stats.dropped++;
+}
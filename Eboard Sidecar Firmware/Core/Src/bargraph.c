@@ -1,6 +1,7 @@
 #include "bargraph.h"
 #include "stdbool.h"
 #include "pindefs.h"
+#include "rtos_objects.h"
 
 //================== some defines =====================
 //how many ticks (ms) we need to wait between the LED muxing
@@ -37,29 +38,23 @@ static void animate_bargraph(void *argument); //runs in a thread context
 void bargraph_init(osMessageQueueId_t soc_buf_id) {
 	//create the flags to notify the status of the animation thread
 	//want to tell the "draw_soc" function whether the animator is running or not
-	animator_run_flags = osEventFlagsNew(NULL);
+	const osEventFlagsAttr_t animator_run_attributes = RTOS_FLAGS_ATTR(animator_run);
+	animator_run_flags = osEventFlagsNew(&animator_run_attributes);
 
 	//create the queue to send the bytes to the draw buffer
 	//just need one element to ferry the new "image" over to the thread safely
-	drawbuf_queue = osMessageQueueNew(1, sizeof(uint16_t), NULL);
+	const osMessageQueueAttr_t drawbuf_attributes = RTOS_QUEUE_ATTR(drawbuf);
+	drawbuf_queue = osMessageQueueNew(RTOS_QUEUE_DEPTH(drawbuf), RTOS_QUEUE_ITEM_SIZE(drawbuf), &drawbuf_attributes);
 
 	//create the bargraph drawing thread
-	const osThreadAttr_t draw_attributes = {
-			.name = "draw",
-			.priority = (osPriority_t) osPriorityHigh,
-			.stack_size = 256
-	};
+	const osThreadAttr_t draw_attributes = RTOS_THREAD_ATTR(draw, "draw", osPriorityHigh);
 	//suspends itself right at startup
 	drawHandle = osThreadNew(draw_bargraph, NULL, &draw_attributes);
 
 	//start a new animation thread too
 	//this thread immediately suspends itself until it gets resumed by the draw_soc function
 	//pass the soc_buf_id to the animator handle to grab the SOC value from
-	const osThreadAttr_t animator_attributes = {
-			.name = "animator",
-			.priority = (osPriority_t) osPriorityAboveNormal,
-			.stack_size = 512
-	};
+	const osThreadAttr_t animator_attributes = RTOS_THREAD_ATTR(animator, "animator", osPriorityAboveNormal);
 	animatorHandle = osThreadNew(animate_bargraph, (void*)soc_buf_id, &animator_attributes);
 }
 
@@ -1,37 +1,106 @@
 #include "batt_monitor.h"
+#include "rtos_objects.h"
+#include "datalog.h"
+#include "board_lights.h"
+#include "pushbutton.h"
+#include "blackbox.h"
+#include "ride_stats.h"
+#include "config.h"
+#include "adc_stream.h"
+#include "dlog.h"
 
 //======================= some defines ======================
-#define DMA_COMPLETE_FLAG (1<<0) //flag that will be asserted when the DMA ADC read is complete
+#define READ_COMPLETE_FLAG (1<<0) //flag that will be asserted when the ADC read is complete
 #define ADC_READY_FLAG (1<<1) //ADC mutex, effectively
 #define SOC_LOW_FLAG (1<<2) //flag asserted when SOC is "low"
 #define SOC_CRIT_FLAG (1<<3) //flag asserted whe SOC is "critical"
 #define SOC_MEASURE_FAIL (1<<4) //flag asserted when the monitor thread fails to read the ADC multiple times
 
-#define ADC_OVERSAMPLES 16
+#define ADC_OVERSAMPLES MONITOR_ADC_BLOCK
 #define SAMPLE_BUFFER_LEN 256
 #define ADC_READ_TIMEOUT 100 //can take 100 ticks max to read the ADC before throwing a timeout error
 #define ADC_MAX_READ_FAILS 8 //how many times the ADC read can fail before asserting the SOC_MEASURE_FAIL flag
-#define DIVIDER_RATIO 0.00887937 //adc bits to volts
-
-#define MONITOR_UPDATE_DELAY 10 //how long the monitor loop should wait for
+#define PRECHARGE_HISTORY (2 * MONITOR_PRECHARGE_GROUP)
+
+//the monitor's reads are injected conversions triggered by TIM4 (the light drivers' PWM timer) on channel 1,
+//moved each period to where neither driver is switching
+#define ADC_SYNC_RANKS 4 //conversions per trigger, all of the battery channel
+#define ADC_SYNC_SAMPLE_TIME ADC_SAMPLETIME_144CYCLES
+#define ADC_SYNC_BURST 40 //TIM4 counts (us) the ranks take: 4 x (144 + 12) ADC clocks at 16MHz
+#define ADC_SYNC_BURST_STREAMING 123 //at the stream's sample time (adc_stream.h): 4 x (480 + 12) ADC clocks
+//divider ratio and the SOC thresholds come from the config store (CONFIG_DIVIDER_NV, CONFIG_SOC_*_MV), as does
+//the loop period (CONFIG_MONITOR_PERIOD_MS)
+
+//compare-exchange for the selection network
+#define CE(a, b) do { \
+		uint16_t lo = samples[a] < samples[b] ? samples[a] : samples[b]; \
+		samples[b] = samples[a] < samples[b] ? samples[b] : samples[a]; \
+		samples[a] = lo; \
+	} while(0)
+#if MONITOR_ADC_BLOCK != 16 || MONITOR_ADC_KEPT != 8
+#error "monitor_adc_trimmed_sum's network is built for 16 samples, keeping the middle 8"
+#endif
+
+//telemetry gets logged every TELEM_DIVIDER passes (10Hz); at the full 100Hz a ride would outgrow the log sectors
+#define TELEM_DIVIDER 10
+
+//telemetry units (see telemetry.h)
+#define TELEM_VOLTAGE_SCALE 100.0f //volts to 10mV
+#define TELEM_SOC_SCALE 1000.0f //0-1 to 0.1%
 
 //===================== PRIVATE VARIABLES =====================
 static osEventFlagsId_t monitor_util_flags; //way for the ISR to signal to the main thread
 static osMessageQueueId_t soc_buf; //a queue that we'll put the updated SOC values into
 
 static osThreadId_t monitor_handle = NULL; //handle for the SOC monitoring thread
+static volatile float latest_voltage = 0, latest_soc = 0; //last good moving average, for status queries
+
+//config values converted to volts once, redone by the watcher when they change
+static volatile float divider_ratio; //adc bits to volts
+static volatile float soc_low_voltage, soc_crit_voltage;
+
+static float boot_voltage = 0; //last sane reading from before the monitor thread starts; 0 for none
+
+//precharge detection, run from the state machine thread until power latches
+static monitor_precharge_t precharge = {0};
+static uint32_t precharge_next_read = 0;
+static bool precharge_done = false;
+
+static uint16_t* volatile sync_buf = NULL; //where the synchronised read is putting its samples
+static volatile uint32_t sync_len, sync_count;
 
 //==================== PRIVATE FUNCTION PROTOTYPES ===================
 static void run_monitor(void* argument); //thread function for SOC monitor
 
-//perform an ADC DMA read
+//perform an ADC read, synchronised to the lights
 //return type is os status e.g. osOK
-static uint32_t do_adc_dma(ADC_HandleTypeDef *hadc, uint16_t *buffer, uint32_t len, uint32_t timeout);
+static uint32_t do_adc_read(ADC_HandleTypeDef *hadc, uint16_t *buffer, uint32_t len, uint32_t timeout);
+
+//arm the injected group and the TIM4 compare that triggers it, and disarm it again
+static void adc_sync_start(ADC_HandleTypeDef *hadc);
+static void adc_sync_stop(ADC_HandleTypeDef *hadc);
+
+//where in the TIM4 period the next burst of conversions should start
+static uint32_t quiet_point();
+
+//log a telemetry sample for this pass of the monitor
+static void log_telemetry(float voltage, float soc, bool read_ok, bool soc_low, bool soc_crit);
+
+//config watcher, keeps the converted values up to date
+static void config_changed(uint8_t id, int32_t value);
 
 // ================== PUBLIC FUNCTION DEFS ==================
 osMessageQueueId_t monitor_init() {
-	monitor_util_flags = osEventFlagsNew(NULL); //create the monitor signaling flag
-	soc_buf = osMessageQueueNew(1, sizeof(float), NULL); //creating the SOC buffer/queue
+	const osEventFlagsAttr_t monitor_util_attributes = RTOS_FLAGS_ATTR(monitor_util);
+	const osMessageQueueAttr_t soc_buf_attributes = RTOS_QUEUE_ATTR(soc_buf);
+	monitor_util_flags = osEventFlagsNew(&monitor_util_attributes); //create the monitor signaling flag
+	soc_buf = osMessageQueueNew(RTOS_QUEUE_DEPTH(soc_buf), RTOS_QUEUE_ITEM_SIZE(soc_buf), &soc_buf_attributes); //creating the SOC buffer/queue
+	adc_stream_init(); //streaming borrows the ADC through us, so it needs to exist first
+
+	config_changed(CONFIG_DIVIDER_NV, config_get(CONFIG_DIVIDER_NV));
+	config_changed(CONFIG_SOC_LOW_MV, config_get(CONFIG_SOC_LOW_MV));
+	config_changed(CONFIG_SOC_CRIT_MV, config_get(CONFIG_SOC_CRIT_MV));
+	config_watch(config_changed);
 
 	osEventFlagsSet(monitor_util_flags, ADC_READY_FLAG); //adc is now ready since everything is initialized
 
@@ -40,11 +109,7 @@ osMessageQueueId_t monitor_init() {
 
 //initialize and start the monitor thread function
 void monitor_start(ADC_HandleTypeDef *hadc) {
-	const osThreadAttr_t monitor_attributes = {
-			.name = "monitor",
-			.priority = (osPriority_t) osPriorityAboveNormal,
-			.stack_size = 2048
-	};
+	const osThreadAttr_t monitor_attributes = RTOS_THREAD_ATTR(monitor, "monitor", osPriorityAboveNormal);
 	monitor_handle = osThreadNew(run_monitor, (void*)hadc, &monitor_attributes);
 }
 
@@ -55,22 +120,38 @@ bool v_sys_check(float min_voltage, ADC_HandleTypeDef *hadc) {
 	//floor the min_voltage to SANE_VOLTAGE_LOWER_LIMIT
 	min_voltage = min_voltage < SANE_VOLTAGE_LOWER_LIMIT ? SANE_VOLTAGE_LOWER_LIMIT : min_voltage;
 
-	//read the ADC via DMA
-	adc_status = do_adc_dma(hadc, adc_results, ADC_OVERSAMPLES, ADC_READ_TIMEOUT);
+	//read the ADC
+	adc_status = do_adc_read(hadc, adc_results, ADC_OVERSAMPLES, ADC_READ_TIMEOUT);
 	if(adc_status & (1<<31)) return false; //if we timed out or something weird happened, fail the check
 
-	//compute the system voltage from the average of the ADC readings
-	uint32_t adc_sum = 0;
-	float v_sys = 0;
-	for(int i = 0; i < ADC_OVERSAMPLES; i++) {
-		adc_sum += adc_results[i];
-	}
-	v_sys = adc_sum * DIVIDER_RATIO / ADC_OVERSAMPLES;
+	//compute the system voltage from the middle of the ADC readings
+	float v_sys = monitor_adc_trimmed_sum(adc_results) * divider_ratio / MONITOR_ADC_KEPT;
+
+	//the moving average starts from here, if it's a real reading
+	if((v_sys > SANE_VOLTAGE_LOWER_LIMIT) && (v_sys < SANE_VOLTAGE_UPPER_LIMIT)) boot_voltage = v_sys;
 
 	//if the measured system voltage is sane
 	return (v_sys > min_voltage) && (v_sys < SANE_VOLTAGE_UPPER_LIMIT);
 }
 
+bool monitor_precharged(float min_voltage, ADC_HandleTypeDef *hadc) {
+	if(precharge_done) return true;
+
+	//evenly spaced readings, however often we're called
+	uint32_t now = HAL_GetTick();
+	if(precharge.count && (int32_t)(now - precharge_next_read) < 0) return false;
+	precharge_next_read = (precharge.count ? precharge_next_read : now) + MONITOR_PRECHARGE_PERIOD;
+
+	uint16_t adc_results[ADC_OVERSAMPLES];
+	if(do_adc_read(hadc, adc_results, ADC_OVERSAMPLES, ADC_READ_TIMEOUT) & (1<<31)) return false; //try again next time
+	float v_bus = monitor_adc_trimmed_sum(adc_results) * divider_ratio / MONITOR_ADC_KEPT;
+	if((v_bus > SANE_VOLTAGE_LOWER_LIMIT) && (v_bus < SANE_VOLTAGE_UPPER_LIMIT)) boot_voltage = v_bus;
+
+	precharge_done = monitor_precharge_step(&precharge, v_bus, min_voltage) && (v_bus < SANE_VOLTAGE_UPPER_LIMIT);
+	if(precharge_done) DLOG1(MONITOR_PRECHARGED, v_bus);
+	return precharge_done;
+}
+
 bool monitor_soc_low(bool clear_flag) {
 	bool result = osEventFlagsGet(monitor_util_flags) & SOC_LOW_FLAG;
 	if(result && clear_flag) osEventFlagsClear(monitor_util_flags, SOC_LOW_FLAG);
@@ -89,21 +170,99 @@ bool monitor_read_fail(bool clear_flag) {
 	return result;
 }
 
+float monitor_voltage() { return latest_voltage; }
+float monitor_soc() { return latest_soc; }
+
 //return the free stack space of the monitor thread
 uint32_t monitor_stack_space() {return osThreadGetStackSpace(monitor_handle);}
 
+uint32_t monitor_adc_sum(const uint16_t* samples, uint32_t n) {
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+	uint32_t sum = 0;
+	uint32_t i = 0;
+	for(; i + 1 < n; i += 2) sum = __SMLAD(__UNALIGNED_UINT32_READ(&samples[i]), 0x00010001, sum); //both halves times one
+	if(i < n) sum += samples[i];
+	return sum;
+#else
+	return monitor_adc_sum_scalar(samples, n);
+#endif
+}
+
+uint32_t monitor_adc_sum_scalar(const uint16_t* samples, uint32_t n) {
+	uint32_t sum = 0;
+	for(uint32_t i = 0; i < n; i++) sum += samples[i];
+	return sum;
+}
+
+//a Batcher odd-even merge sort for 16, cut down to the comparators that decide which samples end up in the
+//bottom and top quarters; the middle half comes out in no particular order, which is all the sum needs
+uint32_t monitor_adc_trimmed_sum(uint16_t* samples) {
+	CE(0, 1); CE(2, 3); CE(4, 5); CE(6, 7); CE(8, 9); CE(10, 11); CE(12, 13);
+	CE(0, 2); CE(1, 3); CE(4, 6); CE(5, 7); CE(8, 10); CE(9, 11); CE(12, 14); CE(13, 15);
+	CE(1, 2); CE(5, 6); CE(9, 10); CE(13, 14); CE(0, 4); CE(3, 7); CE(8, 12); CE(11, 15);
+	CE(1, 5); CE(2, 6); CE(9, 13); CE(10, 14); CE(0, 8); CE(7, 15);
+	CE(2, 4); CE(3, 5); CE(10, 12); CE(11, 13);
+	CE(1, 2); CE(5, 6); CE(3, 11); CE(4, 12);
+	CE(1, 9); CE(2, 10); CE(5, 13); CE(6, 14); CE(4, 8); CE(7, 11);
+	CE(5, 9); CE(6, 10); CE(2, 4); CE(11, 13);
+	CE(3, 5); CE(10, 12);
+	CE(3, 4); CE(11, 12);
+
+	uint32_t sum = 0;
+	for(uint8_t i = 4; i < 12; i++) sum += samples[i];
+	return sum;
+}
+
+float monitor_mav_sum(const float* buffer, uint32_t n) {
+	float sum = 0;
+	for(uint32_t i = 0; i < n; i++) sum += buffer[i];
+	return sum;
+}
+
+//the bus charging through the precharge resistor is an RC curve, so its slope falls off as it closes in on the
+//pack voltage; the mean of the last group of readings against the group before it keeps the ADC noise out of that
+bool monitor_precharge_step(monitor_precharge_t* p, float volts, float min_volts) {
+	p->readings[p->pointer] = volts;
+	p->pointer = (p->pointer + 1) % PRECHARGE_HISTORY;
+	if(p->count < PRECHARGE_HISTORY) p->count++;
+	if(p->count < PRECHARGE_HISTORY) return false;
+
+	//the pointer's back on the oldest reading
+	float older = 0, newer = 0;
+	for(uint8_t i = 0; i < MONITOR_PRECHARGE_GROUP; i++) {
+		older += p->readings[(p->pointer + i) % PRECHARGE_HISTORY];
+		newer += p->readings[(p->pointer + MONITOR_PRECHARGE_GROUP + i) % PRECHARGE_HISTORY];
+	}
+	older /= MONITOR_PRECHARGE_GROUP;
+	newer /= MONITOR_PRECHARGE_GROUP;
+	float slope = (newer - older) * 1000.0f / (MONITOR_PRECHARGE_GROUP * MONITOR_PRECHARGE_PERIOD); //V/s
+
+	bool flat = (slope < MONITOR_PRECHARGE_FLAT) && (slope > -MONITOR_PRECHARGE_FLAT) && (newer > min_volts);
+	if(!flat) p->flat = 0;
+	else if(p->flat < MONITOR_PRECHARGE_SETTLE) p->flat++;
+	return p->flat >= MONITOR_PRECHARGE_SETTLE;
+}
+
 // ==================== PRIVATE FUNCTION DEFINITIONS =====================
 static void run_monitor(void* argument) {
 	ADC_HandleTypeDef *hadc = (ADC_HandleTypeDef*) argument;
 	float sample_buffer[SAMPLE_BUFFER_LEN]; //buffer to compute the moving average voltage reading
 	float mav_voltage = 0, soc = 0; //moving average of system voltage measurement
 	uint16_t buffer_pointer = 0; //for our circular buffer
+	uint16_t buffer_filled = 0; //the average is over the samples we have until the buffer fills up
 	uint8_t read_fail_counter = 0;
 	bool soc_low_asserted = false;
+	bool soc_crit_asserted = false;
+	uint32_t next_wake = osKernelGetTickCount(); //the loop keeps its period however long the synchronised read takes
 
-	//initialize all values of the sample buffer array
+	//start from the reading the bus check took at power on rather than a made up voltage, so the SOC is right
+	//from the first pass instead of dragging in from a guess over the whole buffer length
 	for(int i = 0; i < SAMPLE_BUFFER_LEN; i++) {
-		sample_buffer[i] = MAV_INIT_VALUE;
+		sample_buffer[i] = 0;
+	}
+	if(boot_voltage > 0) {
+		sample_buffer[buffer_pointer++] = boot_voltage / (float)SAMPLE_BUFFER_LEN;
+		buffer_filled = 1;
 	}
 
 	while(1) {
@@ -113,14 +272,14 @@ static void run_monitor(void* argument) {
 		float adc_voltage;
 
 		//attempt to read the ADC
-		adc_status = do_adc_dma(hadc, adc_results, ADC_OVERSAMPLES, ADC_READ_TIMEOUT);
+		adc_status = do_adc_read(hadc, adc_results, ADC_OVERSAMPLES, ADC_READ_TIMEOUT);
 
 		//compute the ADC voltage (will be invalid if the adc timed out, but whatev, we'll handle that)
-		uint32_t adc_sum = 0;
-		for(int i = 0; i < ADC_OVERSAMPLES; i++) {
-			adc_sum += adc_results[i];
-		}
-		adc_voltage = adc_sum * DIVIDER_RATIO / ADC_OVERSAMPLES;
+		//from the middle of the block, so a motor noise spike on the divider doesn't drag it about; the blackbox
+		//still gets the plain average, spikes and all
+		uint32_t adc_sum = monitor_adc_sum(adc_results, ADC_OVERSAMPLES); //before the trimmed sum reorders them
+		adc_voltage = monitor_adc_trimmed_sum(adc_results) * divider_ratio / MONITOR_ADC_KEPT;
+		blackbox_record(BLACKBOX_ADC, (adc_status & (1<<31)) ? 1 : 0, adc_sum / ADC_OVERSAMPLES);
 
 		//if the ADC read was successful and the voltage is sane
 		if(((adc_status & (1<<31)) == 0) && (adc_voltage < SANE_VOLTAGE_UPPER_LIMIT) && (adc_voltage > SANE_VOLTAGE_LOWER_LIMIT)) {
@@ -129,25 +288,29 @@ static void run_monitor(void* argument) {
 			float scaled_voltage = adc_voltage / (float)SAMPLE_BUFFER_LEN;
 			sample_buffer[buffer_pointer] = scaled_voltage;
 
-			//sum up the entire contents of the sample buffer
-			mav_voltage = 0;
-			for(int i = 0; i < SAMPLE_BUFFER_LEN; i++) {
-				mav_voltage += sample_buffer[i];
-			}
+			//sum up the entire contents of the sample buffer; scaled up by however much of it is still empty
+			if(buffer_filled < SAMPLE_BUFFER_LEN) buffer_filled++;
+			mav_voltage = monitor_mav_sum(sample_buffer, buffer_filled) * SAMPLE_BUFFER_LEN / buffer_filled;
 
 			//compute the SOC from 0 to 1 and store that in the soc queue
 			soc = (mav_voltage - MIN_VOLTAGE)/(MAX_VOLTAGE - MIN_VOLTAGE);
 			osMessageQueueReset(soc_buf);
 			osMessageQueuePut(soc_buf, &soc, 0, 0);
+			ride_stats_voltage(adc_voltage, mav_voltage);
+			latest_voltage = mav_voltage;
+			latest_soc = soc;
 
 
 			//check if that sum meets the thresholds for low and critical levels (and assert those flags if appropriate)
-			if(mav_voltage < SOC_VOLTAGE_CRITICAL) {
+			if(mav_voltage < soc_crit_voltage) {
 				osEventFlagsSet(monitor_util_flags, SOC_CRIT_FLAG);
+				if(!soc_crit_asserted) DLOG1(MONITOR_SOC_CRIT, mav_voltage);
+				soc_crit_asserted = true;
 			}
-			else if(mav_voltage < SOC_VOLTAGE_LOW && !soc_low_asserted) {
+			else if(mav_voltage < soc_low_voltage && !soc_low_asserted) {
 				osEventFlagsSet(monitor_util_flags, SOC_LOW_FLAG);
 				soc_low_asserted = true; //latch this so we only trigger once
+				DLOG1(MONITOR_SOC_LOW, mav_voltage);
 			}
 
 			//increment/wrap around the buffer pointer
@@ -160,42 +323,174 @@ static void run_monitor(void* argument) {
 		else {
 			//increment the read fail counter
 			read_fail_counter++;
+			DLOG2(MONITOR_READ_FAIL, read_fail_counter, adc_sum / ADC_OVERSAMPLES);
 
 			//if the read fail counter exceeds the fail threshold, assert the appropriate flag
 			if(read_fail_counter >= ADC_MAX_READ_FAILS) osEventFlagsSet(monitor_util_flags, SOC_MEASURE_FAIL);
 		}
 
-		osDelay(MONITOR_UPDATE_DELAY);
+		log_telemetry(adc_voltage, soc, read_fail_counter == 0, soc_low_asserted, soc_crit_asserted);
+
+		next_wake += config_get(CONFIG_MONITOR_PERIOD_MS);
+		if((int32_t)(next_wake - osKernelGetTickCount()) > 0) osDelayUntil(next_wake);
+		else next_wake = osKernelGetTickCount(); //fell behind (a read timed out), start the period over from here
 	}
 
 	osThreadExit(); //exit gracefully if the function somehow gets here?
 }
 
-static uint32_t do_adc_dma(ADC_HandleTypeDef *hadc, uint16_t *buffer, uint32_t len, uint32_t timeout) {
+static uint32_t do_adc_read(ADC_HandleTypeDef *hadc, uint16_t *buffer, uint32_t len, uint32_t timeout) {
 	uint32_t start_tick = HAL_GetTick();
 	uint32_t status; //see if our event flag wait timed out or not
-	uint32_t dma_timeout; //computed after the resource is released
+	uint32_t read_timeout; //computed after the resource is released
 
 	//wait for the ADC to be free, then lock it out (subject to a timeout)
 	status = osEventFlagsWait(monitor_util_flags, ADC_READY_FLAG, osFlagsWaitAny, timeout);
 	if(status & (1<<31)) return status;
-	dma_timeout = (timeout + start_tick) - HAL_GetTick(); //how much remaining time the DMA read should take to meet the timeout
-
-	//read adc via DMA and wait till it's done
-	osEventFlagsClear(monitor_util_flags, DMA_COMPLETE_FLAG); //clear the DMA complete flag before starting the next DMA request (just to make sure)
-	HAL_ADC_Stop_DMA(hadc); //clear the appropriate DMA bits
-	HAL_ADC_Start_DMA(hadc, (uint32_t*)buffer, len); //restart the DMA request
-	status = osEventFlagsWait(monitor_util_flags, DMA_COMPLETE_FLAG, osFlagsWaitAny, dma_timeout); //wait for DMA to be complete
+	read_timeout = (timeout + start_tick) - HAL_GetTick(); //how much remaining time the read should take to meet the timeout
+
+	//the ADC only changes modes here, while we hold it
+	adc_stream_switch(hadc);
+
+	//a burst of conversions in a quiet part of each light PWM period until we have them all, then stop
+	//this goes on while streaming too: the stream converts flat out, straight through the drivers' edges, so its
+	//samples carry the ringing (volts of it); each burst cuts into it instead, holding the regular conversions up
+	osEventFlagsClear(monitor_util_flags, READ_COMPLETE_FLAG); //clear the complete flag before starting the next read (just to make sure)
+	sync_count = 0;
+	sync_len = len;
+	sync_buf = buffer;
+	adc_sync_start(hadc);
+	status = osEventFlagsWait(monitor_util_flags, READ_COMPLETE_FLAG, osFlagsWaitAny, read_timeout); //wait for the read to be complete
+	adc_sync_stop(hadc);
+	sync_buf = NULL;
 
 	//release the ADC resource
 	osEventFlagsSet(monitor_util_flags, ADC_READY_FLAG);
-	return status; //return whether the DMA completed successfully or whether it timed out
+	return status; //return whether the read completed successfully or whether it timed out
+}
+
+static void adc_sync_start(ADC_HandleTypeDef *hadc) {
+	//the sample time is the channel's, shared with the regular group, so set it every time; while streaming the
+	//bursts have to take the stream's, which makes them longer (quiet_point())
+	ADC_InjectionConfTypeDef injected = {
+		.InjectedChannel = ADC_CHANNEL_10, //same channel as MX_ADC1_Init()
+		.InjectedSamplingTime = adc_stream_running() ? ADC_STREAM_SAMPLE_TIME : ADC_SYNC_SAMPLE_TIME,
+		.InjectedNbrOfConversion = ADC_SYNC_RANKS,
+		.ExternalTrigInjecConv = ADC_EXTERNALTRIGINJECCONV_T4_CC1,
+		.ExternalTrigInjecConvEdge = ADC_EXTERNALTRIGINJECCONVEDGE_RISING,
+	};
+	for(uint8_t rank = 0; rank < ADC_SYNC_RANKS; rank++) {
+		injected.InjectedRank = ADC_INJECTED_RANK_1 + rank;
+		HAL_ADCEx_InjectedConfigChannel(hadc, &injected);
+	}
+	//scan mode, or a trigger only converts rank 1 and JDR2-4 keep old samples; MX_ADC1_Init() leaves it off, but
+	//the regular group is a single conversion, so the stream runs the same with it on
+	SET_BIT(hadc->Instance->CR1, ADC_CR1_SCAN);
+
+	//channel 1 has no pin, it's only there for its compare event; starting it also keeps TIM4 counting before the
+	//lights start their channels (the bus check at power on)
+	TIM_OC_InitTypeDef compare = {.OCMode = TIM_OCMODE_TIMING, .Pulse = quiet_point(), .OCPolarity = TIM_OCPOLARITY_HIGH};
+	HAL_TIM_OC_ConfigChannel(&htim4, &compare, TIM_CHANNEL_1);
+	HAL_TIM_OC_Start(&htim4, TIM_CHANNEL_1);
+
+	HAL_ADCEx_InjectedStart_IT(hadc);
+}
+
+//the HAL only stops the injected group by turning the whole ADC off, so HAL_ADCEx_InjectedStop_IT() refuses while
+//the regular group is busy; while streaming, take away the trigger and the interrupt instead
+static void adc_sync_stop(ADC_HandleTypeDef *hadc) {
+	if(!adc_stream_running()) {
+		HAL_ADCEx_InjectedStop_IT(hadc);
+		return;
+	}
+	CLEAR_BIT(hadc->Instance->CR2, ADC_CR2_JEXTEN); //adc_sync_start() configures it back in
+	__HAL_ADC_DISABLE_IT(hadc, ADC_IT_JEOC);
+	CLEAR_BIT(hadc->State, HAL_ADC_STATE_INJ_BUSY);
+}
+
+//both drivers switch on at the update (count 0) and off at their compare value, unless they're fully off or on;
+//the burst goes in the middle of the longest stretch between those edges, where the ringing has died down
+static uint32_t quiet_point() {
+	uint32_t period = htim4.Instance->ARR + 1;
+	uint32_t counts[2] = {htim4.Instance->CCR3, htim4.Instance->CCR4}; //taillights and headlights (board_lights.c)
+	uint32_t edges[3];
+	uint8_t num_edges = 0;
+	for(uint8_t i = 0; i < 2; i++) {
+		if(counts[i] == 0 || counts[i] >= period) continue; //not switching
+		if(num_edges == 0) edges[num_edges++] = 0;
+		edges[num_edges++] = counts[i];
+	}
+	if(num_edges == 0) return 0; //lights off, it's all quiet
+
+	if(num_edges == 3 && edges[2] < edges[1]) { //in order
+		uint32_t swap = edges[1];
+		edges[1] = edges[2];
+		edges[2] = swap;
+	}
+
+	uint32_t start = 0, gap = 0;
+	for(uint8_t i = 0; i < num_edges; i++) {
+		uint32_t end = (i + 1 < num_edges) ? edges[i + 1] : period; //the last stretch runs to the next update
+		if(end - edges[i] > gap) {
+			start = edges[i];
+			gap = end - edges[i];
+		}
+	}
+	uint32_t burst = adc_stream_running() ? ADC_SYNC_BURST_STREAMING : ADC_SYNC_BURST;
+	return gap > burst ? start + (gap - burst) / 2 : start;
+}
+
+static void log_telemetry(float voltage, float soc, bool read_ok, bool soc_low, bool soc_crit) {
+	static uint16_t last_voltage = 0; //hold the last good reading through a failed one
+	static uint8_t divider = 0;
+
+	if(read_ok) last_voltage = voltage * TELEM_VOLTAGE_SCALE;
+	if(++divider < TELEM_DIVIDER) return;
+	divider = 0;
+
+	soc = soc < 0 ? 0 : (soc > 1 ? 1 : soc);
+
+	telem_sample_t sample = {
+		.tick = HAL_GetTick(),
+		.voltage = last_voltage,
+		.soc = soc * TELEM_SOC_SCALE,
+		.light_mode = board_lights_mode(),
+		.flags = (soc_low ? TELEM_FLAG_SOC_LOW : 0) | (soc_crit ? TELEM_FLAG_SOC_CRIT : 0) |
+				(read_ok ? 0 : TELEM_FLAG_READ_FAIL) | (pushbutton_held() ? TELEM_FLAG_BUTTON : 0),
+	};
+	datalog_telemetry(&sample);
+}
+
+static void config_changed(uint8_t id, int32_t value) {
+	if(id == CONFIG_DIVIDER_NV) divider_ratio = value * 1e-9f;
+	else if(id == CONFIG_SOC_LOW_MV) soc_low_voltage = value * 0.001f;
+	else if(id == CONFIG_SOC_CRIT_MV) soc_crit_voltage = value * 0.001f;
 }
 
 // ======================== ISRs =========================
 
-//service the interrupt that gets called when the ADC DMA request completes
+//first half of a streaming buffer filled (the monitor's own reads don't care about this one)
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
+	if(adc_stream_running()) adc_stream_half_done(0);
+}
+
+//second half of a streaming buffer filled; only streaming uses the regular group now
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
-	//just set the DMA completion event flag here
-	osEventFlagsSet(monitor_util_flags, DMA_COMPLETE_FLAG);
+	if(adc_stream_running()) adc_stream_half_done(1);
+}
+
+//a burst of the synchronised read converted
+void HAL_ADCEx_InjectedConvCpltCallback(ADC_HandleTypeDef* hadc) {
+	uint16_t* buffer = sync_buf;
+	if(!buffer) return;
+
+	for(uint8_t rank = 0; rank < ADC_SYNC_RANKS && sync_count < sync_len; rank++) {
+		buffer[sync_count++] = HAL_ADCEx_InjectedGetValue(hadc, ADC_INJECTED_RANK_1 + rank);
+	}
+
+	if(sync_count >= sync_len) {
+		sync_buf = NULL;
+		osEventFlagsSet(monitor_util_flags, READ_COMPLETE_FLAG);
+	}
+	else __HAL_TIM_SET_COMPARE(&htim4, TIM_CHANNEL_1, quiet_point()); //the lights may have changed since
 }
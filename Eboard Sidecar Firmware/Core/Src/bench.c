@@ -0,0 +1,261 @@
+#include "bench.h"
+#include "string.h"
+#include "batt_monitor.h"
+#include "board_lights.h"
+#include "pushbutton.h"
+#include "bargraph.h"
+#include "dlog.h"
+
+//================ some defines ==================
+#define MAV_LEN 256 //SAMPLE_BUFFER_LEN in batt_monitor.c
+#define MAV_SOURCE_OFFSET 97
+#define ADC_LEN MONITOR_ADC_BLOCK
+#define RC_PULSES 16
+#define BUTTON_PASSES 64
+#define BUTTON_PASS_MS 25 //BUTTON_BOUNCE_TIME in pushbutton.c
+#define BUTTON_LONG_MS 1200
+#define BUTTON_MAX_RUN 56 //passes in one press or gap
+#define BARGRAPH_FRAMES 8
+
+#define PACK_VOLTS 30.0f
+#define NOISE_VOLTS 0.2f
+#define ADC_MID 3380 //30V through the default divider
+#define ADC_NOISE 64
+#define RANDOM_SEED 0x2545F491u
+
+//============= PRIVATE VARIABLES =============
+//inputs, only one benchmark runs at a time
+static union {
+	struct {
+		float buffer[MAV_LEN];
+		uint16_t pointer;
+		float sum; //mav_running
+	} mav;
+	struct {
+		uint16_t samples[ADC_LEN];
+		uint16_t scratch[ADC_LEN]; //the trimmed estimates reorder theirs
+	} adc;
+	uint16_t rc[RC_PULSES];
+	GPIO_PinState button[BUTTON_PASSES];
+	uint16_t frames[BARGRAPH_FRAMES];
+	struct {
+		dlog_ring_t ring; //not the real one, nothing ships this out
+		uint32_t arg;
+	} dlog;
+} in;
+
+static uint32_t random_state;
+
+//============= PRIVATE FUNCTION PROTOTYPES ==============
+static uint32_t next_random();
+static float random_volts();
+
+static void mav_setup();
+static uint32_t mav_sum_run();
+static uint32_t mav_running_run();
+static void adc_setup();
+static uint32_t adc_sum_run();
+static uint32_t adc_sum_scalar_run();
+static uint32_t adc_trimmed_run();
+static uint32_t adc_trimmed_sort_run();
+static void rc_setup();
+static uint32_t rc_filter_run();
+static uint32_t rc_running_run();
+static void button_setup();
+static uint32_t button_step_run();
+static void bargraph_setup();
+static uint32_t bargraph_output_run();
+static void dlog_setup();
+static uint32_t dlog_put0_run();
+static uint32_t dlog_put2_run();
+static uint32_t dlog_put4_run();
+
+static const bench_t benches[] = {
+	{.name = "mav_sum", .job = "mav", .items = MAV_LEN, .setup = mav_setup, .run = mav_sum_run},
+	{.name = "mav_running", .job = "mav", .items = MAV_LEN, .setup = mav_setup, .run = mav_running_run},
+	{.name = "adc_sum", .job = "adc_sum", .items = ADC_LEN, .setup = adc_setup, .run = adc_sum_run},
+	{.name = "adc_sum_scalar", .job = "adc_sum", .items = ADC_LEN, .setup = adc_setup, .run = adc_sum_scalar_run},
+	{.name = "adc_trimmed", .job = "adc_trimmed", .items = ADC_LEN, .setup = adc_setup, .run = adc_trimmed_run},
+	{.name = "adc_trimmed_sort", .job = "adc_trimmed", .items = ADC_LEN, .setup = adc_setup,
+			.run = adc_trimmed_sort_run},
+	{.name = "rc_filter", .job = "rc_debounce", .items = RC_PULSES, .setup = rc_setup, .run = rc_filter_run},
+	{.name = "rc_running", .job = "rc_debounce", .items = RC_PULSES, .setup = rc_setup, .run = rc_running_run},
+	{.name = "button_step", .job = "button", .items = BUTTON_PASSES, .setup = button_setup, .run = button_step_run},
+	{.name = "bargraph_output", .job = "bargraph", .items = BARGRAPH_FRAMES * 10, .setup = bargraph_setup,
+			.run = bargraph_output_run},
+	{.name = "dlog_put0", .job = "dlog_0", .items = 1, .setup = dlog_setup, .run = dlog_put0_run},
+	{.name = "dlog_put2", .job = "dlog_2", .items = 1, .setup = dlog_setup, .run = dlog_put2_run},
+	{.name = "dlog_put4", .job = "dlog_4", .items = 1, .setup = dlog_setup, .run = dlog_put4_run},
+};
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+//============= PUBLIC FUNCTION DEFINITIONS =============
+uint8_t bench_count() { return NUM_BENCHES; }
+const bench_t* bench_get(uint8_t index) { return index < NUM_BENCHES ? &benches[index] : NULL; }
+
+void bench_run(const bench_t* b, uint32_t reps, bench_clock_t clock, bench_result_t* out) {
+	//two back to back reads of the clock, the best of a few
+	uint32_t overhead = UINT32_MAX;
+	for(uint32_t i = 0; i < BENCH_CALIBRATE_REPS; i++) {
+		uint32_t start = clock();
+		uint32_t ticks = clock() - start;
+		if(ticks < overhead) overhead = ticks;
+	}
+
+	random_state = RANDOM_SEED;
+	b->setup();
+
+	*out = (bench_result_t){.min = UINT32_MAX};
+	for(uint32_t i = 0; i < reps; i++) {
+		uint32_t start = clock();
+		out->result = b->run();
+		uint32_t ticks = clock() - start;
+		ticks = ticks > overhead ? ticks - overhead : 0;
+
+		if(ticks < out->min) out->min = ticks;
+		if(ticks > out->max) out->max = ticks;
+		out->total += ticks;
+	}
+}
+
+//====================== PRIVATE FUNCTION DEFINITIONS ======================
+static uint32_t next_random() {
+	random_state ^= random_state << 13; //xorshift32
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static float random_volts() {
+	return PACK_VOLTS + NOISE_VOLTS * ((next_random() >> 8) / (float)(1 << 23) - 1.0f);
+}
+
+//a pass of the monitor's moving average: a new sample into the buffer, then the average (in mV for the result)
+//the new sample is one from elsewhere in the buffer, so there's no generator in the timing
+static void mav_setup() {
+	for(uint16_t i = 0; i < MAV_LEN; i++) in.mav.buffer[i] = random_volts() / MAV_LEN;
+	in.mav.pointer = 0;
+	in.mav.sum = monitor_mav_sum(in.mav.buffer, MAV_LEN);
+}
+
+static uint32_t mav_sum_run() {
+	in.mav.buffer[in.mav.pointer] = in.mav.buffer[(in.mav.pointer + MAV_SOURCE_OFFSET) % MAV_LEN];
+	in.mav.pointer = (in.mav.pointer + 1) % MAV_LEN;
+	return (uint32_t)(monitor_mav_sum(in.mav.buffer, MAV_LEN) * 1000 + 0.5f);
+}
+
+//keeps a running sum instead of adding the whole buffer up; float error builds up in the sum over time
+static uint32_t mav_running_run() {
+	float fresh = in.mav.buffer[(in.mav.pointer + MAV_SOURCE_OFFSET) % MAV_LEN];
+	in.mav.sum += fresh - in.mav.buffer[in.mav.pointer];
+	in.mav.buffer[in.mav.pointer] = fresh;
+	in.mav.pointer = (in.mav.pointer + 1) % MAV_LEN;
+	return (uint32_t)(in.mav.sum * 1000 + 0.5f);
+}
+
+//the monitor's block of oversamples; on the board the scalar version is the before, the other the after
+//on the host the dual halfword version runs on the emulated instruction (Tools/host/include/cmsis_compiler.h),
+//so there only its result means anything: it has to match the scalar one
+static void adc_setup() {
+	for(uint16_t i = 0; i < ADC_LEN; i++) in.adc.samples[i] = ADC_MID - ADC_NOISE / 2 + next_random() % ADC_NOISE;
+}
+
+static uint32_t adc_sum_run() { return monitor_adc_sum(in.adc.samples, ADC_LEN); }
+static uint32_t adc_sum_scalar_run() { return monitor_adc_sum_scalar(in.adc.samples, ADC_LEN); }
+
+//the middle of the oversamples: the selection network against sorting the whole block
+static uint32_t adc_trimmed_run() {
+	memcpy(in.adc.scratch, in.adc.samples, sizeof(in.adc.scratch));
+	return monitor_adc_trimmed_sum(in.adc.scratch);
+}
+
+static uint32_t adc_trimmed_sort_run() {
+	uint16_t* s = in.adc.scratch;
+	memcpy(s, in.adc.samples, sizeof(in.adc.scratch));
+	for(uint16_t i = 1; i < ADC_LEN; i++) {
+		uint16_t x = s[i];
+		uint16_t j = i;
+		for(; j > 0 && s[j - 1] > x; j--) s[j] = s[j - 1];
+		s[j] = x;
+	}
+	uint32_t sum = 0;
+	for(uint16_t i = (ADC_LEN - MONITOR_ADC_KEPT) / 2; i < (ADC_LEN + MONITOR_ADC_KEPT) / 2; i++) sum += s[i];
+	return sum;
+}
+
+//remote pulses either side of the thresholds, with a dropout now and then
+static void rc_setup() {
+	for(uint16_t i = 0; i < RC_PULSES; i++) {
+		uint32_t r = next_random();
+		in.rc[i] = (r & 0x0F) == 0 ? 0 : (r & 0x10) ? 1850 : 1150;
+	}
+}
+
+static uint32_t rc_filter_run() {
+	lights_rc_filter_t f = {0};
+	uint32_t check = 0;
+	for(uint16_t i = 0; i < RC_PULSES; i++) check = check * 31 + lights_rc_filter(&f, in.rc[i]);
+	return check;
+}
+
+static uint32_t rc_running_run() {
+	uint16_t widths[LIGHTS_RC_SAMPLES] = {0};
+	uint8_t pointer = 0;
+	uint32_t sum = 0, check = 0;
+	for(uint16_t i = 0; i < RC_PULSES; i++) {
+		sum += in.rc[i] - widths[pointer];
+		widths[pointer] = in.rc[i];
+		pointer = pointer == LIGHTS_RC_SAMPLES - 1 ? 0 : pointer + 1;
+		check = check * 31 + sum / LIGHTS_RC_SAMPLES;
+	}
+	return check;
+}
+
+//presses and gaps of random lengths, with a bounce after each edge; a short long press time so every kind of
+//event comes up
+static void button_setup() {
+	GPIO_PinState level = GPIO_PIN_RESET;
+	uint16_t i = 0;
+	while(i < BUTTON_PASSES) {
+		uint16_t len = 2 + next_random() % BUTTON_MAX_RUN;
+		for(uint16_t j = 0; j < len && i < BUTTON_PASSES; j++, i++) in.button[i] = (j == 1) ? !level : level;
+		level = !level;
+	}
+}
+
+static uint32_t button_step_run() {
+	pushbutton_state_t state = {0};
+	uint32_t check = 0;
+	for(uint16_t i = 0; i < BUTTON_PASSES; i++)
+		check = check * 31 + pushbutton_step(&state, in.button[i], i * BUTTON_PASS_MS, BUTTON_LONG_MS);
+	return check;
+}
+
+//what the draw thread puts out, both multiplex halves
+static void bargraph_setup() {
+	for(uint16_t i = 0; i < BARGRAPH_FRAMES; i++) in.frames[i] = next_random() & ((i & 1) ? 0x155 : 0x2AA);
+}
+
+static uint32_t bargraph_output_run() {
+	for(uint16_t i = 0; i < BARGRAPH_FRAMES; i++) bargraph_output(in.frames[i]);
+	return 0;
+}
+
+//one DLOGn call site's worth of dlog_put, into a ring of our own that's emptied before every call so it never
+//takes the ring full path; the emptying is a load and a store on top of the put
+static inline uint32_t dlog_put_run(uint8_t n) {
+	dlog_ring_t* r = &in.dlog.ring;
+	uint32_t h = r->head;
+	uint32_t a = in.dlog.arg++;
+	r->tail = h;
+	dlog_put_ring(r, DLOG_DLOG_DROPPED, n, a, a ^ 0x55, a + 7, a << 3);
+	return r->words[h & (DLOG_WORDS - 1)] + (n ? r->words[(h + n + 1) & (DLOG_WORDS - 1)] : 0); //the header and last argument, not the tick
+}
+
+static void dlog_setup() {
+	memset(&in.dlog, 0, sizeof(in.dlog));
+}
+
+static uint32_t dlog_put0_run() { return dlog_put_run(0); }
+static uint32_t dlog_put2_run() { return dlog_put_run(2); }
+static uint32_t dlog_put4_run() { return dlog_put_run(4); }
@@ -0,0 +1,67 @@
+#include "blackbox.h"
+#include "datalog.h" //for committing it, also pulls in the HAL
+#include "trace.h"
+
+_Static_assert((BLACKBOX_ENTRIES & (BLACKBOX_ENTRIES - 1)) == 0, "BLACKBOX_ENTRIES must be a power of 2");
+
+//===================== PRIVATE VARIABLES =====================
+static blackbox_entry_t ring[BLACKBOX_ENTRIES];
+static volatile uint32_t head = 0; //total entries ever claimed, wraps into the ring
+static volatile bool armed = false;
+static volatile uint8_t frozen_reason = BLACKBOX_NONE;
+static uint32_t frozen_tick;
+static uint32_t frozen_head;
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void blackbox_init() {
+	head = 0;
+	frozen_reason = BLACKBOX_NONE;
+	armed = true;
+}
+
+void blackbox_record(uint8_t kind, uint8_t arg, uint16_t value) {
+	if(!armed || frozen_reason != BLACKBOX_NONE) return;
+
+	//claim a slot first so a thread and an ISR can't land on the same one
+	uint32_t slot = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED) & (BLACKBOX_ENTRIES - 1);
+	ring[slot] = (blackbox_entry_t){.tick = HAL_GetTick(), .value = value, .kind = kind, .arg = arg};
+}
+
+void blackbox_trigger(uint8_t reason) {
+	if(!armed || frozen_reason != BLACKBOX_NONE) return;
+	blackbox_freeze(reason);
+	datalog_commit_blackbox();
+}
+
+void blackbox_freeze(uint8_t reason) {
+	trace_trigger(); //keep the RTOS timeline leading up to it too, if a snapshot is running
+	if(!armed || frozen_reason != BLACKBOX_NONE) return;
+	frozen_tick = HAL_GetTick();
+	frozen_head = head;
+	frozen_reason = reason;
+}
+
+uint8_t blackbox_frozen(uint32_t* tick) {
+	if(tick) *tick = frozen_tick;
+	return frozen_reason;
+}
+
+uint16_t blackbox_count() {
+	return frozen_head < BLACKBOX_ENTRIES ? frozen_head : BLACKBOX_ENTRIES;
+}
+
+uint16_t blackbox_read(uint16_t index, blackbox_entry_t* out, uint16_t max) {
+	uint16_t count = blackbox_count();
+	uint32_t oldest = frozen_head - count;
+	uint16_t n = 0;
+
+	for(; n < max && index + n < count; n++) {
+		out[n] = ring[(oldest + index + n) & (BLACKBOX_ENTRIES - 1)];
+	}
+	return n;
+}
+
+void blackbox_release() {
+	head = 0;
+	frozen_reason = BLACKBOX_NONE;
+}
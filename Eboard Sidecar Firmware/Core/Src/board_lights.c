@@ -1,14 +1,19 @@
 #include "board_lights.h"
 #include "main.h" //for pin names
 #include "stdbool.h"
+#include "rtos_objects.h"
+#include "shutdown_coord.h"
+#include "blackbox.h"
+#include "ride_stats.h"
+#include "config.h"
+#include "dlog.h"
 
 //================== some defines =====================
-#define DEBOUNCER_SAMPLES 5 //how many samples the pulse width debouncer has
 #define SUPERVISOR_DELAY 50 //how quickly the supervisor thread runs (osDelay parameter)
 #define NUM_FLASH_PATTERNS 4 //how many different flashing patterns there are
 
-#define THRESHOLD_HIGH 	1700 //upper threshold to register a change to "high" re: pulse width
-#define THRESHOLD_LOW	1300 //lower threshold to register a change to "low"
+//pulse width thresholds for registering a change to "high"/"low" are CONFIG_RC_HIGH_US/CONFIG_RC_LOW_US
+#define LIGHTS_SHUTDOWN_DEADLINE 50 //ms, worst simulated 1ms (sim_replay, long press and fault shutdowns)
 
 #define LIGHTS_OFF 		(1<<0)
 #define TAILLIGHT_ONLY 	(1<<1)
@@ -27,9 +32,13 @@ static osEventFlagsId_t flash_flags; //flags to tell the animator thread what pa
 static osThreadId_t lights_sup_handle = NULL; //handle for the board lights "supervisor" thread
 static osThreadId_t lights_anim_handle = NULL; //handle for the board lights "animator" thread
 
+static int8_t lights_shutdown_id = -1; //signal the shutdown coordinator once the drivers are off
+static volatile uint8_t light_mode = 0; //index of the routine that's running (bit position of its flag)
+
 //====================== PRIVATE FUNCTION PROTOTYPES ======================
 static void run_lights_supervisor(void* argument);
 static void run_board_lights(void* argument);
+static void set_light_mode(uint8_t mode); //note which routine is about to run
 
 //functions for headlight/taillight flashing
 static void do_lights_out();
@@ -42,23 +51,17 @@ static void do_tail_and_head();
 void board_lights_init(TIM_HandleTypeDef* h) {
 	pulse_tim = h;
 
-	flash_flags = osEventFlagsNew(NULL);
-	pulse_buf = osMessageQueueNew(1, sizeof(uint16_t), NULL); //creating the pulse width buffer/queue
+	const osEventFlagsAttr_t flash_attributes = RTOS_FLAGS_ATTR(flash);
+	const osMessageQueueAttr_t pulse_buf_attributes = RTOS_QUEUE_ATTR(pulse_buf);
+	flash_flags = osEventFlagsNew(&flash_attributes);
+	pulse_buf = osMessageQueueNew(RTOS_QUEUE_DEPTH(pulse_buf), RTOS_QUEUE_ITEM_SIZE(pulse_buf), &pulse_buf_attributes); //creating the pulse width buffer/queue
 
 	//create the "supervisor" thread
-	const osThreadAttr_t lights_sup_attributes = {
-			.name = "lights supervisor",
-			.priority = (osPriority_t) osPriorityBelowNormal,
-			.stack_size = 2048
-	};
+	const osThreadAttr_t lights_sup_attributes = RTOS_THREAD_ATTR(lights_super, "lights supervisor", osPriorityBelowNormal);
 	lights_sup_handle = osThreadNew(run_lights_supervisor, NULL, &lights_sup_attributes); //start the board lights thread
 
 	//create the "animator" thread
-	const osThreadAttr_t lights_anim_attributes = {
-			.name = "lights animator",
-			.priority = (osPriority_t) osPriorityHigh,
-			.stack_size = 2048
-	};
+	const osThreadAttr_t lights_anim_attributes = RTOS_THREAD_ATTR(lights_anim, "lights animator", osPriorityHigh);
 	lights_anim_handle = osThreadNew(run_board_lights, NULL, &lights_anim_attributes); //start the board lights thread
 
 	//start the RC interrupt and microsecond timer
@@ -68,6 +71,8 @@ void board_lights_init(TIM_HandleTypeDef* h) {
 	//start the PWM timers for the constant current drivers
 	HAL_TIM_PWM_Start(&htim4, TIM_CHANNEL_3);
 	HAL_TIM_PWM_Start(&htim4, TIM_CHANNEL_4);
+
+	lights_shutdown_id = shutdown_register("lights", board_lights_shutdown, LIGHTS_SHUTDOWN_DEADLINE);
 }
 
 //shutdown the headlights gracefully
@@ -79,6 +84,8 @@ void board_lights_shutdown() {
 	//disable the constant current drivers before power down(just to be gentle to them)
 	CHAN_HEAD_COUNT = 0;
 	CHAN_TAIL_COUNT = 0;
+
+	shutdown_done(lights_shutdown_id);
 }
 
 //called on pulse timer overflow
@@ -88,16 +95,27 @@ void board_lights_tim_overflow() {
 	osMessageQueuePut(pulse_buf, &pulse_width, 0, 0);
 }
 
-uint32_t board_lights_stack_space() { return osThreadGetStackSpace(lights_sup_handle); }
+uint8_t board_lights_mode() { return light_mode; }
+
+uint32_t lights_super_stack_space() { return osThreadGetStackSpace(lights_sup_handle); }
+uint32_t lights_anim_stack_space() { return osThreadGetStackSpace(lights_anim_handle); }
+
+uint32_t lights_rc_filter(lights_rc_filter_t* f, uint16_t width) {
+	f->widths[f->pointer] = width;
+	f->pointer = (f->pointer + 1) % LIGHTS_RC_SAMPLES;
+
+	uint32_t sum = 0;
+	for(int i = 0; i < LIGHTS_RC_SAMPLES; i++) sum += f->widths[i];
+	return sum / LIGHTS_RC_SAMPLES;
+}
 
 //===================== PRIVATE/THREAD FUNCTION DEFINITIONS ====================
 //lights supervisor function
 //controls which lights flashing program to run
 static void run_lights_supervisor(void* argument) {
 	uint16_t pulse_width;
-	uint16_t p_widths[DEBOUNCER_SAMPLES] = {0}; //a simple moving average/debouncer
-	uint8_t buf_pointer = 0; //implementing debouncer as a circular buffer
-	uint32_t filt_p_width = 0; //variable that holds the sum of the moving averager
+	lights_rc_filter_t debouncer = {0}; //a simple moving average/debouncer
+	uint32_t filt_p_width = 0; //output of the moving averager
 
 	uint8_t which_animation = 0;
 	uint8_t timeout_latch = 0;
@@ -108,31 +126,25 @@ static void run_lights_supervisor(void* argument) {
 		if(osMessageQueueGetCount(pulse_buf) > 0) osMessageQueueGet(pulse_buf, &pulse_width, NULL, 0);
 		else pulse_width = 0;
 
-		//save the new pulse width to the debouncer
-		p_widths[buf_pointer] = pulse_width;
-
-		//update the moving average sum
-		filt_p_width = 0;
-		for(int i = 0; i < DEBOUNCER_SAMPLES; i++) filt_p_width += p_widths[i];
-		filt_p_width = filt_p_width / DEBOUNCER_SAMPLES;
-
-		//update the buffer pointer
-		buf_pointer = (buf_pointer + 1) % DEBOUNCER_SAMPLES;
+		//save the new pulse width to the debouncer and update the moving average
+		filt_p_width = lights_rc_filter(&debouncer, pulse_width);
 
 		if(filt_p_width == 0 && !timeout_latch) {
 			osEventFlagsSet(flash_flags, LIGHTS_OFF);
 			which_animation = 0;
 			timeout_latch = 1;
+			DLOG0(LIGHTS_TIMEOUT);
 		}
 		else{
 			//if the controller button was pressed and the RC input represents that
 			//hysteresis for noise reduction
-			if( ((filt_p_width > THRESHOLD_HIGH) && change_polarity) ||
-				((filt_p_width < THRESHOLD_LOW) && !change_polarity)) {
+			if( ((filt_p_width > config_get(CONFIG_RC_HIGH_US)) && change_polarity) ||
+				((filt_p_width < config_get(CONFIG_RC_LOW_US)) && !change_polarity)) {
 
 				//increment the animation that we wanna run and set the appropriate event flag
 				which_animation = (which_animation + 1) % NUM_FLASH_PATTERNS;
 				osEventFlagsSet(flash_flags, (1<<which_animation));
+				DLOG2(LIGHTS_MODE, filt_p_width, which_animation);
 
 				change_polarity = !change_polarity;
 				timeout_latch = 0;
@@ -153,18 +165,22 @@ static void run_board_lights(void* argument) {
 		//order of the conditionals indicates the priority of the flash routines
 		if(osEventFlagsGet(flash_flags) & LIGHTS_OFF) {
 			osEventFlagsClear(flash_flags, LIGHTS_OFF); //clear the flag manually
+			set_light_mode(0);
 			do_lights_out();
 		}
 		else if (osEventFlagsGet(flash_flags) & TAILLIGHT_ONLY) {
 			osEventFlagsClear(flash_flags, TAILLIGHT_ONLY);
+			set_light_mode(1);
 			do_taillight_only();
 		}
 		else if (osEventFlagsGet(flash_flags) & TAIL_SOLID_HEAD) {
 			osEventFlagsClear(flash_flags, TAIL_SOLID_HEAD);
+			set_light_mode(2);
 			do_tail_solid_head();
 		}
 		else if (osEventFlagsGet(flash_flags) & TAIL_AND_HEAD) {
 			osEventFlagsClear(flash_flags, TAIL_AND_HEAD);
+			set_light_mode(3);
 			do_tail_and_head();
 		}
 	}
@@ -172,6 +188,11 @@ static void run_board_lights(void* argument) {
 	osThreadExit();
 }
 
+static void set_light_mode(uint8_t mode) {
+	light_mode = mode;
+	ride_stats_light_mode(mode);
+}
+
 static void do_lights_out() {
 	//set the PWM compare registers to 0
 	CHAN_HEAD_COUNT = 0;
@@ -247,6 +268,7 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
 		else {
 			uint16_t pulse_width;
 			pulse_width = pulse_tim->Instance->CNT;
+			blackbox_record(BLACKBOX_RC, 0, pulse_width);
 			osMessageQueueReset(pulse_buf);
 			osMessageQueuePut(pulse_buf, &pulse_width, 0, 0);
 		}
@@ -1,5 +1,9 @@
 #include "buzzer.h"
 #include "cmsis_os.h"
+#include "melody.h"
+#include "rtos_objects.h"
+#include "shutdown_coord.h"
+#include "stdbool.h"
 
 
 //================ SOME DEFINES ==================
@@ -12,9 +16,10 @@
 #define BIT_ALL_FLAGS 	0x1F
 
 //macro for setting the timer period
+//write the auto-reload directly and restart the count so a shorter period can't get skipped past
 #define TIME_PERIOD(period) { \
-	htim2.Init.Period = period; \
-	HAL_TIM_Base_Init(&htim2); \
+	__HAL_TIM_SET_AUTORELOAD(&htim2, period); \
+	__HAL_TIM_SET_COUNTER(&htim2, 0); \
 }
 
 //quick macros to start and stop the timer
@@ -29,6 +34,68 @@
 #define CRITIAL_ON_TIME 900
 #define CRITICAL_OFF_TIME 100
 
+#define BUZZER_SHUTDOWN_DEADLINE 1000 //ms, enough for the shutdown jingle plus the note that was playing
+									//worst simulated: 601ms (sim_replay, long press and fault shutdowns swept over when they land)
+
+//================ JINGLES ==================
+//B major arpeggio up the octave
+static const uint32_t boot_up_notes[] = {
+	TONE(NOTE_B, 4, BOOT_BUZZ_DELAY),
+	TONE(NOTE_DS, 5, BOOT_BUZZ_DELAY), //major 3rd from base
+	TONE(NOTE_FS, 5, BOOT_BUZZ_DELAY), //perfect 5th from base
+	TONE(NOTE_B, 5, BOOT_BUZZ_DELAY), //perfect octave from base
+	REST(250) //chill for a bit before returning
+};
+
+//same arpeggio, just quicker
+static const uint32_t done_init_notes[] = {
+	TONE(NOTE_B, 4, INIT_DONE_DELAY),
+	TONE(NOTE_DS, 5, INIT_DONE_DELAY),
+	TONE(NOTE_FS, 5, INIT_DONE_DELAY),
+	TONE(NOTE_B, 5, INIT_DONE_DELAY),
+	REST(INIT_DONE_PAUSE)
+};
+
+static const uint32_t warn_low_notes[] = {
+	TONE(NOTE_B, 7, WARN_BUZZ_TIME),
+	TONE(NOTE_E, 7, WARN_BUZZ_TIME),
+	TONE(NOTE_B, 6, WARN_BUZZ_TIME),
+	REST(WARN_OFF_TIME)
+};
+
+static const uint32_t warn_critical_notes[] = {
+	TONE(NOTE_B, 7, CRITIAL_ON_TIME),
+	REST(CRITICAL_OFF_TIME)
+};
+
+//boot up arpeggio, but backwards
+static const uint32_t shutdown_notes[] = {
+	TONE(NOTE_B, 5, BOOT_BUZZ_DELAY),
+	TONE(NOTE_FS, 5, BOOT_BUZZ_DELAY),
+	TONE(NOTE_DS, 5, BOOT_BUZZ_DELAY),
+	TONE(NOTE_B, 4, BOOT_BUZZ_DELAY) //no trailing rest, power gets cut as soon as this finishes
+};
+
+static const melody_t boot_up_jingle = MELODY(boot_up_notes, 1);
+static const melody_t done_init_jingle = MELODY(done_init_notes, 1);
+static const melody_t warn_low_jingle = MELODY(warn_low_notes, 8);
+static const melody_t warn_critical_jingle = MELODY(warn_critical_notes, 8);
+static const melody_t shutdown_jingle = MELODY(shutdown_notes, 1);
+
+//which jingle to play for each action flag
+//order of the table indicates the priority of the buzz routines
+static const struct {
+	uint32_t flag;
+	const melody_t* melody;
+} buzz_routines[] = {
+	{BIT_SHUTDOWN, &shutdown_jingle},
+	{BIT_WARN_CRIT, &warn_critical_jingle},
+	{BIT_WARN_LOW, &warn_low_jingle},
+	{BIT_DONE_INIT, &done_init_jingle},
+	{BIT_BOOT_UP, &boot_up_jingle}
+};
+#define NUM_BUZZ_ROUTINES (sizeof(buzz_routines)/sizeof(buzz_routines[0]))
+
 //============= PRIVATE VARIABLES =============
 //thread handle for the buzzer thread
 static osThreadId_t buzzer_handle = NULL;
@@ -36,35 +103,38 @@ static osThreadId_t buzzer_handle = NULL;
 //flags to tell the buzzer thread what action to run
 static osEventFlagsId_t buzzer_action_flags = NULL;
 
+//ID to signal the shutdown coordinator with once the shutdown jingle is done
+static int8_t buzzer_shutdown_id = -1;
+
 //============= PRIVATE FUNCTION PROTOTYPES ==============
 static void buzzer_thread(void* argument); //main buzzer thread function
 
-static void do_buzz_boot_up();
-static void do_buzz_done_init();
-static void do_buzz_warn_low();
-static void do_buzz_warn_critical();
-static void do_buzz_shutdown();
+//play through a melody table note by note
+static void play_melody(const melody_t* melody);
 
 //============= PUBLIC FUNCTION DEFINITIONS =============
 void buzzer_init() {
 	//initialize the signal flags for the buzzer thread
-	buzzer_action_flags= osEventFlagsNew(NULL);
+	const osEventFlagsAttr_t buzzer_action_attributes = RTOS_FLAGS_ATTR(buzzer_action);
+	buzzer_action_flags = osEventFlagsNew(&buzzer_action_attributes);
 	osEventFlagsSet(buzzer_action_flags, BIT_BOOT_UP); //set the boot up bit right away
 
 	//initialize the main buzzer thread
-	const osThreadAttr_t buzzer_atributes = {
-			.name = "buzzer",
-			.priority = (osPriority_t) osPriorityAboveNormal,
-			.stack_size = 350 //possibly shrink this a little
-	};
+	const osThreadAttr_t buzzer_atributes = RTOS_THREAD_ATTR(buzzer, "buzzer", osPriorityAboveNormal);
 	buzzer_handle = osThreadNew(buzzer_thread, NULL, &buzzer_atributes);
+
+	buzzer_shutdown_id = shutdown_register("buzzer", buzz_shutdown, BUZZER_SHUTDOWN_DEADLINE);
 }
 
 //just set the action flag for the buzzer thread and return
 void buzz_done_init() { osEventFlagsSet(buzzer_action_flags, BIT_DONE_INIT); }
 void buzz_warn_low() {osEventFlagsSet(buzzer_action_flags, BIT_WARN_LOW); }
 void buzz_warn_critical() {osEventFlagsSet(buzzer_action_flags, BIT_WARN_CRIT); }
-void buzz_shutdown() {osEventFlagsSet(buzzer_action_flags, BIT_SHUTDOWN); }
+//drop anything else that's queued up so the shutdown jingle goes next
+void buzz_shutdown() {
+	osEventFlagsClear(buzzer_action_flags, BIT_ALL_FLAGS & ~BIT_SHUTDOWN);
+	osEventFlagsSet(buzzer_action_flags, BIT_SHUTDOWN);
+}
 
 //return the free stack space for the buzzer thread
 uint32_t buzzer_stack_space() {return osThreadGetStackSpace(buzzer_handle);}
@@ -78,113 +148,47 @@ static void buzzer_thread(void* argument) {
 		//suspend this thread until any flag is set (and don't clear the set flag)
 		osEventFlagsWait(buzzer_action_flags, BIT_ALL_FLAGS, osFlagsNoClear, osWaitForever);
 
-		//if a flag bit is set, run the appropriate buzzer routine
-		//order of the conditionals indicates the priority of the buzz routines
+		//if a flag bit is set, play the highest priority jingle
 		//each routine will fully complete before going to another routine
-		if(osEventFlagsGet(buzzer_action_flags) & BIT_WARN_CRIT) {
-			do_buzz_warn_critical();
-			osEventFlagsClear(buzzer_action_flags, BIT_WARN_CRIT); //clear the flag manually
-		}
-		else if (osEventFlagsGet(buzzer_action_flags) & BIT_WARN_LOW) {
-			do_buzz_warn_low();
-			osEventFlagsClear(buzzer_action_flags, BIT_WARN_LOW);
-		}
-		else if (osEventFlagsGet(buzzer_action_flags) & BIT_DONE_INIT) {
-			do_buzz_done_init();
-			osEventFlagsClear(buzzer_action_flags, BIT_DONE_INIT);
-		}
-		else if (osEventFlagsGet(buzzer_action_flags) & BIT_BOOT_UP) {
-			do_buzz_boot_up();
-			osEventFlagsClear(buzzer_action_flags, BIT_BOOT_UP);
-		}
-		else if (osEventFlagsGet(buzzer_action_flags) & BIT_SHUTDOWN) {
-			do_buzz_shutdown();
-			osEventFlagsClear(buzzer_action_flags, BIT_SHUTDOWN);
+		uint32_t flags = osEventFlagsGet(buzzer_action_flags);
+		for(int i = 0; i < NUM_BUZZ_ROUTINES; i++) {
+			if(flags & buzz_routines[i].flag) {
+				play_melody(buzz_routines[i].melody);
+				osEventFlagsClear(buzzer_action_flags, buzz_routines[i].flag); //clear the flag manually
+				if(buzz_routines[i].flag == BIT_SHUTDOWN) shutdown_done(buzzer_shutdown_id);
+				break;
+			}
 		}
 	}
 	//gracefully exiting if it somehow gets here
 	osThreadExit();
 }
 
-static void do_buzz_boot_up() {
-	TIME_PERIOD(1000);
-	START();
-	osDelay(BOOT_BUZZ_DELAY);
-
-	TIME_PERIOD(800); //major 3rd from base
-	osDelay(BOOT_BUZZ_DELAY);
-
-	TIME_PERIOD(666); //perfect 5th from base
-	osDelay(BOOT_BUZZ_DELAY);
-
-	TIME_PERIOD(500); //perfect octave from base
-	osDelay(BOOT_BUZZ_DELAY);
-
-	STOP();
-	osDelay(250); //chill for a bit before returning
-}
-
-static void do_buzz_done_init() {
-	for(int i = 0; i < 1; i++) {
-		TIME_PERIOD(1000);
-		START();
-		osDelay(INIT_DONE_DELAY);
-
-		TIME_PERIOD(800); //major third above base note
-		osDelay(INIT_DONE_DELAY);
-
-		TIME_PERIOD(666); //perfect fifth from base note
-		osDelay(INIT_DONE_DELAY);
-
-		TIME_PERIOD(500); //octave from base note
-		osDelay(INIT_DONE_DELAY);
-
-		STOP();
-		osDelay(INIT_DONE_PAUSE);
-	}
-}
-
-static void do_buzz_warn_low() {
-	for(int i = 0; i < 8; i++) {
-		TIME_PERIOD(125);
-		START();
-		osDelay(WARN_BUZZ_TIME);
-		TIME_PERIOD(188);
-		osDelay(WARN_BUZZ_TIME);
-		TIME_PERIOD(250);
-		osDelay(WARN_BUZZ_TIME);
-		STOP();
-
-		osDelay(WARN_OFF_TIME);
-	}
-
-}
-
-static void do_buzz_warn_critical() {
-	for(int i = 0; i < 8; i++) {
-		TIME_PERIOD(125); //125 before, making 250 to make testing less annoying
-		START();
-		osDelay(CRITIAL_ON_TIME);
-
-		STOP();
-		osDelay(CRITICAL_OFF_TIME);
+static void play_melody(const melody_t* melody) {
+	bool sounding = false; //only poke the output enable when going between tones and rests
+
+	for(int r = 0; r < melody->repeat; r++) {
+		for(int i = 0; i < melody->length; i++) {
+			uint16_t period = NOTE_PERIOD(melody->notes[i]);
+
+			if(period) {
+				TIME_PERIOD(period);
+				if(!sounding) START();
+				sounding = true;
+			}
+			else {
+				if(sounding) STOP();
+				sounding = false;
+			}
+
+			//non blocking delay with escape, so a shutdown cuts any other jingle short
+			if(melody == &shutdown_jingle) osDelay(NOTE_DURATION(melody->notes[i]));
+			else if(osEventFlagsWait(buzzer_action_flags, BIT_SHUTDOWN, osFlagsNoClear, NOTE_DURATION(melody->notes[i])) != osErrorTimeout) {
+				if(sounding) STOP();
+				return;
+			}
+		}
 	}
-}
-
-static void do_buzz_shutdown() {
-	TIME_PERIOD(500);
-	START();
-	osDelay(BOOT_BUZZ_DELAY);
-
-	TIME_PERIOD(666); //major 3rd from base
-	osDelay(BOOT_BUZZ_DELAY);
-
-	TIME_PERIOD(800); //perfect 5th from base
-	osDelay(BOOT_BUZZ_DELAY);
-
-	TIME_PERIOD(1000); //perfect octave from base
-	osDelay(BOOT_BUZZ_DELAY);
 
-	STOP();
-	osDelay(250); //chill for a bit before returning
+	if(sounding) STOP();
 }
@@ -0,0 +1,192 @@
+#include "config.h"
+#include "checksum.h"
+#include "string.h"
+#include "stddef.h"
+
+//======================= on-flash layouts ======================
+//a snapshot is the header followed by count entries
+//the header's seq is programmed last (after the entries), so a snapshot cut off partway reads as unwritten
+typedef struct {
+	uint16_t count;
+	uint16_t version;
+	uint32_t crc; //crc32 over count, version, seq and the entries
+	uint32_t seq;
+} snapshot_header_t;
+
+typedef struct {
+	uint32_t id;
+	int32_t value;
+} snapshot_entry_t;
+
+#define BLANK_WORD 0xFFFFFFFFul
+
+//===================== PRIVATE VARIABLES =====================
+#define CONFIG_DEFAULT(name, def, min, max) [CONFIG_##name] = (def),
+#define CONFIG_LIMITS(name, def, min, max) [CONFIG_##name] = {(min), (max)},
+
+//single word reads and writes, so readers in other threads never see a torn value
+static volatile int32_t values[CONFIG_NUM_PARAMS] = { CONFIG_PARAMS(CONFIG_DEFAULT) };
+static const int32_t limits[CONFIG_NUM_PARAMS][2] = { CONFIG_PARAMS(CONFIG_LIMITS) };
+
+static config_watch_t watchers[CONFIG_MAX_WATCHERS];
+static uint8_t num_watchers = 0;
+
+//store state; commits only come from one thread (usb_cmd)
+static const flash_dev_t* store = NULL;
+static config_store_info_t info;
+static uint32_t slot_used[CONFIG_NUM_SECTORS]; //bytes, the sector size if it's unusable until erased
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static uint32_t scan_slot(uint8_t slot, uint32_t* best_seq, uint32_t* best_offset, uint8_t* best_slot);
+static uint32_t snapshot_crc(const snapshot_header_t* h, const snapshot_entry_t* entries);
+static bool seq_newer(uint32_t a, uint32_t b);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+int32_t config_get(uint8_t id) {
+	return id < CONFIG_NUM_PARAMS ? values[id] : 0;
+}
+
+bool config_set(uint8_t id, int32_t value) {
+	if(id >= CONFIG_NUM_PARAMS) return false;
+	if(value < limits[id][0] || value > limits[id][1]) return false;
+	values[id] = value;
+	for(uint8_t i = 0; i < num_watchers; i++) watchers[i](id, value);
+	return true;
+}
+
+bool config_limits(uint8_t id, int32_t* min, int32_t* max) {
+	if(id >= CONFIG_NUM_PARAMS) return false;
+	*min = limits[id][0];
+	*max = limits[id][1];
+	return true;
+}
+
+bool config_watch(config_watch_t handler) {
+	if(num_watchers >= CONFIG_MAX_WATCHERS) return false;
+	watchers[num_watchers++] = handler;
+	return true;
+}
+
+uint32_t config_load(const flash_dev_t* dev) {
+	memset(&info, 0, sizeof(info));
+	store = dev;
+	if(dev->num_sectors != CONFIG_NUM_SECTORS) {
+		store = NULL;
+		return 0;
+	}
+
+	//find the newest good snapshot in either sector, and where each sector's free space starts
+	uint32_t best_seq = 0, best_offset = 0;
+	uint8_t best_slot = 0;
+	for(uint8_t s = 0; s < CONFIG_NUM_SECTORS; s++) {
+		slot_used[s] = scan_slot(s, &best_seq, &best_offset, &best_slot);
+	}
+	info.slot = best_slot; //keep appending where the newest one is
+
+	if(best_seq != 0) {
+		snapshot_header_t h;
+		snapshot_entry_t e;
+		uint32_t at = best_slot * dev->sector_size + best_offset;
+		dev->read(dev, at, &h, sizeof(h));
+		for(uint16_t i = 0; i < h.count; i++) {
+			dev->read(dev, at + sizeof(h) + i * sizeof(e), &e, sizeof(e));
+			if(e.id < CONFIG_NUM_PARAMS && e.value >= limits[e.id][0] && e.value <= limits[e.id][1]) values[e.id] = e.value;
+		}
+		info.seq = best_seq;
+	}
+	info.used = slot_used[info.slot];
+	return info.seq;
+}
+
+bool config_commit() {
+	if(store == NULL) return false;
+
+	snapshot_header_t h = {.count = CONFIG_NUM_PARAMS, .version = CONFIG_STORE_VERSION, .seq = info.seq + 1};
+	if(h.seq == BLANK_WORD || h.seq == 0) h.seq = 1; //both read as "no snapshot"
+	snapshot_entry_t entries[CONFIG_NUM_PARAMS];
+	for(uint8_t i = 0; i < CONFIG_NUM_PARAMS; i++) {
+		entries[i].id = i;
+		entries[i].value = values[i];
+	}
+	h.crc = snapshot_crc(&h, entries);
+	uint32_t size = sizeof(h) + sizeof(entries);
+
+	//out of room: the other sector takes over, the snapshots in this one stay as the fallback until it's done
+	uint8_t slot = info.slot;
+	if(slot_used[slot] + size > store->sector_size) {
+		slot = (slot + 1) % CONFIG_NUM_SECTORS;
+		if(!store->erase(store, slot)) {
+			slot_used[slot] = store->sector_size;
+			info.failures++;
+			return false;
+		}
+		slot_used[slot] = 0;
+	}
+
+	//header up to the seq, the entries, then the seq to mark it written
+	uint32_t at = slot * store->sector_size + slot_used[slot];
+	bool ok = store->program(store, at, &h, offsetof(snapshot_header_t, seq));
+	ok = ok && store->program(store, at + sizeof(h), entries, sizeof(entries));
+	ok = ok && store->program(store, at + offsetof(snapshot_header_t, seq), &h.seq, sizeof(h.seq));
+
+	//whatever happened, that space is used now
+	slot_used[slot] += size;
+	info.slot = slot;
+	info.used = slot_used[slot];
+	if(!ok) {
+		info.failures++;
+		return false;
+	}
+	info.seq = h.seq;
+	info.commits++;
+	return true;
+}
+
+void config_get_store_info(config_store_info_t* out) {
+	*out = info;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+//walk the snapshots in a sector, keeping track of the newest good one overall
+//returns where the free space starts (the sector size if something unreadable is in the way)
+static uint32_t scan_slot(uint8_t slot, uint32_t* best_seq, uint32_t* best_offset, uint8_t* best_slot) {
+	uint32_t base = slot * store->sector_size;
+	uint32_t offset = 0;
+
+	while(offset + sizeof(snapshot_header_t) <= store->sector_size) {
+		snapshot_header_t h;
+		store->read(store, base + offset, &h, sizeof(h));
+
+		uint32_t first;
+		memcpy(&first, &h, sizeof(first));
+		if(first == BLANK_WORD) return offset; //nothing written here yet
+
+		//a header cut off partway through can have any count; can't tell where the next one starts
+		if(h.count > CONFIG_STORE_MAX_PARAMS) return store->sector_size;
+		uint32_t size = sizeof(h) + h.count * sizeof(snapshot_entry_t);
+		if(offset + size > store->sector_size) return store->sector_size;
+
+		if(h.seq != BLANK_WORD && h.version == CONFIG_STORE_VERSION) {
+			snapshot_entry_t entries[CONFIG_STORE_MAX_PARAMS];
+			store->read(store, base + offset + sizeof(h), entries, h.count * sizeof(snapshot_entry_t));
+			if(h.crc == snapshot_crc(&h, entries) && (*best_seq == 0 || seq_newer(h.seq, *best_seq))) {
+				*best_seq = h.seq;
+				*best_offset = offset;
+				*best_slot = slot;
+			}
+		}
+		offset += size;
+	}
+	return store->sector_size;
+}
+
+static uint32_t snapshot_crc(const snapshot_header_t* h, const snapshot_entry_t* entries) {
+	uint32_t crc = crc32_update(CRC32_INIT, h, offsetof(snapshot_header_t, crc));
+	crc = crc32_update(crc, &h->seq, sizeof(h->seq));
+	return crc32_update(crc, entries, h->count * sizeof(snapshot_entry_t));
+}
+
+//sequence numbers wrap, so compare them the way the tick is compared
+static bool seq_newer(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) > 0;
+}
@@ -0,0 +1,159 @@
+#include "cpu_stats.h"
+#include "stm32f4xx_hal.h"
+#include "rtos_objects.h"
+#include "datalog.h"
+#include "string.h"
+
+_Static_assert(sizeof(cpu_stats_record_t) <= DATALOG_MAX_RECORD, "cpu stats record doesn't fit in a datalog record");
+
+//===================== PUBLIC VARIABLES =====================
+volatile uint32_t cpu_stats_switches[CPU_STATS_MAX_THREADS];
+
+//===================== PRIVATE VARIABLES =====================
+static osThreadId_t cpu_stats_handle = NULL;
+
+//only the cpu_stats thread touches these
+static TaskStatus_t status[CPU_STATS_MAX_THREADS + 4]; //room for a few unnumbered ones too
+static uint32_t last_total = 0;
+static uint32_t last_cycles[CPU_STATS_MAX_THREADS];
+static uint32_t last_switches[CPU_STATS_MAX_THREADS];
+static uint8_t next_number = 1;
+static uint16_t idle_window[CPU_STATS_WINDOW];
+static uint8_t idle_at = 0, idle_filled = 0;
+static cpu_thread_stats_t pass[CPU_STATS_MAX_THREADS]; //being worked out
+
+//latest pass; written and read under the kernel lock
+static cpu_thread_stats_t threads[CPU_STATS_MAX_THREADS];
+static cpu_stats_summary_t summary;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void run_cpu_stats(void* argument);
+static void number_new_threads(UBaseType_t count);
+static void log_pass();
+static uint16_t permille(uint32_t part, uint32_t whole);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void cpu_stats_init() {
+	const osThreadAttr_t cpu_stats_attributes = RTOS_THREAD_ATTR(cpu_stats, "cpu_stats", osPriorityLow);
+	cpu_stats_handle = osThreadNew(run_cpu_stats, NULL, &cpu_stats_attributes);
+}
+
+bool cpu_stats_thread(uint8_t number, cpu_thread_stats_t* out) {
+	if(number >= CPU_STATS_MAX_THREADS) return false;
+	int32_t lock = osKernelLock();
+	*out = threads[number];
+	osKernelRestoreLock(lock);
+	return out->name != NULL;
+}
+
+void cpu_stats_get_summary(cpu_stats_summary_t* out) {
+	int32_t lock = osKernelLock();
+	*out = summary;
+	osKernelRestoreLock(lock);
+}
+
+void cpu_stats_timer_init(void) {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t cpu_stats_stack_space() {return osThreadGetStackSpace(cpu_stats_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void run_cpu_stats(void* argument) {
+	uint8_t passes = 0;
+
+	while(1) {
+		osDelay(CPU_STATS_PERIOD);
+
+		uint32_t total;
+		UBaseType_t count = uxTaskGetSystemState(status, sizeof(status) / sizeof(status[0]), &total);
+		number_new_threads(count);
+
+		//everything below is differences, so the counters wrapping doesn't matter
+		uint32_t period = total - last_total;
+		last_total = total;
+		if(period == 0) continue;
+
+		memset(pass, 0, sizeof(pass));
+		uint32_t switches = 0;
+		uint16_t idle = 0;
+
+		for(UBaseType_t i = 0; i < count; i++) {
+			UBaseType_t n = uxTaskGetTaskNumber(status[i].xHandle);
+			if(n >= CPU_STATS_MAX_THREADS) n = 0;
+			uint32_t cycles = status[i].ulRunTimeCounter - (n ? last_cycles[n] : 0);
+			if(n) last_cycles[n] = status[i].ulRunTimeCounter;
+			else cycles = 0; //no history for the unnumbered ones
+
+			pass[n].name = n ? status[i].pcTaskName : "other";
+			pass[n].cycles += cycles;
+			if(strcmp(status[i].pcTaskName, "IDLE") == 0) idle = permille(cycles, period);
+		}
+		for(uint8_t n = 0; n < CPU_STATS_MAX_THREADS; n++) {
+			uint32_t s = cpu_stats_switches[n];
+			pass[n].switches = s - last_switches[n];
+			last_switches[n] = s;
+			pass[n].share = permille(pass[n].cycles, period);
+			switches += pass[n].switches;
+		}
+
+		idle_window[idle_at] = idle;
+		idle_at = (idle_at + 1) % CPU_STATS_WINDOW;
+		if(idle_filled < CPU_STATS_WINDOW) idle_filled++;
+		uint32_t idle_sum = 0;
+		for(uint8_t i = 0; i < idle_filled; i++) idle_sum += idle_window[i];
+
+		int32_t lock = osKernelLock();
+		memcpy(threads, pass, sizeof(threads));
+		summary.idle = idle;
+		summary.idle_avg = idle_sum / idle_filled;
+		summary.switches = switches;
+		summary.cycles = period;
+		summary.threads = next_number - 1;
+		osKernelRestoreLock(lock);
+
+		if(++passes >= CPU_STATS_LOG_DIVIDER) {
+			passes = 0;
+			log_pass();
+		}
+	}
+
+	osThreadExit();
+}
+
+//give threads we haven't seen before the next numbers, oldest first so the numbering is the same every boot
+static void number_new_threads(UBaseType_t count) {
+	while(next_number < CPU_STATS_MAX_THREADS) {
+		TaskStatus_t* oldest = NULL;
+		for(UBaseType_t i = 0; i < count; i++) {
+			if(uxTaskGetTaskNumber(status[i].xHandle) != 0) continue;
+			if(oldest == NULL || status[i].xTaskNumber < oldest->xTaskNumber) oldest = &status[i];
+		}
+		if(oldest == NULL) return;
+
+		//its first pass counts everything since it was created (the cycle counter starts with the scheduler)
+		vTaskSetTaskNumber(oldest->xHandle, next_number++);
+	}
+}
+
+static void log_pass() {
+	cpu_stats_record_t record = {0};
+
+	int32_t lock = osKernelLock();
+	record.idle = summary.idle;
+	record.idle_avg = summary.idle_avg;
+	record.switches = summary.switches > UINT16_MAX ? UINT16_MAX : summary.switches;
+	for(uint8_t n = 1; n <= CPU_STATS_RECORD_THREADS && n < CPU_STATS_MAX_THREADS; n++) {
+		uint16_t half_percent = threads[n].share / 5;
+		record.share[n - 1] = half_percent > UINT8_MAX ? UINT8_MAX : half_percent;
+	}
+	osKernelRestoreLock(lock);
+
+	datalog_write(DATALOG_CPU_STATS, &record, sizeof(record));
+}
+
+static uint16_t permille(uint32_t part, uint32_t whole) {
+	return (uint64_t)part * 1000 / whole;
+}
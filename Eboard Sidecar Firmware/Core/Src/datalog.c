@@ -0,0 +1,377 @@
+#include "datalog.h"
+#include "rtos_objects.h"
+#include "shutdown_coord.h"
+#include "blackbox.h"
+#include "flash_stm32.h"
+#include "string.h"
+#include "stdio.h"
+
+//======================= some defines ======================
+#define DATALOG_FLUSH_TIME 5000 //ms a part-filled page can sit in RAM before it's written anyway
+#define DATALOG_MIN_FREE_PAGES 256 //start a fresh sector once the ride's under way if there's less than this left at
+										//boot (half a sector)
+#define DATALOG_RESERVE_PAGES 44 //kept at the end of the sector for a black box dump and the end of the ride, see datalog.h
+#define DATALOG_QUEUE_RESERVE 4 //queue slots telemetry and the periodic records can't have
+#define DATALOG_SHUTDOWN_DEADLINE 250 //ms, the telemetry block goes out on the next sample (100ms), then
+										//a page program is ~1ms and a black box dump is ~35 pages
+										//worst simulated: 92ms (a fault shutdown, sim_replay swept over the sample phase)
+
+//what goes through the queue
+typedef struct {
+	uint8_t type;
+	uint8_t len;
+	uint8_t data[DATALOG_MAX_RECORD];
+} datalog_item_t;
+
+_Static_assert(sizeof(datalog_item_t) == RTOS_QUEUE_ITEM_SIZE(datalog_buf), "datalog_buf item size doesn't match datalog_item_t");
+
+//a whole black box dump has to fit in the reserve, with a few pages over for the end of the ride
+#define BLACKBOX_RECORDS_PER_PAGE ((FLASH_LOG_PAGE_PAYLOAD - FLASH_LOG_RECORD_HEADER - sizeof(log_page_info_t)) / \
+		(FLASH_LOG_RECORD_HEADER + DATALOG_BLACKBOX_PER_RECORD * sizeof(blackbox_entry_t)))
+_Static_assert((DATALOG_RESERVE_PAGES - 4) * BLACKBOX_RECORDS_PER_PAGE * DATALOG_BLACKBOX_PER_RECORD >= BLACKBOX_ENTRIES,
+		"DATALOG_RESERVE_PAGES won't hold a black box dump");
+
+//===================== PRIVATE VARIABLES =====================
+static flash_log_t ride_log; //only the writer thread touches this once it's running
+static log_index_t ride_index;
+static uint16_t ride = 0;
+static uint16_t sector_records = 0; //in the active sector, for the page infos
+static bool mounted = false;
+static datalog_stats_t stats;
+static volatile bool flush_requested = false;
+static volatile uint32_t flushes = 0; //done by the writer, for datalog_sync()
+static bool rotate_due = false; //not enough room left for a ride, erase the next sector when we're allowed to
+static volatile bool erase_allowed = false; //power's latched, see datalog_ride_started()
+static volatile bool shedding = false; //down to the reserve, telemetry and the periodic records are turned away
+
+//telemetry encoder; owned by whichever thread calls datalog_telemetry()
+static telem_encoder_t telem;
+static bool telem_running = false;
+static volatile bool telem_flush_requested = false;
+
+static osMessageQueueId_t datalog_buf;
+static osThreadId_t datalog_handle = NULL;
+static int8_t datalog_shutdown_id = -1;
+
+//the page being filled; only touched by the writer thread
+static uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+static uint16_t page_used = 0;
+static uint16_t page_records = 0;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void datalog_thread(void* argument);
+static void add_record(uint8_t type, const void* data, uint8_t len);
+static void start_page();
+static void write_page();
+static void write_blackbox();
+static void write_telem_block(const uint8_t* block, uint8_t len);
+static void start_fresh_sector();
+static void update_shedding();
+static bool sheddable(uint8_t type);
+static void datalog_shutdown();
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void datalog_init() {
+	flash_log_status_t status = flash_log_mount(&ride_log, &flash_stm32_datalog);
+
+	//give each ride a good chunk of sector so it doesn't run out partway through; the erase waits for the latch
+	//(the writer does it), until then records go in what's left of this sector
+	mounted = (status == FLASH_LOG_OK);
+	rotate_due = mounted && flash_log_free_pages(&ride_log) < DATALOG_MIN_FREE_PAGES;
+	telem_encoder_init(&telem);
+
+	//a few page reads per sector, however the last ride ended
+	if(mounted) {
+		log_index_build(&ride_index, &ride_log);
+		if(log_index_last_ride(&ride_index, &ride_log, &ride)) ride++;
+		sector_records = ride_index.sector[ride_log.active].records;
+		update_shedding();
+	}
+
+	//cycle counter for timing the telemetry encoder
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	const osMessageQueueAttr_t datalog_buf_attributes = RTOS_QUEUE_ATTR(datalog_buf);
+	datalog_buf = osMessageQueueNew(RTOS_QUEUE_DEPTH(datalog_buf), RTOS_QUEUE_ITEM_SIZE(datalog_buf), &datalog_buf_attributes);
+
+	if(!mounted) {
+		printf("datalog: mount failed (%d)\r\n", status);
+		return;
+	}
+
+	const osThreadAttr_t datalog_attributes = RTOS_THREAD_ATTR(datalog, "datalog", osPriorityBelowNormal);
+	datalog_handle = osThreadNew(datalog_thread, NULL, &datalog_attributes);
+	datalog_shutdown_id = shutdown_register("datalog", datalog_shutdown, DATALOG_SHUTDOWN_DEADLINE);
+
+	datalog_boot_t boot = {
+		.sector_seq = ride_log.sector_seq[ride_log.active],
+		.erase_count = ride_log.erase_count[ride_log.active],
+		.free_pages = flash_log_free_pages(&ride_log),
+		.torn_pages = ride_log.torn_pages,
+	};
+	datalog_write(DATALOG_BOOT, &boot, sizeof(boot));
+	printf("datalog: ride %u, sector %u (seq %lu, %lu erases), %u pages free, %lu torn\r\n", ride, ride_log.active,
+			boot.sector_seq, boot.erase_count, boot.free_pages, ride_log.torn_pages);
+}
+
+bool datalog_write(uint8_t type, const void* data, uint8_t len) {
+	datalog_item_t item = {.type = type, .len = len};
+
+	if(mounted && type != DATALOG_FLUSH && len <= DATALOG_MAX_RECORD) {
+		//the last few queue slots and the last pages of the sector are for the records that matter
+		if(sheddable(type) && (shedding || osMessageQueueGetSpace(datalog_buf) <= DATALOG_QUEUE_RESERVE)) {
+			stats.shed++;
+			return false;
+		}
+		memcpy(item.data, data, len);
+		if(osMessageQueuePut(datalog_buf, &item, 0, 0) == osOK) return true;
+	}
+
+	stats.dropped++;
+	return false;
+}
+
+void datalog_telemetry(const telem_sample_t* sample) {
+	uint8_t block[TELEM_BLOCK_MAX];
+	telem_running = true;
+
+	uint32_t start = DWT->CYCCNT;
+	uint8_t len = telem_encode(&telem, sample, block);
+	uint32_t cycles = DWT->CYCCNT - start;
+
+	stats.telem_samples++;
+	stats.telem_cycles += cycles;
+	if(cycles > stats.telem_cycles_max) stats.telem_cycles_max = cycles;
+
+	if(len) write_telem_block(block, len);
+
+	//shutting down, get the part-filled block out ahead of the page flush
+	if(telem_flush_requested) {
+		telem_flush_requested = false;
+		len = telem_flush(&telem, block);
+		if(len) write_telem_block(block, len);
+		datalog_flush();
+	}
+}
+
+void datalog_flush() {
+	datalog_item_t marker = {.type = DATALOG_FLUSH};
+	flush_requested = true;
+	osMessageQueuePut(datalog_buf, &marker, 0, 0); //just wakes the writer; if the queue's full it's awake anyway
+}
+
+bool datalog_sync(uint32_t timeout) {
+	uint32_t before = flushes;
+	uint32_t start = HAL_GetTick();
+
+	if(!mounted) return false;
+	datalog_flush();
+	while(flushes == before) {
+		if(HAL_GetTick() - start >= timeout) return false;
+		osDelay(1); //the writer runs below us
+	}
+	return true;
+}
+
+void datalog_commit_blackbox() {
+	datalog_item_t marker = {.type = DATALOG_FLUSH};
+	osMessageQueuePut(datalog_buf, &marker, 0, 0); //the writer checks for a frozen ring every time it wakes, this just wakes it
+}
+
+void datalog_ride_started() {
+	datalog_item_t marker = {.type = DATALOG_FLUSH};
+	erase_allowed = true;
+	if(rotate_due) osMessageQueuePut(datalog_buf, &marker, 0, 0); //just wakes the writer to do it
+}
+
+void datalog_get_stats(datalog_stats_t* s) {*s = stats;}
+uint16_t datalog_ride() {return ride;}
+
+uint32_t datalog_retrieve(uint16_t ride_id, uint32_t from, uint32_t to, datalog_record_cb_t cb, void* ctx) {
+	flash_log_t snapshot;
+	log_index_t idx;
+	flash_log_cursor_t cursor;
+	uint8_t buf[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t len;
+	uint32_t count = 0;
+	log_key_t end = {.ride = ride_id, .tick = to};
+
+	if(!mounted) return 0;
+
+	//work from a snapshot so the writer can carry on; pages it writes after this just aren't seen
+	int32_t lock = osKernelLock();
+	snapshot = ride_log;
+	idx = ride_index;
+	osKernelRestoreLock(lock);
+
+	if(!log_index_seek(&idx, &snapshot, (log_key_t){.ride = ride_id, .tick = from}, &cursor)) return 0;
+
+	while(flash_log_read_next(&snapshot, &cursor, buf, &len, NULL) == FLASH_LOG_OK) {
+		log_page_info_t info;
+		if(!log_page_info(buf, len, &info)) continue;
+		if(log_key_cmp((log_key_t){.ride = info.ride, .tick = info.tick}, end) > 0) break; //past the window
+		if(info.ride < ride_id) continue; //the seek lands on the ride before's last page when the window starts at 0
+
+		uint16_t offset = 0;
+		uint8_t type, rlen;
+		const uint8_t* data;
+		while(flash_log_record_next(buf, len, &offset, &type, &data, &rlen)) {
+			if(type == DATALOG_PAGE_INFO) continue;
+			cb(type, data, rlen, ctx);
+			count++;
+		}
+	}
+
+	return count;
+}
+const flash_log_t* datalog_log() {return &ride_log;}
+uint32_t datalog_stack_space() {return osThreadGetStackSpace(datalog_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void datalog_thread(void* argument) {
+	datalog_item_t item;
+
+	while(1) {
+		//only time out if there's something sitting in the page
+		uint32_t timeout = page_used ? DATALOG_FLUSH_TIME : osWaitForever;
+
+		if(osMessageQueueGet(datalog_buf, &item, NULL, timeout) != osOK) write_page();
+		else if(item.type != DATALOG_FLUSH) {
+			if(shedding && sheddable(item.type)) stats.shed++; //queued before the page that got us to the reserve
+			else add_record(item.type, item.data, item.len);
+		}
+
+		//the black box jumps the queue, it's what led up to whatever just went wrong
+		if(blackbox_frozen(NULL) != BLACKBOX_NONE) write_blackbox();
+
+		if(rotate_due && erase_allowed) start_fresh_sector();
+
+		//flush once everything queued ahead of the request is in the page
+		if(flush_requested && osMessageQueueGetCount(datalog_buf) == 0) {
+			flush_requested = false;
+			write_page();
+			flushes++;
+			shutdown_done(datalog_shutdown_id);
+		}
+	}
+
+	osThreadExit();
+}
+
+static void add_record(uint8_t type, const void* data, uint8_t len) {
+	//records don't span pages, so write this one out and start the next
+	if(page_used == 0) start_page();
+	if(!flash_log_record_put(page, &page_used, type, data, len)) {
+		write_page();
+		start_page();
+		flash_log_record_put(page, &page_used, type, data, len);
+	}
+	page_records++;
+}
+
+//every page starts with its index entry
+static void start_page() {
+	log_page_info_t info = {.ride = ride, .tick = HAL_GetTick(), .records_before = sector_records};
+	flash_log_record_put(page, &page_used, DATALOG_PAGE_INFO, &info, sizeof(info));
+}
+
+static void write_page() {
+	log_page_info_t info;
+	if(page_used == 0) return;
+
+	flash_log_status_t status = flash_log_append_page(&ride_log, page, page_used);
+
+	//the sector filled up; we can only move on if the next one is already blank (no erasing while running)
+	if(status == FLASH_LOG_FULL && flash_log_rotate(&ride_log, false) == FLASH_LOG_OK) {
+		//first page of the new sector, fix up the count in the page info (always the first record)
+		sector_records = 0;
+		log_page_info(page, page_used, &info);
+		info.records_before = 0;
+		memcpy(&page[FLASH_LOG_RECORD_HEADER], &info, sizeof(info));
+
+		status = flash_log_append_page(&ride_log, page, page_used);
+	}
+
+	if(status == FLASH_LOG_OK) {
+		stats.records += page_records;
+		stats.pages++;
+
+		log_page_info(page, page_used, &info);
+		sector_records = info.records_before + page_records;
+
+		int32_t lock = osKernelLock(); //datalog_retrieve() takes a snapshot of the index
+		log_index_page_written(&ride_index, &ride_log, &info, page_records);
+		osKernelRestoreLock(lock);
+	}
+	else {
+		stats.dropped += page_records;
+		if(status == FLASH_LOG_ERROR) stats.page_errors++;
+	}
+
+	page_used = 0;
+	page_records = 0;
+	update_shedding();
+}
+
+static void write_blackbox() {
+	blackbox_entry_t entries[DATALOG_BLACKBOX_PER_RECORD];
+	uint32_t tick;
+	uint8_t reason = blackbox_frozen(&tick);
+	datalog_blackbox_head_t head = {.tick = tick, .count = blackbox_count(), .reason = reason};
+
+	//straight into pages from here, no need to fit through the queue
+	add_record(DATALOG_BLACKBOX_HEAD, &head, sizeof(head));
+	for(uint16_t i = 0; i < head.count; i += DATALOG_BLACKBOX_PER_RECORD) {
+		uint16_t n = blackbox_read(i, entries, DATALOG_BLACKBOX_PER_RECORD);
+		add_record(DATALOG_BLACKBOX, entries, n * sizeof(blackbox_entry_t));
+	}
+	write_page();
+
+	stats.blackbox_dumps++;
+	blackbox_release();
+}
+
+//the erase stalls the whole CPU for 1-2s (we run out of the same flash bank), wherever it's called from
+static void start_fresh_sector() {
+	rotate_due = false;
+	write_page(); //what came before the latch stays in the old sector
+
+	flash_log_status_t status = flash_log_rotate(&ride_log, true);
+	if(status != FLASH_LOG_OK) {
+		printf("datalog: couldn't start a fresh sector (%d)\r\n", status);
+		return; //carry on in what's left of this one
+	}
+	sector_records = 0;
+	update_shedding();
+
+	//whatever the index had for the sector is gone with the erase
+	int32_t lock = osKernelLock();
+	memset(&ride_index.sector[ride_log.active], 0, sizeof(log_sector_index_t));
+	osKernelRestoreLock(lock);
+	printf("datalog: erased sector %u for this ride (%lu erases)\r\n", ride_log.active, ride_log.erase_count[ride_log.active]);
+}
+
+//only counts the active sector: the other one holds the rides before (it's only blank on a brand new log, where the
+//first ride just starts shedding a sector early)
+static void update_shedding() {
+	bool was = shedding;
+	shedding = flash_log_free_pages(&ride_log) <= DATALOG_RESERVE_PAGES;
+	if(shedding && !was) printf("datalog: %u pages left, only keeping black box and end of ride records\r\n",
+			flash_log_free_pages(&ride_log));
+}
+
+static bool sheddable(uint8_t type) {
+	return type == DATALOG_TELEMETRY || type == DATALOG_CPU_STATS || type == DATALOG_STACK;
+}
+
+static void write_telem_block(const uint8_t* block, uint8_t len) {
+	stats.telem_bytes += len;
+	if(!datalog_write(DATALOG_TELEMETRY, block, len)) telem_encoder_resync(&telem); //decoder needs a keyframe after the gap
+}
+
+static void datalog_shutdown() {
+	//the encoder belongs to the monitor thread, so have it flush on its next sample
+	if(telem_running) telem_flush_requested = true;
+	else datalog_flush();
+}
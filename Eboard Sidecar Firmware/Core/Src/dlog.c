@@ -0,0 +1,88 @@
+#include "dlog.h"
+#include "rtos_objects.h"
+#include "usbd_cdc_if.h"
+#include "protocol.h"
+#include "string.h"
+
+_Static_assert((DLOG_WORDS & (DLOG_WORDS - 1)) == 0, "DLOG_WORDS must be a power of 2");
+
+//===================== PUBLIC VARIABLES (for the inline writer) =====================
+dlog_ring_t dlog_ring;
+
+//===================== PRIVATE VARIABLES =====================
+static osThreadId_t dlog_handle = NULL;
+static dlog_stats_t stats;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void run_dlog(void* argument);
+static void send_frame(const uint8_t* frame, uint16_t len, void* ctx);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void dlog_init() {
+	const osThreadAttr_t dlog_attributes = RTOS_THREAD_ATTR(dlog, "dlog", osPriorityBelowNormal);
+	dlog_handle = osThreadNew(run_dlog, NULL, &dlog_attributes);
+}
+
+void dlog_get_stats(dlog_stats_t* out) {
+	*out = stats;
+	out->dropped = dlog_ring.dropped;
+}
+
+uint32_t dlog_stack_space() {return osThreadGetStackSpace(dlog_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void run_dlog(void* argument) {
+	uint32_t batch[PROTO_MAX_REPLY_DATA / sizeof(uint32_t)];
+	uint32_t reported_drops = 0;
+	proto_reply_t reply = {.cmd = PROTO_DLOG, .seq = 0, .send = send_frame};
+
+	while(1) {
+		osDelay(DLOG_FLUSH_TIME);
+
+		//say so (through the ring itself) when messages were lost
+		uint32_t drops = dlog_ring.dropped;
+		if(drops != reported_drops) {
+			DLOG1(DLOG_DROPPED, drops - reported_drops);
+			reported_drops = drops;
+		}
+
+		//pack whole records into frames until the ring is empty or a writer is still mid-record
+		//only while USB has room for a whole frame; whatever is left waits for the next pass
+		while(CDC_Tx_Space() >= PROTO_MAX_FRAME) {
+			uint32_t words = 0, records = 0;
+			uint32_t tail = dlog_ring.tail;
+
+			while(tail != dlog_ring.head) {
+				uint32_t header = __atomic_load_n(&dlog_ring.words[tail & (DLOG_WORDS - 1)], __ATOMIC_ACQUIRE);
+				if(!DLOG_HEADER_VALID(header)) break; //claimed but not written yet
+				uint32_t len = DLOG_HEADER_NARGS(header) + 2;
+				if(words + len > sizeof(batch) / sizeof(batch[0])) break;
+
+				for(uint32_t i = 0; i < len; i++) {
+					batch[words++] = dlog_ring.words[(tail + i) & (DLOG_WORDS - 1)];
+					dlog_ring.words[(tail + i) & (DLOG_WORDS - 1)] = 0; //so the next lap's header reads as unwritten
+				}
+				tail += len;
+				records++;
+			}
+
+			if(words == 0) break;
+			dlog_ring.tail = tail;
+			bool sent = true;
+			reply.ctx = &sent;
+			proto_reply(&reply, PROTO_MORE, batch, words * sizeof(uint32_t));
+			if(sent) {
+				stats.records += records;
+				stats.frames++;
+			}
+			else __atomic_fetch_add(&dlog_ring.dropped, records, __ATOMIC_RELAXED); //reported next pass like any other
+		}
+	}
+
+	osThreadExit();
+}
+
+//the whole frame or none of it; the room checked above can be taken by another writer before we get here
+static void send_frame(const uint8_t* frame, uint16_t len, void* ctx) {
+	if(!CDC_Write_All(frame, len)) *(bool*)ctx = false;
+}
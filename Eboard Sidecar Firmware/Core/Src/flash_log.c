@@ -0,0 +1,259 @@
+#include "flash_log.h"
+#include "checksum.h"
+#include "string.h"
+#include "stddef.h"
+
+//======================= on-flash layouts ======================
+typedef struct {
+	uint32_t magic;
+	uint32_t seq; //sector generation, higher is newer
+	uint32_t erase_count;
+	uint32_t crc; //crc32 over the fields above
+} sector_header_t;
+
+typedef struct {
+	uint16_t len;
+	uint16_t crc; //crc16 over seq and the payload
+	uint32_t seq; //programmed last; marks the page as written
+} page_header_t;
+
+#define BLANK_CHUNK 32 //bytes read at a time when checking for erased flash
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static uint32_t page_offset(const flash_log_t* log, uint8_t sector, uint16_t page);
+static bool is_blank(const flash_log_t* log, uint32_t offset, uint32_t len);
+static bool page_written(const flash_log_t* log, uint8_t sector, uint16_t page);
+static uint16_t page_crc(uint32_t seq, const void* payload, uint16_t len);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+flash_log_status_t flash_log_mount(flash_log_t* log, const flash_dev_t* dev) {
+	memset(log, 0, sizeof(flash_log_t));
+	log->dev = dev;
+	log->active = FLASH_LOG_NO_SECTOR;
+	log->pages_per_sector = dev->sector_size / FLASH_LOG_PAGE_SIZE;
+
+	if(dev->num_sectors < 2 || dev->num_sectors > FLASH_LOG_MAX_SECTORS || log->pages_per_sector < 2) return FLASH_LOG_ERROR;
+
+	//the newest sector with a good header is where we pick up from
+	uint32_t newest = 0;
+	for(uint8_t s = 0; s < dev->num_sectors; s++) {
+		sector_header_t h;
+		dev->read(dev, page_offset(log, s, 0), &h, sizeof(h));
+		if(h.magic != FLASH_LOG_MAGIC || h.crc != crc32_update(CRC32_INIT, &h, offsetof(sector_header_t, crc))) continue;
+
+		log->sector_seq[s] = h.seq;
+		log->erase_count[s] = h.erase_count;
+		if(h.seq > newest) {
+			newest = h.seq;
+			log->active = s;
+		}
+	}
+
+	//nothing there yet, start the first sector
+	if(log->active == FLASH_LOG_NO_SECTOR) return flash_log_rotate(log, true);
+
+	log->next_page = flash_log_sector_end(log, log->active);
+
+	//power was cut partway through this page; close it off so nobody tries to use it
+	if(log->next_page < log->pages_per_sector &&
+			!is_blank(log, page_offset(log, log->active, log->next_page), FLASH_LOG_PAGE_SIZE)) {
+		uint32_t dead = 0;
+		dev->program(dev, page_offset(log, log->active, log->next_page) + offsetof(page_header_t, seq), &dead, sizeof(dead));
+		log->next_page++;
+		log->torn_pages++;
+	}
+
+	return FLASH_LOG_OK;
+}
+
+flash_log_status_t flash_log_append_page(flash_log_t* log, const void* payload, uint16_t len) {
+	const flash_dev_t* dev = log->dev;
+	if(log->active == FLASH_LOG_NO_SECTOR || len > FLASH_LOG_PAGE_PAYLOAD) return FLASH_LOG_ERROR;
+	if(log->next_page >= log->pages_per_sector) return FLASH_LOG_FULL;
+
+	uint32_t offset = page_offset(log, log->active, log->next_page);
+	page_header_t h = {
+		.len = len,
+		.seq = log->sector_seq[log->active] * log->pages_per_sector + log->next_page,
+	};
+	h.crc = page_crc(h.seq, payload, len);
+
+	//programming is in words, so pad the tail out with erased bytes
+	uint32_t buf[FLASH_LOG_PAGE_PAYLOAD / 4];
+	uint16_t padded = (len + 3) & ~3u;
+	memset(buf, 0xFF, padded);
+	memcpy(buf, payload, len);
+
+	//skip past this page whatever happens so a bad page doesn't wedge the log
+	log->next_page++;
+
+	//payload, then length/crc, then seq last to commit the page
+	if(!dev->program(dev, offset + FLASH_LOG_PAGE_HEADER, buf, padded)) return FLASH_LOG_ERROR;
+	if(!dev->program(dev, offset, &h, offsetof(page_header_t, seq))) return FLASH_LOG_ERROR;
+	if(!dev->program(dev, offset + offsetof(page_header_t, seq), &h.seq, sizeof(h.seq))) return FLASH_LOG_ERROR;
+
+	return FLASH_LOG_OK;
+}
+
+flash_log_status_t flash_log_rotate(flash_log_t* log, bool allow_erase) {
+	const flash_dev_t* dev = log->dev;
+	uint8_t target = FLASH_LOG_NO_SECTOR;
+	uint32_t newest = 0, most_worn = 0;
+
+	//sectors without a valid header go first, then the oldest one
+	for(uint8_t s = 0; s < dev->num_sectors; s++) {
+		if(log->sector_seq[s] > newest) newest = log->sector_seq[s];
+		if(log->erase_count[s] > most_worn) most_worn = log->erase_count[s];
+		if(s == log->active) continue;
+		if(target == FLASH_LOG_NO_SECTOR || log->sector_seq[s] < log->sector_seq[target]) target = s;
+	}
+
+	//a sector that's already blank doesn't need erasing (e.g. fresh out of the programmer)
+	uint32_t erase_count = log->sector_seq[target] ? log->erase_count[target] : most_worn; //best guess if the header was lost
+	if(!is_blank(log, page_offset(log, target, 0), dev->sector_size)) {
+		if(!allow_erase) return FLASH_LOG_FULL;
+		if(!dev->erase(dev, target)) return FLASH_LOG_ERROR;
+		erase_count++;
+	}
+
+	sector_header_t h = {
+		.magic = FLASH_LOG_MAGIC,
+		.seq = newest + 1,
+		.erase_count = erase_count,
+	};
+	h.crc = crc32_update(CRC32_INIT, &h, offsetof(sector_header_t, crc));
+	if(!dev->program(dev, page_offset(log, target, 0), &h, sizeof(h))) return FLASH_LOG_ERROR;
+
+	log->sector_seq[target] = h.seq;
+	log->erase_count[target] = erase_count;
+	log->active = target;
+	log->next_page = 1;
+	return FLASH_LOG_OK;
+}
+
+uint32_t flash_log_free_pages(const flash_log_t* log) {
+	if(log->active == FLASH_LOG_NO_SECTOR) return 0;
+	return log->pages_per_sector - log->next_page;
+}
+
+void flash_log_rewind(const flash_log_t* log, flash_log_cursor_t* cursor) {
+	cursor->order = 0;
+	cursor->page = 1;
+}
+
+flash_log_status_t flash_log_read_next(const flash_log_t* log, flash_log_cursor_t* cursor, void* payload, uint16_t* len, uint32_t* seq) {
+	while(true) {
+		uint8_t s = flash_log_sector_by_age(log, cursor->order);
+		if(s == FLASH_LOG_NO_SECTOR) return FLASH_LOG_EMPTY;
+
+		uint16_t end = (s == log->active) ? log->next_page : log->pages_per_sector;
+		if(cursor->page >= end) {
+			cursor->order++;
+			cursor->page = 1;
+			continue;
+		}
+
+		flash_log_status_t status = flash_log_read_page(log, s, cursor->page, payload, len, seq);
+
+		//an unwritten page in an old sector means it was rotated early; move on to the next one
+		if(status == FLASH_LOG_EMPTY) {
+			cursor->order++;
+			cursor->page = 1;
+			continue;
+		}
+		cursor->page++;
+
+		//closed-off or corrupted pages are skipped
+		if(status == FLASH_LOG_OK) return FLASH_LOG_OK;
+	}
+}
+
+flash_log_status_t flash_log_read_page(const flash_log_t* log, uint8_t sector, uint16_t page, void* payload, uint16_t* len, uint32_t* seq) {
+	const flash_dev_t* dev = log->dev;
+	page_header_t h;
+	uint32_t offset = page_offset(log, sector, page);
+
+	if(sector >= dev->num_sectors || page == 0 || page >= log->pages_per_sector) return FLASH_LOG_ERROR;
+
+	dev->read(dev, offset, &h, sizeof(h));
+	if(h.seq == FLASH_LOG_ERASED) return FLASH_LOG_EMPTY;
+	if(h.seq == 0 || h.len > FLASH_LOG_PAGE_PAYLOAD) return FLASH_LOG_ERROR;
+
+	dev->read(dev, offset + FLASH_LOG_PAGE_HEADER, payload, h.len);
+	if(page_crc(h.seq, payload, h.len) != h.crc) return FLASH_LOG_ERROR;
+
+	*len = h.len;
+	if(seq) *seq = h.seq;
+	return FLASH_LOG_OK;
+}
+
+uint16_t flash_log_sector_end(const flash_log_t* log, uint8_t sector) {
+	//pages are written in order, so binary search for the first one without its seq programmed
+	uint16_t lo = 1, hi = log->pages_per_sector;
+	while(lo < hi) {
+		uint16_t mid = lo + (hi - lo) / 2;
+		if(page_written(log, sector, mid)) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+uint8_t flash_log_sector_by_age(const flash_log_t* log, uint8_t order) {
+	//at most FLASH_LOG_MAX_SECTORS, so just count how many valid sectors are older than each one
+	for(uint8_t s = 0; s < log->dev->num_sectors; s++) {
+		if(log->sector_seq[s] == 0) continue;
+		uint8_t older = 0;
+		for(uint8_t t = 0; t < log->dev->num_sectors; t++) {
+			if(log->sector_seq[t] != 0 && log->sector_seq[t] < log->sector_seq[s]) older++;
+		}
+		if(older == order) return s;
+	}
+	return FLASH_LOG_NO_SECTOR;
+}
+
+bool flash_log_record_put(uint8_t* page, uint16_t* used, uint8_t type, const void* data, uint8_t len) {
+	if(type == 0 || *used + FLASH_LOG_RECORD_HEADER + len > FLASH_LOG_PAGE_PAYLOAD) return false;
+	page[*used] = type;
+	page[*used + 1] = len;
+	memcpy(&page[*used + FLASH_LOG_RECORD_HEADER], data, len);
+	*used += FLASH_LOG_RECORD_HEADER + len;
+	return true;
+}
+
+bool flash_log_record_next(const uint8_t* page, uint16_t page_len, uint16_t* offset, uint8_t* type, const uint8_t** data, uint8_t* len) {
+	if(*offset + FLASH_LOG_RECORD_HEADER > page_len || page[*offset] == 0) return false;
+	if(*offset + FLASH_LOG_RECORD_HEADER + page[*offset + 1] > page_len) return false;
+
+	*type = page[*offset];
+	*len = page[*offset + 1];
+	*data = &page[*offset + FLASH_LOG_RECORD_HEADER];
+	*offset += FLASH_LOG_RECORD_HEADER + *len;
+	return true;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static uint32_t page_offset(const flash_log_t* log, uint8_t sector, uint16_t page) {
+	return sector * log->dev->sector_size + page * FLASH_LOG_PAGE_SIZE;
+}
+
+static bool is_blank(const flash_log_t* log, uint32_t offset, uint32_t len) {
+	uint32_t chunk[BLANK_CHUNK / 4];
+	for(uint32_t i = 0; i < len; i += BLANK_CHUNK) {
+		log->dev->read(log->dev, offset + i, chunk, BLANK_CHUNK);
+		for(int j = 0; j < BLANK_CHUNK / 4; j++) {
+			if(chunk[j] != FLASH_LOG_ERASED) return false;
+		}
+	}
+	return true;
+}
+
+static bool page_written(const flash_log_t* log, uint8_t sector, uint16_t page) {
+	uint32_t seq;
+	log->dev->read(log->dev, page_offset(log, sector, page) + offsetof(page_header_t, seq), &seq, sizeof(seq));
+	return seq != FLASH_LOG_ERASED;
+}
+
+static uint16_t page_crc(uint32_t seq, const void* payload, uint16_t len) {
+	uint16_t crc = crc16_ccitt(CRC16_INIT, &seq, sizeof(seq));
+	return crc16_ccitt(crc, payload, len);
+}
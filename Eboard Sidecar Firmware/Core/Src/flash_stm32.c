@@ -0,0 +1,84 @@
+#include "flash_stm32.h"
+#include "stm32f4xx_hal.h"
+#include "cmsis_os.h"
+#include "datalog.h"
+#include "config.h"
+#include "string.h"
+
+//where each region lives
+typedef struct {
+	uint32_t base;
+	uint32_t first_sector;
+} region_t;
+
+static const region_t datalog_region = {.base = DATALOG_FLASH_BASE, .first_sector = DATALOG_FIRST_SECTOR};
+static const region_t config_region = {.base = CONFIG_FLASH_BASE, .first_sector = CONFIG_FIRST_SECTOR};
+
+_Static_assert(CONFIG_FIRST_SECTOR == FLASH_SECTOR_1, "config store has to start at sector 1");
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static bool stm32_erase(const flash_dev_t* dev, uint8_t sector);
+static bool stm32_program(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len);
+static void stm32_read(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len);
+
+//===================== PUBLIC VARIABLES =====================
+const flash_dev_t flash_stm32_datalog = {
+	.ctx = (void*)&datalog_region,
+	.sector_size = DATALOG_SECTOR_SIZE,
+	.num_sectors = DATALOG_NUM_SECTORS,
+	.erase = stm32_erase,
+	.program = stm32_program,
+	.read = stm32_read,
+};
+
+const flash_dev_t flash_stm32_config = {
+	.ctx = (void*)&config_region,
+	.sector_size = CONFIG_SECTOR_SIZE,
+	.num_sectors = CONFIG_NUM_SECTORS,
+	.erase = stm32_erase,
+	.program = stm32_program,
+	.read = stm32_read,
+};
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static bool stm32_erase(const flash_dev_t* dev, uint8_t sector) {
+	const region_t* region = (const region_t*)dev->ctx;
+	FLASH_EraseInitTypeDef erase = {
+		.TypeErase = FLASH_TYPEERASE_SECTORS,
+		.Sector = region->first_sector + sector,
+		.NbSectors = 1,
+		.VoltageRange = FLASH_VOLTAGE_RANGE_3,
+	};
+	uint32_t bad_sector;
+
+	int32_t lock = osKernelLock();
+	HAL_FLASH_Unlock();
+	HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase, &bad_sector);
+	HAL_FLASH_Lock();
+	osKernelRestoreLock(lock);
+	return status == HAL_OK;
+}
+
+static bool stm32_program(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len) {
+	const region_t* region = (const region_t*)dev->ctx;
+	const uint8_t* src = (const uint8_t*)data;
+	HAL_StatusTypeDef status = HAL_OK;
+
+	//a word at a time, so other threads still get to run during a long program
+	for(uint32_t i = 0; i < len && status == HAL_OK; i += 4) {
+		uint32_t word;
+		memcpy(&word, src + i, sizeof(word)); //data isn't necessarily aligned
+
+		int32_t lock = osKernelLock();
+		HAL_FLASH_Unlock();
+		status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, region->base + offset + i, word);
+		HAL_FLASH_Lock();
+		osKernelRestoreLock(lock);
+	}
+	return status == HAL_OK;
+}
+
+static void stm32_read(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len) {
+	const region_t* region = (const region_t*)dev->ctx;
+	memcpy(data, (const void*)(uintptr_t)(region->base + offset), len); //memory mapped
+}
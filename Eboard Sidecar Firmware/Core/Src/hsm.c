@@ -0,0 +1,121 @@
+#include "hsm.h"
+#include "stddef.h"
+
+//====================== PRIVATE FUNCTION PROTOTYPES ======================
+//walk up the tree from a state and record the path (leaf first), returns the depth
+static uint8_t hsm_path(const hsm_def_t* def, hsm_state_t state, hsm_state_t* path);
+
+//exit the current state up to (not including) the common ancestor, then enter down to the target
+static void hsm_transition(hsm_t* sm, hsm_state_t target, hsm_action_t action);
+
+//====================== PUBLIC FUNCTIONS =========================
+void hsm_init(hsm_t* sm, const hsm_def_t* def, hsm_state_t initial, uint32_t now, hsm_trace_t trace) {
+	hsm_state_t path[HSM_MAX_DEPTH];
+	uint8_t depth = hsm_path(def, initial, path);
+
+	sm->def = def;
+	sm->current = initial;
+	sm->now = now;
+	sm->entered_at = now;
+	sm->trace = trace;
+
+	if(sm->trace) sm->trace(sm, HSM_ROOT, initial, def->num_events); //no event caused this one
+
+	//enter from the outermost state in
+	for(int i = depth - 1; i >= 0; i--) {
+		if(def->states[path[i]].on_entry) def->states[path[i]].on_entry();
+	}
+}
+
+bool hsm_dispatch(hsm_t* sm, hsm_event_t event, uint32_t now) {
+	const hsm_def_t* def = sm->def;
+	hsm_state_t state = sm->current;
+	sm->now = now;
+
+	if(event >= def->num_events) return false;
+
+	//check the current state's row first, then bubble the event up through the parents
+	//bounded by HSM_MAX_DEPTH so this is constant time per event
+	for(int level = 0; level < HSM_MAX_DEPTH && state != HSM_ROOT; level++) {
+		const hsm_transition_t* t = &def->transitions[state * def->num_events + event];
+
+		hsm_state_t target = t->target;
+		hsm_action_t action = t->action;
+
+		//if the guard fails, take the alternate branch (with no action) if there is one
+		if(target != HSM_UNHANDLED && t->guard != NULL && !t->guard(sm)) {
+			target = t->guard_fail_target;
+			action = NULL;
+		}
+
+		if(target != HSM_UNHANDLED) {
+			if(target == HSM_INTERNAL) {
+				if(action) action();
+			}
+			else {
+				if(sm->trace) sm->trace(sm, sm->current, target, event);
+				hsm_transition(sm, target, action);
+			}
+			return true;
+		}
+
+		state = def->states[state].parent;
+	}
+
+	return false; //nobody cared about the event
+}
+
+bool hsm_in_state(const hsm_t* sm, hsm_state_t state) {
+	hsm_state_t s = sm->current;
+	for(int i = 0; i < HSM_MAX_DEPTH && s != HSM_ROOT; i++) {
+		if(s == state) return true;
+		s = sm->def->states[s].parent;
+	}
+	return false;
+}
+
+uint32_t hsm_time_in_state(const hsm_t* sm) {
+	return sm->now - sm->entered_at;
+}
+
+//===================== PRIVATE FUNCTION DEFINITIONS ====================
+static uint8_t hsm_path(const hsm_def_t* def, hsm_state_t state, hsm_state_t* path) {
+	uint8_t depth = 0;
+	while(state != HSM_ROOT && depth < HSM_MAX_DEPTH) {
+		path[depth++] = state;
+		state = def->states[state].parent;
+	}
+	return depth;
+}
+
+static void hsm_transition(hsm_t* sm, hsm_state_t target, hsm_action_t action) {
+	const hsm_def_t* def = sm->def;
+	hsm_state_t src_path[HSM_MAX_DEPTH], dst_path[HSM_MAX_DEPTH];
+	uint8_t src_depth = hsm_path(def, sm->current, src_path);
+	uint8_t dst_depth = hsm_path(def, target, dst_path);
+
+	//strip off the ancestors both paths share (compared from the root down)
+	//a self transition always exits and re-enters the state
+	uint8_t common = 0;
+	while(common < src_depth && common < dst_depth &&
+			src_path[src_depth - 1 - common] == dst_path[dst_depth - 1 - common]) {
+		common++;
+	}
+	if(sm->current == target && common > 0) common--;
+
+	//exit from the leaf up
+	for(int i = 0; i < src_depth - common; i++) {
+		if(def->states[src_path[i]].on_exit) def->states[src_path[i]].on_exit();
+	}
+
+	if(action) action();
+
+	//update the bookkeeping before the entry actions in case they never return
+	sm->current = target;
+	sm->entered_at = sm->now;
+
+	//enter from the outermost new state in
+	for(int i = dst_depth - common - 1; i >= 0; i--) {
+		if(def->states[dst_path[i]].on_entry) def->states[dst_path[i]].on_entry();
+	}
+}
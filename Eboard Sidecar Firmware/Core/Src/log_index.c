@@ -0,0 +1,139 @@
+#include "log_index.h"
+#include "string.h"
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+//key of the first good page at or after this one (torn pages take their neighbour's key)
+//returns false if there isn't one before the end
+static bool page_key(const flash_log_t* log, uint8_t sector, uint16_t page, uint16_t end, log_key_t* key, log_page_info_t* info, uint16_t* records);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void log_index_build(log_index_t* idx, const flash_log_t* log) {
+	memset(idx, 0, sizeof(log_index_t));
+
+	for(uint8_t s = 0; s < log->dev->num_sectors; s++) {
+		log_sector_index_t* entry = &idx->sector[s];
+		if(log->sector_seq[s] == 0) continue;
+
+		entry->end = (s == log->active) ? log->next_page : flash_log_sector_end(log, s);
+		if(!page_key(log, s, 1, entry->end, &entry->first, NULL, NULL)) continue;
+
+		//the last page (or the last good one, there's at most one torn page at the end)
+		for(uint16_t p = entry->end - 1; p >= 1; p--) {
+			log_page_info_t info;
+			uint16_t records;
+			if(page_key(log, s, p, p + 1, &entry->last, &info, &records)) {
+				entry->records = info.records_before + records;
+				entry->used = true;
+				break;
+			}
+		}
+	}
+}
+
+void log_index_page_written(log_index_t* idx, const flash_log_t* log, const log_page_info_t* info, uint16_t records) {
+	log_sector_index_t* entry = &idx->sector[log->active];
+	log_key_t key = {.ride = info->ride, .tick = info->tick};
+
+	//first page in a freshly rotated sector, forget what used to be there
+	if(!entry->used || log->next_page == 2) {
+		memset(entry, 0, sizeof(log_sector_index_t));
+		entry->first = key;
+		entry->used = true;
+	}
+	entry->last = key;
+	entry->records = info->records_before + records;
+	entry->end = log->next_page;
+}
+
+bool log_index_seek(const log_index_t* idx, const flash_log_t* log, log_key_t key, flash_log_cursor_t* cursor) {
+	uint8_t order = 0, found = FLASH_LOG_NO_SECTOR, found_order = 0;
+	uint8_t oldest = FLASH_LOG_NO_SECTOR;
+
+	//sectors are in key order oldest to newest; take the last one that starts at or before the key
+	for(uint8_t s; (s = flash_log_sector_by_age(log, order)) != FLASH_LOG_NO_SECTOR; order++) {
+		if(!idx->sector[s].used) continue;
+		if(oldest == FLASH_LOG_NO_SECTOR) oldest = order;
+		if(log_key_cmp(idx->sector[s].first, key) <= 0) {
+			found = s;
+			found_order = order;
+		}
+	}
+	if(oldest == FLASH_LOG_NO_SECTOR) return false;
+
+	//before anything in the log, start right at the beginning
+	if(found == FLASH_LOG_NO_SECTOR) {
+		cursor->order = oldest;
+		cursor->page = 1;
+		return true;
+	}
+
+	//then the last page in that sector that starts at or before the key
+	const log_sector_index_t* entry = &idx->sector[found];
+	uint16_t lo = 1, hi = entry->end - 1;
+	while(lo < hi) {
+		uint16_t mid = lo + (hi - lo + 1) / 2;
+		log_key_t k;
+		if(page_key(log, found, mid, entry->end, &k, NULL, NULL) && log_key_cmp(k, key) <= 0) lo = mid;
+		else hi = mid - 1;
+	}
+
+	cursor->order = found_order;
+	cursor->page = lo;
+	return true;
+}
+
+bool log_index_last_ride(const log_index_t* idx, const flash_log_t* log, uint16_t* ride) {
+	bool any = false;
+	for(uint8_t s = 0; s < log->dev->num_sectors; s++) {
+		if(!idx->sector[s].used) continue;
+		if(!any || idx->sector[s].last.ride > *ride) *ride = idx->sector[s].last.ride;
+		any = true;
+	}
+	return any;
+}
+
+bool log_page_info(const uint8_t* page, uint16_t len, log_page_info_t* info) {
+	uint16_t offset = 0;
+	uint8_t type, rlen;
+	const uint8_t* data;
+
+	if(!flash_log_record_next(page, len, &offset, &type, &data, &rlen)) return false;
+	if(type != LOG_PAGE_INFO || rlen != sizeof(log_page_info_t)) return false;
+	memcpy(info, data, sizeof(log_page_info_t));
+	return true;
+}
+
+int log_key_cmp(log_key_t a, log_key_t b) {
+	if(a.ride != b.ride) return a.ride < b.ride ? -1 : 1;
+	if(a.tick != b.tick) return a.tick < b.tick ? -1 : 1;
+	return 0;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static bool page_key(const flash_log_t* log, uint8_t sector, uint16_t page, uint16_t end, log_key_t* key, log_page_info_t* info, uint16_t* records) {
+	uint8_t buf[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t len;
+	log_page_info_t pi;
+
+	for(; page < end; page++) {
+		if(flash_log_read_page(log, sector, page, buf, &len, NULL) != FLASH_LOG_OK) continue;
+		if(!log_page_info(buf, len, &pi)) continue;
+
+		key->ride = pi.ride;
+		key->tick = pi.tick;
+		if(info) *info = pi;
+
+		//count the records after the page info
+		if(records) {
+			uint16_t offset = 0;
+			uint8_t type, rlen;
+			const uint8_t* data;
+			*records = 0;
+			while(flash_log_record_next(buf, len, &offset, &type, &data, &rlen)) {
+				if(type != LOG_PAGE_INFO) (*records)++;
+			}
+		}
+		return true;
+	}
+	return false;
+}
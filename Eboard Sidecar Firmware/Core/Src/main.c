@@ -26,6 +26,7 @@
 /* USER CODE BEGIN Includes */
 #include "state_machine.h"
 #include "usbd_cdc_if.h"
+#include "rtos_objects.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -51,14 +52,11 @@ TIM_HandleTypeDef htim3;
 TIM_HandleTypeDef htim4;
 TIM_HandleTypeDef htim5;
 
-/* Definitions for state_machine */
-osThreadId_t state_machineHandle;
-const osThreadAttr_t state_machine_attributes = {
-  .name = "state_machine",
-  .priority = (osPriority_t) osPriorityLow,
-  .stack_size = 512 * 4
-};
 /* USER CODE BEGIN PV */
+//state machine thread is created here rather than by CubeMX so it can use the static storage in rtos_objects.c
+osThreadId_t state_machineHandle;
+const osThreadAttr_t state_machine_attributes = RTOS_THREAD_ATTR(state_machine, "state_machine", osPriorityLow);
+
 //starting timer for HAL tick functions
 //weird that this doesn't get thrown in by default
 extern TIM_HandleTypeDef htim11;
@@ -74,9 +72,9 @@ static void MX_TIM5_Init(void);
 static void MX_ADC1_Init(void);
 static void MX_TIM3_Init(void);
 static void MX_TIM4_Init(void);
-void doStateMachine(void *argument);
 
 /* USER CODE BEGIN PFP */
+void doStateMachine(void *argument);
 
 /* USER CODE END PFP */
 
@@ -143,12 +141,9 @@ int main(void)
   /* add queues, ... */
   /* USER CODE END RTOS_QUEUES */
 
-  /* Create the thread(s) */
-  /* creation of state_machine */
-  state_machineHandle = osThreadNew(doStateMachine, NULL, &state_machine_attributes);
-
   /* USER CODE BEGIN RTOS_THREADS */
   /* add threads, ... */
+  state_machineHandle = osThreadNew(doStateMachine, NULL, &state_machine_attributes);
   /* USER CODE END RTOS_THREADS */
 
   /* Start scheduler */
@@ -0,0 +1,66 @@
+#include "power_fsm.h"
+#include "stddef.h"
+
+//====================== GUARDS ======================
+static bool bus_good(const hsm_t* sm) { return power_bus_ok(); }
+static bool fault_timed_out(const hsm_t* sm) { return hsm_time_in_state(sm) >= POWER_FAULT_SHUTDOWN_DELAY; }
+
+//====================== TABLES ======================
+static const hsm_state_def_t power_states[PWR_NUM_STATES] = {
+	[PWR_PRECHARGE] = 			{.name = "precharge", .parent = HSM_ROOT, .on_entry = power_on_precharge},
+	[PWR_POWERED] = 			{.name = "powered", .parent = HSM_ROOT, .on_entry = power_on_latch},
+	[PWR_RUNNING] = 			{.name = "running", .parent = PWR_POWERED},
+	[PWR_SHUTDOWN_PENDING] = 	{.name = "shutdown pending", .parent = PWR_POWERED, .on_entry = power_on_fault},
+	[PWR_SHUTDOWN] = 			{.name = "shutdown", .parent = HSM_ROOT, .on_entry = power_on_shutdown},
+};
+
+//anything left out is unhandled and bubbles up to the parent state
+static const hsm_transition_t power_transitions[PWR_NUM_STATES][PWR_NUM_EVENTS] = {
+	//precharge until the bus has settled, which already means it's above the minimum; the long press
+	//(CONFIG_BUTTON_LONG_MS) is the fallback if it never does, and only latches power if the bus voltage is sane
+	[PWR_PRECHARGE] = {
+		[PWR_EV_PRECHARGED] = {.target = PWR_RUNNING},
+		[PWR_EV_BUTTON_LONG] = {.target = PWR_RUNNING, .guard = bus_good, .guard_fail_target = PWR_SHUTDOWN},
+	},
+
+	//button handling is the same whether or not a shutdown is pending
+	[PWR_POWERED] = {
+		[PWR_EV_BUTTON_BUMPED] = {.target = HSM_INTERNAL, .action = power_on_bump}, //report SOC on short button press
+		[PWR_EV_BUTTON_SHORT] = {.target = HSM_INTERNAL, .action = power_on_hold}, //alert the user that a continued hold will shut down the board
+		[PWR_EV_BUTTON_LONG] = {.target = PWR_SHUTDOWN}, //shutdown the board on long-press
+		[PWR_EV_BUTTON_RELEASED] = {.target = HSM_INTERNAL, .action = power_on_release},
+		[PWR_EV_SOC_LOW] = {.target = HSM_INTERNAL, .action = power_on_soc_low},
+	},
+
+	[PWR_RUNNING] = {
+		[PWR_EV_SOC_CRIT] = {.target = PWR_SHUTDOWN_PENDING, .action = power_on_soc_crit},
+		[PWR_EV_READ_FAIL] = {.target = PWR_SHUTDOWN_PENDING, .action = power_on_read_fail},
+	},
+
+	//further faults are swallowed here so the shutdown timer isn't restarted
+	[PWR_SHUTDOWN_PENDING] = {
+		[PWR_EV_SOC_CRIT] = {.target = HSM_INTERNAL},
+		[PWR_EV_READ_FAIL] = {.target = HSM_INTERNAL},
+		[PWR_EV_TICK] = {.target = PWR_SHUTDOWN, .guard = fault_timed_out, .action = power_on_fault_timeout},
+	},
+};
+
+static const char* const power_event_names[PWR_NUM_EVENTS] = {
+	[PWR_EV_TICK] = "tick",
+	[PWR_EV_BUTTON_BUMPED] = "bumped",
+	[PWR_EV_BUTTON_SHORT] = "short press",
+	[PWR_EV_BUTTON_LONG] = "long press",
+	[PWR_EV_BUTTON_RELEASED] = "released",
+	[PWR_EV_SOC_LOW] = "soc low",
+	[PWR_EV_SOC_CRIT] = "soc critical",
+	[PWR_EV_READ_FAIL] = "read fail",
+	[PWR_EV_PRECHARGED] = "precharged",
+};
+
+const hsm_def_t power_fsm = {
+	.states = power_states,
+	.transitions = &power_transitions[0][0],
+	.event_names = power_event_names,
+	.num_states = PWR_NUM_STATES,
+	.num_events = PWR_NUM_EVENTS,
+};
@@ -0,0 +1,121 @@
+#include "protocol.h"
+#include "checksum.h"
+#include "string.h"
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void frame_done(proto_rx_t* rx, proto_frame_cb_t cb, void* ctx);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void proto_rx_init(proto_rx_t* rx) {
+	memset(rx, 0, sizeof(*rx));
+}
+
+void proto_rx_feed(proto_rx_t* rx, const uint8_t* data, uint32_t len, proto_frame_cb_t cb, void* ctx) {
+	for(uint32_t i = 0; i < len; i++) {
+		uint8_t b = data[i];
+
+		if(b == 0) {
+			frame_done(rx, cb, ctx);
+			continue;
+		}
+		if(rx->dropping) continue;
+
+		if(rx->left == 0) {
+			//code byte; the block before it ended in a zero unless it was a full 254 byte run
+			if(rx->code != 0 && rx->code != 0xFF) {
+				if(rx->len >= sizeof(rx->buf)) { rx->dropping = true; rx->overflows++; continue; }
+				rx->buf[rx->len++] = 0;
+			}
+			rx->code = b;
+			rx->left = b - 1;
+		}
+		else {
+			if(rx->len >= sizeof(rx->buf)) { rx->dropping = true; rx->overflows++; continue; }
+			rx->buf[rx->len++] = b;
+			rx->left--;
+		}
+	}
+}
+
+uint16_t proto_encode(const uint8_t* payload, uint16_t len, uint8_t* out) {
+	if(len > PROTO_MAX_PAYLOAD) len = PROTO_MAX_PAYLOAD;
+	uint16_t crc = crc16_ccitt(CRC16_INIT, payload, len);
+	uint8_t crc_bytes[2] = {crc & 0xFF, crc >> 8};
+
+	uint16_t n = 0;
+	out[n++] = 0;
+
+	uint16_t code_at = n++; //fill in the code once we know how long the block is
+	uint8_t code = 1;
+	for(uint16_t i = 0; i < len + 2; i++) {
+		uint8_t b = i < len ? payload[i] : crc_bytes[i - len];
+		if(b == 0) {
+			out[code_at] = code;
+			code_at = n++;
+			code = 1;
+			continue;
+		}
+		out[n++] = b;
+		if(++code == 0xFF) {
+			out[code_at] = code;
+			code_at = n++;
+			code = 1;
+		}
+	}
+	out[code_at] = code;
+	out[n++] = 0;
+	return n;
+}
+
+void proto_dispatch(const proto_command_t* table, uint8_t num_cmds, const uint8_t* payload, uint16_t len,
+		proto_send_t send, void* ctx) {
+	if(len < 2) return; //not even a command and sequence number, nothing to answer
+	proto_reply_t reply = {.cmd = payload[0], .seq = payload[1], .send = send, .ctx = ctx};
+
+	if(payload[0] & PROTO_REPLY) return; //someone's echoing our replies back at us
+	if(payload[0] >= num_cmds || table[payload[0]].handler == NULL) {
+		proto_reply(&reply, PROTO_BAD_CMD, NULL, 0);
+		return;
+	}
+	if(len - 2 < table[payload[0]].min_args) {
+		proto_reply(&reply, PROTO_BAD_ARG, NULL, 0);
+		return;
+	}
+	table[payload[0]].handler(payload + 2, len - 2, &reply);
+}
+
+void proto_reply(const proto_reply_t* reply, uint8_t status, const void* data, uint16_t len) {
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+	uint8_t frame[PROTO_MAX_FRAME];
+
+	if(len > PROTO_MAX_REPLY_DATA) len = PROTO_MAX_REPLY_DATA;
+	payload[0] = reply->cmd | PROTO_REPLY;
+	payload[1] = reply->seq;
+	payload[2] = status;
+	if(len) memcpy(payload + 3, data, len);
+
+	reply->send(frame, proto_encode(payload, len + 3, frame), reply->ctx);
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void frame_done(proto_rx_t* rx, proto_frame_cb_t cb, void* ctx) {
+	bool idle = (rx->len == 0 && rx->code == 0); //back to back delimiters, not an error
+	if(!idle && !rx->dropping) {
+		//frames need a command, a sequence number and the CRC, and can't stop partway through a block
+		if(rx->left != 0 || rx->len < 4) rx->framing_errors++;
+		else {
+			uint16_t len = rx->len - 2;
+			uint16_t crc = rx->buf[len] | (rx->buf[len + 1] << 8);
+			if(crc16_ccitt(CRC16_INIT, rx->buf, len) != crc) rx->crc_errors++;
+			else {
+				rx->frames++;
+				cb(rx->buf, len, ctx);
+			}
+		}
+	}
+
+	rx->len = 0;
+	rx->code = 0;
+	rx->left = 0;
+	rx->dropping = false;
+}
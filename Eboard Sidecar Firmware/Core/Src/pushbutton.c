@@ -1,6 +1,9 @@
 #include "pushbutton.h"
 #include "cmsis_os.h"
 #include "main.h" //for pin mappings
+#include "rtos_objects.h"
+#include "shutdown_coord.h"
+#include "config.h"
 
 //================ SOME DEFINES ==================
 #define BUTTON_BOUNCE_TIME 25 //sets the speed of the button update thread
@@ -9,6 +12,7 @@
 #define BLINK_PERIOD 333333ul //for LED blink operation
 #define COUNT_STEP 25 //PWM counter step during fading
 #define FADE_DELAY 10 //how quickly the PWM counter should increment/decrement
+#define LED_SHUTDOWN_DEADLINE 50 //ms, worst simulated 1ms (sim_replay, long press and fault shutdowns)
 
 //bit fields for the LED action flags
 #define BIT_LED_ON (1<<0)
@@ -23,6 +27,10 @@ static osEventFlagsId_t led_action_flags;
 static osThreadId_t led_thread_handle = NULL;
 static osThreadId_t button_thread_handle = NULL;
 
+static int8_t led_shutdown_id = -1; //signal the shutdown coordinator once the LED is off
+static volatile bool button_down = false; //debounced button state
+static volatile bool swallow_request = false; //set by pushbutton_swallow_hold(), taken up by the button thread
+
 //============= PRIVATE FUNCTION PROTOTYPES ==============
 //thread functions for the LED and button sampling thread
 static void led_thread(void* argument);
@@ -37,25 +45,22 @@ static void do_led_flash();
 //============= PUBLIC FUNCTION DEFINITIONS =============
 osEventFlagsId_t pushbutton_init() {
 	//initialize the signal flags for the LED thread and the pushbutton status flags
-	led_action_flags = osEventFlagsNew(NULL);
-	pushbutton_flags = osEventFlagsNew(NULL);
+	const osEventFlagsAttr_t led_action_attributes = RTOS_FLAGS_ATTR(led_action);
+	const osEventFlagsAttr_t pushbutton_attributes = RTOS_FLAGS_ATTR(pushbutton);
+	led_action_flags = osEventFlagsNew(&led_action_attributes);
+	pushbutton_flags = osEventFlagsNew(&pushbutton_attributes);
 
 	//initialize the led thread
-	const osThreadAttr_t led_attributes = {
-			.name = "led",
-			.priority = (osPriority_t) osPriorityNormal,
-			.stack_size = 288
-	};
+	const osThreadAttr_t led_attributes = RTOS_THREAD_ATTR(led, "led", osPriorityNormal);
 	led_thread_handle = osThreadNew(led_thread, NULL, &led_attributes);
 
 	//initialize the main button thread
-	const osThreadAttr_t button_attributes = {
-			.name = "button",
-			.priority = (osPriority_t) osPriorityAboveNormal,
-			.stack_size = 256
-	};
+	const osThreadAttr_t button_attributes = RTOS_THREAD_ATTR(button, "button", osPriorityAboveNormal);
 	button_thread_handle = osThreadNew(button_thread, NULL, &button_attributes);
 
+	//turn the LED off on shutdown
+	led_shutdown_id = shutdown_register("led", pushbutton_led_off, LED_SHUTDOWN_DEADLINE);
+
 	//return the ID of the pushbutton event flags
 	return pushbutton_flags;
 }
@@ -89,6 +94,10 @@ bool pushbutton_long_pressed(bool clear_flag) {
 	return result;
 }
 
+bool pushbutton_held() {return button_down;}
+
+void pushbutton_swallow_hold() {swallow_request = true;}
+
 uint32_t pushbutton_stack_space() {
 	return osThreadGetStackSpace(button_thread_handle);
 }
@@ -97,56 +106,73 @@ uint32_t led_stack_space() {
 	return osThreadGetStackSpace(led_thread_handle);
 }
 
-//====================== PRIVATE FUNCTION DEFINITIONS ======================
-static void button_thread(void* argument) {
-	GPIO_PinState last_state;
-	bool last_button; //high equates to the button currently being pressed
-	bool short_press, long_press; //flags that tell us if we've set the appropriate event flags yet
-	uint32_t push_time; //timestamp of when the button was pressed
+uint32_t pushbutton_step(pushbutton_state_t* s, GPIO_PinState current_button_state, uint32_t now, uint32_t long_ms) {
+	uint32_t events = 0;
 
-	while(1) {
-		//button pressed -> gpio state will be high
-		GPIO_PinState current_button_state = HAL_GPIO_ReadPin(PB_IN_GPIO_Port, PB_IN_Pin);
+	//if the button has settled, record the state
+	if(current_button_state == s->last_state) {
+
+		if(current_button_state == GPIO_PIN_SET) { //button is pressed
+			if(!s->last_button) s->push_time = now; //store the time if it was just pressed
+
+			//check for short or long presses
+			if(!s->short_press && ((now - s->push_time) > BUTTON_SHORT_PRESS_TIME)) {
+				events |= BUTTON_SHORT_PRESSED;
+				s->short_press = true;
+			}
+			if(!s->long_press && ((now - s->push_time) > long_ms)) {
+				events |= BUTTON_LONG_PRESSED;
+				s->long_press = true;
+			}
 
-		//if the button has settled, record the state
-		if(current_button_state == last_state) {
+			//remember the button state
+			s->last_button = true;
+		}
 
-			if(current_button_state == GPIO_PIN_SET) { //button is pressed
-				if(!last_button) push_time = HAL_GetTick(); //store the time if it was just pressed
+		else { //button is released
+			if(s->last_button) {//button was just released
+				//if the button was pressed for less than the "short press time"
+				if((now - s->push_time) < BUTTON_SHORT_PRESS_TIME)
+					events |= BUTTON_BUMPED; //set the event flag for a "bump"
 
-				//check for short or long presses
-				if(!short_press && ((HAL_GetTick() - push_time) > BUTTON_SHORT_PRESS_TIME)) {
-					osEventFlagsSet(pushbutton_flags, BUTTON_SHORT_PRESSED);
-					short_press = true;
-				}
-				if(!long_press && ((HAL_GetTick() - push_time) > BUTTON_LONG_PRESS_TIME)) {
-					osEventFlagsSet(pushbutton_flags, BUTTON_LONG_PRESSED);
-					long_press = true;
-				}
+				//also set the event flag for releasing the button
+				events |= BUTTON_RELEASED;
 
-				//remember the button state
-				last_button = true;
+				//reset some of our local flags for short and long presses
+				s->short_press = false;
+				s->long_press = false;
 			}
+			s->last_button = false;
+		}
 
-			else { //button is released
-				if(last_button) {//button was just released
-					//if the button was pressed for less than the "short press time"
-					if((HAL_GetTick() - push_time) < BUTTON_SHORT_PRESS_TIME)
-						osEventFlagsSet(pushbutton_flags, BUTTON_BUMPED); //set the event flag for a "bump"
+	}
 
-					//also set the event flag for releasing the button
-					osEventFlagsSet(pushbutton_flags, BUTTON_RELEASED);
+	s->last_state = current_button_state; //updating the debounce memory (pin state)
+	if(s->swallow) {
+		events &= BUTTON_RELEASED;
+		if(events) s->swallow = false; //over with
+	}
+	return events;
+}
 
-					//reset some of our local flags for short and long presses
-					short_press = false;
-					long_press = false;
-				}
-				last_button = false;
-			}
+//====================== PRIVATE FUNCTION DEFINITIONS ======================
+static void button_thread(void* argument) {
+	pushbutton_state_t state = {0};
 
+	while(1) {
+		if(swallow_request) {
+			state.swallow = state.last_button;
+			swallow_request = false;
 		}
 
-		last_state = current_button_state; //updating the debounce memory (pin state)
+		//button pressed -> gpio state will be high
+		GPIO_PinState current_button_state = HAL_GPIO_ReadPin(PB_IN_GPIO_Port, PB_IN_Pin);
+
+		uint32_t events = pushbutton_step(&state, current_button_state, HAL_GetTick(),
+				(uint32_t)config_get(CONFIG_BUTTON_LONG_MS));
+		if(events) osEventFlagsSet(pushbutton_flags, events);
+		button_down = state.last_button;
+
 		osDelay(BUTTON_BOUNCE_TIME);
 	}
 }
@@ -176,6 +202,7 @@ static void led_thread(void* argument) {
 		else if (osEventFlagsGet(led_action_flags) & BIT_LED_OFF) {
 			do_led_off();
 			osEventFlagsClear(led_action_flags, BIT_LED_OFF);
+			shutdown_done(led_shutdown_id); //ignored unless we're shutting down
 		}
 	}
 	//gracefully exiting if it somehow gets here
@@ -199,7 +226,7 @@ static void do_led_fade() {
 	HAL_TIM_PWM_Init(&htim5);
 
 	//have a local variable that sets the increment/decrement amount
-	int count_amount;
+	int count_amount = COUNT_STEP; //up from the 0 it starts at
 
 	//run the fade forever until we want to swap to a different event
 	while(1) {
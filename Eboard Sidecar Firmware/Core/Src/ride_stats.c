@@ -0,0 +1,158 @@
+#include "ride_stats.h"
+#include "batt_monitor.h" //for the SOC range
+#include "datalog.h"
+#include "config.h"
+#include "cmsis_os.h"
+#include "math.h"
+#include "string.h"
+
+//======================= some defines ======================
+#define SAMPLE_RATE 100 //monitor passes per second
+#define SETTLE_SAMPLES 256 //wait for the monitor's moving average to fill before taking the starting SOC
+
+//welford running mean/variance
+typedef struct {
+	uint32_t n;
+	float mean;
+	float m2; //sum of squared differences from the mean
+} moments_t;
+
+//===================== PRIVATE VARIABLES =====================
+//updates and reads happen under the kernel lock, the feeders are in different threads
+static struct {
+	bool running;
+	uint16_t ride;
+	uint32_t start_tick;
+
+	moments_t voltage;
+	float v_min, v_max;
+	moments_t sag;
+	float sag_max;
+	uint32_t hist[RIDE_HIST_BINS]; //samples
+
+	uint8_t mode;
+	uint32_t mode_since;
+	uint32_t mode_time[RIDE_LIGHT_MODES]; //ms, not counting the current stretch
+
+	float soc_start;
+	float soc_now;
+} stats;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void moments_add(moments_t* m, float x);
+static float moments_std(const moments_t* m);
+static void find_summary(uint8_t type, const uint8_t* data, uint8_t len, void* ctx);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void ride_stats_init(uint16_t ride) {
+	int32_t lock = osKernelLock();
+	memset(&stats, 0, sizeof(stats));
+	stats.ride = ride;
+	stats.start_tick = HAL_GetTick();
+	stats.mode_since = stats.start_tick;
+	stats.v_min = SANE_VOLTAGE_UPPER_LIMIT;
+	stats.running = true;
+	osKernelRestoreLock(lock);
+}
+
+void ride_stats_voltage(float voltage, float mav) {
+	int32_t lock = osKernelLock();
+	moments_add(&stats.voltage, voltage);
+	if(voltage < stats.v_min) stats.v_min = voltage;
+	if(voltage > stats.v_max) stats.v_max = voltage;
+
+	//under load when the reading sags well below the average (once the average means something)
+	float sag = mav - voltage;
+	if(stats.voltage.n > SETTLE_SAMPLES && sag > RIDE_SAG_THRESHOLD) {
+		moments_add(&stats.sag, sag);
+		if(sag > stats.sag_max) stats.sag_max = sag;
+	}
+
+	int bin = (voltage - RIDE_HIST_MIN) / RIDE_HIST_WIDTH;
+	stats.hist[bin < 0 ? 0 : (bin >= RIDE_HIST_BINS ? RIDE_HIST_BINS - 1 : bin)]++;
+
+	stats.soc_now = (mav - MIN_VOLTAGE) / (MAX_VOLTAGE - MIN_VOLTAGE);
+	if(stats.voltage.n == SETTLE_SAMPLES) stats.soc_start = stats.soc_now;
+	osKernelRestoreLock(lock);
+}
+
+void ride_stats_light_mode(uint8_t mode) {
+	uint32_t now = HAL_GetTick();
+	if(mode >= RIDE_LIGHT_MODES) return;
+
+	int32_t lock = osKernelLock();
+	stats.mode_time[stats.mode] += now - stats.mode_since;
+	stats.mode = mode;
+	stats.mode_since = now;
+	osKernelRestoreLock(lock);
+}
+
+void ride_stats_summary(ride_summary_t* summary, ride_hist_t* hist) {
+	uint32_t now = HAL_GetTick();
+
+	int32_t lock = osKernelLock();
+	summary->ride = stats.ride;
+	summary->duration = (now - stats.start_tick) / 1000;
+	summary->v_min = stats.voltage.n ? stats.v_min * 100 : 0;
+	summary->v_max = stats.v_max * 100;
+	summary->v_mean = stats.voltage.mean * 100;
+	summary->v_std = moments_std(&stats.voltage) * 100;
+	summary->sag_mean = stats.sag.mean * 100;
+	summary->sag_max = stats.sag_max * 100;
+
+	for(int i = 0; i < RIDE_LIGHT_MODES; i++) {
+		uint32_t ms = stats.mode_time[i] + (i == stats.mode ? now - stats.mode_since : 0); //plus the stretch we're in now
+		summary->mode_time[i] = ms / 1000;
+	}
+
+	float used = (stats.voltage.n > SETTLE_SAMPLES) ? stats.soc_start - stats.soc_now : 0;
+	summary->energy = used > 0 ? used * config_get(CONFIG_PACK_WH) * 10 : 0;
+
+	if(hist) {
+		hist->ride = stats.ride;
+		for(int i = 0; i < RIDE_HIST_BINS; i++) hist->seconds[i] = stats.hist[i] / SAMPLE_RATE;
+	}
+	osKernelRestoreLock(lock);
+}
+
+void ride_stats_persist() {
+	ride_summary_t summary;
+	ride_hist_t hist;
+	if(!stats.running) return; //never latched power, no ride
+
+	ride_stats_summary(&summary, &hist);
+	datalog_write(DATALOG_RIDE_HIST, &hist, sizeof(hist));
+	datalog_write(DATALOG_RIDE_SUMMARY, &summary, sizeof(summary));
+}
+
+bool ride_stats_load(uint16_t ride, ride_summary_t* summary) {
+	bool found = false;
+	void* ctx[2] = {summary, &found};
+	summary->ride = ride; //find_summary() only takes this ride's
+
+	//the whole ride: telemetry, the black box, cpu and stack records can all be written after the summary,
+	//so it isn't necessarily in the last page (if there's more than one, the last one wins)
+	datalog_retrieve(ride, 0, UINT32_MAX, find_summary, ctx);
+	return found;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void moments_add(moments_t* m, float x) {
+	m->n++;
+	float delta = x - m->mean;
+	m->mean += delta / m->n;
+	m->m2 += delta * (x - m->mean);
+}
+
+static float moments_std(const moments_t* m) {
+	return m->n > 1 ? sqrtf(m->m2 / (m->n - 1)) : 0;
+}
+
+static void find_summary(uint8_t type, const uint8_t* data, uint8_t len, void* ctx) {
+	void** out = (void**)ctx;
+	ride_summary_t* summary = out[0];
+	if(type != DATALOG_RIDE_SUMMARY || len != sizeof(ride_summary_t)) return;
+	if(((const ride_summary_t*)data)->ride != summary->ride) return;
+	memcpy(summary, data, sizeof(ride_summary_t));
+	*(bool*)out[1] = true;
+}
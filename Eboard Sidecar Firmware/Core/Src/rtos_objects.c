@@ -0,0 +1,33 @@
+#include "rtos_objects.h"
+
+//every object gets its own .bss.rtos_static.* input section
+//the linker script gathers them at the start of .bss, so the map file shows one line (and size) per object
+#define RTOS_STATIC(obj) __attribute__((section(".bss.rtos_static." #obj)))
+
+//======================= storage definitions =======================
+#define RTOS_DEFINE_THREAD(obj, stack) \
+	RTOS_STATIC(obj##_tcb) StaticTask_t rtos_##obj##_tcb; \
+	RTOS_STATIC(obj##_stack) __attribute__((aligned(8))) StackType_t rtos_##obj##_stack[(stack)/sizeof(StackType_t)];
+#define RTOS_DEFINE_FLAGS(obj) \
+	RTOS_STATIC(obj##_flags) StaticEventGroup_t rtos_##obj##_cb;
+#define RTOS_DEFINE_QUEUE(obj, depth, size) \
+	RTOS_STATIC(obj##_cb) StaticQueue_t rtos_##obj##_cb; \
+	RTOS_STATIC(obj##_mq) uint8_t rtos_##obj##_mq[(depth)*(size)];
+
+RTOS_THREADS(RTOS_DEFINE_THREAD)
+RTOS_EVENT_FLAGS(RTOS_DEFINE_FLAGS)
+RTOS_QUEUES(RTOS_DEFINE_QUEUE)
+
+//======================= compile-time budget check =======================
+//add up everything in the table (rounded up to the word alignment the linker will give it)
+#define WORDS(bytes) ((((bytes) + 3) / 4) * 4)
+#define THREAD_BYTES(obj, stack) + WORDS(sizeof(StaticTask_t)) + WORDS(stack)
+#define FLAGS_BYTES(obj) + WORDS(sizeof(StaticEventGroup_t))
+#define QUEUE_BYTES(obj, depth, size) + WORDS(sizeof(StaticQueue_t)) + WORDS((depth)*(size))
+
+#define RTOS_STATIC_BYTES (0 RTOS_THREADS(THREAD_BYTES) RTOS_EVENT_FLAGS(FLAGS_BYTES) RTOS_QUEUES(QUEUE_BYTES))
+
+#define STACK_IS_ALIGNED(obj, stack) _Static_assert(((stack) % 8) == 0, "stack size for " #obj " must be a multiple of 8");
+RTOS_THREADS(STACK_IS_ALIGNED)
+
+_Static_assert(RTOS_STATIC_BYTES <= RTOS_STATIC_BUDGET, "RTOS objects exceed RTOS_STATIC_BUDGET, see rtos_objects.h");
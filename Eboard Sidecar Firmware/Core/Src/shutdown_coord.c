@@ -0,0 +1,93 @@
+#include "shutdown_coord.h"
+#include "rtos_objects.h"
+#include "datalog.h"
+#include "stdbool.h"
+#include "stdio.h"
+
+_Static_assert(sizeof(shutdown_record_t) <= DATALOG_MAX_RECORD, "shutdown record doesn't fit in a datalog record");
+
+//===================== PRIVATE VARIABLES =====================
+static struct {
+	const char* name;
+	shutdown_handler_t handler;
+	uint32_t deadline;
+	uint32_t done_at; //tick count when the handler signalled completion
+} handlers[SHUTDOWN_MAX_HANDLERS];
+
+static uint8_t num_handlers = 0;
+static osEventFlagsId_t done_flags; //one bit per handler, set when it finishes
+static volatile bool shutting_down = false;
+static uint32_t start_tick;
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void shutdown_coord_init() {
+	const osEventFlagsAttr_t done_attributes = RTOS_FLAGS_ATTR(shutdown_done);
+	done_flags = osEventFlagsNew(&done_attributes);
+}
+
+int8_t shutdown_register(const char* name, shutdown_handler_t handler, uint32_t deadline_ms) {
+	if(num_handlers >= SHUTDOWN_MAX_HANDLERS) return -1;
+
+	handlers[num_handlers].name = name;
+	handlers[num_handlers].handler = handler;
+	handlers[num_handlers].deadline = deadline_ms;
+	return num_handlers++;
+}
+
+void shutdown_done(int8_t id) {
+	if(!shutting_down || id < 0 || id >= num_handlers) return;
+	handlers[id].done_at = HAL_GetTick();
+	osEventFlagsSet(done_flags, 1ul << id);
+}
+
+uint32_t shutdown_run() {
+	uint32_t all_done = 0;
+	uint32_t budget = 0;
+
+	//everyone starts from a clean slate
+	osEventFlagsClear(done_flags, (1ul << SHUTDOWN_MAX_HANDLERS) - 1);
+	start_tick = HAL_GetTick();
+	shutting_down = true;
+
+	//the worst-case wait is the slowest deadline, but never longer than the hard cap
+	for(int i = 0; i < num_handlers; i++) {
+		all_done |= 1ul << i;
+		if(handlers[i].deadline > budget) budget = handlers[i].deadline;
+	}
+	budget = budget > SHUTDOWN_MAX_TIME ? SHUTDOWN_MAX_TIME : budget;
+
+	//kick off every handler; they run in parallel in their own threads
+	for(int i = 0; i < num_handlers; i++) {
+		handlers[i].done_at = 0;
+		handlers[i].handler();
+	}
+
+	//wait on the barrier for whatever time is left in the budget
+	uint32_t waited = HAL_GetTick() - start_tick;
+	if(all_done && waited < budget) {
+		osEventFlagsWait(done_flags, all_done, osFlagsWaitAll | osFlagsNoClear, budget - waited);
+	}
+
+	uint32_t elapsed = HAL_GetTick() - start_tick;
+	shutdown_record_t record = {.tick = start_tick, .total = elapsed, .handlers = num_handlers};
+
+	//report how long everything took (the USB link is still up at this point)
+	for(int i = 0; i < num_handlers; i++) {
+		if(handlers[i].done_at) {
+			uint32_t took = handlers[i].done_at - start_tick;
+			record.took[i] = took;
+			printf("shutdown: %s done in %lums%s\r\n", handlers[i].name, took, took > handlers[i].deadline ? " (late)" : "");
+		}
+		else {
+			record.took[i] = SHUTDOWN_TIMED_OUT;
+			printf("shutdown: %s timed out\r\n", handlers[i].name);
+		}
+	}
+	printf("shutdown: total %lums\r\n", elapsed);
+
+	//and into the log, so it can be read back off the board after the fact
+	datalog_write(DATALOG_SHUTDOWN, &record, sizeof(record));
+	datalog_sync(SHUTDOWN_LOG_TIMEOUT);
+
+	return elapsed;
+}
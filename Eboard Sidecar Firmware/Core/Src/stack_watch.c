@@ -0,0 +1,116 @@
+#include "stack_watch.h"
+#include "rtos_objects.h"
+#include "datalog.h"
+#include "blackbox.h"
+#include "dlog.h"
+#include "string.h"
+
+//======================= some defines ======================
+#define STACK_FILL_WORD 0xA5A5A5A5ul //tskSTACK_FILL_BYTE in every byte
+
+typedef struct {
+	const char* name;
+	const StackType_t* stack; //lowest address; the stacks grow down towards it
+	uint16_t size; //bytes
+	const StaticTask_t* tcb; //also the thread's handle once it's started
+} stack_entry_t;
+
+#define STACK_ENTRY(obj, stack) {#obj, rtos_##obj##_stack, sizeof(rtos_##obj##_stack), &rtos_##obj##_tcb},
+static const stack_entry_t stacks[] = { RTOS_THREADS(STACK_ENTRY) };
+#undef STACK_ENTRY
+
+#define NUM_STACKS (sizeof(stacks) / sizeof(stacks[0]))
+_Static_assert(NUM_STACKS < STACK_WATCH_UNKNOWN, "too many threads to number");
+_Static_assert(sizeof(stack_watch_record_t) <= DATALOG_MAX_RECORD, "stack record doesn't fit in a datalog record");
+
+//===================== PRIVATE VARIABLES =====================
+static osThreadId_t stack_watch_handle = NULL;
+static uint16_t logged_peak[NUM_STACKS]; //only the watch thread touches this
+
+//set by the overflow hook
+static volatile bool overflow_seen = false;
+static volatile uint8_t overflow_thread = STACK_WATCH_UNKNOWN;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void run_stack_watch(void* argument);
+static uint16_t peak_used(const stack_entry_t* entry);
+static uint16_t suggest_size(uint16_t peak);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void stack_watch_init() {
+	const osThreadAttr_t stack_watch_attributes = RTOS_THREAD_ATTR(stack_watch, "stack_watch", osPriorityLow);
+	stack_watch_handle = osThreadNew(run_stack_watch, NULL, &stack_watch_attributes);
+}
+
+bool stack_watch_thread(uint8_t number, stack_watch_info_t* info) {
+	if(number >= NUM_STACKS) return false;
+	const stack_entry_t* entry = &stacks[number];
+
+	info->name = entry->name;
+	info->size = entry->size;
+	info->started = entry->tcb->pxDummy1 != NULL; //top of stack, set when the thread's created
+	info->peak = info->started ? peak_used(entry) : 0;
+	info->suggested = info->started ? suggest_size(info->peak) : 0;
+	return true;
+}
+
+uint8_t stack_watch_count() { return NUM_STACKS; }
+
+uint8_t stack_watch_find(void* handle) {
+	for(uint8_t i = 0; i < NUM_STACKS; i++) {
+		if((const void*)stacks[i].tcb == handle) return i;
+	}
+	return STACK_WATCH_UNKNOWN;
+}
+
+uint8_t stack_watch_overflowed(bool* overflowed) {
+	*overflowed = overflow_seen;
+	return overflow_thread;
+}
+
+void stack_watch_overflow(void* handle) {
+	overflow_thread = stack_watch_find(handle);
+	overflow_seen = true;
+	blackbox_record(BLACKBOX_STACK, 0, overflow_thread);
+}
+
+uint32_t stack_watch_stack_space() {return osThreadGetStackSpace(stack_watch_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void run_stack_watch(void* argument) {
+	while(1) {
+		for(uint8_t i = 0; i < NUM_STACKS; i++) {
+			stack_watch_info_t info;
+			stack_watch_thread(i, &info);
+			if(!info.started || info.peak < logged_peak[i] + STACK_LOG_STEP) continue;
+
+			//only warn the first time it crosses the line
+			bool over = (uint32_t)info.peak * 100 >= (uint32_t)info.size * STACK_WARN_PERCENT;
+			bool was_over = (uint32_t)logged_peak[i] * 100 >= (uint32_t)info.size * STACK_WARN_PERCENT;
+			if(over && !was_over) DLOG3(STACK_HIGH, i, info.peak, info.size);
+
+			stack_watch_record_t record = {.thread = i, .size = info.size, .peak = info.peak, .suggested = info.suggested};
+			memcpy(record.name, info.name, strnlen(info.name, sizeof(record.name))); //the rest was zeroed above
+			datalog_write(DATALOG_STACK, &record, sizeof(record));
+			logged_peak[i] = info.peak;
+		}
+
+		osDelay(STACK_WATCH_PERIOD);
+	}
+
+	osThreadExit();
+}
+
+//count the untouched words up from the bottom of the stack
+static uint16_t peak_used(const stack_entry_t* entry) {
+	uint16_t words = entry->size / sizeof(StackType_t);
+	uint16_t untouched = 0;
+	while(untouched < words && entry->stack[untouched] == STACK_FILL_WORD) untouched++;
+	return (words - untouched) * sizeof(StackType_t);
+}
+
+static uint16_t suggest_size(uint16_t peak) {
+	uint32_t size = (uint32_t)peak * (100 + STACK_MARGIN_PERCENT) / 100;
+	if(size < STACK_MIN_SIZE) size = STACK_MIN_SIZE;
+	return (size + 7) & ~7ul; //RTOS_THREADS wants multiples of 8
+}
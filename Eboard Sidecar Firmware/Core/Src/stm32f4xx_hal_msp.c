@@ -128,6 +128,9 @@ void HAL_ADC_MspInit(ADC_HandleTypeDef* hadc)
     __HAL_LINKDMA(hadc,DMA_Handle,hdma_adc1);
 
   /* USER CODE BEGIN ADC1_MspInit 1 */
+    //the battery monitor's injected conversions (batt_monitor.c); same priority as the DMA
+    HAL_NVIC_SetPriority(ADC_IRQn, 9, 0);
+    HAL_NVIC_EnableIRQ(ADC_IRQn);
 
   /* USER CODE END ADC1_MspInit 1 */
   }
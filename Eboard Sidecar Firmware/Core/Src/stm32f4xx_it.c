@@ -23,6 +23,7 @@
 #include "stm32f4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "trace.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -62,6 +63,7 @@ extern TIM_HandleTypeDef htim3;
 extern TIM_HandleTypeDef htim11;
 
 /* USER CODE BEGIN EV */
+extern ADC_HandleTypeDef hadc1;
 
 /* USER CODE END EV */
 
@@ -167,11 +169,11 @@ void DebugMon_Handler(void)
 void EXTI1_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI1_IRQn 0 */
-
+  TRACE_IRQ_ENTER(EXTI1_IRQn);
   /* USER CODE END EXTI1_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_1);
   /* USER CODE BEGIN EXTI1_IRQn 1 */
-
+  TRACE_IRQ_EXIT(EXTI1_IRQn);
   /* USER CODE END EXTI1_IRQn 1 */
 }
 
@@ -181,11 +183,11 @@ void EXTI1_IRQHandler(void)
 void TIM1_TRG_COM_TIM11_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM1_TRG_COM_TIM11_IRQn 0 */
-
+  TRACE_IRQ_ENTER(TIM1_TRG_COM_TIM11_IRQn);
   /* USER CODE END TIM1_TRG_COM_TIM11_IRQn 0 */
   HAL_TIM_IRQHandler(&htim11);
   /* USER CODE BEGIN TIM1_TRG_COM_TIM11_IRQn 1 */
-
+  TRACE_IRQ_EXIT(TIM1_TRG_COM_TIM11_IRQn);
   /* USER CODE END TIM1_TRG_COM_TIM11_IRQn 1 */
 }
 
@@ -195,11 +197,11 @@ void TIM1_TRG_COM_TIM11_IRQHandler(void)
 void TIM3_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM3_IRQn 0 */
-
+  TRACE_IRQ_ENTER(TIM3_IRQn);
   /* USER CODE END TIM3_IRQn 0 */
   HAL_TIM_IRQHandler(&htim3);
   /* USER CODE BEGIN TIM3_IRQn 1 */
-
+  TRACE_IRQ_EXIT(TIM3_IRQn);
   /* USER CODE END TIM3_IRQn 1 */
 }
 
@@ -209,11 +211,11 @@ void TIM3_IRQHandler(void)
 void DMA2_Stream0_IRQHandler(void)
 {
   /* USER CODE BEGIN DMA2_Stream0_IRQn 0 */
-
+  TRACE_IRQ_ENTER(DMA2_Stream0_IRQn);
   /* USER CODE END DMA2_Stream0_IRQn 0 */
   HAL_DMA_IRQHandler(&hdma_adc1);
   /* USER CODE BEGIN DMA2_Stream0_IRQn 1 */
-
+  TRACE_IRQ_EXIT(DMA2_Stream0_IRQn);
   /* USER CODE END DMA2_Stream0_IRQn 1 */
 }
 
@@ -223,15 +225,24 @@ void DMA2_Stream0_IRQHandler(void)
 void OTG_FS_IRQHandler(void)
 {
   /* USER CODE BEGIN OTG_FS_IRQn 0 */
-
+  TRACE_IRQ_ENTER(OTG_FS_IRQn);
   /* USER CODE END OTG_FS_IRQn 0 */
   HAL_PCD_IRQHandler(&hpcd_USB_OTG_FS);
   /* USER CODE BEGIN OTG_FS_IRQn 1 */
-
+  TRACE_IRQ_EXIT(OTG_FS_IRQn);
   /* USER CODE END OTG_FS_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
+/**
+  * @brief This function handles the ADC1 global interrupt (the battery monitor's injected conversions).
+  */
+void ADC_IRQHandler(void)
+{
+  TRACE_IRQ_ENTER(ADC_IRQn);
+  HAL_ADC_IRQHandler(&hadc1);
+  TRACE_IRQ_EXIT(ADC_IRQn);
+}
 
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
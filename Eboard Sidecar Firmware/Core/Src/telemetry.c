@@ -0,0 +1,196 @@
+#include "telemetry.h"
+#include "string.h"
+
+//======================= tag bits ======================
+#define TAG_KEYFRAME	(1<<7)
+#define TAG_DT			(1<<0)
+#define TAG_VOLTAGE		(1<<1)
+#define TAG_SOC			(1<<2)
+#define TAG_MODE		(1<<3)
+#define TAG_FLAGS		(1<<4)
+
+#define RECORD_MAX 16 //keyframe: tag + 5 byte tick + 3 + 3 + 1 + 1
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static uint8_t put_varint(uint8_t* buf, uint32_t value);
+static bool get_varint(const uint8_t* buf, uint8_t len, uint8_t* pos, uint32_t* value);
+static inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static uint8_t encode_record(telem_encoder_t* enc, const telem_sample_t* s, uint8_t* rec);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void telem_encoder_init(telem_encoder_t* enc) {
+	memset(enc, 0, sizeof(telem_encoder_t));
+	enc->need_keyframe = true;
+}
+
+uint8_t telem_encode(telem_encoder_t* enc, const telem_sample_t* sample, uint8_t* out) {
+	uint8_t rec[RECORD_MAX];
+	uint8_t n = encode_record(enc, sample, rec);
+	uint8_t finished = 0;
+
+	//doesn't fit, hand back the full block and start the next one
+	if(enc->used + n > TELEM_BLOCK_MAX) finished = telem_flush(enc, out);
+
+	if(enc->used == 0) enc->block[enc->used++] = enc->block_seq++;
+	memcpy(&enc->block[enc->used], rec, n);
+	enc->used += n;
+	return finished;
+}
+
+uint8_t telem_flush(telem_encoder_t* enc, uint8_t* out) {
+	uint8_t len = enc->used;
+	memcpy(out, enc->block, len);
+	enc->used = 0;
+	return len;
+}
+
+void telem_encoder_resync(telem_encoder_t* enc) {
+	enc->need_keyframe = true;
+}
+
+void telem_decoder_init(telem_decoder_t* dec) {
+	memset(dec, 0, sizeof(telem_decoder_t));
+}
+
+int telem_decode_block(telem_decoder_t* dec, const uint8_t* block, uint8_t len, telem_sample_cb_t cb, void* ctx) {
+	int count = 0;
+	uint8_t pos = 1;
+	if(len < 1) return -1;
+
+	//a hole in the sequence means the deltas can't be trusted until the next keyframe
+	if(dec->started && block[0] != dec->next_seq) {
+		dec->lost_blocks += (uint8_t)(block[0] - dec->next_seq);
+		dec->synced = false;
+	}
+	dec->started = true;
+	dec->next_seq = block[0] + 1;
+
+	while(pos < len) {
+		uint8_t tag = block[pos++];
+		uint32_t v;
+		telem_sample_t s = dec->last;
+
+		if(tag & TAG_KEYFRAME) {
+			if(!get_varint(block, len, &pos, &s.tick)) return -1;
+			if(!get_varint(block, len, &pos, &v)) return -1;
+			s.voltage = v;
+			if(!get_varint(block, len, &pos, &v)) return -1;
+			s.soc = v;
+			if(pos + 2 > len) return -1;
+			s.light_mode = block[pos++];
+			s.flags = block[pos++];
+			dec->last_dt = 0;
+			dec->synced = true;
+		}
+		else {
+			//still have to walk the fields while unsynced to find the next record
+			if(tag & TAG_DT) {
+				if(!get_varint(block, len, &pos, &v)) return -1;
+				dec->last_dt = v;
+			}
+			s.tick += dec->last_dt;
+			if(tag & TAG_VOLTAGE) {
+				if(!get_varint(block, len, &pos, &v)) return -1;
+				s.voltage += unzigzag(v);
+			}
+			if(tag & TAG_SOC) {
+				if(!get_varint(block, len, &pos, &v)) return -1;
+				s.soc += unzigzag(v);
+			}
+			if(tag & TAG_MODE) {
+				if(pos >= len) return -1;
+				s.light_mode = block[pos++];
+			}
+			if(tag & TAG_FLAGS) {
+				if(pos >= len) return -1;
+				s.flags = block[pos++];
+			}
+		}
+
+		dec->last = s;
+		if(!dec->synced) {
+			dec->skipped++;
+			continue;
+		}
+		if(cb) cb(&s, ctx);
+		count++;
+	}
+
+	return count;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static uint8_t encode_record(telem_encoder_t* enc, const telem_sample_t* s, uint8_t* rec) {
+	uint8_t n = 1;
+
+	if(enc->need_keyframe || enc->since_keyframe >= TELEM_KEYFRAME_INTERVAL) {
+		rec[0] = TAG_KEYFRAME;
+		n += put_varint(&rec[n], s->tick);
+		n += put_varint(&rec[n], s->voltage);
+		n += put_varint(&rec[n], s->soc);
+		rec[n++] = s->light_mode;
+		rec[n++] = s->flags;
+
+		enc->need_keyframe = false;
+		enc->since_keyframe = 0;
+		enc->last_dt = 0;
+	}
+	else {
+		uint8_t tag = 0;
+		uint32_t dt = s->tick - enc->last.tick;
+
+		if(dt != enc->last_dt) {
+			tag |= TAG_DT;
+			n += put_varint(&rec[n], dt);
+			enc->last_dt = dt;
+		}
+		if(s->voltage != enc->last.voltage) {
+			tag |= TAG_VOLTAGE;
+			n += put_varint(&rec[n], zigzag((int32_t)s->voltage - enc->last.voltage));
+		}
+		if(s->soc != enc->last.soc) {
+			tag |= TAG_SOC;
+			n += put_varint(&rec[n], zigzag((int32_t)s->soc - enc->last.soc));
+		}
+		if(s->light_mode != enc->last.light_mode) {
+			tag |= TAG_MODE;
+			rec[n++] = s->light_mode;
+		}
+		if(s->flags != enc->last.flags) {
+			tag |= TAG_FLAGS;
+			rec[n++] = s->flags;
+		}
+		rec[0] = tag;
+		enc->since_keyframe++;
+	}
+
+	enc->last = *s;
+	return n;
+}
+
+//little-endian base 128, 7 bits per byte with the top bit set on all but the last
+static uint8_t put_varint(uint8_t* buf, uint32_t value) {
+	uint8_t n = 0;
+	while(value >= 0x80) {
+		buf[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	buf[n++] = value;
+	return n;
+}
+
+static bool get_varint(const uint8_t* buf, uint8_t len, uint8_t* pos, uint32_t* value) {
+	uint32_t v = 0;
+	for(uint8_t shift = 0; shift < 35; shift += 7) {
+		if(*pos >= len) return false;
+		uint8_t b = buf[(*pos)++];
+		v |= (uint32_t)(b & 0x7F) << shift;
+		if(!(b & 0x80)) {
+			*value = v;
+			return true;
+		}
+	}
+	return false;
+}
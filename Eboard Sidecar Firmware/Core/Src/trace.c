@@ -0,0 +1,268 @@
+#include "trace.h"
+#include "stm32f4xx_hal.h"
+#include "rtos_objects.h"
+#include "queue.h"
+#include "event_groups.h"
+#include "cpu_stats.h"
+#include "usbd_cdc_if.h"
+#include "protocol.h"
+#include "stdio.h"
+#include "string.h"
+
+_Static_assert((TRACE_EVENTS & (TRACE_EVENTS - 1)) == 0, "TRACE_EVENTS must be a power of 2");
+_Static_assert(sizeof(trace_event_t) == 8, "trace events are meant to be a single 8 byte store");
+
+//======================= some defines ======================
+#define EVENTS_PER_FRAME ((PROTO_MAX_REPLY_DATA - 1) / sizeof(trace_event_t))
+#define STREAM_SLACK 32 //events kept clear of the writers when catching up after an overrun
+#define NAMES_TX_SPACE 1024 //the info and name frames go out in one burst when a stream starts
+#define CALIBRATE_EVENTS 64
+
+//===================== PUBLIC VARIABLES (for the inline writer) =====================
+trace_event_t trace_ring[TRACE_EVENTS];
+volatile uint32_t trace_head = 0;
+volatile bool trace_recording = false;
+
+//===================== PRIVATE VARIABLES =====================
+static osThreadId_t trace_handle = NULL;
+
+static volatile uint8_t mode = TRACE_OFF;
+static volatile uint32_t mode_starts = 0; //bumped by trace_set_mode, the trace thread restarts its stream on a change
+static volatile bool frozen = false;
+static volatile uint32_t frozen_head = 0;
+static uint16_t cycles_per_event = 0;
+static uint32_t lost = 0, frames = 0;
+static bool stream_failed = false; //a stream frame didn't fit in the USB ring, see send_frame()
+
+#define QUEUE_NAME(obj, depth, size) #obj,
+#define FLAGS_NAME(obj) #obj,
+static const char* const queue_names[] = { RTOS_QUEUES(QUEUE_NAME) };
+static const char* const flags_names[] = { RTOS_EVENT_FLAGS(FLAGS_NAME) };
+#undef QUEUE_NAME
+#undef FLAGS_NAME
+
+#define NUM_QUEUES (sizeof(queue_names) / sizeof(queue_names[0]))
+#define NUM_FLAGS (sizeof(flags_names) / sizeof(flags_names[0]))
+_Static_assert(NUM_QUEUES < 256 && NUM_FLAGS < 256, "too many objects to number");
+
+//the handlers with TRACE_ISR_ENTER/EXIT in stm32f4xx_it.c
+typedef struct {
+	IRQn_Type irqn;
+	const char* name;
+} isr_name_t;
+
+static const isr_name_t isr_names[] = {
+	{EXTI1_IRQn, "button"},
+	{TIM1_TRG_COM_TIM11_IRQn, "hal_tick"},
+	{TIM3_IRQn, "tim3"},
+	{DMA2_Stream0_IRQn, "adc_dma"},
+	{OTG_FS_IRQn, "usb"},
+};
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void run_trace(void* argument);
+static void number_objects();
+static void calibrate();
+static void send_names(trace_send_t send, void* ctx);
+static void send_name(trace_send_t send, void* ctx, uint8_t what, uint8_t number, const char* name);
+static uint32_t send_events(uint32_t from, uint32_t count, trace_send_t send, void* ctx);
+static void send_frame(const uint8_t* frame, uint16_t len, void* ctx);
+static void send_stream(const uint8_t* data, uint16_t len, void* ctx);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void trace_init() {
+	number_objects();
+	calibrate();
+	if(cycles_per_event > TRACE_BUDGET_CYCLES) {
+		printf("trace: %u cycles per event, over the %u budget\r\n", cycles_per_event, TRACE_BUDGET_CYCLES);
+	}
+
+	const osThreadAttr_t trace_attributes = RTOS_THREAD_ATTR(trace, "trace", osPriorityLow);
+	trace_handle = osThreadNew(run_trace, NULL, &trace_attributes);
+}
+
+void trace_set_mode(uint8_t new_mode) {
+	if(new_mode > TRACE_SNAPSHOT) return;
+
+	trace_recording = false;
+	frozen = false;
+	mode = new_mode;
+	mode_starts++;
+	trace_recording = new_mode != TRACE_OFF;
+}
+
+void trace_trigger() {
+	if(mode != TRACE_SNAPSHOT || frozen) return;
+	trace_recording = false;
+	frozen_head = trace_head;
+	frozen = true;
+}
+
+void trace_mark(uint8_t arg, uint16_t value) {
+	//the hooks all run in ISRs or with the scheduler held off (see trace.h); thread code has to do the same
+	UBaseType_t state = taskENTER_CRITICAL_FROM_ISR();
+	trace_put(TRACE_MARK, arg, value);
+	taskEXIT_CRITICAL_FROM_ISR(state);
+}
+
+uint32_t trace_dump(trace_send_t send, void* ctx) {
+	if(mode != TRACE_SNAPSHOT) return 0;
+	trace_trigger(); //no-op if something already froze it
+
+	send_names(send, ctx);
+	uint32_t head = frozen_head;
+	uint32_t count = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+	uint32_t sent = send_events(head - count, count, send, ctx);
+
+	//re-arm; whatever's still in the ring is older than the next trigger will care about
+	frozen = false;
+	trace_recording = mode == TRACE_SNAPSHOT;
+	return sent;
+}
+
+void trace_get_stats(trace_stats_t* out) {
+	out->mode = mode;
+	out->frozen = frozen;
+	out->cycles_per_event = cycles_per_event;
+	out->events = trace_head;
+	out->lost = lost;
+	out->frames = frames;
+}
+
+uint32_t trace_stack_space() {return osThreadGetStackSpace(trace_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void run_trace(void* argument) {
+	proto_reply_t reply = {.cmd = PROTO_TRACE, .seq = 0, .send = send_frame};
+	uint32_t seen_starts = 0;
+	uint32_t tail = 0;
+	bool names_due = false;
+
+	while(1) {
+		osDelay(TRACE_FLUSH_TIME);
+
+		//a new mode starts the stream over from the events recorded since
+		uint32_t starts = mode_starts;
+		if(starts != seen_starts) {
+			seen_starts = starts;
+			tail = trace_head;
+			names_due = mode == TRACE_STREAM;
+		}
+		if(mode != TRACE_STREAM) continue;
+
+		if(names_due) {
+			if(CDC_Tx_Space() < NAMES_TX_SPACE) continue; //try again next pass
+			stream_failed = false;
+			send_names(send_stream, &reply);
+			names_due = stream_failed; //all of them again next pass
+		}
+
+		//fell a lap behind: skip ahead, leaving the writers some room
+		uint32_t head = trace_head;
+		if(head - tail > TRACE_EVENTS - STREAM_SLACK) {
+			uint32_t skipped = head - tail - (TRACE_EVENTS - STREAM_SLACK);
+			tail += skipped;
+			lost += skipped;
+			uint8_t data[1 + sizeof(uint32_t)] = {TRACE_FRAME_LOST};
+			memcpy(&data[1], &skipped, sizeof(skipped));
+			send_stream(data, sizeof(data), &reply);
+		}
+
+		//only while USB has room for a whole frame; whatever is left waits for the next pass
+		while(tail != head && CDC_Tx_Space() >= PROTO_MAX_FRAME) {
+			uint32_t count = head - tail;
+			if(count > EVENTS_PER_FRAME) count = EVENTS_PER_FRAME;
+			tail += send_events(tail, count, send_stream, &reply);
+		}
+	}
+
+	osThreadExit();
+}
+
+//the trace hooks find the objects by these numbers; creating an object doesn't touch them, so they can be set up
+//before (or after) the power latch creates its share
+static void number_objects() {
+	#define NUMBER_QUEUE(obj, depth, size) vQueueSetQueueNumber((QueueHandle_t)&rtos_##obj##_cb, number++);
+	#define NUMBER_FLAGS(obj) vEventGroupSetNumber((EventGroupHandle_t)&rtos_##obj##_cb, number++);
+	UBaseType_t number = 1;
+	RTOS_QUEUES(NUMBER_QUEUE)
+	number = 1;
+	RTOS_EVENT_FLAGS(NUMBER_FLAGS)
+	#undef NUMBER_QUEUE
+	#undef NUMBER_FLAGS
+}
+
+//time a burst of events with nothing else running, then throw them away
+static void calibrate() {
+	taskENTER_CRITICAL();
+	trace_recording = true;
+	uint32_t start = TRACE_CYCLES();
+	for(uint8_t i = 0; i < CALIBRATE_EVENTS; i++) trace_put(TRACE_MARK, 0, i);
+	uint32_t cycles = TRACE_CYCLES() - start;
+	trace_recording = false;
+	trace_head = 0;
+	taskEXIT_CRITICAL();
+
+	cycles_per_event = (cycles + CALIBRATE_EVENTS / 2) / CALIBRATE_EVENTS;
+}
+
+static void send_names(trace_send_t send, void* ctx) {
+	uint8_t data[1 + sizeof(trace_info_t)] = {TRACE_FRAME_INFO};
+	trace_info_t info = {.cpu_hz = SystemCoreClock, .cycles_per_event = cycles_per_event};
+	memcpy(&data[1], &info, sizeof(info));
+	send(data, sizeof(data), ctx);
+
+	//threads by their cpu_stats numbers; anything not numbered yet shows up as thread 0
+	for(uint8_t n = 1; n < CPU_STATS_MAX_THREADS; n++) {
+		cpu_thread_stats_t thread;
+		if(cpu_stats_thread(n, &thread)) send_name(send, ctx, TRACE_NAME_THREAD, n, thread.name);
+	}
+	for(uint8_t i = 0; i < NUM_QUEUES; i++) send_name(send, ctx, TRACE_NAME_QUEUE, i + 1, queue_names[i]);
+	for(uint8_t i = 0; i < NUM_FLAGS; i++) send_name(send, ctx, TRACE_NAME_FLAGS, i + 1, flags_names[i]);
+	for(uint8_t i = 0; i < sizeof(isr_names) / sizeof(isr_names[0]); i++) {
+		send_name(send, ctx, TRACE_NAME_ISR, isr_names[i].irqn + 16, isr_names[i].name);
+	}
+}
+
+static void send_name(trace_send_t send, void* ctx, uint8_t what, uint8_t number, const char* name) {
+	uint8_t data[3 + configMAX_TASK_NAME_LEN] = {TRACE_FRAME_NAME, what, number};
+	size_t len = strnlen(name, configMAX_TASK_NAME_LEN);
+	memcpy(&data[3], name, len);
+	send(data, 3 + len, ctx);
+}
+
+//send count events starting at index from, in frames; returns how far it got (events overwritten while they were
+//being copied are counted as lost, not sent)
+static uint32_t send_events(uint32_t from, uint32_t count, trace_send_t send, void* ctx) {
+	uint8_t data[1 + EVENTS_PER_FRAME * sizeof(trace_event_t)] = {TRACE_FRAME_EVENTS};
+	uint32_t done = 0;
+
+	while(done < count) {
+		uint32_t n = count - done;
+		if(n > EVENTS_PER_FRAME) n = EVENTS_PER_FRAME;
+		uint32_t at = from + done;
+		for(uint32_t i = 0; i < n; i++) {
+			memcpy(&data[1 + i * sizeof(trace_event_t)], &trace_ring[(at + i) & (TRACE_EVENTS - 1)], sizeof(trace_event_t));
+		}
+
+		//a writer that lapped us partway through the copy leaves a torn batch; drop the lot
+		if(trace_head - at > TRACE_EVENTS) lost += n;
+		else {
+			stream_failed = false;
+			send(data, 1 + n * sizeof(trace_event_t), ctx);
+			if(stream_failed) lost += n;
+			else frames++;
+		}
+		done += n;
+	}
+	return done;
+}
+
+//the whole frame or none of it; the room checked before sending can be taken by another writer in between
+static void send_frame(const uint8_t* frame, uint16_t len, void* ctx) {
+	if(!CDC_Write_All(frame, len)) stream_failed = true;
+}
+
+static void send_stream(const uint8_t* data, uint16_t len, void* ctx) {
+	proto_reply((const proto_reply_t*)ctx, PROTO_MORE, data, len);
+}
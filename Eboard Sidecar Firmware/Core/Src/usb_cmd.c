@@ -0,0 +1,281 @@
+#include "usb_cmd.h"
+#include "rtos_objects.h"
+#include "usbd_cdc_if.h"
+#include "protocol.h"
+#include "config.h"
+#include "batt_monitor.h"
+#include "board_lights.h"
+#include "datalog.h"
+#include "ride_stats.h"
+#include "adc_stream.h"
+#include "cpu_stats.h"
+#include "stack_watch.h"
+#include "trace.h"
+#include "bench.h"
+#include "string.h"
+
+//======================= some defines ======================
+#define RX_FLAG (1<<0) //packets are waiting in the CDC receive slots
+#define TX_WAIT_TIME 100 //ms to wait for room in the transmit ring before deciding the host isn't reading
+#define CURRENT_RIDE 0xFFFF
+#define ALL_BENCHMARKS 0xFF
+
+//===================== PRIVATE VARIABLES =====================
+static osEventFlagsId_t usb_cmd_flags = NULL;
+static osThreadId_t usb_cmd_handle = NULL;
+static proto_rx_t rx;
+static bool tx_gave_up = false; //the host stopped reading partway through a request, skip the rest of its replies
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void run_usb_cmd(void* argument);
+static void on_frame(const uint8_t* payload, uint16_t len, void* ctx);
+static void send_frame(const uint8_t* frame, uint16_t len, void* ctx);
+static void send_record(uint8_t type, const uint8_t* data, uint8_t len, void* ctx);
+static void send_trace(const uint8_t* data, uint16_t len, void* ctx);
+
+//command handlers, see protocol.h for the argument and reply layouts
+static void do_ping(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_status(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_config_get(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_config_set(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_config_save(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_cpu_stats(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_stacks(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_trace(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_bench(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static uint32_t bench_cycles();
+static void do_log_read(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_ride_summary(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+static void do_stream(const uint8_t* args, uint16_t len, const proto_reply_t* reply);
+
+static const proto_command_t commands[PROTO_NUM_CMDS] = {
+	[PROTO_PING] = 			{.min_args = 0, .handler = do_ping},
+	[PROTO_STATUS] = 		{.min_args = 0, .handler = do_status},
+	[PROTO_CONFIG_GET] = 	{.min_args = 1, .handler = do_config_get},
+	[PROTO_CONFIG_SET] = 	{.min_args = 1 + sizeof(int32_t), .handler = do_config_set},
+	[PROTO_LOG_READ] = 		{.min_args = sizeof(proto_log_read_t), .handler = do_log_read},
+	[PROTO_RIDE_SUMMARY] = 	{.min_args = sizeof(uint16_t), .handler = do_ride_summary},
+	[PROTO_STREAM] = 		{.min_args = 1, .handler = do_stream},
+	[PROTO_CONFIG_SAVE] = 	{.min_args = 0, .handler = do_config_save},
+	[PROTO_CPU_STATS] = 	{.min_args = 0, .handler = do_cpu_stats},
+	[PROTO_STACKS] = 		{.min_args = 0, .handler = do_stacks},
+	[PROTO_TRACE] = 		{.min_args = 1, .handler = do_trace},
+	[PROTO_BENCH] = 		{.min_args = 0, .handler = do_bench},
+};
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void usb_cmd_init() {
+	proto_rx_init(&rx);
+
+	const osEventFlagsAttr_t usb_cmd_flags_attributes = RTOS_FLAGS_ATTR(usb_cmd);
+	usb_cmd_flags = osEventFlagsNew(&usb_cmd_flags_attributes);
+
+	const osThreadAttr_t usb_cmd_attributes = RTOS_THREAD_ATTR(usb_cmd, "usb_cmd", osPriorityBelowNormal);
+	usb_cmd_handle = osThreadNew(run_usb_cmd, NULL, &usb_cmd_attributes);
+}
+
+void usb_cmd_rx_notify() {
+	if(usb_cmd_flags) osEventFlagsSet(usb_cmd_flags, RX_FLAG);
+}
+
+uint32_t usb_cmd_stack_space() {return osThreadGetStackSpace(usb_cmd_handle);}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void run_usb_cmd(void* argument) {
+	const uint8_t* packet;
+	uint16_t len;
+
+	while(1) {
+		//decode every waiting packet straight out of its receive slot, then give the slot back
+		while(CDC_Rx_Peek(&packet, &len)) {
+			proto_rx_feed(&rx, packet, len, on_frame, NULL);
+			CDC_Rx_Release();
+		}
+		osEventFlagsWait(usb_cmd_flags, RX_FLAG, osFlagsWaitAny, osWaitForever);
+	}
+
+	osThreadExit();
+}
+
+static void on_frame(const uint8_t* payload, uint16_t len, void* ctx) {
+	tx_gave_up = false;
+	proto_dispatch(commands, PROTO_NUM_CMDS, payload, len, send_frame, NULL);
+}
+
+static void send_frame(const uint8_t* frame, uint16_t len, void* ctx) {
+	//wait for the whole frame to fit rather than send half of one; printf, dlog and the streams share the ring,
+	//so the room can still be gone by the time we write, in which case CDC_Write_All() takes none of it
+	for(uint32_t waited = 0; CDC_Tx_Space() < len || !CDC_Write_All(frame, len); waited++) {
+		if(tx_gave_up || waited >= TX_WAIT_TIME) {
+			tx_gave_up = true;
+			return;
+		}
+		osDelay(1);
+	}
+}
+
+static void send_record(uint8_t type, const uint8_t* data, uint8_t len, void* ctx) {
+	uint8_t record[1 + DATALOG_MAX_RECORD];
+	record[0] = type;
+	memcpy(record + 1, data, len);
+	proto_reply((const proto_reply_t*)ctx, PROTO_MORE, record, len + 1);
+}
+
+static void send_trace(const uint8_t* data, uint16_t len, void* ctx) {
+	proto_reply((const proto_reply_t*)ctx, PROTO_MORE, data, len);
+}
+
+static void do_ping(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	proto_reply(reply, PROTO_OK, args, len);
+}
+
+static void do_status(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	datalog_stats_t log;
+	cdc_tx_stats_t tx;
+	datalog_get_stats(&log);
+	CDC_Get_Tx_Stats(&tx);
+
+	proto_status_t status = {
+		.tick = HAL_GetTick(),
+		.voltage = monitor_voltage() * 100,
+		.soc = monitor_soc() > 0 ? monitor_soc() * 1000 : 0,
+		.light_mode = board_lights_mode(),
+		.ride = datalog_ride(),
+		.log_records = log.records,
+		.log_dropped = log.dropped + log.shed,
+		.tx_dropped = tx.dropped,
+		.rx_bad_frames = rx.crc_errors + rx.framing_errors + rx.overflows,
+	};
+	proto_reply(reply, PROTO_OK, &status, sizeof(status));
+}
+
+static void do_config_get(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	int32_t min, max;
+	if(!config_limits(args[0], &min, &max)) {
+		proto_reply(reply, PROTO_BAD_ARG, NULL, 0);
+		return;
+	}
+	proto_config_t config = {.id = args[0], .value = config_get(args[0]), .min = min, .max = max};
+	proto_reply(reply, PROTO_OK, &config, sizeof(config));
+}
+
+static void do_config_set(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	int32_t value;
+	memcpy(&value, args + 1, sizeof(value));
+	if(!config_set(args[0], value)) {
+		proto_reply(reply, PROTO_BAD_ARG, NULL, 0);
+		return;
+	}
+	do_config_get(args, len, reply); //answer with what it's set to now
+}
+
+static void do_config_save(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	bool ok = config_commit();
+	config_store_info_t store;
+	config_get_store_info(&store);
+	proto_config_save_t save = {.seq = store.seq, .slot = store.slot, .used = store.used, .failures = store.failures};
+	proto_reply(reply, ok ? PROTO_OK : PROTO_FAILED, &save, sizeof(save));
+}
+
+static void do_cpu_stats(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	for(uint8_t n = 0; n < CPU_STATS_MAX_THREADS; n++) {
+		cpu_thread_stats_t stats;
+		if(!cpu_stats_thread(n, &stats)) continue;
+		proto_cpu_thread_t thread = {.number = n, .share = stats.share, .switches = stats.switches};
+		strncpy(thread.name, stats.name, sizeof(thread.name) - 1);
+		proto_reply(reply, PROTO_MORE, &thread, sizeof(thread));
+	}
+
+	cpu_stats_summary_t summary;
+	cpu_stats_get_summary(&summary);
+	proto_cpu_summary_t out = {.idle = summary.idle, .idle_avg = summary.idle_avg, .switches = summary.switches,
+			.cycles = summary.cycles};
+	proto_reply(reply, PROTO_OK, &out, sizeof(out));
+}
+
+static void do_stacks(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	stack_watch_info_t info;
+	for(uint8_t n = 0; stack_watch_thread(n, &info); n++) {
+		if(!info.started) continue;
+		proto_stack_t stack = {.number = n, .size = info.size, .peak = info.peak, .suggested = info.suggested};
+		strncpy(stack.name, info.name, sizeof(stack.name) - 1);
+		proto_reply(reply, PROTO_MORE, &stack, sizeof(stack));
+	}
+
+	bool overflowed;
+	uint8_t thread = stack_watch_overflowed(&overflowed);
+	proto_stack_summary_t summary = {.threads = stack_watch_count(), .overflowed = overflowed ? thread : 0xFF};
+	proto_reply(reply, PROTO_OK, &summary, sizeof(summary));
+}
+
+static void do_trace(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	uint32_t sent = 0;
+	if(args[0] == TRACE_DUMP) sent = trace_dump(send_trace, (void*)reply);
+	else if(args[0] <= TRACE_SNAPSHOT) trace_set_mode(args[0]);
+	else {
+		proto_reply(reply, PROTO_BAD_ARG, NULL, 0);
+		return;
+	}
+
+	trace_stats_t stats;
+	trace_get_stats(&stats);
+	proto_trace_t out = {.mode = stats.mode, .cycles_per_event = stats.cycles_per_event, .events = stats.events,
+			.lost = stats.lost, .sent = sent};
+	proto_reply(reply, PROTO_OK, &out, sizeof(out));
+}
+
+static void do_bench(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	uint8_t which = len >= 1 ? args[0] : ALL_BENCHMARKS;
+	uint16_t reps = BENCH_DEFAULT_REPS;
+	if(len >= 1 + sizeof(reps)) memcpy(&reps, args + 1, sizeof(reps));
+	if(!reps || reps > BENCH_MAX_REPS || (which != ALL_BENCHMARKS && which >= bench_count())) {
+		proto_reply(reply, PROTO_BAD_ARG, NULL, 0);
+		return;
+	}
+
+	//runs right here in the command thread, so everything above it still gets in; the minimum sees past that
+	for(uint8_t n = 0; n < bench_count(); n++) {
+		if(which != ALL_BENCHMARKS && n != which) continue;
+		const bench_t* b = bench_get(n);
+		bench_result_t result;
+		bench_run(b, reps, bench_cycles, &result);
+
+		proto_bench_t out = {.number = n, .items = b->items, .reps = reps, .min = result.min, .max = result.max,
+				.mean = result.total / reps, .result = result.result};
+		strncpy(out.name, b->name, sizeof(out.name) - 1);
+		strncpy(out.job, b->job, sizeof(out.job) - 1);
+		proto_reply(reply, PROTO_MORE, &out, sizeof(out));
+	}
+
+	proto_bench_summary_t summary = {.benchmarks = bench_count(), .clock_hz = SystemCoreClock};
+	proto_reply(reply, PROTO_OK, &summary, sizeof(summary));
+}
+
+static uint32_t bench_cycles() { return TRACE_CYCLES(); } //DWT->CYCCNT
+
+static void do_log_read(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	proto_log_read_t req;
+	memcpy(&req, args, sizeof(req));
+
+	uint32_t count = datalog_retrieve(req.ride, req.from, req.to, send_record, (void*)reply);
+	proto_reply(reply, PROTO_OK, &count, sizeof(count));
+}
+
+static void do_ride_summary(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	ride_summary_t summary;
+	uint16_t ride;
+	memcpy(&ride, args, sizeof(ride));
+
+	if(ride == CURRENT_RIDE || ride == datalog_ride()) ride_stats_summary(&summary, NULL);
+	else if(!ride_stats_load(ride, &summary)) {
+		proto_reply(reply, PROTO_NOT_FOUND, NULL, 0);
+		return;
+	}
+	proto_reply(reply, PROTO_OK, &summary, sizeof(summary));
+}
+
+static void do_stream(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	uint32_t rate = ADC_STREAM_RATE;
+	adc_stream_enable(args[0] != 0);
+	proto_reply(reply, PROTO_OK, &rate, sizeof(rate));
+}
@@ -0,0 +1,131 @@
+//capture the raw battery ADC stream (PROTO_STREAM) on a Linux host
+//turns streaming on, writes every sample out as CSV, reports gaps in the block sequence, and
+//turns streaming back off at the end
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc Tools/adc_stream.c Core/Src/protocol.c Core/Src/checksum.c -o adc_stream
+//usage: ./adc_stream /dev/ttyACM0 [seconds] > samples.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include "protocol.h"
+
+#define DIVIDER_RATIO 0.00887937 //adc bits to volts, default of CONFIG_DIVIDER_NV (config.h)
+#define DRAIN_TIME 1 //s to let the last blocks in flight arrive after turning the stream off
+
+static int port;
+static uint32_t rate = 0; //from the reply to the enable command
+static uint32_t raw_left = 0; //bytes of samples still to come after a block header
+static uint8_t raw_buf[2];
+static uint8_t raw_have = 0;
+
+static uint32_t blocks = 0, gaps = 0, missing = 0, torn = 0;
+static uint32_t expect_seq = 0, last_torn = 0;
+static uint64_t sample_index = 0;
+
+static void send_command(uint8_t cmd, const uint8_t* args, uint16_t len) {
+	static uint8_t seq = 0;
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+	uint8_t frame[PROTO_MAX_FRAME];
+	payload[0] = cmd;
+	payload[1] = seq++;
+	memcpy(payload + 2, args, len);
+	uint16_t n = proto_encode(payload, len + 2, frame);
+	if(write(port, frame, n) != n) perror("write");
+}
+
+static void on_frame(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len < 3 || payload[0] != (PROTO_STREAM | PROTO_REPLY)) return; //anything else (status replies etc) is ignored
+
+	if(payload[2] == PROTO_OK && len >= 3 + sizeof(uint32_t)) {
+		memcpy(&rate, payload + 3, sizeof(rate));
+		fprintf(stderr, "streaming at %u Hz\n", rate);
+	}
+	else if(payload[2] == PROTO_MORE && len >= 3 + sizeof(proto_stream_block_t)) {
+		proto_stream_block_t block;
+		memcpy(&block, payload + 3, sizeof(block));
+
+		if(blocks > 0 && block.seq != expect_seq) {
+			gaps++;
+			missing += block.seq - expect_seq;
+			fprintf(stderr, "gap: blocks %u to %u missing\n", expect_seq, block.seq - 1);
+		}
+		//the count is the device's since boot, only what goes up while we're listening is ours
+		if(blocks > 0 && block.torn != last_torn) {
+			torn += block.torn - last_torn;
+			fprintf(stderr, "torn: block %u was overwritten on its way out\n", block.seq - 1);
+		}
+		last_torn = block.torn;
+		//keep the sample index on the device's timeline, so a gap shows up as a jump
+		if(blocks == 0) sample_index = 0;
+		else sample_index += (uint64_t)(block.seq - expect_seq) * block.samples;
+
+		expect_seq = block.seq + 1;
+		blocks++;
+		raw_left = block.samples * sizeof(uint16_t);
+	}
+}
+
+static void on_sample(uint16_t raw) {
+	double t = rate ? (double)sample_index / rate : 0;
+	printf("%llu,%.6f,%u,%.3f\n", (unsigned long long)sample_index, t, raw, raw * DIVIDER_RATIO);
+	sample_index++;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s /dev/ttyACM0 [seconds] > samples.csv\n", argv[0]);
+		return 1;
+	}
+	double seconds = argc > 2 ? atof(argv[2]) : 10;
+
+	port = open(argv[1], O_RDWR | O_NOCTTY);
+	if(port < 0) { perror(argv[1]); return 1; }
+	struct termios tio;
+	tcgetattr(port, &tio);
+	cfmakeraw(&tio);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 1; //reads give up after 100ms
+	tcsetattr(port, TCSANOW, &tio);
+
+	proto_rx_t rx;
+	proto_rx_init(&rx);
+
+	uint8_t on = 1, off = 0;
+	send_command(PROTO_STREAM, &on, 1);
+	printf("index,seconds,raw,volts\n");
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint8_t buf[4096];
+	do {
+		ssize_t n = read(port, buf, sizeof(buf));
+		for(ssize_t i = 0; i < n; i++) {
+			//samples aren't framed, they just follow their header
+			if(raw_left) {
+				raw_buf[raw_have++] = buf[i];
+				raw_left--;
+				if(raw_have == 2) {
+					on_sample(raw_buf[0] | (raw_buf[1] << 8));
+					raw_have = 0;
+				}
+				continue;
+			}
+			proto_rx_feed(&rx, &buf[i], 1, on_frame, NULL);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9 < seconds);
+
+	send_command(PROTO_STREAM, &off, 1);
+	sleep(DRAIN_TIME);
+	tcflush(port, TCIFLUSH);
+	close(port);
+
+	fprintf(stderr, "%u blocks (%llu samples), %u gaps, %u blocks missing, %u torn, %u bad frames\n", blocks,
+			(unsigned long long)sample_index, gaps, missing, torn, rx.crc_errors + rx.framing_errors + rx.overflows);
+	return 0;
+}
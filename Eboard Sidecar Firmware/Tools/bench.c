@@ -0,0 +1,164 @@
+//run the hot routine benchmarks (Core/Inc/bench.h) on a Linux host, or on the board over USB (PROTO_BENCH)
+//either way it writes one CSV line per benchmark to stdout, the same columns from both, and compares each
+//candidate implementation against the first one of its job on stderr:
+//  where,job,name,items,reps,unit,min,mean,max,min_per_item,result
+//on the host the clock is the TSC (ns elsewhere) and the firmware is the host build (Tools/host), so the HAL
+//calls in bargraph_output time the mock; on the board it's the DWT cycle counter
+//build from the Tools directory:
+//  cmake -S . -B build && cmake --build build
+//usage: ./build/bench [reps] > host.csv
+//       ./build/bench /dev/ttyACM0 [reps] > board.csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include "bench.h"
+#include "protocol.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CLOCK_UNIT "TSC"
+static uint32_t host_clock() { return (uint32_t)__rdtsc(); }
+#else
+#define CLOCK_UNIT "ns"
+static uint32_t host_clock() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint32_t)(t.tv_sec * 1000000000ull + t.tv_nsec);
+}
+#endif
+
+#define MAX_RESULTS 256
+#define REPLY_WAIT 10 //s for the board to get through the whole table
+
+typedef struct {
+	char job[16], name[20];
+	uint16_t items, reps;
+	uint32_t min, mean, max, result;
+} row_t;
+
+static row_t rows[MAX_RESULTS];
+static uint32_t num_rows = 0;
+static int port = -1;
+static bool done = false;
+
+static void send_command(uint8_t cmd, const uint8_t* args, uint16_t len) {
+	static uint8_t seq = 0;
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+	uint8_t frame[PROTO_MAX_FRAME];
+	payload[0] = cmd;
+	payload[1] = seq++;
+	memcpy(payload + 2, args, len);
+	uint16_t n = proto_encode(payload, len + 2, frame);
+	if(write(port, frame, n) != n) perror("write");
+}
+
+static void on_frame(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len < 3 || payload[0] != (PROTO_BENCH | PROTO_REPLY)) return;
+	if(payload[2] == PROTO_MORE && len >= 3 + sizeof(proto_bench_t) && num_rows < MAX_RESULTS) {
+		proto_bench_t b;
+		memcpy(&b, payload + 3, sizeof(b));
+		row_t* r = &rows[num_rows++];
+		*r = (row_t){.items = b.items, .reps = b.reps, .min = b.min, .mean = b.mean, .max = b.max, .result = b.result};
+		snprintf(r->name, sizeof(r->name), "%.*s", (int)sizeof(b.name), b.name);
+		snprintf(r->job, sizeof(r->job), "%.*s", (int)sizeof(b.job), b.job);
+	}
+	else if(payload[2] == PROTO_OK && len >= 3 + sizeof(proto_bench_summary_t)) {
+		proto_bench_summary_t summary;
+		memcpy(&summary, payload + 3, sizeof(summary));
+		fprintf(stderr, "board: %u benchmarks at %u Hz\n", summary.benchmarks, summary.clock_hz);
+		done = true;
+	}
+	else if(payload[2] != PROTO_MORE) {
+		fprintf(stderr, "board refused the benchmark request (status %u)\n", payload[2]);
+		done = true;
+	}
+}
+
+static bool run_on_board(const char* device, uint16_t reps) {
+	port = open(device, O_RDWR | O_NOCTTY);
+	if(port < 0) { perror(device); return false; }
+	struct termios tio;
+	tcgetattr(port, &tio);
+	cfmakeraw(&tio);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 1; //reads give up after 100ms
+	tcsetattr(port, TCSANOW, &tio);
+
+	proto_rx_t rx;
+	proto_rx_init(&rx);
+	uint8_t args[3] = {0xFF}; //all of them
+	memcpy(args + 1, &reps, sizeof(reps));
+	send_command(PROTO_BENCH, args, sizeof(args));
+
+	struct timespec start, now;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	uint8_t buf[4096];
+	do {
+		ssize_t n = read(port, buf, sizeof(buf));
+		if(n > 0) proto_rx_feed(&rx, buf, n, on_frame, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while(!done && now.tv_sec - start.tv_sec < REPLY_WAIT);
+	close(port);
+
+	if(!done) fprintf(stderr, "no reply from the board\n");
+	return done && num_rows > 0;
+}
+
+static void run_on_host(uint16_t reps) {
+	for(uint8_t n = 0; n < bench_count() && num_rows < MAX_RESULTS; n++) {
+		const bench_t* b = bench_get(n);
+		bench_result_t result;
+		bench_run(b, reps, host_clock, &result);
+
+		row_t* r = &rows[num_rows++];
+		*r = (row_t){.items = b->items, .reps = reps, .min = result.min, .mean = result.total / reps,
+				.max = result.max, .result = result.result};
+		snprintf(r->name, sizeof(r->name), "%s", b->name);
+		snprintf(r->job, sizeof(r->job), "%s", b->job);
+	}
+}
+
+int main(int argc, char** argv) {
+	bool board = argc > 1 && argv[1][0] == '/';
+	int reps_arg = board ? 2 : 1;
+	uint16_t reps = argc > reps_arg ? (uint16_t)atoi(argv[reps_arg]) : BENCH_DEFAULT_REPS;
+	if(!reps || reps > BENCH_MAX_REPS) {
+		fprintf(stderr, "reps: 1 to %u\n", BENCH_MAX_REPS);
+		return 1;
+	}
+
+	if(board) {
+		if(!run_on_board(argv[1], reps)) return 1;
+	}
+	else run_on_host(reps);
+
+	const char* where = board ? "board" : "host";
+	const char* unit = board ? "cycles" : CLOCK_UNIT;
+	printf("where,job,name,items,reps,unit,min,mean,max,min_per_item,result\n");
+	for(uint32_t i = 0; i < num_rows; i++) {
+		row_t* r = &rows[i];
+		printf("%s,%s,%s,%u,%u,%s,%u,%u,%u,%.3f,%u\n", where, r->job, r->name, r->items, r->reps, unit, r->min,
+				r->mean, r->max, r->items ? (double)r->min / r->items : 0, r->result);
+	}
+
+	//candidates against the first implementation of their job
+	for(uint32_t i = 0; i < num_rows; i++) {
+		row_t* r = &rows[i];
+		uint32_t first = 0;
+		while(strcmp(rows[first].job, r->job)) first++;
+		if(first == i) {
+			fprintf(stderr, "%-12s %-16s %8u %s (%.2f per item)\n", r->job, r->name, r->min, unit,
+					r->items ? (double)r->min / r->items : 0);
+			continue;
+		}
+		row_t* f = &rows[first];
+		fprintf(stderr, "%-12s %-16s %8u %s (%.2fx %s)%s\n", r->job, r->name, r->min, unit,
+				r->min ? (double)f->min / r->min : 0, f->name, r->result == f->result ? "" : ", result differs");
+	}
+	return 0;
+}
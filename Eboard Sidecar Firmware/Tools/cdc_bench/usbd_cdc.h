@@ -0,0 +1,59 @@
+#ifndef __USB_CDC_H
+#define __USB_CDC_H
+
+#include "stdint.h"
+#include "stddef.h"
+
+//just enough of the ST USB device library for USB_DEVICE/App/usbd_cdc_if.c to build on its own, under
+//Tools/cdc_ring_bench.c; names and values are the real ones (usbd_def.h, usbd_cdc.h), the endpoint
+//calls are the bench's model of the bus
+
+#define UNUSED(X) (void)X
+
+#define CDC_DATA_FS_MAX_PACKET_SIZE 64U
+#define CDC_DATA_FS_OUT_PACKET_SIZE CDC_DATA_FS_MAX_PACKET_SIZE
+
+#define CDC_SEND_ENCAPSULATED_COMMAND 0x00U
+#define CDC_GET_ENCAPSULATED_RESPONSE 0x01U
+#define CDC_SET_COMM_FEATURE 0x02U
+#define CDC_GET_COMM_FEATURE 0x03U
+#define CDC_CLEAR_COMM_FEATURE 0x04U
+#define CDC_SET_LINE_CODING 0x20U
+#define CDC_GET_LINE_CODING 0x21U
+#define CDC_SET_CONTROL_LINE_STATE 0x22U
+#define CDC_SEND_BREAK 0x23U
+
+#define USBD_STATE_CONFIGURED 0x03U
+
+typedef enum {
+	USBD_OK = 0U,
+	USBD_BUSY,
+	USBD_EMEM,
+	USBD_FAIL,
+} USBD_StatusTypeDef;
+
+typedef struct {
+	uint8_t dev_state;
+	void* pClassData;
+} USBD_HandleTypeDef;
+
+typedef struct {
+	int8_t (*Init)(void);
+	int8_t (*DeInit)(void);
+	int8_t (*Control)(uint8_t cmd, uint8_t* pbuf, uint16_t length);
+	int8_t (*Receive)(uint8_t* Buf, uint32_t* Len);
+	int8_t (*TransmitCplt)(uint8_t* Buf, uint32_t* Len, uint8_t epnum);
+} USBD_CDC_ItfTypeDef;
+
+uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef* pdev, uint8_t* pbuff, uint32_t length);
+uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef* pdev, uint8_t* pbuff);
+uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef* pdev);
+uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef* pdev);
+
+//the bench has no interrupts of its own, nothing to mask
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) {}
+static inline void __DMB(void) { __sync_synchronize(); }
+
+#endif
@@ -0,0 +1,209 @@
+//host throughput check for the CDC transmit ring (USB_DEVICE/App/usbd_cdc_if.c) against a model of the
+//full-speed bulk IN pipe: the host keeps asking for packets back to back, each transaction takes its bytes plus
+//PROTOCOL_BYTES at 12Mbit/s, none may run past the end of the 1ms frame, and asking while nothing is armed
+//costs a NAK; a transfer that ends on a packet boundary gets a zero length packet (what usbd_cdc.c does), and
+//the transfer-complete interrupt comes some microseconds after the last packet
+//with the whole frame that's 19 packets, 1216 KB/s, the most full speed bulk can do
+//a writer offers a steady stream in writes of a given size, below and above what the pipe can take; every
+//byte is numbered so anything lost or reordered inside what the ring accepted shows up as a mismatch
+//"direct" is the old path for comparison: straight to the endpoint, dropped while a transfer is running
+//the pipe is the best case, a host that polls every slot; real ones often give less
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ITools/cdc_bench -IUSB_DEVICE/App -ICore/Inc Tools/cdc_ring_bench.c USB_DEVICE/App/usbd_cdc_if.c -o cdc_ring_bench
+//usage: ./cdc_ring_bench [packets per frame the host gives the endpoint] [interrupt latency us]
+//exit status 1 on a mismatch, or on anything dropped while the writer is under the pipe's rate; ctest runs it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usbd_cdc_if.h"
+
+#define PACKETS_PER_FRAME 19 //the most a full-speed frame can carry of 64-byte bulk packets
+#define PACKET_SIZE CDC_DATA_FS_MAX_PACKET_SIZE
+#define FRAME_NS 1000000ull
+#define BIT_NS 83.333
+#define PROTOCOL_BYTES 13 //token, data packet and handshake framing, and the gaps; what gets the spec to 19
+#define NAK_BYTES 6 //token and NAK
+#define SOF_NS 3000ull
+#define ISR_LATENCY_NS 3000ull //DataIn interrupt, the class and CDC_TransmitCplt_FS() chaining the next chunk
+#define RUN_MS 2000
+#define WARMUP_MS 100 //left out of the rate, the ring fills up first
+#define MAX_WRITE 1024
+
+typedef struct {
+	bool busy; //TxState
+	uint8_t* buf;
+	uint32_t len; //TxLength
+	uint32_t sent;
+	bool zlp; //one more, empty, packet to go
+	uint64_t ready_at; //armed at, nothing goes before this
+	uint64_t done_at; //the completion interrupt, 0 until the last packet is out
+} pipe_t;
+
+typedef struct {
+	uint64_t delivered; //in the measured window
+	uint64_t accepted, offered;
+	uint32_t mismatches;
+} result_t;
+
+USBD_HandleTypeDef hUsbDeviceFS = {.dev_state = USBD_STATE_CONFIGURED, .pClassData = &hUsbDeviceFS};
+
+static pipe_t pipe;
+static uint64_t now;
+static uint64_t frame_end_ns; //how much of each frame the endpoint gets
+static uint64_t isr_ns = ISR_LATENCY_NS;
+static uint8_t* pending_buf; //SetTxBuffer
+static uint32_t pending_len;
+static uint8_t received; //the number the next byte should have
+static result_t result;
+static bool measuring;
+
+// ================== USB DEVICE LIBRARY ==================
+uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef* pdev, uint8_t* pbuff, uint32_t length) {
+	pending_buf = pbuff;
+	pending_len = length;
+	return USBD_OK;
+}
+
+uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef* pdev) {
+	if(pipe.busy) return USBD_BUSY;
+	pipe = (pipe_t){.busy = true, .buf = pending_buf, .len = pending_len, .ready_at = now};
+	pipe.zlp = pipe.len > 0 && pipe.len % PACKET_SIZE == 0;
+	return USBD_OK;
+}
+
+uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef* pdev, uint8_t* pbuff) { return USBD_OK; }
+uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef* pdev) { return USBD_OK; }
+void usb_cmd_rx_notify() {}
+
+// ================== PIPE ==================
+static uint64_t bus_ns(uint32_t bytes) {
+	return bytes * 8 * BIT_NS;
+}
+
+//the host asks for a packet at now, returns when the bus is free again
+static uint64_t transaction() {
+	uint64_t frame = now - now % FRAME_NS;
+	if(now < frame + SOF_NS) return frame + SOF_NS;
+
+	if(!pipe.busy || pipe.done_at || pipe.ready_at > now) {
+		uint64_t end = now + bus_ns(NAK_BYTES);
+		return end <= frame + frame_end_ns ? end : frame + FRAME_NS;
+	}
+
+	uint32_t n = pipe.len - pipe.sent;
+	if(n > PACKET_SIZE) n = PACKET_SIZE;
+	uint64_t end = now + bus_ns(PROTOCOL_BYTES + n);
+	if(end > frame + frame_end_ns) return frame + FRAME_NS; //doesn't fit, next frame
+
+	if(n == 0) pipe.zlp = false;
+	for(uint32_t i = 0; i < n; i++) {
+		if(pipe.buf[pipe.sent + i] != received++) result.mismatches++;
+	}
+	pipe.sent += n;
+	if(measuring) result.delivered += n;
+
+	if(pipe.sent == pipe.len && !pipe.zlp) pipe.done_at = end + isr_ns;
+	return end;
+}
+
+//OTG_FS_IRQHandler() -> USBD_CDC_DataIn() -> CDC_TransmitCplt_FS()
+static void complete() {
+	uint32_t len = pipe.len;
+	pipe.busy = false;
+	pipe.done_at = 0;
+	USBD_Interface_fops_FS.TransmitCplt(pipe.buf, &len, 1);
+}
+
+// ================== WRITER ==================
+static uint8_t direct_buf[MAX_WRITE]; //the old path handed the caller's buffer over, it has to stay put
+
+static void write(uint8_t* data, uint32_t size, bool direct) {
+	for(uint32_t i = 0; i < size; i++) data[i] = result.accepted + i;
+	result.offered += size;
+
+	if(!direct) {
+		result.accepted += CDC_Write_FS(data, size);
+		return;
+	}
+	if(pipe.busy) return; //CDC_Transmit_FS() saying USBD_BUSY
+	memcpy(direct_buf, data, size);
+	USBD_CDC_SetTxBuffer(&hUsbDeviceFS, direct_buf, size);
+	USBD_CDC_TransmitPacket(&hUsbDeviceFS);
+	result.accepted += size;
+}
+
+static void run(uint32_t size, uint32_t percent, bool direct, uint32_t link) {
+	uint8_t data[MAX_WRITE];
+	uint64_t write_every = (uint64_t)size * FRAME_NS * 100 / ((uint64_t)link * percent);
+	cdc_tx_stats_t before, after;
+
+	//the ring carries on from the last run; let it drain first so the numbering starts clean
+	while(pipe.busy || CDC_Tx_Space() < APP_TX_DATA_SIZE) {
+		if(pipe.done_at && pipe.done_at <= now) complete();
+		now = transaction();
+	}
+	memset(&result, 0, sizeof(result));
+	received = 0;
+	CDC_Get_Tx_Stats(&before);
+
+	uint64_t start = now, next_slot = now, next_write = now;
+	while(now < start + RUN_MS * FRAME_NS) {
+		uint64_t next = next_slot;
+		if(next_write < next) next = next_write;
+		if(pipe.done_at && pipe.done_at < next) next = pipe.done_at;
+		now = next;
+		measuring = now >= start + WARMUP_MS * FRAME_NS;
+
+		if(pipe.done_at && pipe.done_at == now) complete();
+		else if(next_write == now) {
+			write(data, size, direct);
+			next_write += write_every;
+		}
+		else next_slot = transaction();
+	}
+	CDC_Get_Tx_Stats(&after);
+
+	double rate = result.delivered * 1.0 / (RUN_MS - WARMUP_MS); //bytes per ms, so KB/s
+	uint32_t transfers = after.transfers - before.transfers;
+	char per_transfer[16] = "-"; //the old path is one transfer per write
+	if(!direct && transfers) {
+		snprintf(per_transfer, sizeof(per_transfer), "%lu", (unsigned long)((after.queued - before.queued) / transfers));
+	}
+	printf("%-7s %5lu %4lu%%  %7.1f KB/s %5.1f%%  %6.1f%% dropped  %5s B/transfer  %lu mismatches\n",
+			direct ? "direct" : "ring", (unsigned long)size, (unsigned long)percent, rate, rate * 100 / link,
+			(result.offered - result.accepted) * 100.0 / result.offered, per_transfer, (unsigned long)result.mismatches);
+}
+
+int main(int argc, char** argv) {
+	uint32_t packets = argc > 1 ? atoi(argv[1]) : PACKETS_PER_FRAME;
+	if(argc > 2) isr_ns = atoi(argv[2]) * 1000ull;
+	if(packets == 0 || packets > PACKETS_PER_FRAME) {
+		fprintf(stderr, "packets per frame: 1 to %d\n", PACKETS_PER_FRAME);
+		return 2;
+	}
+	frame_end_ns = SOF_NS + packets * bus_ns(PROTOCOL_BYTES + PACKET_SIZE);
+	if(frame_end_ns > FRAME_NS) frame_end_ns = FRAME_NS;
+	uint32_t link = packets * PACKET_SIZE; //bytes per ms
+
+	static const uint32_t sizes[] = {16, 64, 256, 1024};
+	static const uint32_t loads[] = {90, 120};
+	uint32_t failed = 0;
+
+	USBD_Interface_fops_FS.Init();
+	printf("pipe: %lu packets per frame, %lu KB/s, completion interrupt %luus after the last packet\n",
+			(unsigned long)packets, (unsigned long)link, (unsigned long)(isr_ns / 1000));
+	printf("path     write  load  delivered   of pipe\n");
+	for(uint32_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		for(uint32_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+			run(sizes[s], loads[l], false, link);
+			if(result.mismatches || (loads[l] < 100 && result.accepted != result.offered)) failed++;
+		}
+		run(sizes[s], 90, true, link);
+	}
+
+	cdc_tx_stats_t stats;
+	CDC_Get_Tx_Stats(&stats);
+	printf("ring high-water mark %u of %u bytes\n", stats.max_fill, APP_TX_DATA_SIZE);
+	return failed ? 1 : 0;
+}
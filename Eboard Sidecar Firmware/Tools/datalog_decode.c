@@ -0,0 +1,195 @@
+//decode a dump of the datalog flash sectors on the host
+//pull the dump off the board with e.g.
+//  st-flash read datalog.bin 0x08040000 0x40000
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc Tools/datalog_decode.c Core/Src/flash_log.c Core/Src/log_index.c Core/Src/telemetry.c Core/Src/checksum.c -o datalog_decode
+//usage: ./datalog_decode datalog.bin [--index] [--ride n [--from ms] [--to ms]] > ride.csv
+//telemetry comes out as CSV on stdout, everything else as # comments
+//--index lists what each sector holds, --ride seeks straight to a window of one ride with the index
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_log.h"
+#include "telemetry.h"
+#include "log_index.h"
+#include "blackbox.h"
+#include "ride_stats.h"
+#include "cpu_stats.h"
+#include "stack_watch.h"
+#include "datalog_records.h"
+#include "shutdown_record.h"
+
+static const char* const blackbox_reasons[] = {"none", "soc critical", "read fail", "fault shutdown", "stack overflow"};
+static const char* const blackbox_kinds[] = {"?", "adc", "rc", "state", "stack overflow"};
+
+//the dump is read only; mounting never needs to write unless the log is blank or torn
+static bool image_erase(const flash_dev_t* dev, uint8_t sector) { return false; }
+static bool image_program(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len) { return false; }
+static void image_read(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len) {
+	memcpy(data, (const uint8_t*)dev->ctx + offset, len);
+}
+
+static void print_sample(const telem_sample_t* s, void* ctx) {
+	printf("%lu,%.2f,%.1f,%u,%u\n", (unsigned long)s->tick, s->voltage / 100.0, s->soc / 10.0, s->light_mode, s->flags);
+}
+
+int main(int argc, char** argv) {
+	bool list_index = false, window = false;
+	log_key_t from = {0}, to = {0, UINT32_MAX};
+
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s datalog.bin [--index] [--ride n [--from ms] [--to ms]]\n", argv[0]);
+		return 1;
+	}
+	for(int i = 2; i < argc; i++) {
+		if(!strcmp(argv[i], "--index")) list_index = true;
+		else if(!strcmp(argv[i], "--ride") && i + 1 < argc) {
+			window = true;
+			from.ride = to.ride = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--from") && i + 1 < argc) from.tick = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "--to") && i + 1 < argc) to.tick = strtoul(argv[++i], NULL, 0);
+	}
+
+	static uint8_t image[DATALOG_SECTOR_SIZE * DATALOG_NUM_SECTORS];
+	FILE* f = fopen(argv[1], "rb");
+	if(!f) {
+		perror(argv[1]);
+		return 1;
+	}
+	size_t got = fread(image, 1, sizeof(image), f);
+	fclose(f);
+	if(got != sizeof(image)) fprintf(stderr, "warning: dump is %zu bytes, expected %zu\n", got, sizeof(image));
+
+	flash_dev_t dev = {
+		.ctx = image,
+		.sector_size = DATALOG_SECTOR_SIZE,
+		.num_sectors = DATALOG_NUM_SECTORS,
+		.erase = image_erase,
+		.program = image_program,
+		.read = image_read,
+	};
+	flash_log_t log;
+	if(flash_log_mount(&log, &dev) != FLASH_LOG_OK) {
+		fprintf(stderr, "no log found in %s\n", argv[1]);
+		return 1;
+	}
+
+	log_index_t idx;
+	log_index_build(&idx, &log);
+	if(list_index) {
+		for(uint8_t order = 0, sector; (sector = flash_log_sector_by_age(&log, order)) != FLASH_LOG_NO_SECTOR; order++) {
+			const log_sector_index_t* e = &idx.sector[sector];
+			if(!e->used) printf("# sector %u: empty\n", sector);
+			else printf("# sector %u: ride %u @%lums to ride %u @%lums, %lu records in %u pages\n", sector, e->first.ride,
+					(unsigned long)e->first.tick, e->last.ride, (unsigned long)e->last.tick, (unsigned long)e->records, e->end - 1);
+		}
+		return 0;
+	}
+
+	flash_log_cursor_t cursor;
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t len;
+	uint32_t seq, pages = 0, records = 0, samples = 0;
+	telem_decoder_t dec;
+
+	telem_decoder_init(&dec);
+	printf("tick,voltage,soc,light_mode,flags\n");
+
+	if(!window) flash_log_rewind(&log, &cursor);
+	else if(!log_index_seek(&idx, &log, from, &cursor)) return 0;
+
+	while(flash_log_read_next(&log, &cursor, page, &len, &seq) == FLASH_LOG_OK) {
+		uint16_t offset = 0;
+		uint8_t type, rlen;
+		const uint8_t* data;
+		log_page_info_t info;
+
+		//stop once a page starts past the window
+		//(the window starts at a page boundary, so telemetry only picks up from the first keyframe in it)
+		if(window && log_page_info(page, len, &info) && log_key_cmp((log_key_t){info.ride, info.tick}, to) > 0) break;
+		pages++;
+
+		while(flash_log_record_next(page, len, &offset, &type, &data, &rlen)) {
+			records++;
+			if(type == DATALOG_BOOT && rlen == sizeof(datalog_boot_t)) {
+				datalog_boot_t b;
+				memcpy(&b, data, sizeof(b));
+				printf("# boot: sector seq %lu, %lu erases, %u pages free, %u torn\n", (unsigned long)b.sector_seq,
+						(unsigned long)b.erase_count, b.free_pages, b.torn_pages);
+				telem_decoder_init(&dec); //fresh encoder every boot
+			}
+			else if(type == DATALOG_STATE && rlen == sizeof(datalog_state_t)) {
+				datalog_state_t st;
+				memcpy(&st, data, sizeof(st));
+				printf("# [%lu] state %u -> %u (event %u)\n", (unsigned long)st.tick, st.from, st.to, st.event);
+			}
+			else if(type == LOG_PAGE_INFO) continue;
+			else if(type == DATALOG_BLACKBOX_HEAD && rlen == sizeof(datalog_blackbox_head_t)) {
+				datalog_blackbox_head_t h;
+				memcpy(&h, data, sizeof(h));
+				printf("# [%lu] black box (%s), %u entries:\n", (unsigned long)h.tick,
+						h.reason < sizeof(blackbox_reasons) / sizeof(blackbox_reasons[0]) ? blackbox_reasons[h.reason] : "?", h.count);
+			}
+			else if(type == DATALOG_BLACKBOX) {
+				for(uint8_t i = 0; i + sizeof(blackbox_entry_t) <= rlen; i += sizeof(blackbox_entry_t)) {
+					blackbox_entry_t e;
+					memcpy(&e, data + i, sizeof(e));
+					printf("#   %lu %s %u %u\n", (unsigned long)e.tick, e.kind <= BLACKBOX_STACK ? blackbox_kinds[e.kind] : "?", e.value, e.arg);
+				}
+			}
+			else if(type == DATALOG_RIDE_SUMMARY && rlen == sizeof(ride_summary_t)) {
+				ride_summary_t r;
+				memcpy(&r, data, sizeof(r));
+				printf("# ride %u summary: %us, %.2f-%.2fV (mean %.2f, sd %.2f), sag %.2fV mean %.2fV max, %.1fWh\n", r.ride,
+						r.duration, r.v_min / 100.0, r.v_max / 100.0, r.v_mean / 100.0, r.v_std / 100.0, r.sag_mean / 100.0,
+						r.sag_max / 100.0, r.energy / 10.0);
+				printf("#   light modes (s):");
+				for(int i = 0; i < RIDE_LIGHT_MODES; i++) printf(" %u", r.mode_time[i]);
+				printf("\n");
+			}
+			else if(type == DATALOG_RIDE_HIST && rlen == sizeof(ride_hist_t)) {
+				ride_hist_t h;
+				memcpy(&h, data, sizeof(h));
+				printf("# ride %u voltage histogram (s per %.1fV from %.1fV):", h.ride, RIDE_HIST_WIDTH, RIDE_HIST_MIN);
+				for(int i = 0; i < RIDE_HIST_BINS; i++) printf(" %u", h.seconds[i]);
+				printf("\n");
+			}
+			else if(type == DATALOG_CPU_STATS && rlen == sizeof(cpu_stats_record_t)) {
+				cpu_stats_record_t c;
+				memcpy(&c, data, sizeof(c));
+				printf("# cpu: idle %.1f%% (%.1f%% avg), %u switches/s, threads (%%):", c.idle / 10.0, c.idle_avg / 10.0,
+						c.switches * 1000 / CPU_STATS_PERIOD);
+				for(int i = 0; i < CPU_STATS_RECORD_THREADS; i++) if(c.share[i]) printf(" %d:%.1f", i + 1, c.share[i] / 2.0);
+				printf("\n");
+			}
+			else if(type == DATALOG_STACK && rlen == sizeof(stack_watch_record_t)) {
+				stack_watch_record_t s;
+				memcpy(&s, data, sizeof(s));
+				printf("# stack: thread %u (%.*s) peak %u of %u bytes, suggest %u\n", s.thread, (int)sizeof(s.name), s.name,
+						s.peak, s.size, s.suggested);
+			}
+			else if(type == DATALOG_SHUTDOWN && rlen == sizeof(shutdown_record_t)) {
+				shutdown_record_t s;
+				memcpy(&s, data, sizeof(s));
+				printf("# [%lu] shutdown in %ums, handlers (ms, in the order they registered):", (unsigned long)s.tick, s.total);
+				for(int i = 0; i < s.handlers && i < SHUTDOWN_MAX_HANDLERS; i++) {
+					if(s.took[i] == SHUTDOWN_TIMED_OUT) printf(" timed out");
+					else printf(" %u", s.took[i]);
+				}
+				printf("\n");
+			}
+			else if(type == DATALOG_TELEMETRY) {
+				int n = telem_decode_block(&dec, data, rlen, print_sample, NULL);
+				if(n < 0) printf("# bad telemetry block in page %lu\n", (unsigned long)seq);
+				else samples += n;
+			}
+			else printf("# unknown record type %u (%u bytes)\n", type, rlen);
+		}
+	}
+
+	fprintf(stderr, "%lu pages, %lu records, %lu samples, %lu telemetry blocks lost\n", (unsigned long)pages,
+			(unsigned long)records, (unsigned long)samples, (unsigned long)dec.lost_blocks);
+	return 0;
+}
@@ -0,0 +1,138 @@
+//format the deferred log (PROTO_DLOG frames) on a Linux host
+//the firmware only sends message IDs and raw argument words; the strings come from dlog_formats.h,
+//so build this from the same tree as the firmware that's running
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc Tools/dlog_decode.c Core/Src/protocol.c Core/Src/checksum.c -o dlog_decode
+//usage: ./dlog_decode /dev/ttyACM0    (or a file captured from the port)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "protocol.h"
+#include "dlog_formats.h"
+
+typedef struct {
+	const char* name;
+	uint8_t args;
+	const char* fmt;
+} dlog_format_t;
+
+#define DLOG_ENTRY(name, args, fmt) {#name, args, fmt},
+static const dlog_format_t formats[DLOG_NUM_FORMATS] = { DLOG_FORMATS(DLOG_ENTRY) };
+#undef DLOG_ENTRY
+
+static uint32_t records = 0, unknown = 0;
+
+static float word_to_float(uint32_t w) {
+	union { uint32_t u; float f; } v = {.u = w};
+	return v.f;
+}
+
+//printf one conversion at a time so each argument word goes in as the type its conversion expects
+//length modifiers are dropped since the words are always 32 bits on the wire
+static void format_record(char* out, size_t size, const char* fmt, const uint32_t* args, uint8_t nargs) {
+	size_t used = 0;
+	uint8_t arg = 0;
+
+	while(*fmt && used < size - 1) {
+		if(*fmt != '%') {
+			out[used++] = *fmt++;
+			continue;
+		}
+		if(fmt[1] == '%') {
+			out[used++] = '%';
+			fmt += 2;
+			continue;
+		}
+
+		char spec[16];
+		size_t n = 0;
+		spec[n++] = *fmt++;
+		while(*fmt && strchr("-+ #0123456789.", *fmt) && n < sizeof(spec) - 3) spec[n++] = *fmt++;
+		while(*fmt && strchr("hlLjzt", *fmt)) fmt++;
+		if(!*fmt) break;
+		char conv = *fmt++;
+		spec[n++] = conv;
+		spec[n] = 0;
+
+		uint32_t w = arg < nargs ? args[arg] : 0;
+		arg++;
+		int wrote;
+		if(strchr("fFeEgGaA", conv)) wrote = snprintf(out + used, size - used, spec, (double)word_to_float(w));
+		else if(strchr("di", conv)) wrote = snprintf(out + used, size - used, spec, (int)w);
+		else if(strchr("uxXoc", conv)) wrote = snprintf(out + used, size - used, spec, (unsigned)w);
+		else wrote = snprintf(out + used, size - used, "<%%%c?>", conv); //strings etc can't come across
+		if(wrote > 0) used += (size_t)wrote < size - used ? (size_t)wrote : size - used - 1;
+	}
+	out[used] = 0;
+}
+
+static void on_frame(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len < 3 || payload[0] != (PROTO_DLOG | PROTO_REPLY) || payload[2] != PROTO_MORE) return;
+
+	const uint8_t* p = payload + 3;
+	uint16_t words = (len - 3) / sizeof(uint32_t);
+	uint32_t w[PROTO_MAX_REPLY_DATA / sizeof(uint32_t)];
+	memcpy(w, p, words * sizeof(uint32_t));
+
+	for(uint16_t i = 0; i + 2 <= words;) {
+		uint32_t header = w[i];
+		uint8_t nargs = DLOG_HEADER_NARGS(header);
+		uint16_t id = DLOG_HEADER_ID(header);
+		if(!DLOG_HEADER_VALID(header) || i + 2 + nargs > words) {
+			fprintf(stderr, "bad record header 0x%08x, rest of frame skipped\n", header);
+			return;
+		}
+		uint32_t tick = w[i + 1];
+		const uint32_t* args = &w[i + 2];
+
+		char text[256];
+		if(id < DLOG_NUM_FORMATS && formats[id].args == nargs) {
+			format_record(text, sizeof(text), formats[id].fmt, args, nargs);
+		}
+		else {
+			//firmware and decoder built from different tables; show what we can
+			int n = snprintf(text, sizeof(text), "unknown message %u:", id);
+			for(uint8_t a = 0; a < nargs && n > 0 && n < (int)sizeof(text); a++) {
+				n += snprintf(text + n, sizeof(text) - n, " 0x%08x", args[a]);
+			}
+			unknown++;
+		}
+		printf("[%10u.%03u] %s\n", tick / 1000, tick % 1000, text);
+		fflush(stdout);
+		records++;
+		i += 2 + nargs;
+	}
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s /dev/ttyACM0\n", argv[0]);
+		return 1;
+	}
+
+	int port = open(argv[1], O_RDONLY | O_NOCTTY);
+	if(port < 0) { perror(argv[1]); return 1; }
+	struct termios tio;
+	if(tcgetattr(port, &tio) == 0) { //not a tty when reading back a capture
+		cfmakeraw(&tio);
+		tcsetattr(port, TCSANOW, &tio);
+	}
+
+	proto_rx_t rx;
+	proto_rx_init(&rx);
+
+	uint8_t buf[4096];
+	ssize_t n;
+	while((n = read(port, buf, sizeof(buf))) > 0) {
+		//printf text from the firmware is interleaved with the frames; the decoder drops it as framing errors
+		proto_rx_feed(&rx, buf, n, on_frame, NULL);
+	}
+	close(port);
+
+	fprintf(stderr, "%u records, %u unknown, %u bad frames\n", records, unknown, rx.crc_errors + rx.overflows);
+	return 0;
+}
@@ -0,0 +1,194 @@
+//host benchmark and power-cut check for the flash log (Core/Src/flash_log.c) on the RAM flash simulator
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc -ITools Tools/flash_log_bench.c Tools/flash_sim.c Core/Src/flash_log.c Core/Src/checksum.c -o flash_log_bench
+//usage: ./flash_log_bench [power cut trials]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_log.h"
+#include "flash_sim.h"
+#include "datalog_records.h"
+
+//same geometry as the firmware log (sectors 6-7 of the F401)
+#define SECTOR_SIZE DATALOG_SECTOR_SIZE
+#define NUM_SECTORS DATALOG_NUM_SECTORS
+
+#define RECORD_TYPE 1
+#define RECORD_LEN 14 //about the size of a telemetry sample
+
+static double now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+//pack records numbered from *next into a page; returns the page length
+static uint16_t fill_page(uint8_t* page, uint32_t* next) {
+	uint16_t used = 0;
+	uint8_t rec[RECORD_LEN];
+	while(true) {
+		memset(rec, (uint8_t)*next, sizeof(rec));
+		memcpy(rec, next, sizeof(*next));
+		if(!flash_log_record_put(page, &used, RECORD_TYPE, rec, sizeof(rec))) return used;
+		(*next)++;
+	}
+}
+
+//read everything back; checks the records come out in order with nothing corrupted
+//returns the number of records, or -1 if something was wrong
+static long verify(const flash_log_t* log, uint32_t* first) {
+	flash_log_cursor_t cur;
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t len;
+	uint32_t seq, last_seq = 0;
+	long count = 0;
+	uint32_t expect = 0;
+
+	flash_log_rewind(log, &cur);
+	while(flash_log_read_next(log, &cur, page, &len, &seq) == FLASH_LOG_OK) {
+		if(seq <= last_seq) return -1;
+		last_seq = seq;
+
+		uint16_t off = 0;
+		uint8_t type, rlen;
+		const uint8_t* data;
+		while(flash_log_record_next(page, len, &off, &type, &data, &rlen)) {
+			uint32_t n;
+			memcpy(&n, data, sizeof(n));
+			if(type != RECORD_TYPE || rlen != RECORD_LEN) return -1;
+			for(int i = sizeof(n); i < RECORD_LEN; i++) if(data[i] != (uint8_t)n) return -1;
+			if(count == 0) {
+				if(first) *first = n;
+			}
+			else if(n != expect) return -1; //a page went missing
+			expect = n + 1;
+			count++;
+		}
+	}
+	return count;
+}
+
+static int bench_throughput() {
+	flash_sim_t sim;
+	flash_dev_t dev;
+	flash_log_t log;
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	uint32_t next = 0, pages = 0, payload = 0;
+	const int rotations = 20;
+
+	flash_sim_init(&sim, &dev, SECTOR_SIZE, NUM_SECTORS);
+	double t0 = now_us();
+	if(flash_log_mount(&log, &dev) != FLASH_LOG_OK) return 1;
+	double t_mount_blank = now_us() - t0;
+	uint32_t read_blank = sim.bytes_read;
+
+	t0 = now_us();
+	for(int r = 0; r < rotations; r++) {
+		flash_log_status_t status;
+		do {
+			uint16_t len = fill_page(page, &next);
+			status = flash_log_append_page(&log, page, len);
+			if(status == FLASH_LOG_OK) {
+				pages++;
+				payload += len;
+			}
+		} while(status == FLASH_LOG_OK);
+		if(status != FLASH_LOG_FULL || flash_log_rotate(&log, true) != FLASH_LOG_OK) return 1;
+	}
+	double t_write = now_us() - t0;
+
+	t0 = now_us();
+	flash_log_t remount;
+	uint32_t bytes_before = sim.bytes_read;
+	flash_log_mount(&remount, &dev);
+	double t_mount = now_us() - t0;
+	uint32_t read_full = sim.bytes_read - bytes_before;
+
+	uint32_t first;
+	long count = verify(&remount, &first);
+
+	printf("throughput (%d rotations over %d x %dK sectors)\n", rotations, NUM_SECTORS, SECTOR_SIZE / 1024);
+	printf("  pages written      %lu, %.2f us/page on the host\n", (unsigned long)pages, t_write / pages);
+	printf("  records/page       %lu (%d byte records)\n", (unsigned long)(next / pages), RECORD_LEN);
+	printf("  payload efficiency %.1f%% of programmed bytes\n", 100.0 * payload / (sim.words_programmed * 4.0));
+	printf("  words programmed   %lu (%.1f per page)\n", (unsigned long)sim.words_programmed, (double)sim.words_programmed / pages);
+	printf("  erases per sector ");
+	for(int s = 0; s < NUM_SECTORS; s++) printf(" %lu", (unsigned long)sim.sector_erases[s]);
+	printf("\n  mount: blank %.1f us (%lu bytes read), full %.1f us (%lu bytes read)\n",
+			t_mount_blank, (unsigned long)read_blank, t_mount, (unsigned long)read_full);
+	printf("  readback           %ld records from #%lu %s\n", count, (unsigned long)first, count > 0 ? "ok" : "FAILED");
+
+	flash_sim_free(&sim);
+	return count > 0 ? 0 : 1;
+}
+
+//write a while, cut the power somewhere random, remount and make sure
+//every page that was acknowledged is still there and nothing came back corrupted
+static int bench_power_cut(int trials) {
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	int failures = 0;
+	uint32_t torn = 0;
+
+	for(int t = 0; t < trials; t++) {
+		flash_sim_t sim;
+		flash_dev_t dev;
+		flash_log_t log;
+		uint32_t next = 0;
+		long acked = 0;
+
+		flash_sim_init(&sim, &dev, SECTOR_SIZE, NUM_SECTORS);
+		flash_log_mount(&log, &dev);
+
+		//somewhere in the first few sectors' worth of writes, sometimes during an erase
+		flash_sim_cut_after(&sim, 1 + rand() % (3 * SECTOR_SIZE / 4));
+		while(!sim.powered_off) {
+			uint32_t start = next;
+			uint16_t len = fill_page(page, &next);
+			flash_log_status_t status = flash_log_append_page(&log, page, len);
+			if(status == FLASH_LOG_FULL) {
+				next = start;
+				flash_log_rotate(&log, true);
+			}
+		}
+
+		flash_sim_power_on(&sim);
+		flash_log_t after;
+		if(flash_log_mount(&after, &dev) != FLASH_LOG_OK) {
+			failures++;
+			continue;
+		}
+		torn += after.torn_pages;
+
+		//only two sectors, so the oldest records may have been rotated out -- just check what's left is intact
+		uint32_t first = 0;
+		acked = verify(&after, &first);
+		if(acked < 0) {
+			failures++;
+			flash_sim_free(&sim);
+			continue;
+		}
+
+		//and that we can carry on writing afterwards (the cut may have landed in a rotate, leaving the old sector full)
+		next = first + acked;
+		uint16_t len = fill_page(page, &next);
+		flash_log_status_t status = flash_log_append_page(&after, page, len);
+		if(status == FLASH_LOG_FULL && flash_log_rotate(&after, true) == FLASH_LOG_OK) status = flash_log_append_page(&after, page, len);
+		long total = verify(&after, &first);
+		if(status != FLASH_LOG_OK || total < 0 || first + total != next) failures++;
+
+		flash_sim_free(&sim);
+	}
+
+	printf("power cut: %d trials, %lu torn pages repaired, %d failures\n", trials, (unsigned long)torn, failures);
+	return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+	int trials = argc > 1 ? atoi(argv[1]) : 500;
+	srand(1);
+	int result = bench_throughput();
+	result |= bench_power_cut(trials);
+	return result;
+}
@@ -0,0 +1,89 @@
+#include "flash_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+//returns false (and marks the power as gone) if the cut point has been reached
+static bool sim_tick(flash_sim_t* sim) {
+	if(sim->cut_countdown && --sim->cut_countdown == 0) {
+		sim->powered_off = true;
+		return false;
+	}
+	return true;
+}
+
+static bool sim_erase(const flash_dev_t* dev, uint8_t sector) {
+	flash_sim_t* sim = (flash_sim_t*)dev->ctx;
+	uint8_t* base = sim->mem + sector * dev->sector_size;
+	if(sim->powered_off || sector >= dev->num_sectors) return false;
+
+	if(!sim_tick(sim)) {
+		//erase interrupted: some of the sector is erased, the rest is left as junk
+		uint32_t done = rand() % dev->sector_size;
+		memset(base, 0xFF, done);
+		for(uint32_t i = done; i < dev->sector_size; i++) base[i] &= rand();
+		return false;
+	}
+
+	memset(base, 0xFF, dev->sector_size);
+	sim->erases++;
+	sim->sector_erases[sector]++;
+	return true;
+}
+
+static bool sim_program(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len) {
+	flash_sim_t* sim = (flash_sim_t*)dev->ctx;
+	const uint8_t* src = (const uint8_t*)data;
+	if(sim->powered_off || (offset | len) & 3 || offset + len > sim->size) return false;
+
+	for(uint32_t i = 0; i < len; i += 4) {
+		uint32_t word, cur;
+		memcpy(&word, src + i, 4);
+		memcpy(&cur, sim->mem + offset + i, 4);
+
+		//interrupted word: only some of the bits made it
+		if(!sim_tick(sim)) {
+			cur &= word | (uint32_t)rand();
+			memcpy(sim->mem + offset + i, &cur, 4);
+			return false;
+		}
+
+		cur &= word; //can only clear bits
+		memcpy(sim->mem + offset + i, &cur, 4);
+		sim->words_programmed++;
+	}
+	return true;
+}
+
+static void sim_read(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len) {
+	flash_sim_t* sim = (flash_sim_t*)dev->ctx;
+	memcpy(data, sim->mem + offset, len);
+	sim->bytes_read += len;
+}
+
+void flash_sim_init(flash_sim_t* sim, flash_dev_t* dev, uint32_t sector_size, uint8_t num_sectors) {
+	memset(sim, 0, sizeof(flash_sim_t));
+	sim->size = sector_size * num_sectors;
+	sim->mem = malloc(sim->size);
+	memset(sim->mem, 0xFF, sim->size);
+
+	dev->ctx = sim;
+	dev->sector_size = sector_size;
+	dev->num_sectors = num_sectors;
+	dev->erase = sim_erase;
+	dev->program = sim_program;
+	dev->read = sim_read;
+}
+
+void flash_sim_free(flash_sim_t* sim) {
+	free(sim->mem);
+	sim->mem = NULL;
+}
+
+void flash_sim_cut_after(flash_sim_t* sim, uint32_t n) {
+	sim->cut_countdown = n;
+}
+
+void flash_sim_power_on(flash_sim_t* sim) {
+	sim->powered_off = false;
+	sim->cut_countdown = 0;
+}
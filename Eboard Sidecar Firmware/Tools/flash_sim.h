@@ -0,0 +1,38 @@
+#ifndef FLASH_SIM_H
+#define FLASH_SIM_H
+
+#include "flash_dev.h"
+
+#define FLASH_SIM_MAX_SECTORS 16
+
+//RAM-backed NOR flash for running the log code on the host
+//behaves like the real thing: program ANDs bits in, erase sets a sector to 0xFF
+//and it can fake a power cut partway through a program or erase
+
+typedef struct {
+	uint8_t* mem;
+	uint32_t size;
+
+	//counters
+	uint32_t erases;
+	uint32_t words_programmed;
+	uint32_t bytes_read;
+	uint32_t sector_erases[FLASH_SIM_MAX_SECTORS];
+
+	//power cut injection: after this many more word programs (or erases) everything fails
+	//0 disables it
+	uint32_t cut_countdown;
+	bool powered_off;
+} flash_sim_t;
+
+//sets up a simulated region, all erased
+void flash_sim_init(flash_sim_t* sim, flash_dev_t* dev, uint32_t sector_size, uint8_t num_sectors);
+void flash_sim_free(flash_sim_t* sim);
+
+//cut the power after n more flash operations (words or erases)
+void flash_sim_cut_after(flash_sim_t* sim, uint32_t n);
+
+//power back on; the flash contents are left as they were
+void flash_sim_power_on(flash_sim_t* sim);
+
+#endif
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include "board.h"
+#include "main.h"
+#include "cmsis_os.h"
+#include "usb_device.h"
+
+#include "state_machine.h" //defines the state machine thread and its globals, so only ever included here
+#include "usbd_cdc_if.h"
+#include "rtos_objects.h"
+
+//what main.c and the MSP/timebase files do on the board, minus the clock tree (the simulator runs at
+//SystemCoreClock from power on); keep the peripheral settings in step with them
+
+//===================== PUBLIC VARIABLES =====================
+ADC_HandleTypeDef hadc1;
+DMA_HandleTypeDef hdma_adc1;
+TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim3;
+TIM_HandleTypeDef htim4;
+TIM_HandleTypeDef htim5;
+TIM_HandleTypeDef htim11;
+
+osThreadId_t state_machineHandle;
+const osThreadAttr_t state_machine_attributes = RTOS_THREAD_ATTR(state_machine, "state_machine", osPriorityLow);
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
+static void MX_TIM2_Init(void);
+static void MX_TIM5_Init(void);
+static void MX_ADC1_Init(void);
+static void MX_TIM3_Init(void);
+static void MX_TIM4_Init(void);
+
+// ================== PUBLIC FUNCTION DEFS ==================
+void board_boot() {
+	HAL_Init();
+	MX_GPIO_Init();
+	MX_DMA_Init();
+	MX_TIM2_Init();
+	MX_TIM5_Init();
+	MX_ADC1_Init();
+	MX_TIM3_Init();
+	MX_TIM4_Init();
+	HAL_TIM_Base_Start_IT(&htim11);
+	MX_USB_DEVICE_Init();
+
+	osKernelInitialize();
+	state_machineHandle = osThreadNew(doStateMachine, NULL, &state_machine_attributes);
+	osKernelStart();
+}
+
+uint16_t board_battery_raw(float volts) {
+	float raw = volts / (config_get(CONFIG_DIVIDER_NV) * 1e-9f); //the divider as configured
+	if(raw > 4095) raw = 4095;
+	return (uint16_t)(raw + 0.5f);
+}
+
+void board_battery(float volts) {
+	sim_adc_constant(board_battery_raw(volts));
+}
+
+void board_button(bool pressed) {
+	sim_gpio_input(PB_IN_GPIO_Port, PB_IN_Pin, pressed);
+}
+
+void board_rc(bool high) {
+	sim_gpio_input(RC_IN_GPIO_Port, RC_IN_Pin, high);
+}
+
+bool board_fet_on() {
+	return sim_gpio_output(FET_DRV_GPIO_Port, FET_DRV_Pin);
+}
+
+// ================== HAL CALLBACKS ==================
+//stm32f4xx_hal_timebase_tim.c: TIM11 at 1MHz, updating every ms
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority) {
+	HAL_NVIC_SetPriority(TIM1_TRG_COM_TIM11_IRQn, TickPriority, 0);
+	HAL_NVIC_EnableIRQ(TIM1_TRG_COM_TIM11_IRQn);
+
+	htim11.Instance = TIM11;
+	htim11.Init.Period = (1000000 / 1000) - 1;
+	htim11.Init.Prescaler = (SystemCoreClock / 1000000) - 1;
+	htim11.Init.ClockDivision = 0;
+	htim11.Init.CounterMode = TIM_COUNTERMODE_UP;
+	if(HAL_TIM_Base_Init(&htim11) == HAL_OK) return HAL_TIM_Base_Start_IT(&htim11);
+	return HAL_ERROR;
+}
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim) {
+	if(htim->Instance == TIM3) board_lights_tim_overflow();
+	if(htim->Instance == TIM11) HAL_IncTick();
+}
+
+void HAL_TIM_MspPostInit(TIM_HandleTypeDef* htim) {
+	UNUSED(htim);
+}
+
+void Error_Handler(void) {
+	fprintf(stderr, "sim: Error_Handler()\n");
+	sim_power_off("Error_Handler");
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void MX_ADC1_Init(void) {
+	ADC_ChannelConfTypeDef sConfig = {0};
+
+	hadc1.Instance = ADC1;
+	hadc1.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
+	hadc1.Init.Resolution = ADC_RESOLUTION_12B;
+	hadc1.Init.ScanConvMode = DISABLE;
+	hadc1.Init.ContinuousConvMode = ENABLE;
+	hadc1.Init.DiscontinuousConvMode = DISABLE;
+	hadc1.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+	hadc1.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+	hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+	hadc1.Init.NbrOfConversion = 1;
+	hadc1.Init.DMAContinuousRequests = DISABLE;
+	hadc1.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+	if(HAL_ADC_Init(&hadc1) != HAL_OK) Error_Handler();
+
+	//HAL_ADC_MspInit()
+	hdma_adc1.Init.Mode = DMA_NORMAL;
+	if(HAL_DMA_Init(&hdma_adc1) != HAL_OK) Error_Handler();
+	hadc1.DMA_Handle = &hdma_adc1;
+	hdma_adc1.Parent = &hadc1;
+
+	sConfig.Channel = ADC_CHANNEL_10;
+	sConfig.Rank = 1;
+	sConfig.SamplingTime = ADC_SAMPLETIME_3CYCLES;
+	if(HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK) Error_Handler();
+}
+
+static void MX_TIM2_Init(void) {
+	TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+	TIM_MasterConfigTypeDef sMasterConfig = {0};
+	TIM_OC_InitTypeDef sConfigOC = {0};
+
+	htim2.Instance = TIM2;
+	htim2.Init.Prescaler = 64;
+	htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim2.Init.Period = 1000;
+	htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim2.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if(HAL_TIM_Base_Init(&htim2) != HAL_OK) Error_Handler();
+	sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+	if(HAL_TIM_ConfigClockSource(&htim2, &sClockSourceConfig) != HAL_OK) Error_Handler();
+	if(HAL_TIM_OC_Init(&htim2) != HAL_OK) Error_Handler();
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if(HAL_TIMEx_MasterConfigSynchronization(&htim2, &sMasterConfig) != HAL_OK) Error_Handler();
+	sConfigOC.OCMode = TIM_OCMODE_TOGGLE;
+	sConfigOC.Pulse = 0;
+	sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+	sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+	if(HAL_TIM_OC_ConfigChannel(&htim2, &sConfigOC, TIM_CHANNEL_3) != HAL_OK) Error_Handler();
+	HAL_TIM_MspPostInit(&htim2);
+}
+
+static void MX_TIM3_Init(void) {
+	TIM_MasterConfigTypeDef sMasterConfig = {0};
+	TIM_OC_InitTypeDef sConfigOC = {0};
+
+	htim3.Instance = TIM3;
+	htim3.Init.Prescaler = 63;
+	htim3.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim3.Init.Period = 49999;
+	htim3.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim3.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if(HAL_TIM_OC_Init(&htim3) != HAL_OK) Error_Handler();
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if(HAL_TIMEx_MasterConfigSynchronization(&htim3, &sMasterConfig) != HAL_OK) Error_Handler();
+	sConfigOC.OCMode = TIM_OCMODE_TIMING;
+	sConfigOC.Pulse = 0;
+	sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+	sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+	if(HAL_TIM_OC_ConfigChannel(&htim3, &sConfigOC, TIM_CHANNEL_1) != HAL_OK) Error_Handler();
+}
+
+static void MX_TIM4_Init(void) {
+	TIM_MasterConfigTypeDef sMasterConfig = {0};
+	TIM_OC_InitTypeDef sConfigOC = {0};
+
+	htim4.Instance = TIM4;
+	htim4.Init.Prescaler = 63;
+	htim4.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim4.Init.Period = 1000;
+	htim4.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim4.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if(HAL_TIM_PWM_Init(&htim4) != HAL_OK) Error_Handler();
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if(HAL_TIMEx_MasterConfigSynchronization(&htim4, &sMasterConfig) != HAL_OK) Error_Handler();
+	sConfigOC.OCMode = TIM_OCMODE_PWM1;
+	sConfigOC.Pulse = 0;
+	sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+	sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+	if(HAL_TIM_PWM_ConfigChannel(&htim4, &sConfigOC, TIM_CHANNEL_3) != HAL_OK) Error_Handler();
+	if(HAL_TIM_PWM_ConfigChannel(&htim4, &sConfigOC, TIM_CHANNEL_4) != HAL_OK) Error_Handler();
+	HAL_TIM_MspPostInit(&htim4);
+}
+
+static void MX_TIM5_Init(void) {
+	TIM_MasterConfigTypeDef sMasterConfig = {0};
+	TIM_OC_InitTypeDef sConfigOC = {0};
+
+	htim5.Instance = TIM5;
+	htim5.Init.Prescaler = 63;
+	htim5.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim5.Init.Period = 999;
+	htim5.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim5.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if(HAL_TIM_PWM_Init(&htim5) != HAL_OK) Error_Handler();
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if(HAL_TIMEx_MasterConfigSynchronization(&htim5, &sMasterConfig) != HAL_OK) Error_Handler();
+	sConfigOC.OCMode = TIM_OCMODE_PWM1;
+	sConfigOC.Pulse = 127;
+	sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+	sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+	if(HAL_TIM_PWM_ConfigChannel(&htim5, &sConfigOC, TIM_CHANNEL_1) != HAL_OK) Error_Handler();
+	HAL_TIM_MspPostInit(&htim5);
+}
+
+static void MX_DMA_Init(void) {
+	HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 9, 0);
+	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+}
+
+static void MX_GPIO_Init(void) {
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	HAL_GPIO_WritePin(GPIOC, FET_DRV_Pin|LED2_Pin|LED5_Pin|LED4_Pin|LED7_Pin, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GPIOB, LED1_Pin|LED0_Pin|LED3_Pin, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(GPIOA, LED6_Pin|LED9_Pin|LED8_Pin, GPIO_PIN_RESET);
+
+	GPIO_InitStruct.Pin = FET_DRV_Pin|LED2_Pin|LED5_Pin|LED4_Pin|LED7_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = PB_IN_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+	GPIO_InitStruct.Pull = GPIO_PULLUP;
+	HAL_GPIO_Init(PB_IN_GPIO_Port, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = RC_IN_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+	GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+	HAL_GPIO_Init(RC_IN_GPIO_Port, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = LED1_Pin|LED0_Pin|LED3_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = LED6_Pin|LED9_Pin|LED8_Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+	HAL_NVIC_SetPriority(EXTI1_IRQn, 7, 0); //enabled by board_lights_init()
+}
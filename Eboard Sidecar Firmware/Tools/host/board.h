@@ -0,0 +1,20 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "mock_hal.h"
+
+//the board around the firmware for the host build: the peripheral handles and setup from main.c, and the
+//handful of signals a harness drives
+
+//main() up to and including osKernelStart(), which returns here; sim_run_until() runs the threads
+void board_boot();
+
+//the battery as the divider presents it to ADC1 (replaces any sample source)
+uint16_t board_battery_raw(float volts);
+void board_battery(float volts);
+
+void board_button(bool pressed); //PB_IN
+void board_rc(bool high); //RC_IN from the receiver
+bool board_fet_on(); //FET_DRV, the power latch
+
+#endif
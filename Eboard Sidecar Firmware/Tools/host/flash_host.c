@@ -0,0 +1,89 @@
+#include "mock_hal.h"
+#include "flash_stm32.h"
+#include "config.h"
+#include "datalog.h"
+
+//flash_stm32.h for the host build: the same two regions on the RAM flash simulator (Tools/flash_sim.c)
+//erases and word programs stall the CPU for their typical time from the F401 datasheet (x32 parallelism),
+//interrupts included, like running out of the flash being written does on the board
+
+#define ERASE_16K_CYCLES SIM_MS(250)
+#define ERASE_128K_CYCLES SIM_MS(1000)
+#define WORD_CYCLES SIM_US(16)
+#define READ_CYCLES_PER_WORD 2
+
+typedef struct {
+	flash_sim_t sim;
+	flash_dev_t dev;
+	bool ready;
+} region_t;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static bool host_erase(const flash_dev_t* dev, uint8_t sector);
+static bool host_program(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len);
+static void host_read(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len);
+static region_t* region(const flash_dev_t* dev);
+
+//===================== PRIVATE VARIABLES =====================
+static region_t datalog_region, config_region;
+
+//===================== PUBLIC VARIABLES =====================
+const flash_dev_t flash_stm32_datalog = {
+	.ctx = (void*)&datalog_region,
+	.sector_size = DATALOG_SECTOR_SIZE,
+	.num_sectors = DATALOG_NUM_SECTORS,
+	.erase = host_erase,
+	.program = host_program,
+	.read = host_read,
+};
+
+const flash_dev_t flash_stm32_config = {
+	.ctx = (void*)&config_region,
+	.sector_size = CONFIG_SECTOR_SIZE,
+	.num_sectors = CONFIG_NUM_SECTORS,
+	.erase = host_erase,
+	.program = host_program,
+	.read = host_read,
+};
+
+// ================== HARNESS SIDE ==================
+flash_sim_t* sim_flash_datalog() { return &region(&flash_stm32_datalog)->sim; }
+flash_sim_t* sim_flash_config() { return &region(&flash_stm32_config)->sim; }
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static bool host_erase(const flash_dev_t* dev, uint8_t sector) {
+	region_t* r = region(dev);
+	sim_advance(dev->sector_size > CONFIG_SECTOR_SIZE ? ERASE_128K_CYCLES : ERASE_16K_CYCLES);
+	bool ok = r->dev.erase(&r->dev, sector);
+	sim_charge(0);
+	return ok;
+}
+
+static bool host_program(const flash_dev_t* dev, uint32_t offset, const void* data, uint32_t len) {
+	region_t* r = region(dev);
+	const uint8_t* src = (const uint8_t*)data;
+
+	//a word at a time like flash_stm32.c, so interrupts get in between words
+	for(uint32_t i = 0; i < len; i += 4) {
+		sim_advance(WORD_CYCLES);
+		if(!r->dev.program(&r->dev, offset + i, src + i, 4)) return false;
+		sim_charge(0);
+	}
+	return true;
+}
+
+static void host_read(const flash_dev_t* dev, uint32_t offset, void* data, uint32_t len) {
+	region_t* r = region(dev);
+	r->dev.read(&r->dev, offset, data, len);
+	sim_charge(SIM_HAL_CYCLES + len / 4 * READ_CYCLES_PER_WORD);
+}
+
+//set up on first use, erased like a fresh part
+static region_t* region(const flash_dev_t* dev) {
+	region_t* r = (region_t*)dev->ctx;
+	if(!r->ready) {
+		flash_sim_init(&r->sim, &r->dev, dev->sector_size, dev->num_sectors);
+		r->ready = true;
+	}
+	return r;
+}
@@ -0,0 +1,32 @@
+#ifndef SIM_FREERTOS_CONFIG_H
+#define SIM_FREERTOS_CONFIG_H
+
+//the firmware's own kernel configuration, with the few board-only settings swapped for the host port's
+#include_next "FreeRTOSConfig.h"
+#include "sim_target.h"
+
+//the idle hook is where the host port skips ahead to the next event (see sim_idle())
+#undef configUSE_IDLE_HOOK
+#define configUSE_IDLE_HOOK 1
+
+//threads run on host stacks, the static ones in rtos_objects.c are never touched
+#undef configCHECK_FOR_STACK_OVERFLOW
+#define configCHECK_FOR_STACK_OVERFLOW 0
+
+#undef configASSERT
+void sim_assert_failed(const char* file, int line);
+#define configASSERT(x) if((x) == 0) sim_assert_failed(__FILE__, __LINE__)
+
+//event flags being set go to the harness too (mock_hal.h, SIM_OUT_FLAGS); the firmware consumes most of them
+//on its next pass, so they can't be polled
+void sim_flags_set(void* group, uint32_t bits);
+#undef traceEVENT_GROUP_SET_BITS
+#define traceEVENT_GROUP_SET_BITS(xEventGroup, uxBitsToSet) do { \
+  trace_put(TRACE_FLAGS_SET, ((EventGroup_t*)(xEventGroup))->uxEventGroupNumber, (uxBitsToSet)); \
+  sim_flags_set((void*)(xEventGroup), (uxBitsToSet)); \
+} while(0)
+
+#undef portGET_RUN_TIME_COUNTER_VALUE
+#define portGET_RUN_TIME_COUNTER_VALUE() sim_cycles32()
+
+#endif
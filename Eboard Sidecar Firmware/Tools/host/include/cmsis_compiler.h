@@ -0,0 +1,53 @@
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+#include "stdint.h"
+#include "sim.h"
+
+//the CMSIS compiler layer for the host build: the core registers cmsis_os2.c and the USB glue read are the
+//host port's (Tools/host/port/port.c)
+
+#define __ASM __asm
+#define __INLINE inline
+#define __STATIC_INLINE static inline
+#define __STATIC_FORCEINLINE static inline __attribute__((always_inline))
+#define __NO_RETURN __attribute__((__noreturn__))
+#define __USED __attribute__((used))
+#define __WEAK __attribute__((weak))
+#define __PACKED __attribute__((packed, aligned(1)))
+#define __ALIGNED(x) __attribute__((aligned(x)))
+
+//what the board is, so cmsis_os2.c counts BASEPRI as masked like it does there
+#define __ARM_ARCH_7EM__ 1
+//and that it has the DSP extension, so batt_monitor.c builds and runs its dual halfword path here as well; the
+//instructions are done in C further down, the same answers as the M4's but none of the speed
+#define __ARM_FEATURE_DSP 1
+
+static inline uint32_t __get_IPSR(void) { return port_ipsr(); }
+static inline uint32_t __get_PRIMASK(void) { return port_primask(); }
+static inline uint32_t __get_BASEPRI(void) { return port_basepri(); }
+static inline void __set_PRIMASK(uint32_t primask) { port_set_primask(primask); }
+static inline void __disable_irq(void) { port_set_primask(1); }
+static inline void __enable_irq(void) { port_set_primask(0); }
+
+static inline void __NOP(void) {}
+static inline void __DSB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __ISB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __DMB(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+//================ DSP extension (see cmsis_gcc.h for the real ones) ================
+#define LO16(x) ((uint16_t)(x))
+#define HI16(x) ((uint16_t)((x) >> 16))
+
+struct __attribute__((packed)) T_UINT32_READ { uint32_t v; };
+#define __UNALIGNED_UINT32_READ(addr) (((const struct T_UINT32_READ*)(const void*)(addr))->v)
+
+//dual signed halfword multiply, added to a 32-bit accumulator
+static inline uint32_t __SMLAD(uint32_t x, uint32_t y, uint32_t acc) {
+	return acc + (uint32_t)((int32_t)(int16_t)LO16(x) * (int16_t)LO16(y)) + (uint32_t)((int32_t)(int16_t)HI16(x) * (int16_t)HI16(y));
+}
+
+#undef LO16
+#undef HI16
+
+#endif
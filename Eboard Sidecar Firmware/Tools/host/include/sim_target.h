@@ -0,0 +1,12 @@
+#ifndef SIM_TARGET_H
+#define SIM_TARGET_H
+
+#include "stdint.h"
+
+//force-included ahead of every firmware source in the host build (see Tools/CMakeLists.txt)
+//for the few places the firmware reads Cortex-M debug hardware straight through a pointer
+
+uint32_t sim_cycles32();
+#define TRACE_CYCLES() sim_cycles32() //trace.h
+
+#endif
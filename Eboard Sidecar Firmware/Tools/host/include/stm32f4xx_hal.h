@@ -0,0 +1,400 @@
+#ifndef __STM32F4xx_HAL_H
+#define __STM32F4xx_HAL_H
+
+#include "stdint.h"
+#include "stddef.h"
+#include "cmsis_compiler.h"
+
+//just enough of the STM32F4 device header and HAL for the firmware modules to build on the host
+//names and values are the real ones; the registers the firmware touches directly are plain memory that
+//Tools/host/mock_hal.c keeps up to date (timer counters) or watches (compare registers)
+
+//================ device ================
+typedef enum {
+	NonMaskableInt_IRQn = -14,
+	MemoryManagement_IRQn = -12,
+	BusFault_IRQn = -11,
+	UsageFault_IRQn = -10,
+	SVCall_IRQn = -5,
+	DebugMonitor_IRQn = -4,
+	PendSV_IRQn = -2,
+	SysTick_IRQn = -1,
+	EXTI0_IRQn = 6,
+	EXTI1_IRQn = 7,
+	EXTI2_IRQn = 8,
+	EXTI3_IRQn = 9,
+	EXTI4_IRQn = 10,
+	ADC_IRQn = 18,
+	EXTI9_5_IRQn = 23,
+	TIM1_BRK_TIM9_IRQn = 24,
+	TIM1_UP_TIM10_IRQn = 25,
+	TIM1_TRG_COM_TIM11_IRQn = 26,
+	TIM2_IRQn = 28,
+	TIM3_IRQn = 29,
+	TIM4_IRQn = 30,
+	EXTI15_10_IRQn = 40,
+	TIM5_IRQn = 50,
+	DMA2_Stream0_IRQn = 56,
+	OTG_FS_IRQn = 67,
+} IRQn_Type;
+
+#define __IO volatile
+
+typedef struct {
+	__IO uint32_t IDR;
+	__IO uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SMCR;
+	__IO uint32_t DIER;
+	__IO uint32_t SR;
+	__IO uint32_t EGR;
+	__IO uint32_t CCMR1;
+	__IO uint32_t CCMR2;
+	__IO uint32_t CCER;
+	__IO uint32_t CNT;
+	__IO uint32_t PSC;
+	__IO uint32_t ARR;
+	__IO uint32_t RCR;
+	__IO uint32_t CCR1;
+	__IO uint32_t CCR2;
+	__IO uint32_t CCR3;
+	__IO uint32_t CCR4;
+} TIM_TypeDef;
+
+typedef struct {
+	__IO uint32_t SR;
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SMPR1;
+	__IO uint32_t SMPR2;
+	__IO uint32_t DR;
+} ADC_TypeDef;
+
+typedef struct {
+	__IO uint32_t DHCSR;
+	__IO uint32_t DCRSR;
+	__IO uint32_t DCRDR;
+	__IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+typedef struct {
+	__IO uint32_t CTRL;
+	__IO uint32_t CYCCNT; //refreshed from the simulator's clock on every DWT-> access (writes are ignored)
+} DWT_Type;
+
+#define SIM_GPIO_PORTS 8 //A to H
+#define SIM_TIMERS 12 //TIM1 to TIM11, by number
+
+extern GPIO_TypeDef sim_gpio[SIM_GPIO_PORTS];
+extern TIM_TypeDef sim_tim[SIM_TIMERS];
+extern ADC_TypeDef sim_adc1;
+extern CoreDebug_Type sim_core_debug;
+extern DWT_Type sim_dwt;
+
+#define GPIOA (&sim_gpio[0])
+#define GPIOB (&sim_gpio[1])
+#define GPIOC (&sim_gpio[2])
+#define GPIOH (&sim_gpio[7])
+#define TIM1 (&sim_tim[1])
+#define TIM2 (&sim_tim[2])
+#define TIM3 (&sim_tim[3])
+#define TIM4 (&sim_tim[4])
+#define TIM5 (&sim_tim[5])
+#define TIM9 (&sim_tim[9])
+#define TIM10 (&sim_tim[10])
+#define TIM11 (&sim_tim[11])
+#define ADC1 (&sim_adc1)
+#define CoreDebug (&sim_core_debug)
+#define DWT (sim_dwt_now())
+
+static inline DWT_Type* sim_dwt_now(void) {
+	sim_dwt.CYCCNT = sim_cycles32();
+	return &sim_dwt;
+}
+
+#define ADC_CR1_JEOCIE (1ul << 7)
+#define ADC_CR1_SCAN (1ul << 8)
+#define ADC_CR2_DDS (1ul << 9)
+#define ADC_CR2_JEXTEN (3ul << 20)
+#define CoreDebug_DEMCR_TRCENA_Msk (1ul << 24)
+#define DWT_CTRL_CYCCNTENA_Msk (1ul << 0)
+
+extern uint32_t SystemCoreClock;
+
+//================ HAL common ================
+typedef enum { HAL_OK = 0x00, HAL_ERROR = 0x01, HAL_BUSY = 0x02, HAL_TIMEOUT = 0x03 } HAL_StatusTypeDef;
+typedef enum { HAL_UNLOCKED = 0x00, HAL_LOCKED = 0x01 } HAL_LockTypeDef;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+#define SET_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+#define UNUSED(X) (void)X
+#define TICK_INT_PRIORITY 15U
+
+extern __IO uint32_t uwTick;
+
+HAL_StatusTypeDef HAL_Init(void);
+HAL_StatusTypeDef HAL_DeInit(void); //the firmware's last act before its power goes, see mock_hal.h
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority);
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+//================ GPIO ================
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+
+typedef struct {
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+	uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_5 ((uint16_t)0x0020)
+#define GPIO_PIN_6 ((uint16_t)0x0040)
+#define GPIO_PIN_7 ((uint16_t)0x0080)
+#define GPIO_PIN_8 ((uint16_t)0x0100)
+#define GPIO_PIN_9 ((uint16_t)0x0200)
+#define GPIO_PIN_10 ((uint16_t)0x0400)
+#define GPIO_PIN_11 ((uint16_t)0x0800)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+#define GPIO_PIN_13 ((uint16_t)0x2000)
+#define GPIO_PIN_14 ((uint16_t)0x4000)
+#define GPIO_PIN_15 ((uint16_t)0x8000)
+#define GPIO_PIN_All ((uint16_t)0xFFFF)
+
+#define GPIO_MODE_INPUT 0x00000000U
+#define GPIO_MODE_OUTPUT_PP 0x00000001U
+#define GPIO_MODE_AF_PP 0x00000002U
+#define GPIO_MODE_IT_RISING 0x10110000U
+#define GPIO_MODE_IT_FALLING 0x10210000U
+#define GPIO_MODE_IT_RISING_FALLING 0x10310000U
+#define GPIO_NOPULL 0x00000000U
+#define GPIO_PULLUP 0x00000001U
+#define GPIO_PULLDOWN 0x00000002U
+#define GPIO_SPEED_FREQ_LOW 0x00000000U
+
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+//================ DMA ================
+typedef struct {
+	uint32_t Channel;
+	uint32_t Direction;
+	uint32_t PeriphInc;
+	uint32_t MemInc;
+	uint32_t PeriphDataAlignment;
+	uint32_t MemDataAlignment;
+	uint32_t Mode;
+	uint32_t Priority;
+	uint32_t FIFOMode;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+	void* Instance;
+	DMA_InitTypeDef Init;
+	void* Parent;
+} DMA_HandleTypeDef;
+
+#define DMA_NORMAL 0x00000000U
+#define DMA_CIRCULAR 0x00000100U
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma);
+
+//================ ADC ================
+typedef struct {
+	uint32_t ClockPrescaler;
+	uint32_t Resolution;
+	uint32_t DataAlign;
+	uint32_t ScanConvMode;
+	uint32_t EOCSelection;
+	FunctionalState ContinuousConvMode;
+	uint32_t NbrOfConversion;
+	FunctionalState DiscontinuousConvMode;
+	uint32_t NbrOfDiscConversion;
+	uint32_t ExternalTrigConv;
+	uint32_t ExternalTrigConvEdge;
+	FunctionalState DMAContinuousRequests;
+} ADC_InitTypeDef;
+
+typedef struct {
+	ADC_TypeDef* Instance;
+	ADC_InitTypeDef Init;
+	DMA_HandleTypeDef* DMA_Handle;
+	HAL_LockTypeDef Lock;
+	__IO uint32_t State;
+	__IO uint32_t ErrorCode;
+} ADC_HandleTypeDef;
+
+typedef struct {
+	uint32_t Channel;
+	uint32_t Rank;
+	uint32_t SamplingTime;
+	uint32_t Offset;
+} ADC_ChannelConfTypeDef;
+
+#define HAL_ADC_STATE_ERROR_CONFIG 0x00000020U
+#define HAL_ADC_STATE_REG_BUSY 0x00000100U
+#define HAL_ADC_STATE_INJ_BUSY 0x00001000U
+
+#define ADC_IT_JEOC ADC_CR1_JEOCIE
+#define __HAL_ADC_DISABLE_IT(__HANDLE__, __INTERRUPT__) (((__HANDLE__)->Instance->CR1) &= ~(__INTERRUPT__))
+
+#define ADC_CLOCK_SYNC_PCLK_DIV2 0x00000000U
+#define ADC_RESOLUTION_12B 0x00000000U
+#define ADC_DATAALIGN_RIGHT 0x00000000U
+#define ADC_SOFTWARE_START 0x0F000001U
+#define ADC_EXTERNALTRIGCONVEDGE_NONE 0x00000000U
+#define ADC_EOC_SINGLE_CONV 0x00000001U
+#define ADC_CHANNEL_10 0x0000000AU
+
+#define ADC_SAMPLETIME_3CYCLES 0x00000000U
+#define ADC_SAMPLETIME_15CYCLES 0x00000001U
+#define ADC_SAMPLETIME_28CYCLES 0x00000002U
+#define ADC_SAMPLETIME_56CYCLES 0x00000003U
+#define ADC_SAMPLETIME_84CYCLES 0x00000004U
+#define ADC_SAMPLETIME_112CYCLES 0x00000005U
+#define ADC_SAMPLETIME_144CYCLES 0x00000006U
+#define ADC_SAMPLETIME_480CYCLES 0x00000007U
+
+typedef struct {
+	uint32_t InjectedChannel;
+	uint32_t InjectedRank;
+	uint32_t InjectedSamplingTime;
+	uint32_t InjectedOffset;
+	uint32_t InjectedNbrOfConversion;
+	FunctionalState InjectedDiscontinuousConvMode;
+	FunctionalState AutoInjectedConv;
+	uint32_t ExternalTrigInjecConv;
+	uint32_t ExternalTrigInjecConvEdge;
+} ADC_InjectionConfTypeDef;
+
+#define ADC_INJECTED_RANK_1 0x00000001U
+#define ADC_INJECTED_RANK_2 0x00000002U
+#define ADC_INJECTED_RANK_3 0x00000003U
+#define ADC_INJECTED_RANK_4 0x00000004U
+
+//JEXTSEL, the ones that are timer compare events
+#define ADC_EXTERNALTRIGINJECCONV_T1_CC4 0x00000000U
+#define ADC_EXTERNALTRIGINJECCONV_T2_CC1 0x00020000U
+#define ADC_EXTERNALTRIGINJECCONV_T3_CC2 0x00040000U
+#define ADC_EXTERNALTRIGINJECCONV_T3_CC4 0x00050000U
+#define ADC_EXTERNALTRIGINJECCONV_T4_CC1 0x00060000U
+#define ADC_EXTERNALTRIGINJECCONV_T4_CC2 0x00070000U
+#define ADC_EXTERNALTRIGINJECCONV_T4_CC3 0x00080000U
+#define ADC_EXTERNALTRIGINJECCONV_T5_CC4 0x000A0000U
+#define ADC_EXTERNALTRIGINJECCONVEDGE_NONE 0x00000000U
+#define ADC_EXTERNALTRIGINJECCONVEDGE_RISING 0x00100000U
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc);
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* sConfig);
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length);
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef* hadc);
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc);
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc);
+HAL_StatusTypeDef HAL_ADCEx_InjectedConfigChannel(ADC_HandleTypeDef* hadc, ADC_InjectionConfTypeDef* sConfigInjected);
+HAL_StatusTypeDef HAL_ADCEx_InjectedStart_IT(ADC_HandleTypeDef* hadc);
+HAL_StatusTypeDef HAL_ADCEx_InjectedStop_IT(ADC_HandleTypeDef* hadc);
+uint32_t HAL_ADCEx_InjectedGetValue(ADC_HandleTypeDef* hadc, uint32_t InjectedRank);
+void HAL_ADCEx_InjectedConvCpltCallback(ADC_HandleTypeDef* hadc);
+
+//================ TIM ================
+typedef struct {
+	uint32_t Prescaler;
+	uint32_t CounterMode;
+	uint32_t Period;
+	uint32_t ClockDivision;
+	uint32_t RepetitionCounter;
+	uint32_t AutoReloadPreload;
+} TIM_Base_InitTypeDef;
+
+typedef struct {
+	TIM_TypeDef* Instance;
+	TIM_Base_InitTypeDef Init;
+	uint32_t Channel;
+	HAL_LockTypeDef Lock;
+	__IO uint32_t State;
+} TIM_HandleTypeDef;
+
+typedef struct {
+	uint32_t OCMode;
+	uint32_t Pulse;
+	uint32_t OCPolarity;
+	uint32_t OCNPolarity;
+	uint32_t OCFastMode;
+	uint32_t OCIdleState;
+	uint32_t OCNIdleState;
+} TIM_OC_InitTypeDef;
+
+typedef struct {
+	uint32_t ClockSource;
+	uint32_t ClockPolarity;
+	uint32_t ClockPrescaler;
+	uint32_t ClockFilter;
+} TIM_ClockConfigTypeDef;
+
+typedef struct {
+	uint32_t MasterOutputTrigger;
+	uint32_t MasterSlaveMode;
+} TIM_MasterConfigTypeDef;
+
+#define TIM_CHANNEL_1 0x00000000U
+#define TIM_CHANNEL_2 0x00000004U
+#define TIM_CHANNEL_3 0x00000008U
+#define TIM_CHANNEL_4 0x0000000CU
+#define TIM_COUNTERMODE_UP 0x00000000U
+#define TIM_CLOCKDIVISION_DIV1 0x00000000U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0x00000000U
+#define TIM_CLOCKSOURCE_INTERNAL 0x00001000U
+#define TIM_TRGO_RESET 0x00000000U
+#define TIM_MASTERSLAVEMODE_DISABLE 0x00000000U
+#define TIM_OCMODE_TIMING 0x00000000U
+#define TIM_OCMODE_TOGGLE 0x00000030U
+#define TIM_OCMODE_PWM1 0x00000060U
+#define TIM_OCPOLARITY_HIGH 0x00000000U
+#define TIM_OCFAST_DISABLE 0x00000000U
+
+//the mock keeps the counter running off the simulator's clock, so these go through it
+void sim_tim_set_autoreload(TIM_HandleTypeDef* htim, uint32_t arr);
+void sim_tim_set_counter(TIM_HandleTypeDef* htim, uint32_t cnt);
+#define __HAL_TIM_SET_AUTORELOAD(__HANDLE__, __AUTORELOAD__) sim_tim_set_autoreload((__HANDLE__), (__AUTORELOAD__))
+#define __HAL_TIM_SET_COUNTER(__HANDLE__, __COUNTER__) sim_tim_set_counter((__HANDLE__), (__COUNTER__))
+#define __HAL_TIM_GET_COUNTER(__HANDLE__) ((__HANDLE__)->Instance->CNT)
+#define __HAL_TIM_SET_COMPARE(__HANDLE__, __CHANNEL__, __COMPARE__) \
+	(*(&(__HANDLE__)->Instance->CCR1 + ((__CHANNEL__) >> 2U)) = (__COMPARE__))
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef* htim, TIM_ClockConfigTypeDef* sClockSourceConfig);
+HAL_StatusTypeDef HAL_TIM_OC_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_OC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* sConfig, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_OC_Start(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_OC_Stop(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef* htim);
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* sConfig, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef* htim, uint32_t Channel);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef* htim, TIM_MasterConfigTypeDef* sMasterConfig);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim);
+
+#endif
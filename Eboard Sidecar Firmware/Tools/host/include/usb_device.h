@@ -0,0 +1,7 @@
+#ifndef __USB_DEVICE__H__
+#define __USB_DEVICE__H__
+
+//USB_DEVICE/App/usb_device.h for the host build; there's no device stack, see Tools/host/mock_usb.c
+void MX_USB_DEVICE_Init(void);
+
+#endif
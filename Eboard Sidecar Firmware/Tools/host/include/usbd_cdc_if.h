@@ -0,0 +1,33 @@
+#ifndef __USBD_CDC_IF_H__
+#define __USBD_CDC_IF_H__
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//the CDC interface the firmware uses (USB_DEVICE/App/usbd_cdc_if.h), backed by Tools/host/mock_usb.c
+//see mock_hal.h for what a harness can do with it
+
+#define APP_RX_DATA_SIZE 2048
+#define APP_TX_DATA_SIZE 2048
+
+typedef struct {
+	uint32_t queued;
+	uint32_t dropped;
+	uint32_t drop_events;
+	uint32_t transfers;
+	uint16_t max_fill;
+	uint32_t blocks;
+	uint32_t blocks_dropped;
+} cdc_tx_stats_t;
+
+uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
+uint16_t CDC_Write_FS(const uint8_t* Buf, uint16_t Len);
+bool CDC_Write_All(const uint8_t* Buf, uint16_t Len);
+void CDC_Get_Tx_Stats(cdc_tx_stats_t* stats);
+bool CDC_Write_Block(const uint8_t* Header, uint16_t HeaderLen, const uint8_t* Block, uint16_t BlockLen);
+bool CDC_Block_Busy(void);
+uint16_t CDC_Tx_Space(void);
+bool CDC_Rx_Peek(const uint8_t** Buf, uint16_t* Len);
+void CDC_Rx_Release(void);
+
+#endif
@@ -0,0 +1,796 @@
+#include "mock_hal.h"
+#include "trace.h"
+#include "rtos_objects.h"
+#include <stdio.h>
+
+//see mock_hal.h
+
+#define ADC_CYCLES_PER_CLOCK 4 //64MHz core, ADC clock is PCLK2 (32MHz) / 2
+#define ADC_CONVERSION_CLOCKS 12 //12 bit successive approximation, on top of the sample time
+#define NVIC_WORDS 3
+
+typedef struct {
+	TIM_HandleTypeDef* handle; //last one initialised or started, for the callback
+	bool base_started;
+	bool update_it;
+	uint8_t channels; //started, a bit per channel
+	uint8_t no_pin; //channels in TIM_OCMODE_TIMING, only there for their compare event; not reported as outputs
+	bool running;
+
+	//the count runs from base_cnt at base_at; the registers as they were left, to notice the firmware writing them
+	uint64_t base_at;
+	uint32_t base_cnt;
+	uint32_t cnt, psc, arr;
+
+	uint64_t update_at; //next update event
+	uint32_t gen; //bumped to cancel the one in flight
+
+	uint32_t out_ccr[4], out_arr; //last reported
+} tim_t;
+
+typedef struct {
+	int8_t port; //-1 when the line isn't set up for interrupts
+	bool rising, falling;
+} exti_t;
+
+//===================== PUBLIC VARIABLES =====================
+GPIO_TypeDef sim_gpio[SIM_GPIO_PORTS];
+TIM_TypeDef sim_tim[SIM_TIMERS];
+ADC_TypeDef sim_adc1;
+CoreDebug_Type sim_core_debug;
+DWT_Type sim_dwt;
+uint32_t SystemCoreClock = SIM_CPU_HZ;
+volatile uint32_t uwTick = 0;
+
+//===================== PRIVATE VARIABLES =====================
+#define FLAGS_CB(obj) (void*)&rtos_##obj##_cb,
+#define FLAGS_NAME(obj) #obj,
+static void* const flag_groups[] = { RTOS_EVENT_FLAGS(FLAGS_CB) };
+static const char* const flag_names[] = { RTOS_EVENT_FLAGS(FLAGS_NAME) };
+#define NUM_FLAG_GROUPS (sizeof(flag_groups) / sizeof(flag_groups[0]))
+
+static uint32_t nvic_enabled[NVIC_WORDS];
+
+static sim_out_hook_t out_hook = NULL;
+static void* out_ctx = NULL;
+
+static exti_t exti[16];
+static uint16_t exti_pending = 0;
+
+static tim_t tims[SIM_TIMERS];
+
+static struct {
+	ADC_HandleTypeDef* handle;
+	uint32_t channel;
+	uint32_t sample_time; //ADC_SAMPLETIME_x
+	bool running;
+	uint16_t* buf;
+	uint32_t len;
+	uint32_t filled; //samples of this pass written to the buffer
+	bool half_done; //the half transfer interrupt of this pass has been
+	bool circular;
+	uint64_t start_at; //of the current pass through the buffer
+	uint32_t conversion; //cycles per sample
+	uint32_t gen;
+	uint32_t conversions;
+} adc;
+
+static struct {
+	ADC_HandleTypeDef* handle;
+	uint32_t channel;
+	uint32_t ranks;
+	uint32_t burst; //ranks converted per trigger: all of them in scan mode, only the first otherwise
+	uint32_t trigger; //ADC_EXTERNALTRIGINJECCONV_x
+	bool running; //ADC on and the group started; triggers only convert while JEXTEN is set as well
+	bool converting; //the source is being asked for an injected sample
+	uint64_t trigger_at; //of the burst being converted
+	uint32_t gen;
+	uint16_t jdr[4];
+} inj;
+
+typedef struct {
+	uint32_t trigger;
+	uint8_t tim;
+	uint8_t channel; //0 to 3
+} trigger_t;
+
+static const trigger_t inj_triggers[] = {
+	{ADC_EXTERNALTRIGINJECCONV_T1_CC4, 1, 3}, {ADC_EXTERNALTRIGINJECCONV_T2_CC1, 2, 0},
+	{ADC_EXTERNALTRIGINJECCONV_T3_CC2, 3, 1}, {ADC_EXTERNALTRIGINJECCONV_T3_CC4, 3, 3},
+	{ADC_EXTERNALTRIGINJECCONV_T4_CC1, 4, 0}, {ADC_EXTERNALTRIGINJECCONV_T4_CC2, 4, 1},
+	{ADC_EXTERNALTRIGINJECCONV_T4_CC3, 4, 2}, {ADC_EXTERNALTRIGINJECCONV_T5_CC4, 5, 3},
+};
+#define NUM_INJ_TRIGGERS (sizeof(inj_triggers) / sizeof(inj_triggers[0]))
+
+static sim_adc_source_t adc_source = NULL;
+static void* adc_ctx = NULL;
+static uint16_t adc_constant = 0;
+
+static const uint16_t sample_clocks[8] = {3, 15, 28, 56, 84, 112, 144, 480}; //by ADC_SAMPLETIME_x
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void report(sim_out_t kind, uint16_t id, uint32_t value);
+static void watch_registers();
+static IRQn_Type exti_irqn(uint8_t line);
+static bool nvic_is_enabled(IRQn_Type irqn);
+static void exti_raise(uint8_t line);
+static void exti_isr(void* ctx, uint32_t tag);
+static void input_event(void* ctx, uint32_t tag);
+static uint8_t tim_num(TIM_TypeDef* instance);
+static IRQn_Type tim_irqn(uint8_t num);
+static void tim_sync(uint8_t num);
+static void tim_sync_all();
+static void tim_rebase(uint8_t num);
+static void tim_set_running(uint8_t num);
+static void tim_update(void* ctx, uint32_t tag);
+static void tim_init(TIM_HandleTypeDef* htim);
+static void tim_channel(TIM_HandleTypeDef* htim, uint32_t channel, bool on);
+static uint64_t tim_next_compare(uint8_t num, uint8_t channel, uint64_t after);
+static void adc_schedule();
+static void adc_fill(uint32_t to);
+static void adc_stall(uint64_t at, uint64_t until);
+static void adc_isr(void* ctx, uint32_t tag);
+static uint32_t adc_conversion_cycles();
+static void inj_schedule(uint64_t after);
+static void inj_trigger(void* ctx, uint32_t tag);
+static void inj_isr(void* ctx, uint32_t tag);
+
+// ================== HARNESS SIDE ==================
+void sim_out_hook(sim_out_hook_t hook, void* ctx) {
+	out_hook = hook;
+	out_ctx = ctx;
+	sim_watch(watch_registers);
+}
+
+const char* sim_flags_name(uint16_t id) {
+	return id < NUM_FLAG_GROUPS ? flag_names[id] : NULL;
+}
+
+uint16_t sim_pin_id(GPIO_TypeDef* port, uint16_t pin) {
+	return (uint16_t)((port - sim_gpio) * 16 + __builtin_ctz(pin));
+}
+
+bool sim_gpio_output(GPIO_TypeDef* port, uint16_t pin) {
+	return (port->ODR & pin) != 0;
+}
+
+void sim_gpio_input(GPIO_TypeDef* port, uint16_t pin, bool level) {
+	uint8_t line = __builtin_ctz(pin);
+	bool was = (port->IDR & pin) != 0;
+	if(level) port->IDR |= pin;
+	else port->IDR &= ~(uint32_t)pin;
+	if(was == level) return;
+
+	const exti_t* e = &exti[line];
+	if(e->port != port - sim_gpio) return;
+	if((level && e->rising) || (!level && e->falling)) exti_raise(line);
+}
+
+void sim_gpio_input_at(uint64_t at, GPIO_TypeDef* port, uint16_t pin, bool level) {
+	sim_at(at, SIM_NO_IRQ, input_event, port, pin | (level ? 0x10000u : 0));
+}
+
+void sim_adc_source(sim_adc_source_t source, void* ctx) {
+	adc_source = source;
+	adc_ctx = ctx;
+}
+
+void sim_adc_constant(uint16_t raw) {
+	adc_constant = raw;
+	adc_source = NULL;
+}
+
+uint32_t sim_adc_conversions() { return adc.conversions; }
+bool sim_adc_injected() { return inj.converting; }
+
+uint64_t sim_tim_pwm_edge(TIM_TypeDef* tim, uint32_t channel, uint64_t at, bool* rising) {
+	uint8_t num = tim_num(tim);
+	tim_t* t = &tims[num];
+	tim_sync(num);
+	uint32_t ccr = *(&tim->CCR1 + (channel >> 2));
+	uint64_t period = (uint64_t)t->arr + 1;
+	if(!t->running || !(t->channels & (1u << (channel >> 2))) || ccr == 0 || ccr >= period) return UINT64_MAX;
+
+	uint64_t tick = t->psc + 1;
+	uint64_t since_base = at > t->base_at ? at - t->base_at : 0;
+	uint64_t phase = (t->base_cnt * tick + since_base) % (period * tick);
+	*rising = phase < ccr * tick;
+	return *rising ? phase : phase - ccr * tick;
+}
+
+void sim_isr_enter(IRQn_Type irqn) {
+	tim_sync_all();
+	TRACE_IRQ_ENTER(irqn);
+}
+
+void sim_isr_exit(IRQn_Type irqn) {
+	TRACE_IRQ_EXIT(irqn);
+	tim_sync_all(); //the handler may have written a counter
+}
+
+//from traceEVENT_GROUP_SET_BITS (include/FreeRTOSConfig.h), inside the kernel's critical section
+void sim_flags_set(void* group, uint32_t bits) {
+	for(uint16_t id = 0; id < NUM_FLAG_GROUPS; id++) {
+		if(flag_groups[id] == group) {
+			report(SIM_OUT_FLAGS, id, bits);
+			return;
+		}
+	}
+}
+
+// ================== HAL: COMMON ==================
+HAL_StatusTypeDef HAL_Init(void) {
+	for(uint8_t i = 0; i < 16; i++) exti[i].port = -1;
+	return HAL_InitTick(TICK_INT_PRIORITY);
+}
+
+HAL_StatusTypeDef HAL_DeInit(void) {
+	sim_power_off("HAL_DeInit");
+	return HAL_OK;
+}
+
+__attribute__((weak)) HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority) {
+	UNUSED(TickPriority);
+	return HAL_OK;
+}
+
+void HAL_IncTick(void) { uwTick++; }
+
+uint32_t HAL_GetTick(void) {
+	sim_charge(SIM_HAL_CYCLES);
+	return uwTick;
+}
+
+void HAL_Delay(uint32_t Delay) {
+	uint32_t start = HAL_GetTick();
+	while(HAL_GetTick() - start < Delay);
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+	UNUSED(IRQn);
+	UNUSED(PreemptPriority);
+	UNUSED(SubPriority);
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+	nvic_enabled[IRQn / 32] |= 1u << (IRQn % 32);
+
+	//anything that came in while it was off
+	for(uint8_t line = 0; line < 16; line++) {
+		if((exti_pending & (1u << line)) && exti_irqn(line) == IRQn) sim_at(sim_now(), IRQn, exti_isr, NULL, line);
+	}
+	sim_charge(SIM_HAL_CYCLES);
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+	nvic_enabled[IRQn / 32] &= ~(1u << (IRQn % 32));
+}
+
+// ================== HAL: GPIO ==================
+void HAL_GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_Init) {
+	for(uint8_t line = 0; line < 16; line++) {
+		if(!(GPIO_Init->Pin & (1u << line))) continue;
+		exti_t* e = &exti[line];
+		if((GPIO_Init->Mode & 0x10000000u) == 0) {
+			if(e->port == GPIOx - sim_gpio) e->port = -1;
+			continue;
+		}
+		e->port = (int8_t)(GPIOx - sim_gpio);
+		e->rising = (GPIO_Init->Mode & 0x00100000u) != 0;
+		e->falling = (GPIO_Init->Mode & 0x00200000u) != 0;
+	}
+	sim_charge(SIM_HAL_CYCLES);
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+	sim_charge(SIM_HAL_CYCLES);
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+	uint32_t was = GPIOx->ODR;
+	if(PinState == GPIO_PIN_SET) GPIOx->ODR |= GPIO_Pin;
+	else GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+
+	uint32_t changed = was ^ GPIOx->ODR;
+	while(changed) {
+		uint16_t pin = changed & -changed;
+		changed &= changed - 1;
+		report(SIM_OUT_PIN, sim_pin_id(GPIOx, pin), (GPIOx->ODR & pin) != 0);
+	}
+	sim_charge(SIM_HAL_CYCLES);
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+	HAL_GPIO_WritePin(GPIOx, GPIO_Pin, (GPIOx->ODR & GPIO_Pin) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
+__attribute__((weak)) void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) { UNUSED(GPIO_Pin); }
+
+// ================== HAL: DMA and ADC ==================
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef* hdma) {
+	UNUSED(hdma); //the mode is read when a transfer starts
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef* hadc) {
+	adc.handle = hadc;
+	CLEAR_BIT(hadc->Instance->CR1, ADC_CR1_SCAN);
+	if(hadc->Init.ScanConvMode) SET_BIT(hadc->Instance->CR1, ADC_CR1_SCAN);
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_ConfigChannel(ADC_HandleTypeDef* hadc, ADC_ChannelConfTypeDef* sConfig) {
+	UNUSED(hadc);
+	adc.channel = sConfig->Channel;
+	adc.sample_time = sConfig->SamplingTime & 7;
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef* hadc, uint32_t* pData, uint32_t Length) {
+	adc.handle = hadc;
+	adc.buf = (uint16_t*)pData; //half word transfers
+	adc.len = Length;
+	adc.filled = 0;
+	adc.half_done = false;
+	adc.circular = hadc->DMA_Handle != NULL && hadc->DMA_Handle->Init.Mode == DMA_CIRCULAR;
+	adc.conversion = adc_conversion_cycles();
+	adc.start_at = sim_now();
+	adc.running = true;
+	adc.gen++;
+	adc_schedule();
+	SET_BIT(hadc->State, HAL_ADC_STATE_REG_BUSY);
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+//turns the ADC off, so the injected group stops too
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef* hadc) {
+	adc.running = false;
+	adc.gen++;
+	inj.running = false;
+	inj.gen++;
+	CLEAR_BIT(hadc->State, HAL_ADC_STATE_REG_BUSY | HAL_ADC_STATE_INJ_BUSY);
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) { UNUSED(hadc); }
+__attribute__((weak)) void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) { UNUSED(hadc); }
+
+//one channel for the whole sequence; the sample time is the channel's, so it's the regular group's too
+HAL_StatusTypeDef HAL_ADCEx_InjectedConfigChannel(ADC_HandleTypeDef* hadc, ADC_InjectionConfTypeDef* sConfigInjected) {
+	inj.handle = hadc;
+	inj.channel = sConfigInjected->InjectedChannel;
+	inj.ranks = sConfigInjected->InjectedNbrOfConversion > 4 ? 4 : sConfigInjected->InjectedNbrOfConversion;
+	inj.trigger = sConfigInjected->ExternalTrigInjecConv;
+	CLEAR_BIT(hadc->Instance->CR2, ADC_CR2_JEXTEN);
+	SET_BIT(hadc->Instance->CR2, sConfigInjected->ExternalTrigInjecConvEdge);
+	adc.sample_time = sConfigInjected->InjectedSamplingTime & 7;
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADCEx_InjectedStart_IT(ADC_HandleTypeDef* hadc) {
+	inj.handle = hadc;
+	inj.running = true;
+	inj.gen++;
+	inj_schedule(sim_now());
+	SET_BIT(hadc->Instance->CR1, ADC_CR1_JEOCIE);
+	SET_BIT(hadc->State, HAL_ADC_STATE_INJ_BUSY);
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+//like the real one: stopping means turning the ADC off, which it won't do while the regular group is converting
+HAL_StatusTypeDef HAL_ADCEx_InjectedStop_IT(ADC_HandleTypeDef* hadc) {
+	sim_charge(SIM_HAL_CYCLES);
+	if(adc.running) {
+		SET_BIT(hadc->State, HAL_ADC_STATE_ERROR_CONFIG);
+		return HAL_ERROR;
+	}
+	inj.running = false;
+	inj.gen++;
+	CLEAR_BIT(hadc->Instance->CR1, ADC_CR1_JEOCIE);
+	CLEAR_BIT(hadc->State, HAL_ADC_STATE_REG_BUSY | HAL_ADC_STATE_INJ_BUSY);
+	return HAL_OK;
+}
+
+uint32_t HAL_ADCEx_InjectedGetValue(ADC_HandleTypeDef* hadc, uint32_t InjectedRank) {
+	UNUSED(hadc);
+	return InjectedRank >= 1 && InjectedRank <= 4 ? inj.jdr[InjectedRank - 1] : 0;
+}
+
+__attribute__((weak)) void HAL_ADCEx_InjectedConvCpltCallback(ADC_HandleTypeDef* hadc) { UNUSED(hadc); }
+
+// ================== HAL: TIM ==================
+void sim_tim_set_autoreload(TIM_HandleTypeDef* htim, uint32_t arr) {
+	uint8_t num = tim_num(htim->Instance);
+	tim_sync(num);
+	htim->Instance->ARR = arr;
+	htim->Init.Period = arr;
+	tim_rebase(num);
+}
+
+void sim_tim_set_counter(TIM_HandleTypeDef* htim, uint32_t cnt) {
+	uint8_t num = tim_num(htim->Instance);
+	tim_sync(num);
+	htim->Instance->CNT = cnt;
+	tim_rebase(num);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef* htim) {
+	tim_init(htim);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start(TIM_HandleTypeDef* htim) {
+	uint8_t num = tim_num(htim->Instance);
+	tims[num].handle = htim;
+	tims[num].base_started = true;
+	tim_set_running(num);
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef* htim) {
+	tims[tim_num(htim->Instance)].update_it = true;
+	return HAL_TIM_Base_Start(htim);
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef* htim) {
+	uint8_t num = tim_num(htim->Instance);
+	tims[num].update_it = false;
+	tims[num].base_started = false;
+	tim_set_running(num);
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef* htim, TIM_ClockConfigTypeDef* sClockSourceConfig) {
+	UNUSED(htim);
+	UNUSED(sClockSourceConfig);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_Init(TIM_HandleTypeDef* htim) {
+	tim_init(htim);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef* htim) {
+	tim_init(htim);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* sConfig, uint32_t Channel) {
+	tim_t* t = &tims[tim_num(htim->Instance)];
+	uint8_t bit = 1u << (Channel >> 2);
+	if(sConfig->OCMode == TIM_OCMODE_TIMING) t->no_pin |= bit;
+	else t->no_pin &= ~bit;
+	*(&htim->Instance->CCR1 + (Channel >> 2)) = sConfig->Pulse;
+	sim_charge(SIM_HAL_CYCLES);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef* htim, TIM_OC_InitTypeDef* sConfig, uint32_t Channel) {
+	return HAL_TIM_OC_ConfigChannel(htim, sConfig, Channel);
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_Start(TIM_HandleTypeDef* htim, uint32_t Channel) {
+	tim_channel(htim, Channel, true);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_OC_Stop(TIM_HandleTypeDef* htim, uint32_t Channel) {
+	tim_channel(htim, Channel, false);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef* htim, uint32_t Channel) {
+	tim_channel(htim, Channel, true);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef* htim, uint32_t Channel) {
+	tim_channel(htim, Channel, false);
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef* htim, TIM_MasterConfigTypeDef* sMasterConfig) {
+	UNUSED(htim);
+	UNUSED(sMasterConfig);
+	return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim) { UNUSED(htim); }
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void report(sim_out_t kind, uint16_t id, uint32_t value) {
+	if(out_hook) out_hook(out_ctx, kind, id, value);
+}
+
+//compare and reload registers the firmware writes directly
+static void watch_registers() {
+	for(uint8_t num = 1; num < SIM_TIMERS; num++) {
+		tim_t* t = &tims[num];
+		TIM_TypeDef* r = &sim_tim[num];
+		const volatile uint32_t* ccr = &r->CCR1;
+		for(uint8_t ch = 0; ch < 4; ch++) {
+			if(ccr[ch] == t->out_ccr[ch] || (t->no_pin & (1u << ch))) continue;
+			t->out_ccr[ch] = ccr[ch];
+			report(SIM_OUT_CCR, SIM_TIM_ID(num, ch << 2), ccr[ch]);
+		}
+		if(r->ARR != t->out_arr) {
+			t->out_arr = r->ARR;
+			report(SIM_OUT_ARR, SIM_TIM_ID(num, TIM_CHANNEL_1), r->ARR);
+		}
+	}
+}
+
+static IRQn_Type exti_irqn(uint8_t line) {
+	if(line <= 4) return EXTI0_IRQn + line;
+	if(line <= 9) return EXTI9_5_IRQn;
+	return EXTI15_10_IRQn;
+}
+
+static bool nvic_is_enabled(IRQn_Type irqn) {
+	return (nvic_enabled[irqn / 32] & (1u << (irqn % 32))) != 0;
+}
+
+//an edge latches the pending bit; a second one before the handler runs is lost, like on the part
+static void exti_raise(uint8_t line) {
+	if(exti_pending & (1u << line)) return;
+	exti_pending |= 1u << line;
+	if(nvic_is_enabled(exti_irqn(line))) sim_at(sim_now(), exti_irqn(line), exti_isr, NULL, line);
+}
+
+//EXTIx_IRQHandler() -> HAL_GPIO_EXTI_IRQHandler()
+static void exti_isr(void* ctx, uint32_t tag) {
+	UNUSED(ctx);
+	if(!(exti_pending & (1u << tag))) return; //already taken
+	IRQn_Type irqn = exti_irqn(tag);
+	sim_isr_enter(irqn);
+	exti_pending &= ~(1u << tag);
+	HAL_GPIO_EXTI_Callback((uint16_t)(1u << tag));
+	sim_isr_exit(irqn);
+}
+
+static void input_event(void* ctx, uint32_t tag) {
+	sim_gpio_input((GPIO_TypeDef*)ctx, (uint16_t)tag, (tag & 0x10000u) != 0);
+}
+
+static uint8_t tim_num(TIM_TypeDef* instance) {
+	return (uint8_t)(instance - sim_tim);
+}
+
+static IRQn_Type tim_irqn(uint8_t num) {
+	switch(num) {
+		case 1:
+		case 10: return TIM1_UP_TIM10_IRQn;
+		case 2: return TIM2_IRQn;
+		case 3: return TIM3_IRQn;
+		case 4: return TIM4_IRQn;
+		case 5: return TIM5_IRQn;
+		case 9: return TIM1_BRK_TIM9_IRQn;
+		default: return TIM1_TRG_COM_TIM11_IRQn;
+	}
+}
+
+//bring CNT up to date, or start counting from whatever the firmware wrote into it
+static void tim_sync(uint8_t num) {
+	tim_t* t = &tims[num];
+	TIM_TypeDef* r = &sim_tim[num];
+	if(!t->running || r->CNT != t->cnt || r->PSC != t->psc || r->ARR != t->arr) {
+		tim_rebase(num);
+		return;
+	}
+	uint64_t counts = (sim_now() - t->base_at) / (t->psc + 1);
+	r->CNT = t->cnt = (uint32_t)((t->base_cnt + counts) % ((uint64_t)t->arr + 1));
+}
+
+static void tim_sync_all() {
+	for(uint8_t num = 1; num < SIM_TIMERS; num++) tim_sync(num);
+}
+
+static void tim_rebase(uint8_t num) {
+	tim_t* t = &tims[num];
+	TIM_TypeDef* r = &sim_tim[num];
+	t->base_at = sim_now();
+	t->base_cnt = t->cnt = r->CNT;
+	t->psc = r->PSC;
+	t->arr = r->ARR;
+
+	t->gen++;
+	if(!t->running || !t->update_it) return;
+	uint64_t period = (uint64_t)t->arr + 1;
+	t->update_at = t->base_at + (period - t->base_cnt % period) * (t->psc + 1);
+	sim_at(t->update_at, tim_irqn(num), tim_update, t, t->gen);
+}
+
+static void tim_set_running(uint8_t num) {
+	tim_t* t = &tims[num];
+	tim_sync(num);
+	t->running = t->base_started || t->channels;
+	tim_rebase(num);
+}
+
+//TIMx_IRQHandler() -> HAL_TIM_IRQHandler(), update interrupt
+static void tim_update(void* ctx, uint32_t tag) {
+	tim_t* t = (tim_t*)ctx;
+	if(tag != t->gen) return; //rescheduled since
+	uint8_t num = (uint8_t)(t - tims);
+	TIM_TypeDef* r = &sim_tim[num];
+
+	//counting from zero since the update, however late the interrupt is being taken
+	uint64_t period = ((uint64_t)t->arr + 1) * (t->psc + 1);
+	t->base_at = t->update_at;
+	t->base_cnt = 0;
+	while(t->update_at + period <= sim_now()) t->base_at = t->update_at += period;
+	t->update_at += period;
+	r->CNT = t->cnt = (uint32_t)((sim_now() - t->base_at) / (t->psc + 1));
+	sim_at(t->update_at, tim_irqn(num), tim_update, t, t->gen);
+
+	sim_isr_enter(tim_irqn(num));
+	HAL_TIM_PeriodElapsedCallback(t->handle);
+	sim_isr_exit(tim_irqn(num));
+}
+
+//what TIM_Base_SetConfig() does, update event included
+static void tim_init(TIM_HandleTypeDef* htim) {
+	uint8_t num = tim_num(htim->Instance);
+	tims[num].handle = htim;
+	htim->Instance->PSC = htim->Init.Prescaler;
+	htim->Instance->ARR = htim->Init.Period;
+	htim->Instance->CNT = 0;
+	tim_rebase(num);
+	sim_charge(SIM_HAL_CYCLES);
+}
+
+static void tim_channel(TIM_HandleTypeDef* htim, uint32_t channel, bool on) {
+	uint8_t num = tim_num(htim->Instance);
+	tim_t* t = &tims[num];
+	uint8_t bit = 1u << (channel >> 2);
+	t->handle = htim;
+	if(on == ((t->channels & bit) != 0)) return;
+
+	if(on) t->channels |= bit;
+	else t->channels &= ~bit;
+	tim_set_running(num);
+	if(!(t->no_pin & bit)) report(SIM_OUT_ENABLE, SIM_TIM_ID(num, channel), on);
+	sim_charge(SIM_HAL_CYCLES);
+}
+
+//when CNT next reaches CCRx, at or after a time; 0 for never
+static uint64_t tim_next_compare(uint8_t num, uint8_t channel, uint64_t after) {
+	tim_t* t = &tims[num];
+	tim_sync(num);
+	uint32_t ccr = *(&sim_tim[num].CCR1 + channel);
+	uint64_t period = (uint64_t)t->arr + 1;
+	if(!t->running || ccr >= period) return 0;
+
+	uint64_t tick = t->psc + 1;
+	if(after < t->base_at) after = t->base_at;
+	uint64_t counts = (after - t->base_at) / tick;
+	uint64_t count_at = t->base_at + counts * tick; //when the count in progress at that time started
+	uint64_t count = (t->base_cnt + counts) % period;
+	uint64_t at = count_at + (ccr + period - count) % period * tick;
+	return at < after ? at + period * tick : at;
+}
+
+//half and full transfer interrupts for the current pass through the buffer
+static void adc_schedule() {
+	uint32_t half = adc.len / 2;
+	if(half && !adc.half_done) sim_at(adc.start_at + (uint64_t)half * adc.conversion, DMA2_Stream0_IRQn, adc_isr, NULL, adc.gen << 1);
+	sim_at(adc.start_at + (uint64_t)adc.len * adc.conversion, DMA2_Stream0_IRQn, adc_isr, NULL, (adc.gen << 1) | 1);
+}
+
+//the DMA writing the samples up to to of this pass
+static void adc_fill(uint32_t to) {
+	if(to <= adc.filled) return;
+	for(uint32_t i = adc.filled; i < to; i++) {
+		uint64_t at = adc.start_at + (uint64_t)(i + 1) * adc.conversion;
+		uint16_t sample = adc_source ? adc_source(adc_ctx, adc.channel, at) : adc_constant;
+		adc.buf[i] = sample & 0xFFF;
+		sim_adc1.DR = adc.buf[i];
+	}
+	adc.conversions += to - adc.filled;
+	adc.filled = to;
+}
+
+//an injected trigger resets the regular conversion in progress, which starts over once the burst is done
+static void adc_stall(uint64_t at, uint64_t until) {
+	uint64_t done = at > adc.start_at ? (at - adc.start_at) / adc.conversion : 0;
+	if(done > adc.len) done = adc.len;
+	adc_fill(done); //before the source sees anything later
+	adc.start_at = until - done * adc.conversion;
+	adc.gen++;
+	adc_schedule();
+}
+
+static uint32_t adc_conversion_cycles() {
+	return (sample_clocks[adc.sample_time] + ADC_CONVERSION_CLOCKS) * ADC_CYCLES_PER_CLOCK;
+}
+
+//the next trigger
+static void inj_schedule(uint64_t after) {
+	for(uint8_t i = 0; i < NUM_INJ_TRIGGERS; i++) {
+		if(inj_triggers[i].trigger != inj.trigger) continue;
+		uint64_t at = tim_next_compare(inj_triggers[i].tim, inj_triggers[i].channel, after);
+		if(!at) return;
+		inj.trigger_at = at;
+		//it only needs an event of its own to hold up regular conversions; the rest of the time that would charge the
+		//firmware for an interrupt the hardware doesn't take, so straight on to the end of the burst
+		if(adc.running) sim_at(at, SIM_NO_IRQ, inj_trigger, NULL, inj.gen);
+		else inj_trigger(NULL, inj.gen);
+		return;
+	}
+}
+
+//the compare event: a burst of the ranks, and the end of conversion interrupt once it's done
+static void inj_trigger(void* ctx, uint32_t tag) {
+	UNUSED(ctx);
+	if(!inj.running || tag != inj.gen) return;
+	if(!READ_BIT(inj.handle->Instance->CR2, ADC_CR2_JEXTEN)) { //trigger taken away, nothing until it's started again
+		inj.running = false;
+		return;
+	}
+
+	inj.burst = READ_BIT(inj.handle->Instance->CR1, ADC_CR1_SCAN) ? inj.ranks : 1;
+	uint64_t done_at = inj.trigger_at + (uint64_t)inj.burst * adc_conversion_cycles();
+	if(adc.running) adc_stall(inj.trigger_at, done_at);
+	sim_at(done_at, ADC_IRQn, inj_isr, NULL, inj.gen);
+}
+
+//ADC_IRQHandler() -> HAL_ADC_IRQHandler(), end of the injected sequence
+static void inj_isr(void* ctx, uint32_t tag) {
+	UNUSED(ctx);
+	if(!inj.running || tag != inj.gen) return;
+
+	uint32_t conversion = adc_conversion_cycles();
+	inj.converting = true;
+	for(uint32_t i = 0; i < inj.burst; i++) { //the rest of the data registers keep whatever they had
+		uint64_t at = inj.trigger_at + (uint64_t)(i + 1) * conversion;
+		inj.jdr[i] = (adc_source ? adc_source(adc_ctx, inj.channel, at) : adc_constant) & 0xFFF;
+	}
+	inj.converting = false;
+	adc.conversions += inj.burst;
+
+	if(READ_BIT(inj.handle->Instance->CR1, ADC_CR1_JEOCIE)) {
+		sim_isr_enter(ADC_IRQn);
+		HAL_ADCEx_InjectedConvCpltCallback(inj.handle);
+		sim_isr_exit(ADC_IRQn);
+	}
+
+	//the callback may have stopped it or moved the compare
+	if(inj.running && tag == inj.gen) inj_schedule(inj.trigger_at + 1);
+}
+
+//DMA2_Stream0_IRQHandler() -> HAL_DMA_IRQHandler() -> the ADC's DMA callbacks
+static void adc_isr(void* ctx, uint32_t tag) {
+	UNUSED(ctx);
+	if(!adc.running || (tag >> 1) != (adc.gen & 0x7FFFFFFFu)) return;
+	bool full = tag & 1;
+
+	sim_isr_enter(DMA2_Stream0_IRQn);
+	if(full) {
+		adc_fill(adc.len);
+		if(adc.circular) {
+			adc.start_at += (uint64_t)adc.len * adc.conversion;
+			adc.filled = 0;
+			adc.half_done = false;
+			adc_schedule();
+		}
+		else adc.running = false;
+		HAL_ADC_ConvCpltCallback(adc.handle);
+	}
+	else {
+		adc_fill(adc.len / 2);
+		adc.half_done = true;
+		HAL_ADC_ConvHalfCpltCallback(adc.handle);
+	}
+	sim_isr_exit(DMA2_Stream0_IRQn);
+}
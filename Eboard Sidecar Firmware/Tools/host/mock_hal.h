@@ -0,0 +1,75 @@
+#ifndef MOCK_HAL_H
+#define MOCK_HAL_H
+
+#include "stm32f4xx_hal.h"
+#include "stdbool.h"
+#include "sim.h"
+#include "flash_sim.h"
+
+//the board's peripherals for the host build, running off the simulator's clock (sim.h)
+//  GPIO: writes land in ODR and go to the output hook; inputs are set by the harness and raise the EXTI
+//        interrupt on the configured edges once its NVIC line is enabled (an edge before that stays pending)
+//  TIM:  CNT counts at (PSC + 1) cycles a count from the clock; timers started with HAL_TIM_Base_Start_IT()
+//        call HAL_TIM_PeriodElapsedCallback() on every update; compare and reload changes go to the output hook
+//  ADC:  DMA conversions complete at the real rate for the configured sample time (ADC clock PCLK2/2), with
+//        the samples from the harness's source; half and full callbacks both fire, circular mode repeats
+//        injected conversions wait for their trigger, a timer compare event (CNT reaching CCRx), then convert
+//        every rank and call HAL_ADCEx_InjectedConvCpltCallback(); no trigger comes if the timer is stopped
+//        or the compare value is past the reload
+//  HAL_DeInit() powers the board off; the firmware only calls it right after letting go of its own power
+//interrupts go through the same trace hooks as the handlers in stm32f4xx_it.c
+//only the EXTI lines pay attention to the NVIC enables, everything else is enabled from reset like the
+//CubeMX MSP code leaves it
+
+typedef enum {
+	SIM_OUT_PIN, //id is sim_pin_id(), value the level
+	SIM_OUT_CCR, //id is SIM_TIM_ID(timer number, channel), value the compare register
+	SIM_OUT_ARR, //id is SIM_TIM_ID(timer number, TIM_CHANNEL_1), value the reload register
+	SIM_OUT_ENABLE, //id is SIM_TIM_ID(timer number, channel), value 1 for started, 0 for stopped
+	SIM_OUT_FLAGS, //id is the group's place in RTOS_EVENT_FLAGS (sim_flags_name()), value the bits being set
+} sim_out_t;
+
+#define SIM_TIM_ID(num, channel) ((uint16_t)((num) * 4 + ((channel) >> 2)))
+
+typedef void (*sim_out_hook_t)(void* ctx, sim_out_t kind, uint16_t id, uint32_t value);
+typedef uint16_t (*sim_adc_source_t)(void* ctx, uint32_t channel, uint64_t at);
+typedef void (*sim_usb_tx_t)(void* ctx, const uint8_t* data, uint16_t len);
+
+//================ outputs ================
+//every output change, as it happens; compare register writes are noticed at the next checkpoint
+void sim_out_hook(sim_out_hook_t hook, void* ctx);
+uint16_t sim_pin_id(GPIO_TypeDef* port, uint16_t pin); //port * 16 + pin number
+bool sim_gpio_output(GPIO_TypeDef* port, uint16_t pin);
+const char* sim_flags_name(uint16_t id); //the object name from rtos_objects.h, NULL past the end
+
+//================ inputs ================
+void sim_gpio_input(GPIO_TypeDef* port, uint16_t pin, bool level);
+void sim_gpio_input_at(uint64_t at, GPIO_TypeDef* port, uint16_t pin, bool level);
+
+//called for each sample with the cycle its conversion finished on; the default source is sim_adc_constant()
+void sim_adc_source(sim_adc_source_t source, void* ctx);
+void sim_adc_constant(uint16_t raw);
+uint32_t sim_adc_conversions(); //samples delivered since boot
+bool sim_adc_injected(); //from the source: whether the sample being asked for is an injected conversion
+
+//cycles since a PWM channel's output (mode 1: high from the update to the compare) last switched at a time,
+//and which way it went; UINT64_MAX if it isn't switching (stopped, or compare at 0 or past the reload)
+uint64_t sim_tim_pwm_edge(TIM_TypeDef* tim, uint32_t channel, uint64_t at, bool* rising);
+
+//================ USB (mock_usb.c) ================
+//everything the firmware writes goes to the hook (discarded without one); the ring never fills
+void sim_usb_tx_hook(sim_usb_tx_t hook, void* ctx);
+//the host sends something: it arrives in 64 byte packets, one USB interrupt each
+//false if there aren't enough free receive slots for all of it (a real host would be NAKed and retry)
+bool sim_usb_rx(const uint8_t* data, uint16_t len);
+
+//================ flash (flash_host.c) ================
+//the RAM behind flash_stm32_datalog and flash_stm32_config, for loading or inspecting between runs
+flash_sim_t* sim_flash_datalog();
+flash_sim_t* sim_flash_config();
+
+//================ for the other mocks ================
+void sim_isr_enter(IRQn_Type irqn);
+void sim_isr_exit(IRQn_Type irqn);
+
+#endif
@@ -0,0 +1,110 @@
+#include "mock_hal.h"
+#include "usbd_cdc_if.h"
+#include "usb_device.h"
+#include "usb_cmd.h"
+#include <string.h>
+
+//the CDC interface from USB_DEVICE/App/usbd_cdc_if.c without the device stack underneath: what the
+//firmware writes goes straight to the harness, and what the harness sends lands in the same packet slots
+//the parser reads in place (see mock_hal.h)
+
+#define RX_SLOT_SIZE 64 //full speed bulk packet
+#define RX_SLOTS (APP_RX_DATA_SIZE / RX_SLOT_SIZE)
+
+//===================== PRIVATE VARIABLES =====================
+static sim_usb_tx_t tx_hook = NULL;
+static void* tx_ctx = NULL;
+static cdc_tx_stats_t tx_stats;
+
+static uint8_t rx_buf[RX_SLOTS][RX_SLOT_SIZE];
+static uint16_t rx_len[RX_SLOTS];
+static uint32_t rx_written = 0; //slots the host has filled
+static volatile uint32_t rx_head = 0; //slots the firmware has been told about
+static volatile uint32_t rx_tail = 0; //slots released
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static void tx(const uint8_t* data, uint16_t len);
+static void rx_isr(void* ctx, uint32_t tag);
+
+// ================== HARNESS SIDE ==================
+void sim_usb_tx_hook(sim_usb_tx_t hook, void* ctx) {
+	tx_hook = hook;
+	tx_ctx = ctx;
+}
+
+bool sim_usb_rx(const uint8_t* data, uint16_t len) {
+	uint32_t packets = (len + RX_SLOT_SIZE - 1) / RX_SLOT_SIZE;
+	if(rx_written - rx_tail + packets > RX_SLOTS) return false;
+
+	for(uint32_t i = 0; i < packets; i++) {
+		uint16_t n = len - i * RX_SLOT_SIZE;
+		if(n > RX_SLOT_SIZE) n = RX_SLOT_SIZE;
+		uint32_t slot = rx_written++ % RX_SLOTS;
+		memcpy(rx_buf[slot], data + i * RX_SLOT_SIZE, n);
+		rx_len[slot] = n;
+		sim_at(sim_now(), OTG_FS_IRQn, rx_isr, NULL, 0);
+	}
+	return true;
+}
+
+// ================== CDC INTERFACE ==================
+void MX_USB_DEVICE_Init(void) {}
+
+uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len) {
+	tx(Buf, Len);
+	return 0; //USBD_OK
+}
+
+uint16_t CDC_Write_FS(const uint8_t* Buf, uint16_t Len) {
+	tx(Buf, Len);
+	return Len;
+}
+
+bool CDC_Write_All(const uint8_t* Buf, uint16_t Len) {
+	tx(Buf, Len);
+	return true;
+}
+
+void CDC_Get_Tx_Stats(cdc_tx_stats_t* stats) {
+	*stats = tx_stats;
+}
+
+bool CDC_Write_Block(const uint8_t* Header, uint16_t HeaderLen, const uint8_t* Block, uint16_t BlockLen) {
+	tx(Header, HeaderLen);
+	tx(Block, BlockLen);
+	tx_stats.blocks++;
+	return true;
+}
+
+bool CDC_Block_Busy(void) { return false; }
+uint16_t CDC_Tx_Space(void) { return APP_TX_DATA_SIZE; }
+
+bool CDC_Rx_Peek(const uint8_t** Buf, uint16_t* Len) {
+	if(rx_tail == rx_head) return false;
+	uint32_t slot = rx_tail % RX_SLOTS;
+	*Buf = rx_buf[slot];
+	*Len = rx_len[slot];
+	return true;
+}
+
+void CDC_Rx_Release(void) {
+	if(rx_tail != rx_head) rx_tail++;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static void tx(const uint8_t* data, uint16_t len) {
+	tx_stats.queued += len;
+	tx_stats.transfers++;
+	if(tx_hook) tx_hook(tx_ctx, data, len);
+	sim_charge(SIM_HAL_CYCLES + len / 4); //the copy into the ring
+}
+
+//OTG_FS_IRQHandler() -> CDC_Receive_FS()
+static void rx_isr(void* ctx, uint32_t tag) {
+	(void)ctx;
+	(void)tag;
+	sim_isr_enter(OTG_FS_IRQn);
+	rx_head++;
+	usb_cmd_rx_notify();
+	sim_isr_exit(OTG_FS_IRQn);
+}
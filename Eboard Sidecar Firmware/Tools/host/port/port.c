@@ -0,0 +1,190 @@
+#include "FreeRTOS.h"
+#include "task.h"
+#include "sim.h"
+#include <ucontext.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+//host port: see portmacro.h for the model, sim.h for the clock
+
+typedef struct {
+	ucontext_t context;
+	TaskFunction_t code;
+	void* params;
+	uint8_t stack[SIM_THREAD_STACK];
+} host_thread_t;
+
+extern void* volatile pxCurrentTCB; //tasks.c; the first word of a TCB is its top of stack, which is our host_thread_t
+
+//===================== PRIVATE VARIABLES =====================
+static ucontext_t harness; //whatever called sim_run_until()
+static bool in_harness = true;
+static bool started = false;
+
+//the CPU as the kernel sees it
+static uint32_t basepri = 0;
+static uint32_t primask = 0;
+static uint32_t ipsr = 0; //exception number, 0 in thread mode
+static UBaseType_t critical_nesting = 0xaaaaaaaa; //like the M4 port, so nothing unmasks before the scheduler starts
+static bool switch_pending = false;
+static uint64_t next_tick = 0;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static host_thread_t* current_thread();
+static void thread_entry();
+static void switch_thread();
+static void to_harness();
+static void tick(void* ctx, uint32_t tag);
+
+// ================== KERNEL PORT LAYER ==================
+StackType_t* pxPortInitialiseStack(StackType_t* pxTopOfStack, TaskFunction_t pxCode, void* pvParameters) {
+	host_thread_t* thread = malloc(sizeof(host_thread_t));
+	if(thread == NULL) {
+		fprintf(stderr, "sim: out of memory for a thread\n");
+		abort();
+	}
+	thread->code = pxCode;
+	thread->params = pvParameters;
+
+	getcontext(&thread->context);
+	thread->context.uc_stack.ss_sp = thread->stack;
+	thread->context.uc_stack.ss_size = sizeof(thread->stack);
+	thread->context.uc_link = NULL;
+	makecontext(&thread->context, thread_entry, 0);
+	return (StackType_t*)thread;
+}
+
+void vPortCleanUpTCB(void* pxTCB) {
+	free(*(host_thread_t**)pxTCB);
+}
+
+BaseType_t xPortStartScheduler(void) {
+	started = true;
+	critical_nesting = 0;
+	basepri = 0;
+	next_tick = sim_now() + SIM_CYCLES_PER_MS;
+	sim_at(next_tick, -1, tick, NULL, 0); //SysTick_IRQn
+
+	//unlike on the board this returns to main(); sim_run_until() starts the first thread
+	return pdTRUE;
+}
+
+void vPortEndScheduler(void) {}
+
+void vPortYield(void) {
+	switch_pending = true;
+	port_checkpoint();
+}
+
+void vPortEnterCritical(void) {
+	basepri = configMAX_SYSCALL_INTERRUPT_PRIORITY;
+	critical_nesting++;
+}
+
+void vPortExitCritical(void) {
+	configASSERT(critical_nesting);
+	if(--critical_nesting) return;
+	basepri = 0;
+	sim_advance(SIM_KERNEL_CYCLES);
+	port_checkpoint();
+}
+
+uint32_t ulPortRaiseBASEPRI(void) {
+	uint32_t old = basepri;
+	basepri = configMAX_SYSCALL_INTERRUPT_PRIORITY;
+	return old;
+}
+
+void vPortSetBASEPRI(uint32_t ulNewMaskValue) {
+	basepri = ulNewMaskValue;
+	if(basepri == 0) port_checkpoint();
+}
+
+BaseType_t xPortIsInsideInterrupt(void) {
+	return ipsr != 0;
+}
+
+//only called when every thread is blocked
+void vApplicationIdleHook(void) {
+	sim_idle();
+}
+
+// ================== SIMULATOR SIDE ==================
+void port_checkpoint() {
+	sim_poll_watch();
+	while(!in_harness && !ipsr && !basepri && !primask) {
+		if(sim_take_interrupt()) continue;
+		if(switch_pending) switch_thread();
+		else if(sim_stop_due()) to_harness();
+		else return;
+	}
+}
+
+void port_resume() {
+	if(!started) {
+		fprintf(stderr, "sim: run before the scheduler was started\n");
+		abort();
+	}
+	in_harness = false;
+	swapcontext(&harness, &current_thread()->context);
+	in_harness = true;
+}
+
+void port_power_off() {
+	while(!in_harness) to_harness(); //never resumed
+}
+
+bool port_started() { return started; }
+
+void port_isr_enter(int16_t irqn) { ipsr = irqn + 16; }
+void port_isr_exit() { ipsr = 0; }
+uint32_t port_ipsr() { return ipsr; }
+uint32_t port_basepri() { return basepri; }
+uint32_t port_primask() { return primask; }
+
+void port_set_primask(uint32_t mask) {
+	primask = mask;
+	if(!primask) port_checkpoint();
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static host_thread_t* current_thread() {
+	return *(host_thread_t* volatile*)pxCurrentTCB;
+}
+
+static void thread_entry() {
+	host_thread_t* thread = current_thread();
+	thread->code(thread->params);
+
+	//same as prvTaskExitError() on the board
+	fprintf(stderr, "sim: thread \"%s\" returned from its function\n", pcTaskGetName(NULL));
+	sim_power_off("thread returned");
+}
+
+//what PendSV does
+static void switch_thread() {
+	switch_pending = false;
+	sim_advance(SIM_SWITCH_CYCLES);
+
+	host_thread_t* from = current_thread();
+	vTaskSwitchContext();
+	host_thread_t* to = current_thread();
+	if(to != from) swapcontext(&from->context, &to->context);
+}
+
+static void to_harness() {
+	in_harness = true;
+	swapcontext(&current_thread()->context, &harness);
+}
+
+//xPortSysTickHandler()
+static void tick(void* ctx, uint32_t tag) {
+	//on the dot, however late this one was taken; ticks missed behind a long stall are lost like on the board,
+	//where SysTick only has the one pending bit
+	do next_tick += SIM_CYCLES_PER_MS; while(next_tick <= sim_now());
+	sim_at(next_tick, -1, tick, NULL, 0);
+
+	uint32_t mask = ulPortRaiseBASEPRI();
+	if(xTaskIncrementTick() != pdFALSE) switch_pending = true;
+	vPortSetBASEPRI(mask);
+}
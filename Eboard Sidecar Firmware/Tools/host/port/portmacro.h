@@ -0,0 +1,77 @@
+#ifndef PORTMACRO_H
+#define PORTMACRO_H
+
+#include "stdint.h"
+#include "stddef.h"
+
+//FreeRTOS port for running the firmware on a Linux host (see Tools/host/sim.h)
+//every thread gets a ucontext of its own and exactly one of them runs at a time, so the kernel sees a single core
+//"interrupts" are the simulator's events, taken at checkpoints (kernel calls, HAL calls) whenever they aren't masked;
+//a yield is a pended switch that happens at the first checkpoint where interrupts are unmasked, like PendSV
+//the types are the same widths as the Cortex-M4 port's, except for pointers
+
+//================== types ==================
+#define portCHAR		char
+#define portFLOAT		float
+#define portDOUBLE		double
+#define portLONG		long
+#define portSHORT		short
+#define portSTACK_TYPE	uint32_t
+#define portBASE_TYPE	long
+#define portPOINTER_SIZE_TYPE size_t
+
+typedef portSTACK_TYPE StackType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#if( configUSE_16_BIT_TICKS == 1 )
+	typedef uint16_t TickType_t;
+	#define portMAX_DELAY ( TickType_t ) 0xffff
+#else
+	typedef uint32_t TickType_t;
+	#define portMAX_DELAY ( TickType_t ) 0xffffffffUL
+	#define portTICK_TYPE_IS_ATOMIC 1 //only one thing ever runs at once
+#endif
+
+//================== architecture ==================
+#define portSTACK_GROWTH			( -1 )
+#define portTICK_PERIOD_MS			( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portBYTE_ALIGNMENT			8
+
+//================== scheduler ==================
+void vPortYield( void );
+#define portYIELD()									vPortYield()
+#define portEND_SWITCHING_ISR( xSwitchRequired )	if( xSwitchRequired != pdFALSE ) portYIELD()
+#define portYIELD_FROM_ISR( x )						portEND_SWITCHING_ISR( x )
+
+//================== critical sections ==================
+void vPortEnterCritical( void );
+void vPortExitCritical( void );
+uint32_t ulPortRaiseBASEPRI( void );
+void vPortSetBASEPRI( uint32_t ulNewMaskValue );
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()		ulPortRaiseBASEPRI()
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)	vPortSetBASEPRI(x)
+#define portDISABLE_INTERRUPTS()				( void ) ulPortRaiseBASEPRI()
+#define portENABLE_INTERRUPTS()					vPortSetBASEPRI(0)
+#define portENTER_CRITICAL()					vPortEnterCritical()
+#define portEXIT_CRITICAL()						vPortExitCritical()
+
+//================== threads ==================
+//the host context lives in a block of its own; the TCB's top of stack points at it and the real stack goes unused
+void vPortCleanUpTCB( void *pxTCB );
+#define portCLEAN_UP_TCB( pxTCB )		vPortCleanUpTCB( pxTCB )
+
+#define portTASK_FUNCTION_PROTO( vFunction, pvParameters ) void vFunction( void *pvParameters )
+#define portTASK_FUNCTION( vFunction, pvParameters ) void vFunction( void *pvParameters )
+
+BaseType_t xPortIsInsideInterrupt( void );
+
+#define portNOP()
+#define portINLINE	__inline
+#ifndef portFORCE_INLINE
+	#define portFORCE_INLINE inline __attribute__(( always_inline))
+#endif
+#define portMEMORY_BARRIER() __asm volatile( "" ::: "memory" )
+
+#endif /* PORTMACRO_H */
@@ -0,0 +1,151 @@
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//see sim.h
+
+typedef struct {
+	uint64_t at;
+	uint64_t order; //ties go to whatever was scheduled first
+	sim_event_t fn;
+	void* ctx;
+	uint32_t tag;
+	int16_t irqn;
+} event_t;
+
+//===================== PRIVATE VARIABLES =====================
+static uint64_t now = 0;
+static uint64_t stop_at = 0;
+static bool powered_off = false;
+static const char* off_reason = NULL;
+static double host_seconds = 0;
+static sim_watch_t watch = NULL;
+static uint64_t watched_at = 0;
+
+//binary min-heap by (at, order)
+static event_t events[SIM_MAX_EVENTS];
+static uint32_t num_events = 0;
+static uint64_t next_order = 0;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static bool earlier(const event_t* a, const event_t* b);
+static void pop_event(event_t* out);
+static double host_now();
+
+// ================== PUBLIC FUNCTION DEFS ==================
+uint64_t sim_now() { return now; }
+uint32_t sim_cycles32() { return (uint32_t)now; }
+
+void sim_charge(uint32_t cycles) {
+	now += cycles;
+	port_checkpoint();
+}
+
+void sim_at(uint64_t at, int16_t irqn, sim_event_t fn, void* ctx, uint32_t tag) {
+	if(num_events >= SIM_MAX_EVENTS) {
+		fprintf(stderr, "sim: more than %u events waiting\n", SIM_MAX_EVENTS);
+		abort();
+	}
+
+	//sift up
+	event_t event = {.at = at, .order = next_order++, .fn = fn, .ctx = ctx, .tag = tag, .irqn = irqn};
+	uint32_t i = num_events++;
+	while(i > 0 && earlier(&event, &events[(i - 1) / 2])) {
+		events[i] = events[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	events[i] = event;
+}
+
+void sim_watch(sim_watch_t fn) { watch = fn; }
+
+void sim_run_until(uint64_t at) {
+	if(powered_off || at <= now) return;
+	stop_at = at;
+
+	double start = host_now();
+	port_resume();
+	if(watch) watch(); //anything written since the last look
+	host_seconds += host_now() - start;
+}
+
+void sim_run_for(uint32_t ms) { sim_run_until(now + SIM_MS(ms)); }
+
+void sim_power_off(const char* why) {
+	if(!powered_off) {
+		powered_off = true;
+		off_reason = why;
+	}
+	port_power_off();
+}
+
+bool sim_powered_off() { return powered_off; }
+const char* sim_power_off_reason() { return off_reason; }
+double sim_host_seconds() { return host_seconds; }
+
+void sim_assert_failed(const char* file, int line) {
+	fprintf(stderr, "sim: configASSERT failed at %s:%d (cycle %llu)\n", file, line, (unsigned long long)now);
+	abort();
+}
+
+//================ between sim.c and the port ================
+void sim_advance(uint32_t cycles) { now += cycles; }
+
+bool sim_take_interrupt() {
+	if(num_events == 0 || events[0].at > now) return false;
+
+	event_t event;
+	pop_event(&event);
+	port_isr_enter(event.irqn);
+	now += SIM_ISR_CYCLES;
+	event.fn(event.ctx, event.tag);
+	port_isr_exit();
+	return true;
+}
+
+bool sim_stop_due() { return now >= stop_at; }
+
+//scanning the registers on every checkpoint was most of the cost of a busy thread, and nothing on the
+//board reacts to a compare register faster than a PWM period anyway
+void sim_poll_watch() {
+	if(!watch || now - watched_at < SIM_WATCH_CYCLES) return;
+	watched_at = now;
+	watch();
+}
+
+void sim_idle() {
+	//the tick is always waiting, so there's always something to skip to
+	uint64_t next = num_events ? events[0].at : stop_at;
+	if(next > stop_at) next = stop_at;
+	if(next > now) now = next;
+	port_checkpoint();
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static bool earlier(const event_t* a, const event_t* b) {
+	return a->at < b->at || (a->at == b->at && a->order < b->order);
+}
+
+static void pop_event(event_t* out) {
+	*out = events[0];
+	event_t last = events[--num_events];
+
+	//sift down
+	uint32_t i = 0;
+	while(true) {
+		uint32_t child = 2 * i + 1;
+		if(child >= num_events) break;
+		if(child + 1 < num_events && earlier(&events[child + 1], &events[child])) child++;
+		if(!earlier(&events[child], &last)) break;
+		events[i] = events[child];
+		i = child;
+	}
+	if(num_events) events[i] = last;
+}
+
+static double host_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
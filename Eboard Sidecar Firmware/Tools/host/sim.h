@@ -0,0 +1,88 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "stdint.h"
+#include "stdbool.h"
+
+//virtual time for running the firmware on a Linux host
+//the firmware runs unchanged on the real kernel with the host port in Tools/host/port; only this clock moves time
+//forward: every kernel critical section, context switch, interrupt and HAL call is charged a rough Cortex-M4 cost,
+//and when every thread is blocked the idle thread skips straight to the next event
+//so a run only takes as long as the work the firmware actually does, and the same inputs always give the same run
+//
+//events (the RTOS tick, timer overflows, DMA completions, anything a harness schedules) are taken as interrupts at
+//the next checkpoint where interrupts aren't masked, in time order; they never nest
+//the harness runs between calls to sim_run_until(), while no firmware code is running; it can schedule events and
+//call anything that doesn't block
+
+#define SIM_CPU_HZ 64000000ul //SystemCoreClock
+#define SIM_CYCLES_PER_MS (SIM_CPU_HZ / 1000)
+#define SIM_MS(ms) ((uint64_t)(ms) * SIM_CYCLES_PER_MS)
+#define SIM_US(us) ((uint64_t)(us) * (SIM_CPU_HZ / 1000000))
+
+//what things cost, in CPU cycles
+#define SIM_KERNEL_CYCLES 100 //one kernel critical section, start to finish
+#define SIM_SWITCH_CYCLES 200 //PendSV and picking the next thread
+#define SIM_ISR_CYCLES 40 //interrupt entry and exit
+#define SIM_HAL_CYCLES 20 //a HAL call
+
+#define SIM_WATCH_CYCLES 640 //10us, how late a direct register write can be noticed
+#define SIM_MAX_EVENTS 4096 //waiting at once
+#define SIM_NO_IRQ (-15) //for events that are hardware changing rather than an interrupt (still run like one)
+#define SIM_THREAD_STACK (64*1024) //host stack for each thread; the firmware's own stacks go unused
+
+typedef void (*sim_event_t)(void* ctx, uint32_t tag);
+typedef void (*sim_watch_t)();
+
+//================ time ================
+uint64_t sim_now(); //cycles since power on
+uint32_t sim_cycles32(); //same thing as the DWT cycle counter sees it
+//spend some cycles, then take anything that came due
+void sim_charge(uint32_t cycles);
+
+//================ events ================
+//call fn(ctx, tag) as interrupt irqn at cycle `at` (or as soon as possible if that's past)
+//events due at the same cycle go in the order they were scheduled
+void sim_at(uint64_t at, int16_t irqn, sim_event_t fn, void* ctx, uint32_t tag);
+
+//called at checkpoints at most every SIM_WATCH_CYCLES, and whenever the harness gets control back, for noticing
+//registers the firmware writes directly (one watcher, the mock HAL's)
+void sim_watch(sim_watch_t fn);
+
+//================ running ================
+//let the firmware run until the clock reaches `at`; returns early if the board powers off
+void sim_run_until(uint64_t at);
+void sim_run_for(uint32_t ms);
+
+//the board cut its own power, or got stuck somewhere it'll never come back from; nothing runs after this
+void sim_power_off(const char* why);
+bool sim_powered_off();
+const char* sim_power_off_reason();
+
+//configASSERT() on the host: report where and abort
+void sim_assert_failed(const char* file, int line);
+
+//host seconds spent running firmware, for working out the speed
+double sim_host_seconds();
+
+//================ between sim.c and the port ================
+void sim_advance(uint32_t cycles); //move the clock without taking anything
+bool sim_take_interrupt(); //run the oldest due event, false if nothing's due
+bool sim_stop_due(); //reached the time sim_run_until() was asked for
+void sim_idle(); //every thread is blocked: skip ahead to whatever happens next
+void sim_poll_watch();
+
+void port_checkpoint(); //take due interrupts and pended switches if they aren't masked
+void port_resume(); //run the threads until the stop time
+void port_power_off(); //leave the threads for good
+bool port_started();
+
+//the core registers the CMSIS intrinsics read (see include/cmsis_compiler.h)
+void port_isr_enter(int16_t irqn);
+void port_isr_exit();
+uint32_t port_ipsr();
+uint32_t port_basepri();
+uint32_t port_primask();
+void port_set_primask(uint32_t primask);
+
+#endif
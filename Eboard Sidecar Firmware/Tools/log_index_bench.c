@@ -0,0 +1,183 @@
+//host check of the flash log time index (Core/Src/log_index.c) on the RAM flash simulator
+//writes many rides through the same page/index steps as the firmware writer, cuts the power now and then,
+//and checks that a rebuilt index matches the live one and that seeks land where a full scan says they should
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc -ITools Tools/log_index_bench.c Tools/flash_sim.c Core/Src/log_index.c Core/Src/flash_log.c Core/Src/checksum.c -o log_index_bench
+//usage: ./log_index_bench [rides]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log_index.h"
+#include "flash_sim.h"
+#include "datalog_records.h"
+
+#define SECTOR_SIZE DATALOG_SECTOR_SIZE
+#define NUM_SECTORS DATALOG_NUM_SECTORS
+#define RECORD_TYPE 3
+#define SEEKS_PER_RIDE 20
+
+typedef struct {
+	flash_sim_t sim;
+	flash_dev_t dev;
+	flash_log_t log;
+	log_index_t idx;
+	uint16_t ride;
+	uint16_t sector_records;
+} bench_t;
+
+//mount and rebuild like datalog_init(); returns the flash bytes read by the rebuild
+static uint32_t boot(bench_t* b) {
+	flash_log_mount(&b->log, &b->dev);
+	if(flash_log_free_pages(&b->log) < b->log.pages_per_sector / 2) flash_log_rotate(&b->log, true);
+
+	uint32_t before = b->sim.bytes_read;
+	log_index_build(&b->idx, &b->log);
+	uint32_t read = b->sim.bytes_read - before;
+
+	b->ride = 0;
+	if(log_index_last_ride(&b->idx, &b->log, &b->ride)) b->ride++;
+	b->sector_records = b->idx.sector[b->log.active].records;
+	return read;
+}
+
+//one page the way the firmware writer builds it; returns false if the power went
+static bool write_page(bench_t* b, uint32_t tick) {
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t used = 0, records = 0;
+	uint8_t rec[20] = {0};
+
+	log_page_info_t info = {.ride = b->ride, .tick = tick, .records_before = b->sector_records};
+	flash_log_record_put(page, &used, LOG_PAGE_INFO, &info, sizeof(info));
+	uint8_t len = 4 + rand() % 16;
+	while(flash_log_record_put(page, &used, RECORD_TYPE, rec, len)) records++;
+
+	flash_log_status_t status = flash_log_append_page(&b->log, page, used);
+	if(status == FLASH_LOG_FULL) {
+		if(flash_log_rotate(&b->log, true) != FLASH_LOG_OK) return false;
+		b->sector_records = info.records_before = 0;
+		memcpy(&page[FLASH_LOG_RECORD_HEADER], &info, sizeof(info));
+		status = flash_log_append_page(&b->log, page, used);
+	}
+	if(status != FLASH_LOG_OK) return false;
+
+	b->sector_records += records;
+	log_index_page_written(&b->idx, &b->log, &info, records);
+	return true;
+}
+
+static bool same_index(const log_index_t* a, const log_index_t* b) {
+	for(int s = 0; s < NUM_SECTORS; s++) {
+		const log_sector_index_t *x = &a->sector[s], *y = &b->sector[s];
+		if(x->used != y->used) return false;
+		if(!x->used) continue;
+		if(log_key_cmp(x->first, y->first) || log_key_cmp(x->last, y->last) || x->records != y->records || x->end != y->end) return false;
+	}
+	return true;
+}
+
+//where a seek should end up: the last page starting at or before the key, found by reading everything
+static void scan_seek(const flash_log_t* log, log_key_t key, flash_log_cursor_t* best) {
+	flash_log_cursor_t cur, before;
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t len;
+	bool first = true;
+
+	flash_log_rewind(log, &cur);
+	before = cur;
+	while(flash_log_read_next(log, &cur, page, &len, NULL) == FLASH_LOG_OK) {
+		log_page_info_t info;
+		if(log_page_info(page, len, &info)) {
+			log_key_t k = {.ride = info.ride, .tick = info.tick};
+			if(first || log_key_cmp(k, key) <= 0) {
+				//read_next already moved on, so this page is the one before the cursor
+				*best = cur;
+				best->page--;
+				if(best->page == 0) *best = before;
+			}
+			if(log_key_cmp(k, key) > 0) return;
+			first = false;
+		}
+		before = cur;
+	}
+}
+
+//the page a cursor points at, skipping torn ones like read_next does
+static bool cursor_page(const flash_log_t* log, flash_log_cursor_t cur, uint32_t* seq) {
+	uint8_t page[FLASH_LOG_PAGE_PAYLOAD];
+	uint16_t len;
+	return flash_log_read_next(log, &cur, page, &len, seq) == FLASH_LOG_OK;
+}
+
+int main(int argc, char** argv) {
+	int rides = argc > 1 ? atoi(argv[1]) : 200;
+	bench_t b;
+	int failures = 0, cuts = 0, seeks = 0;
+	uint32_t worst_build = 0, seek_bytes = 0, scan_bytes = 0;
+
+	srand(1);
+	flash_sim_init(&b.sim, &b.dev, SECTOR_SIZE, NUM_SECTORS);
+	boot(&b);
+
+	for(int r = 0; r < rides; r++) {
+		uint32_t tick = 3000 + rand() % 1000;
+		int pages = 20 + rand() % 400;
+
+		//some rides end with the power cut partway through a page
+		bool cut = rand() % 4 == 0;
+		int cut_page = cut ? rand() % pages : pages;
+
+		for(int p = 0; p < pages; p++) {
+			if(p == cut_page) flash_sim_cut_after(&b.sim, 1 + rand() % 64);
+			tick += 100 + rand() % 5000;
+			if(!write_page(&b, tick)) break;
+		}
+		if(cut) cuts++;
+
+		//the index the writer kept should be what a rebuild after a clean shutdown finds
+		log_index_t live = b.idx;
+		flash_sim_power_on(&b.sim);
+		flash_log_t before_boot = b.log;
+		uint32_t build = boot(&b);
+		if(build > worst_build) worst_build = build;
+		if(!cut && before_boot.active == b.log.active && !same_index(&live, &b.idx)) {
+			printf("ride %d: rebuilt index doesn't match\n", r);
+			failures++;
+		}
+
+		//random seeks into the rides that are still in the log
+		uint16_t oldest = b.ride;
+		for(int s = 0; s < NUM_SECTORS; s++) {
+			if(b.idx.sector[s].used && b.idx.sector[s].first.ride < oldest) oldest = b.idx.sector[s].first.ride;
+		}
+		for(int i = 0; i < SEEKS_PER_RIDE; i++) {
+			log_key_t key = {.ride = oldest + rand() % (b.ride - oldest + 1), .tick = rand() % 1000000};
+			flash_log_cursor_t fast, slow;
+			uint32_t fast_seq, slow_seq;
+
+			uint32_t start = b.sim.bytes_read;
+			bool ok = log_index_seek(&b.idx, &b.log, key, &fast);
+			seek_bytes += b.sim.bytes_read - start;
+
+			start = b.sim.bytes_read;
+			scan_seek(&b.log, key, &slow);
+			scan_bytes += b.sim.bytes_read - start;
+
+			if(!ok) continue;
+			bool f = cursor_page(&b.log, fast, &fast_seq), s = cursor_page(&b.log, slow, &slow_seq);
+			if(f != s || (f && fast_seq != slow_seq)) {
+				printf("ride %d: seek to %u/%lu landed on page %lu, scan says %lu\n", r, key.ride, (unsigned long)key.tick,
+						(unsigned long)fast_seq, (unsigned long)slow_seq);
+				failures++;
+			}
+			seeks++;
+		}
+	}
+
+	printf("%d rides (%d power cuts), %d seeks\n", rides, cuts, seeks);
+	printf("  index rebuild: at most %lu bytes read (%.1f pages)\n", (unsigned long)worst_build, worst_build / (double)FLASH_LOG_PAGE_SIZE);
+	printf("  seek: %.0f bytes read on average, full scan %.0f\n", (double)seek_bytes / seeks, (double)scan_bytes / seeks);
+	printf("  %d failures\n", failures);
+	flash_sim_free(&b.sim);
+	return failures ? 1 : 0;
+}
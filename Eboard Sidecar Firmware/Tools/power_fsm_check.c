@@ -0,0 +1,146 @@
+//host check of the power lifecycle tables (Core/Src/power_fsm.c) against event scripts
+//the tables run on the real hsm (Core/Src/hsm.c) with the hooks stubbed out to just note that they were called
+//script format, one line per step, time in ms from power on, # starts a comment:
+//  <ms> <event>               dispatch an event, by its name in the table (soc critical, long press...)
+//  <ms> bus ok|bad            what the power_bus_ok() guard answers from here on (ok to start with)
+//  <ms> expect <state>        the machine has to be in that state, by its name in the table
+//  <ms> hooks <hook>...       the hooks called since the last hooks line, in order; - for none
+//a tick goes in every ms, like the main loop's, and the tick for a line's ms goes in ahead of the line
+//build from the Tools directory:
+//  cmake -S . -B build && cmake --build build
+//usage: ./build/power_fsm_check power_fsm/*.txt
+//prints a line per script and one per step that went wrong, exit status 1 if any did; ctest runs it over all of them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "power_fsm.h"
+
+#define MAX_LINE 256
+
+static bool bus_ok;
+static char called[MAX_LINE]; //hooks since the last hooks line, space separated
+
+//====================== HOOKS ======================
+static void hook(const char* name) {
+	if(called[0]) strncat(called, " ", sizeof(called) - strlen(called) - 1);
+	strncat(called, name, sizeof(called) - strlen(called) - 1);
+}
+
+void power_on_precharge() { hook("precharge"); }
+bool power_bus_ok() { return bus_ok; }
+void power_on_latch() { hook("latch"); }
+void power_on_bump() { hook("bump"); }
+void power_on_hold() { hook("hold"); }
+void power_on_release() { hook("release"); }
+void power_on_soc_low() { hook("soc_low"); }
+void power_on_fault() { hook("fault"); }
+void power_on_soc_crit() { hook("soc_crit"); }
+void power_on_read_fail() { hook("read_fail"); }
+void power_on_fault_timeout() { hook("fault_timeout"); }
+void power_on_shutdown() { hook("shutdown"); }
+
+//====================== SCRIPTS ======================
+static int find_event(const char* name) {
+	for(int i = 0; i < power_fsm.num_events; i++) if(!strcmp(power_fsm.event_names[i], name)) return i;
+	return -1;
+}
+
+static int find_state(const char* name) {
+	for(int i = 1; i < power_fsm.num_states; i++) if(!strcmp(power_fsm.states[i].name, name)) return i;
+	return -1;
+}
+
+//the names on a hooks line with the spacing evened out, to compare against what was called
+static void normalise(char* names, char* out, size_t size) {
+	char* saveptr;
+	out[0] = 0;
+	for(char* name = strtok_r(names, " \t", &saveptr); name; name = strtok_r(NULL, " \t", &saveptr)) {
+		if(!strcmp(name, "-")) continue;
+		if(out[0]) strncat(out, " ", size - strlen(out) - 1);
+		strncat(out, name, size - strlen(out) - 1);
+	}
+}
+
+static bool run_script(const char* path) {
+	FILE* f = fopen(path, "r");
+	if(!f) { perror(path); return false; }
+	const char* name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+
+	hsm_t power;
+	uint32_t now = 0, steps = 0, failed = 0, line_num = 0;
+	char line[MAX_LINE];
+
+	bus_ok = true;
+	called[0] = 0;
+	hsm_init(&power, &power_fsm, PWR_PRECHARGE, 0, NULL);
+
+	while(fgets(line, sizeof(line), f)) {
+		line_num++;
+		char* hash = strchr(line, '#');
+		if(hash) *hash = 0;
+		line[strcspn(line, "\r\n")] = 0;
+
+		unsigned ms;
+		int used;
+		if(sscanf(line, " %u %n", &ms, &used) != 1) continue; //blank or a comment
+		char* rest = line + used;
+		for(char* end = rest + strlen(rest); end > rest && (end[-1] == ' ' || end[-1] == '\t'); end--) end[-1] = 0;
+
+		if(ms < now) {
+			printf("FAIL  %s:%u goes back in time (%ums after %ums)\n", name, line_num, ms, now);
+			failed++;
+			continue;
+		}
+		while(now < ms) hsm_dispatch(&power, PWR_EV_TICK, ++now);
+
+		steps++;
+		if(!strncmp(rest, "expect ", 7)) {
+			int state = find_state(rest + 7);
+			if(state < 0) {
+				printf("FAIL  %s:%u no state called \"%s\"\n", name, line_num, rest + 7);
+				failed++;
+			}
+			else if(power.current != state) {
+				printf("FAIL  %s:%u at %ums in %s, expected %s\n", name, line_num, ms,
+						power_fsm.states[power.current].name, rest + 7);
+				failed++;
+			}
+		}
+		else if(!strncmp(rest, "hooks ", 6) || !strcmp(rest, "hooks")) {
+			char expected[MAX_LINE];
+			normalise(rest + 5, expected, sizeof(expected));
+			if(strcmp(expected, called)) {
+				printf("FAIL  %s:%u at %ums hooks were [%s], expected [%s]\n", name, line_num, ms, called, expected);
+				failed++;
+			}
+			called[0] = 0;
+		}
+		else if(!strcmp(rest, "bus ok")) bus_ok = true;
+		else if(!strcmp(rest, "bus bad")) bus_ok = false;
+		else {
+			int event = find_event(rest);
+			if(event < 0) {
+				printf("FAIL  %s:%u no event called \"%s\"\n", name, line_num, rest);
+				failed++;
+			}
+			else hsm_dispatch(&power, event, ms);
+		}
+	}
+	fclose(f);
+
+	if(!failed) printf("ok    %-22s %u steps, %ums\n", name, steps, now);
+	return failed == 0;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s <script.txt>...\n", argv[0]);
+		return 2;
+	}
+
+	uint32_t failed = 0;
+	for(int i = 1; i < argc; i++) if(!run_script(argv[i])) failed++;
+	printf("%u of %u scripts failed\n", failed, argc - 1);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+//host check of the precharge detector (monitor_precharge_step in Core/Src/batt_monitor.c) on bus voltage curves
+//each curve is a CSV of ms,volts from the button going down, with what should happen in a comment at the top:
+//  # expect latch by <ms>   the detector has to call it by then, with the bus within MAX_GAP of where it settles
+//  # expect none            it must never call it (the long press and the bus check take over)
+//the curve is read at the detector's period, straight lines between the points, the way the monitor would
+//build from the Tools directory:
+//  cmake -S . -B build && cmake --build build
+//usage: ./build/precharge_check precharge/*.csv
+//prints a line per curve, exit status 1 if any of them went wrong; ctest runs it over all of them
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batt_monitor.h"
+
+#define MAX_POINTS 65536
+#define MIN_VOLTS 20.0f //BUS_MIN_VOLTAGE in state_machine.h
+#define MAX_GAP 0.5f //V left to go at the latch; all the FETs and the capacitors have to take
+#define SETTLED_MS 50 //the end of the curve that's averaged for where it settles
+
+typedef struct {
+	float ms, volts;
+} point_t;
+
+static point_t points[MAX_POINTS];
+static uint32_t num_points;
+
+static bool load_curve(const char* path, int32_t* expect_ms) {
+	FILE* f = fopen(path, "r");
+	if(!f) { perror(path); return false; }
+
+	char line[256];
+	num_points = 0;
+	*expect_ms = -2; //not given
+	while(fgets(line, sizeof(line), f) && num_points < MAX_POINTS) {
+		int ms;
+		if(!strncmp(line, "# expect none", 13)) *expect_ms = -1;
+		else if(sscanf(line, "# expect latch by %d", &ms) == 1) *expect_ms = ms;
+		else if(sscanf(line, "%f,%f", &points[num_points].ms, &points[num_points].volts) == 2) num_points++;
+	}
+	fclose(f);
+
+	if(*expect_ms == -2 || num_points < 2) {
+		fprintf(stderr, "%s: no expectation or not enough points\n", path);
+		return false;
+	}
+	return true;
+}
+
+static float volts_at(float ms) {
+	uint32_t i = 1;
+	while(i < num_points - 1 && points[i].ms < ms) i++;
+	point_t* a = &points[i - 1];
+	point_t* b = &points[i];
+	if(ms <= a->ms) return a->volts;
+	if(ms >= b->ms) return b->volts;
+	return a->volts + (b->volts - a->volts) * (ms - a->ms) / (b->ms - a->ms);
+}
+
+static bool check_curve(const char* path) {
+	int32_t expect_ms;
+	if(!load_curve(path, &expect_ms)) return false;
+
+	float end = points[num_points - 1].ms;
+	float settled = 0;
+	uint32_t num_settled = 0;
+	for(uint32_t i = 0; i < num_points; i++) {
+		if(points[i].ms < end - SETTLED_MS) continue;
+		settled += points[i].volts;
+		num_settled++;
+	}
+	settled /= num_settled;
+
+	monitor_precharge_t p = {0};
+	float latch_ms = -1, latch_volts = 0;
+	for(float ms = 0; ms <= end; ms += MONITOR_PRECHARGE_PERIOD) {
+		float volts = volts_at(ms);
+		if(monitor_precharge_step(&p, volts, MIN_VOLTS)) {
+			latch_ms = ms;
+			latch_volts = volts;
+			break;
+		}
+	}
+
+	const char* name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	bool ok;
+	if(expect_ms < 0) {
+		ok = latch_ms < 0;
+		if(ok) printf("ok    %-22s never latched (settles at %.2fV)\n", name, settled);
+		else printf("FAIL  %-22s latched at %.0fms on %.2fV, it shouldn't have\n", name, latch_ms, latch_volts);
+		return ok;
+	}
+
+	if(latch_ms < 0) {
+		printf("FAIL  %-22s never latched, expected by %dms (settles at %.2fV)\n", name, expect_ms, settled);
+		return false;
+	}
+	float gap = settled - latch_volts;
+	ok = latch_ms <= expect_ms && gap <= MAX_GAP;
+	printf("%-5s %-22s latched at %.0fms (by %dms) on %.2fV, %.3fV short of %.2fV\n", ok ? "ok" : "FAIL", name,
+			latch_ms, expect_ms, latch_volts, gap, settled);
+	return ok;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s <curve.csv>...\n", argv[0]);
+		return 2;
+	}
+
+	uint32_t failed = 0;
+	for(int i = 1; i < argc; i++) if(!check_curve(argv[i])) failed++;
+	printf("%u of %u curves failed\n", failed, argc - 1);
+	return failed ? 1 : 0;
+}
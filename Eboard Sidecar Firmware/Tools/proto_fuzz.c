@@ -0,0 +1,169 @@
+//host fuzz harness for the USB command protocol (Core/Src/protocol.c)
+//round trips random frames through the encoder and the streaming decoder split into random
+//USB-sized pieces with printf noise in between, then throws mutated and purely random streams at
+//the decoder and dispatcher and checks nothing gets through that shouldn't
+//build from the project directory (the sanitizers do most of the checking):
+//  gcc -O1 -g -std=gnu11 -fsanitize=address,undefined -ICore/Inc Tools/proto_fuzz.c Core/Src/protocol.c Core/Src/checksum.c -o proto_fuzz
+//usage: ./proto_fuzz [iterations] [seed]
+//or with libFuzzer:
+//  clang -O1 -g -fsanitize=fuzzer,address,undefined -DLIBFUZZER -ICore/Inc Tools/proto_fuzz.c Core/Src/protocol.c Core/Src/checksum.c -o proto_fuzz
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "protocol.h"
+
+#define STREAM_MAX 4096
+#define USB_PACKET 64
+
+//a stand-in command table, the handlers check they were given what the table promised
+static const uint8_t min_args[PROTO_NUM_CMDS] = {[PROTO_PING] = 0, [PROTO_CONFIG_GET] = 1, [PROTO_LOG_READ] = sizeof(proto_log_read_t)};
+static uint32_t handled, replies, bad_replies;
+
+static void check_handler(const uint8_t* args, uint16_t len, const proto_reply_t* reply) {
+	if(len < min_args[reply->cmd]) { printf("handler for %u got %u bytes of arguments\n", reply->cmd, len); exit(1); }
+	handled++;
+	proto_reply(reply, PROTO_OK, args, len);
+}
+
+static const proto_command_t table[PROTO_NUM_CMDS] = {
+	[PROTO_PING] = {0, check_handler},
+	[PROTO_CONFIG_GET] = {1, check_handler},
+	[PROTO_LOG_READ] = {sizeof(proto_log_read_t), check_handler},
+};
+
+//replies must decode cleanly with the same decoder
+static void on_reply(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len < 3 || !(payload[0] & PROTO_REPLY)) bad_replies++;
+	replies++;
+}
+
+static void send(const uint8_t* frame, uint16_t len, void* ctx) {
+	proto_rx_t reply_rx;
+	if(len > PROTO_MAX_FRAME) { printf("reply frame of %u bytes\n", len); exit(1); }
+	if(frame[0] != 0 || frame[len - 1] != 0) { printf("reply frame isn't delimited\n"); exit(1); }
+	for(uint16_t i = 1; i < len - 1; i++) if(frame[i] == 0) { printf("zero inside an encoded frame\n"); exit(1); }
+
+	proto_rx_init(&reply_rx);
+	proto_rx_feed(&reply_rx, frame, len, on_reply, NULL);
+	if(reply_rx.frames != 1) bad_replies++;
+}
+
+static void dispatch(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len > PROTO_MAX_PAYLOAD) { printf("decoded %u bytes, more than the max\n", len); exit(1); }
+	proto_dispatch(table, PROTO_NUM_CMDS, payload, len, send, NULL);
+}
+
+//feed a stream in random pieces no bigger than a USB packet
+static void feed_split(proto_rx_t* rx, const uint8_t* data, uint32_t len, proto_frame_cb_t cb, void* ctx) {
+	while(len) {
+		uint32_t n = 1 + rand() % USB_PACKET;
+		if(n > len) n = len;
+		proto_rx_feed(rx, data, n, cb, ctx);
+		data += n;
+		len -= n;
+	}
+}
+
+#ifdef LIBFUZZER
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	proto_rx_t rx;
+	proto_rx_init(&rx);
+	proto_rx_feed(&rx, data, size, dispatch, NULL);
+	return 0;
+}
+#else
+
+//========== round trip ==========
+static uint8_t expect[PROTO_MAX_PAYLOAD];
+static uint16_t expect_len;
+static uint32_t matched;
+
+static void check_frame(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len != expect_len || memcmp(payload, expect, len) != 0) {
+		printf("round trip mismatch (%u bytes back, %u sent)\n", len, expect_len);
+		exit(1);
+	}
+	matched++;
+}
+
+static void round_trip(uint32_t iterations) {
+	proto_rx_t rx;
+	uint8_t frame[PROTO_MAX_FRAME];
+	proto_rx_init(&rx);
+
+	for(uint32_t i = 0; i < iterations; i++) {
+		//lots of zeros and long non-zero runs, that's where COBS goes wrong
+		expect_len = 2 + rand() % (PROTO_MAX_PAYLOAD - 1);
+		int style = rand() % 3;
+		for(uint16_t j = 0; j < expect_len; j++) {
+			expect[j] = style == 0 ? rand() : style == 1 ? (rand() % 4 ? 0 : rand()) : 1 + rand() % 255;
+		}
+		uint16_t n = proto_encode(expect, expect_len, frame);
+
+		//printf noise (never contains a zero) before the frame
+		char noise[80];
+		int noise_len = snprintf(noise, sizeof(noise), "[%u] state change %d\r\n", i, rand());
+		feed_split(&rx, (const uint8_t*)noise, noise_len, check_frame, NULL);
+		feed_split(&rx, frame, n, check_frame, NULL);
+	}
+
+	if(matched != iterations) { printf("round trip lost frames (%u of %u)\n", matched, iterations); exit(1); }
+	printf("round trip: %u frames, noise rejected as %u framing and %u CRC errors\n", matched, rx.framing_errors, rx.crc_errors);
+}
+
+//========== mutated and random streams ==========
+static void mutate(uint32_t iterations) {
+	static uint8_t stream[STREAM_MAX];
+	proto_rx_t rx;
+	proto_rx_init(&rx);
+
+	for(uint32_t i = 0; i < iterations; i++) {
+		uint32_t len = 0;
+
+		//a handful of valid requests...
+		while(len + PROTO_MAX_FRAME < STREAM_MAX && rand() % 8) {
+			uint8_t payload[PROTO_MAX_PAYLOAD];
+			uint16_t plen = 2 + rand() % 20;
+			for(uint16_t j = 0; j < plen; j++) payload[j] = rand();
+			payload[0] = rand() % (PROTO_NUM_CMDS + 2);
+			len += proto_encode(payload, plen, stream + len);
+		}
+
+		//...then damage them: flip bits, drop bytes, splice in junk
+		uint32_t hits = rand() % 8;
+		for(uint32_t h = 0; h < hits && len > 0; h++) {
+			uint32_t at = rand() % len;
+			switch(rand() % 3) {
+				case 0: stream[at] ^= 1 << (rand() % 8); break;
+				case 1: memmove(stream + at, stream + at + 1, len - at - 1); len--; break;
+				case 2: stream[at] = rand(); break;
+			}
+		}
+
+		//and every so often just noise, including frames too long for the buffer
+		if(rand() % 16 == 0) {
+			len = rand() % STREAM_MAX;
+			uint8_t density = rand() % 256;
+			for(uint32_t j = 0; j < len; j++) stream[j] = (rand() % 256 < density) ? 0 : rand();
+		}
+
+		feed_split(&rx, stream, len, dispatch, NULL);
+	}
+
+	printf("mutated: %u frames passed the CRC, %u CRC errors, %u framing errors, %u overflows\n",
+			rx.frames, rx.crc_errors, rx.framing_errors, rx.overflows);
+	printf("         %u handled, %u replies, %u bad replies\n", handled, replies, bad_replies);
+	if(bad_replies) exit(1);
+}
+
+int main(int argc, char** argv) {
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 200000;
+	srand(argc > 2 ? strtoul(argv[2], NULL, 0) : 1);
+
+	round_trip(iterations);
+	mutate(iterations);
+	printf("ok\n");
+	return 0;
+}
+#endif
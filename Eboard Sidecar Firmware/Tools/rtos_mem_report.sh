@@ -0,0 +1,61 @@
+#!/bin/sh
+# RAM report for the statically allocated RTOS objects (see Core/Inc/rtos_objects.h)
+# reads the map file the linker writes and lists every object with its size, then the RAM headroom
+# usage: Tools/rtos_mem_report.sh "Debug/Eboard Sidecar Firmware.map"
+
+MAP=${1:-"Debug/Eboard Sidecar Firmware.map"}
+
+if [ ! -f "$MAP" ]; then
+	echo "can't find map file: $MAP" >&2
+	exit 1
+fi
+
+awk '
+function hex(s,    i, c, v) {
+	v = 0
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	for(i = 1; i <= length(s); i++) {
+		c = index("0123456789abcdef", substr(s, i, 1)) - 1
+		v = v * 16 + c
+	}
+	return v
+}
+
+function report(name, size) {
+	printf("  %-32s %7d\n", name, size)
+	total += size
+}
+
+# memory region sizes
+$1 == "RAM" && $2 ~ /^0x/ { ram_start = hex($2); ram_len = hex($3) }
+
+# input sections we care about, either on one line or wrapped onto the next
+/^ \.bss\.(rtos_static\.|Idle_|Timer_|ucHeap)/ {
+	name = $1
+	sub(/^\.bss\.(rtos_static\.)?/, "", name)
+	if(NF >= 3) report(name, hex($3))
+	else pending = name
+	next
+}
+pending != "" {
+	if($1 ~ /^0x/) report(pending, hex($2))
+	pending = ""
+}
+
+# end of the reserved heap/stack is the last thing in RAM
+/^\._user_heap_stack/ {
+	if(NF >= 3) { used_end = hex($2) + hex($3) }
+	else wrapped = 1
+	next
+}
+wrapped { used_end = hex($1) + hex($2); wrapped = 0 }
+
+BEGIN { print "RTOS object RAM (bytes):" }
+END {
+	printf("  %-32s %7d\n", "total", total)
+	if(ram_len > 0 && used_end > 0) {
+		printf("RAM used %d of %d bytes, %d bytes headroom\n", used_end - ram_start, ram_len, ram_start + ram_len - used_end)
+	}
+}
+' "$MAP"
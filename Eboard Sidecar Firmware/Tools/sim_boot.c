@@ -0,0 +1,58 @@
+//boot the whole firmware on a Linux host (Tools/host, see sim.h): a 30V battery, the button held through
+//precharge (and past the long press, the fallback) and let go, then however many virtual seconds of running
+//prints the firmware's own output, then what the outputs did and how much faster than real time it ran
+//build from the Tools directory:
+//  cmake -S . -B build && cmake --build build
+//usage: ./build/sim_boot [virtual seconds] [battery volts]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "board.h"
+#include "main.h"
+
+#define BUTTON_HOLD_MS 3500 //past the long press
+
+typedef struct {
+	uint32_t pin_changes;
+	uint32_t ccr_changes;
+	uint32_t buzzer_notes; //TIM2 reloads
+	uint64_t latched_at;
+} outputs_t;
+
+static void on_output(void* ctx, sim_out_t kind, uint16_t id, uint32_t value) {
+	outputs_t* out = (outputs_t*)ctx;
+	switch(kind) {
+		case SIM_OUT_PIN:
+			out->pin_changes++;
+			if(id == sim_pin_id(FET_DRV_GPIO_Port, FET_DRV_Pin) && value && !out->latched_at) out->latched_at = sim_now();
+			break;
+		case SIM_OUT_CCR: out->ccr_changes++; break;
+		case SIM_OUT_ARR: if(id == SIM_TIM_ID(2, TIM_CHANNEL_1)) out->buzzer_notes++; break;
+		default: break;
+	}
+}
+
+int main(int argc, char** argv) {
+	uint32_t seconds = argc > 1 ? (uint32_t)atoi(argv[1]) : 10;
+	float volts = argc > 2 ? (float)atof(argv[2]) : 30;
+	outputs_t out = {0};
+
+	sim_out_hook(on_output, &out);
+	board_battery(volts);
+	board_boot();
+
+	board_button(true);
+	sim_run_for(BUTTON_HOLD_MS);
+	board_button(false);
+	sim_run_until(SIM_MS(seconds * 1000ull));
+	fflush(stdout);
+
+	printf("\n%.3f virtual seconds in %.3f host seconds (%.0fx real time)\n",
+			sim_now() / (double)SIM_CPU_HZ, sim_host_seconds(), sim_now() / (double)SIM_CPU_HZ / sim_host_seconds());
+	if(out.latched_at) printf("power latched at %.3fs\n", out.latched_at / (double)SIM_CPU_HZ);
+	else printf("power never latched\n");
+	printf("%u pin changes, %u compare register changes, %u buzzer notes, %u ADC samples\n",
+			out.pin_changes, out.ccr_changes, out.buzzer_notes, sim_adc_conversions());
+	if(sim_powered_off()) printf("powered off: %s\n", sim_power_off_reason());
+	return 0;
+}
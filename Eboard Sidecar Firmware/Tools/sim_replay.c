@@ -0,0 +1,618 @@
+//replay a trace of the board's inputs through the whole firmware on the host (Tools/host, see sim.h) and record
+//everything it drives, with the virtual time it happened at:
+//  pin       output pins other than the bargraph (FET_DRV is the power latch)
+//  ccr       compare registers (lights on TIM4, button LED on TIM5)
+//  arr       reload registers (the buzzer's note on TIM2)
+//  enable    timer channels starting and stopping
+//  flags     event flags being set, by name where the firmware gives the bit one (soc_crit, long_press...)
+//  bargraph  the 10 LEDs as the rider sees them: everything lit over the last two multiplex periods
+//  off       the board cutting its own power
+//pin, enable, flags and off are recorded inside the call that does them, so their times are to the cycle; ccr and
+//arr are plain register writes that the mock only notices every SIM_WATCH_CYCLES (host/sim.h), so those can be up
+//to 10us late, and the bargraph is looked at once a ms
+//the same trace always gives the same record, so records can be kept and compared bit for bit after a change to
+//a filter or a threshold; marks in the trace measure how long the firmware takes to react to something
+//
+//trace format, one event per line, time in ms from power on, # starts a comment:
+//  <ms> volts <V>       battery voltage; straight lines between points, two at the same time make a step
+//  <ms> raw <counts>    same thing as the ADC code, for recorded samples
+//  <ms> noise <mV>      uniform noise on every sample from here on (deterministic)
+//  <ms> spikes <n>      n samples in a thousand pulled to 0 from here on, motor current bouncing the divider's
+//                       ground (deterministic)
+//  <ms> precharge <ms>  the divider is on the ESC side of the power FETs: from here the bus starts over from 0V and
+//                       comes up through the precharge resistor with this RC time constant, until FET_DRV latches
+//                       it onto the pack; how far short of the pack it was at the latch is printed after the first run
+//  <ms> ringing <mV>    the light drivers' switching on the divider from here on: a damped ring after every edge
+//                       of TIM4 CH3/CH4, this big at the edge, down when a driver turns on and up when it turns
+//                       off; how much of it ended up in the samples is printed after the first run
+//  <ms> button <0|1>    PB_IN
+//  <ms> rc <us>         a 50Hz pulse train of that width on RC_IN, 0 for signal lost (line held low)
+//  <ms> rc_level <0|1>  RC_IN edge by hand
+//  <ms> stream <0|1>    raw ADC streaming over USB on or off, as PROTO_STREAM asks for it; the monitor makes the
+//                       switch on its next pass, and the ringing figure only counts the monitor's own samples
+//  <ms> mark <signal>   start a latency timer, stopped the next time <signal> happens: a flag name from the
+//                       record, latch (FET_DRV on) or off
+//  <ms> end             stop here (otherwise 1s past the last event)
+//with -n, the trace runs that many times, shifted later by the jitter each time, so the inputs land at different
+//points in the firmware's loops; the latencies from all the runs are printed as histograms
+//
+//build from the Tools directory:
+//  cmake -S . -B build && cmake --build build
+//usage: ./build/sim_replay <trace> [-o record.txt] [-c expected.txt] [-n runs] [-j jitter ms]
+//  -o writes the record of the first run, -c compares it against a saved one (exit status 1 if they differ)
+//traces/<name>.expected is the saved record of traces/<name>.trace and ctest checks every trace against its own;
+//after a change that's meant to move them, look at the diff and write them again with -o
+//a mark on something that shouldn't happen (read_fail, soc_crit on a healthy pack) counts the runs it happened in
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "board.h"
+#include "main.h"
+#include "pushbutton.h"
+#include "config.h"
+#include "batt_monitor.h"
+#include "adc_stream.h"
+
+#define MAX_INPUTS 65536
+#define MAX_MARKS 256
+#define MAX_LATENCIES MAX_MARKS //per run
+#define SLICE_CYCLES SIM_MS(1) //the harness gets control back this often to feed inputs and sample the bargraph
+#define BAR_WINDOW 4 //slices; two multiplex periods of the draw thread (BARGRAPH_UPDATE_DELAY)
+#define RC_PERIOD SIM_MS(20)
+#define END_MARGIN SIM_MS(1000)
+#define HIST_BUCKETS 10
+#define HIST_WIDTH 40
+#define RING_TAU 3e-6 //s, the ringing's decay
+#define RING_HZ 500e3
+
+typedef enum { IN_VOLTS, IN_RAW, IN_NOISE, IN_SPIKES, IN_PRECHARGE, IN_RINGING, IN_BUTTON, IN_RC, IN_RC_LEVEL, IN_STREAM, IN_MARK, IN_END } in_kind_t;
+
+typedef struct {
+	uint64_t at;
+	in_kind_t kind;
+	float value;
+	char signal[24]; //IN_MARK
+} input_t;
+
+typedef struct {
+	const char* group; //RTOS_EVENT_FLAGS name
+	uint32_t bit;
+	const char* name;
+} flag_name_t;
+
+typedef struct {
+	GPIO_TypeDef* port;
+	uint16_t pin;
+	const char* name;
+} pin_name_t;
+
+typedef struct {
+	char signal[24];
+	uint64_t at;
+	bool open;
+} mark_t;
+
+typedef struct {
+	char signal[24];
+	double ms;
+} latency_t;
+
+//bits the firmware keeps private: batt_monitor.c, pushbutton.h, board_lights.c
+static const flag_name_t flag_bits[] = {
+	{"monitor_util", 1<<2, "soc_low"},
+	{"monitor_util", 1<<3, "soc_crit"},
+	{"monitor_util", 1<<4, "read_fail"},
+	{"pushbutton", BUTTON_BUMPED, "bumped"}, //in the order the state machine takes them
+	{"pushbutton", BUTTON_SHORT_PRESSED, "short_press"},
+	{"pushbutton", BUTTON_LONG_PRESSED, "long_press"},
+	{"pushbutton", BUTTON_RELEASED, "released"},
+	{"flash", 1<<0, "lights_off"},
+	{"flash", 1<<1, "taillight_only"},
+	{"flash", 1<<2, "tail_solid_head"},
+	{"flash", 1<<3, "tail_and_head"},
+};
+#define NUM_FLAG_BITS (sizeof(flag_bits) / sizeof(flag_bits[0]))
+
+//the other groups are the modules talking to themselves (ADC ready, DMA done...), not something they drive
+static const char* const quiet_groups[] = {"led_action", "buzzer_action", "monitor_util", "animator_run",
+		"shutdown_done", "usb_cmd", "adc_stream"};
+#define NUM_QUIET_GROUPS (sizeof(quiet_groups) / sizeof(quiet_groups[0]))
+
+//===================== PRIVATE VARIABLES =====================
+static input_t inputs[MAX_INPUTS];
+static uint32_t num_inputs = 0;
+
+static pin_name_t pins[] = {
+	{FET_DRV_GPIO_Port, FET_DRV_Pin, "FET_DRV"}, {PB_LED_GPIO_Port, PB_LED_Pin, "PB_LED"},
+	{BUZZER_GPIO_Port, BUZZER_Pin, "BUZZER"}, {CC_CHAN_1_GPIO_Port, CC_CHAN_1_Pin, "CC_CHAN_1"},
+	{CC_CHAN_2_GPIO_Port, CC_CHAN_2_Pin, "CC_CHAN_2"},
+};
+#define NUM_PINS (sizeof(pins) / sizeof(pins[0]))
+
+static pin_name_t leds[10] = {
+	{LED0_GPIO_Port, LED0_Pin, "LED0"}, {LED1_GPIO_Port, LED1_Pin, "LED1"}, {LED2_GPIO_Port, LED2_Pin, "LED2"},
+	{LED3_GPIO_Port, LED3_Pin, "LED3"}, {LED4_GPIO_Port, LED4_Pin, "LED4"}, {LED5_GPIO_Port, LED5_Pin, "LED5"},
+	{LED6_GPIO_Port, LED6_Pin, "LED6"}, {LED7_GPIO_Port, LED7_Pin, "LED7"}, {LED8_GPIO_Port, LED8_Pin, "LED8"},
+	{LED9_GPIO_Port, LED9_Pin, "LED9"},
+};
+
+//this run
+static FILE* record;
+static uint64_t shift; //jitter for this run
+static mark_t marks[MAX_MARKS];
+static uint32_t num_marks = 0;
+static latency_t latencies[MAX_LATENCIES];
+static uint32_t num_latencies = 0;
+static uint16_t bar_pins = 0; //LEDs lit right now
+static uint16_t bar_window[BAR_WINDOW];
+static uint16_t bar_frame = 0;
+
+//the battery, as the ADC source sees it
+static uint32_t batt_cursor = 0, noise_cursor = 0, spike_cursor = 0, ring_cursor = 0, precharge_cursor = 0;
+static uint64_t latched_at = 0; //FET_DRV on, the bus is the pack from here
+static uint64_t precharge_from; //the one in force started
+static float precharge_gap = 0; //counts the bus was short of the pack at the last sample
+static double precharge_latch_gap = -1, precharge_latch_ms; //at the latch; -1 for none
+static uint32_t noise_state = 0x2545F491u;
+static uint32_t spike_state = 0x9E3779B9u; //its own, so adding spikes leaves the noise as it was
+static uint32_t ring_samples = 0; //the ringing in the monitor's samples (injected, not the stream's), in counts
+static double ring_sum = 0, ring_sum_sq = 0, ring_worst = 0;
+
+//==================== PRIVATE FUNCTION PROTOTYPES ===================
+static bool load_trace(const char* path);
+static uint64_t trace_end();
+static int run(uint32_t index, bool first, const char* out_path, const char* expect_path, int latency_fd);
+static uint16_t battery_source(void* ctx, uint32_t channel, uint64_t at);
+static float ringing(float amplitude, uint64_t at);
+static void on_output(void* ctx, sim_out_t kind, uint16_t id, uint32_t value);
+static void put_time(uint64_t at);
+static void signal_event(const char* signal, uint64_t at);
+static void sample_bargraph();
+static int compare(FILE* got, const char* expect_path);
+static void print_histograms(latency_t* all, uint32_t count, uint32_t runs);
+
+int main(int argc, char** argv) {
+	const char* trace_path = NULL;
+	const char* out_path = NULL;
+	const char* expect_path = NULL;
+	uint32_t runs = 1;
+	double jitter_ms = 0.37; //doesn't divide into any of the firmware's periods
+
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-o") && i + 1 < argc) out_path = argv[++i];
+		else if(!strcmp(argv[i], "-c") && i + 1 < argc) expect_path = argv[++i];
+		else if(!strcmp(argv[i], "-n") && i + 1 < argc) runs = (uint32_t)atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc) jitter_ms = atof(argv[++i]);
+		else if(argv[i][0] != '-' && !trace_path) trace_path = argv[i];
+		else {
+			fprintf(stderr, "usage: %s <trace> [-o record.txt] [-c expected.txt] [-n runs] [-j jitter ms]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(!trace_path || !runs) {
+		fprintf(stderr, "usage: %s <trace> [-o record.txt] [-c expected.txt] [-n runs] [-j jitter ms]\n", argv[0]);
+		return 2;
+	}
+	if(!load_trace(trace_path)) return 2;
+
+	//the firmware and the kernel are all static, so each run gets a fresh process
+	//its latencies come back over a pipe, a latency_t at a time
+	int status = 0;
+	latency_t* all = NULL;
+	uint32_t num_all = 0;
+	for(uint32_t k = 0; k < runs; k++) {
+		int fds[2];
+		if(pipe(fds)) { perror("pipe"); return 2; }
+		pid_t pid = fork();
+		if(pid < 0) { perror("fork"); return 2; }
+		if(pid == 0) {
+			close(fds[0]);
+			shift = (uint64_t)llround(k * jitter_ms * SIM_CYCLES_PER_MS);
+			exit(run(k, k == 0, out_path, expect_path, fds[1]));
+		}
+		close(fds[1]);
+
+		latency_t l;
+		while(read(fds[0], &l, sizeof(l)) == sizeof(l)) {
+			all = realloc(all, (num_all + 1) * sizeof(l));
+			all[num_all++] = l;
+		}
+		close(fds[0]);
+
+		int child_status;
+		waitpid(pid, &child_status, 0);
+		if(!WIFEXITED(child_status) || WEXITSTATUS(child_status)) status = 1;
+	}
+
+	if(num_all) print_histograms(all, num_all, runs);
+	free(all);
+	return status;
+}
+
+// ==================== PRIVATE FUNCTION DEFINITIONS =====================
+static bool load_trace(const char* path) {
+	FILE* f = fopen(path, "r");
+	if(!f) { perror(path); return false; }
+
+	char line[256];
+	uint32_t line_num = 0;
+	while(fgets(line, sizeof(line), f)) {
+		line_num++;
+		char* hash = strchr(line, '#');
+		if(hash) *hash = 0;
+
+		double ms;
+		char cmd[16], arg[24] = "";
+		int n = sscanf(line, "%lf %15s %23s", &ms, cmd, arg);
+		if(n <= 0) continue; //blank or comment
+
+		input_t* in = &inputs[num_inputs];
+		in->at = (uint64_t)llround(ms * SIM_CYCLES_PER_MS);
+		in->value = (float)atof(arg);
+		if(!strcmp(cmd, "volts")) in->kind = IN_VOLTS;
+		else if(!strcmp(cmd, "raw")) in->kind = IN_RAW;
+		else if(!strcmp(cmd, "noise")) in->kind = IN_NOISE;
+		else if(!strcmp(cmd, "spikes")) in->kind = IN_SPIKES;
+		else if(!strcmp(cmd, "precharge")) in->kind = IN_PRECHARGE;
+		else if(!strcmp(cmd, "ringing")) in->kind = IN_RINGING;
+		else if(!strcmp(cmd, "button")) in->kind = IN_BUTTON;
+		else if(!strcmp(cmd, "rc")) in->kind = IN_RC;
+		else if(!strcmp(cmd, "rc_level")) in->kind = IN_RC_LEVEL;
+		else if(!strcmp(cmd, "stream")) in->kind = IN_STREAM;
+		else if(!strcmp(cmd, "mark")) in->kind = IN_MARK;
+		else if(!strcmp(cmd, "end")) in->kind = IN_END;
+		else n = 0;
+
+		if(n < (in->kind == IN_END ? 2 : 3) || (num_inputs && in->at < inputs[num_inputs - 1].at)) {
+			fprintf(stderr, "%s:%u: bad or out of order event\n", path, line_num);
+			fclose(f);
+			return false;
+		}
+		if(in->kind == IN_MARK) snprintf(in->signal, sizeof(in->signal), "%s", arg);
+		if(++num_inputs == MAX_INPUTS) break;
+	}
+	fclose(f);
+	return true;
+}
+
+static uint64_t trace_end() {
+	for(uint32_t i = 0; i < num_inputs; i++) if(inputs[i].kind == IN_END) return inputs[i].at;
+	return (num_inputs ? inputs[num_inputs - 1].at : 0) + END_MARGIN;
+}
+
+static int run(uint32_t index, bool first, const char* out_path, const char* expect_path, int latency_fd) {
+	char* text = NULL;
+	size_t text_len = 0;
+	record = open_memstream(&text, &text_len);
+	if(!first && !freopen("/dev/null", "w", stdout)) return 1; //the firmware's own printing, once is enough
+
+	sim_out_hook(on_output, NULL);
+	sim_adc_source(battery_source, NULL);
+	board_boot();
+
+	uint64_t end = trace_end() + shift;
+	uint64_t rc_next = 0;
+	uint32_t rc_width = 0; //cycles, 0 for no pulses
+	uint32_t next_input = 0;
+
+	while(sim_now() < end && !sim_powered_off()) {
+		uint64_t slice_end = sim_now() + SLICE_CYCLES;
+		if(slice_end > end) slice_end = end;
+
+		//everything due in this slice goes in at its exact time
+		while(next_input < num_inputs && inputs[next_input].at + shift < slice_end) {
+			input_t* in = &inputs[next_input++];
+			uint64_t at = in->at + shift;
+			switch(in->kind) {
+				case IN_BUTTON: sim_gpio_input_at(at, PB_IN_GPIO_Port, PB_IN_Pin, in->value != 0); break;
+				case IN_RC_LEVEL: sim_gpio_input_at(at, RC_IN_GPIO_Port, RC_IN_Pin, in->value != 0); break;
+				case IN_STREAM: adc_stream_enable(in->value != 0); break; //only a request, no need for the exact time
+				case IN_RC:
+					if(!rc_width && in->value > 0) rc_next = at;
+					rc_width = (uint32_t)llround(in->value * (SIM_CPU_HZ / 1000000));
+					break;
+				case IN_MARK:
+					if(num_marks == MAX_MARKS) break;
+					marks[num_marks] = (mark_t){.at = at, .open = true};
+					memcpy(marks[num_marks++].signal, in->signal, sizeof(in->signal));
+					break;
+				default: break; //the battery source reads the rest straight from the trace
+			}
+		}
+		while(rc_width && rc_next < slice_end) {
+			sim_gpio_input_at(rc_next, RC_IN_GPIO_Port, RC_IN_Pin, true);
+			sim_gpio_input_at(rc_next + rc_width, RC_IN_GPIO_Port, RC_IN_Pin, false);
+			rc_next += RC_PERIOD;
+		}
+
+		sim_run_until(slice_end);
+		sample_bargraph();
+	}
+
+	if(sim_powered_off()) {
+		put_time(sim_now());
+		fprintf(record, "off %s\n", sim_power_off_reason());
+		signal_event("off", sim_now());
+	}
+	fflush(stdout);
+	fclose(record);
+
+	int status = 0;
+	for(uint32_t i = 0; i < num_marks; i++) {
+		if(marks[i].open) fprintf(stderr, "run %u: mark at %.3fms: %s never happened\n", index,
+				(marks[i].at - shift) / (double)SIM_CYCLES_PER_MS, marks[i].signal);
+	}
+	if(first) {
+		if(out_path) {
+			FILE* f = fopen(out_path, "w");
+			if(!f) { perror(out_path); status = 1; }
+			else {
+				fwrite(text, 1, text_len, f);
+				fclose(f);
+			}
+		}
+		if(expect_path) {
+			FILE* got = fmemopen(text, text_len, "r");
+			status |= compare(got, expect_path);
+			fclose(got);
+		}
+		if(precharge_latch_gap >= 0) {
+			fprintf(stderr, "precharge: latched %.1fms in, the bus %.3fV short of the pack\n", precharge_latch_ms,
+					precharge_latch_gap * config_get(CONFIG_DIVIDER_NV) * 1e-9f);
+		}
+		if(ring_samples) {
+			float mv_per_count = config_get(CONFIG_DIVIDER_NV) * 1e-6f;
+			fprintf(stderr, "ringing in %u samples: mean %+.1fmV, rms %.1fmV, worst %.1fmV; the monitor ended on %.3fV\n",
+					ring_samples, ring_sum / ring_samples * mv_per_count, sqrt(ring_sum_sq / ring_samples) * mv_per_count,
+					ring_worst * mv_per_count, monitor_voltage());
+		}
+		fprintf(stderr, "%.3f virtual seconds in %.3f host seconds (%.0fx real time)\n",
+				sim_now() / (double)SIM_CPU_HZ, sim_host_seconds(), sim_now() / (double)SIM_CPU_HZ / sim_host_seconds());
+	}
+
+	for(uint32_t i = 0; i < num_latencies; i++) {
+		if(write(latency_fd, &latencies[i], sizeof(latencies[i])) != sizeof(latencies[i])) status = 1;
+	}
+	free(text);
+	return status;
+}
+
+//straight lines between the trace's battery points, plus the noise in force at the time
+static uint16_t battery_source(void* ctx, uint32_t channel, uint64_t at) {
+	static input_t* batt[MAX_INPUTS];
+	static input_t* noise[MAX_INPUTS];
+	static input_t* spikes[MAX_INPUTS];
+	static input_t* rings[MAX_INPUTS];
+	static input_t* precharges[MAX_INPUTS];
+	static uint32_t num_batt = 0, num_noise = 0, num_spikes = 0, num_rings = 0, num_precharges = 0;
+	static bool sorted = false;
+	if(!sorted) {
+		for(uint32_t i = 0; i < num_inputs; i++) {
+			if(inputs[i].kind == IN_VOLTS || inputs[i].kind == IN_RAW) batt[num_batt++] = &inputs[i];
+			else if(inputs[i].kind == IN_NOISE) noise[num_noise++] = &inputs[i];
+			else if(inputs[i].kind == IN_SPIKES) spikes[num_spikes++] = &inputs[i];
+			else if(inputs[i].kind == IN_RINGING) rings[num_rings++] = &inputs[i];
+			else if(inputs[i].kind == IN_PRECHARGE) precharges[num_precharges++] = &inputs[i];
+		}
+		sorted = true;
+	}
+	if(!num_batt) return 0;
+
+	//samples arrive in time order, so the cursors only move forward
+	while(batt_cursor + 1 < num_batt && batt[batt_cursor + 1]->at + shift <= at) batt_cursor++;
+	while(noise_cursor < num_noise && noise[noise_cursor]->at + shift <= at) noise_cursor++;
+	while(spike_cursor < num_spikes && spikes[spike_cursor]->at + shift <= at) spike_cursor++;
+	while(ring_cursor < num_rings && rings[ring_cursor]->at + shift <= at) ring_cursor++;
+	while(precharge_cursor < num_precharges && precharges[precharge_cursor]->at + shift <= at) precharge_cursor++;
+
+	const input_t* a = batt[batt_cursor];
+	float raw_a = a->kind == IN_RAW ? a->value : board_battery_raw(a->value);
+	float raw = raw_a;
+	if(a->at + shift <= at && batt_cursor + 1 < num_batt) {
+		const input_t* b = batt[batt_cursor + 1];
+		float raw_b = b->kind == IN_RAW ? b->value : board_battery_raw(b->value);
+		raw = raw_a + (raw_b - raw_a) * (float)(at - (a->at + shift)) / (float)(b->at - a->at);
+	}
+
+	if(precharge_cursor && !latched_at) {
+		const input_t* p = precharges[precharge_cursor - 1];
+		precharge_from = p->at + shift;
+		float bus = raw * (1.0f - (float)exp(-(double)(at - precharge_from) / (p->value * SIM_CYCLES_PER_MS)));
+		precharge_gap = raw - bus;
+		raw = bus;
+	}
+
+	if(noise_cursor) {
+		float volts_per_count = config_get(CONFIG_DIVIDER_NV) * 1e-9f;
+		float amplitude = noise[noise_cursor - 1]->value * 1e-3f / volts_per_count;
+		noise_state ^= noise_state << 13; //xorshift32
+		noise_state ^= noise_state >> 17;
+		noise_state ^= noise_state << 5;
+		raw += amplitude * ((noise_state >> 8) / (float)(1 << 23) - 1.0f);
+	}
+	if(ring_cursor) {
+		float ring = ringing(rings[ring_cursor - 1]->value, at);
+		if(sim_adc_injected()) {
+			ring_samples++;
+			ring_sum += ring;
+			ring_sum_sq += ring * ring;
+			if(fabs(ring) > ring_worst) ring_worst = fabs(ring);
+		}
+		raw += ring;
+	}
+	if(spike_cursor) {
+		spike_state ^= spike_state << 13;
+		spike_state ^= spike_state >> 17;
+		spike_state ^= spike_state << 5;
+		if(spike_state % 1000 < spikes[spike_cursor - 1]->value) raw = 0;
+	}
+	return raw <= 0 ? 0 : raw >= 4095 ? 4095 : (uint16_t)(raw + 0.5f);
+}
+
+//in counts: the last edge of each light driver, rung down since
+static float ringing(float amplitude, uint64_t at) {
+	float counts = amplitude * 1e-3f / (config_get(CONFIG_DIVIDER_NV) * 1e-9f);
+	const uint32_t channels[] = {TIM_CHANNEL_3, TIM_CHANNEL_4};
+	float ring = 0;
+	for(uint8_t i = 0; i < 2; i++) {
+		bool rising;
+		uint64_t since = sim_tim_pwm_edge(TIM4, channels[i], at, &rising);
+		if(since == UINT64_MAX) continue;
+		double t = since / (double)SIM_CPU_HZ;
+		ring += (rising ? -counts : counts) * exp(-t / RING_TAU) * cos(2 * M_PI * RING_HZ * t);
+	}
+	return ring;
+}
+
+static void on_output(void* ctx, sim_out_t kind, uint16_t id, uint32_t value) {
+	uint64_t now = sim_now();
+
+	if(kind == SIM_OUT_PIN) {
+		for(uint8_t i = 0; i < 10; i++) {
+			if(id != sim_pin_id(leds[i].port, leds[i].pin)) continue;
+			bar_pins = value ? bar_pins | (1 << i) : bar_pins & ~(1 << i);
+			return;
+		}
+		put_time(now);
+		const char* name = NULL;
+		for(uint8_t i = 0; i < NUM_PINS; i++) if(id == sim_pin_id(pins[i].port, pins[i].pin)) name = pins[i].name;
+		if(name) fprintf(record, "pin %s %u\n", name, value);
+		else fprintf(record, "pin P%c%u %u\n", 'A' + id / 16, id % 16, value);
+		if(name && !strcmp(name, "FET_DRV") && value) {
+			signal_event("latch", now);
+			if(!latched_at && precharge_cursor) {
+				precharge_latch_gap = precharge_gap;
+				precharge_latch_ms = (now - precharge_from) / (double)SIM_CYCLES_PER_MS;
+			}
+			latched_at = now;
+		}
+	}
+	else if(kind == SIM_OUT_CCR || kind == SIM_OUT_ENABLE) {
+		put_time(now);
+		fprintf(record, "%s TIM%u_CH%u %u\n", kind == SIM_OUT_CCR ? "ccr" : "enable", id / 4, id % 4 + 1, value);
+	}
+	else if(kind == SIM_OUT_ARR) {
+		put_time(now);
+		fprintf(record, "arr TIM%u %u\n", id / 4, value);
+	}
+	else if(kind == SIM_OUT_FLAGS) {
+		const char* group = sim_flags_name(id);
+		for(uint8_t i = 0; i < NUM_FLAG_BITS; i++) {
+			if(strcmp(group, flag_bits[i].group) || !(value & flag_bits[i].bit)) continue;
+			put_time(now);
+			fprintf(record, "flags %s\n", flag_bits[i].name);
+			signal_event(flag_bits[i].name, now);
+			value &= ~flag_bits[i].bit;
+		}
+		bool quiet = false;
+		for(uint8_t i = 0; i < NUM_QUIET_GROUPS; i++) if(!strcmp(group, quiet_groups[i])) quiet = true;
+		if(value && !quiet) {
+			put_time(now);
+			fprintf(record, "flags %s 0x%x\n", group, value);
+		}
+	}
+}
+
+//microseconds, printed exactly: a cycle is 15.625ns
+static void put_time(uint64_t at) {
+	at -= shift;
+	fprintf(record, "%llu.%06llu ", (unsigned long long)(at / 64), (unsigned long long)(at % 64 * 15625));
+}
+
+static void signal_event(const char* signal, uint64_t at) {
+	for(uint32_t i = 0; i < num_marks; i++) {
+		mark_t* m = &marks[i];
+		if(!m->open || at < m->at || strcmp(m->signal, signal)) continue;
+		m->open = false;
+		if(num_latencies < MAX_LATENCIES) {
+			latency_t* l = &latencies[num_latencies++];
+			snprintf(l->signal, sizeof(l->signal), "%s", signal);
+			l->ms = (at - m->at) / (double)SIM_CYCLES_PER_MS;
+		}
+	}
+}
+
+//the draw thread lights the odd and the even LEDs in turn, so a frame is whatever was lit over both halves
+static void sample_bargraph() {
+	uint16_t frame = bar_pins;
+	for(uint8_t i = BAR_WINDOW - 1; i > 0; i--) {
+		bar_window[i] = bar_window[i - 1];
+		frame |= bar_window[i];
+	}
+	bar_window[0] = bar_pins;
+	if(frame == bar_frame) return;
+	bar_frame = frame;
+	put_time(sim_now());
+	fprintf(record, "bargraph 0x%03x\n", frame);
+}
+
+static int compare(FILE* got, const char* expect_path) {
+	FILE* want = fopen(expect_path, "r");
+	if(!want) { perror(expect_path); return 1; }
+
+	char a[256], b[256];
+	uint32_t line = 0;
+	int status = 0;
+	while(true) {
+		line++;
+		char* ga = fgets(a, sizeof(a), got);
+		char* gb = fgets(b, sizeof(b), want);
+		if(!ga && !gb) break;
+		if(!ga || !gb || strcmp(a, b)) {
+			fprintf(stderr, "record differs from %s at line %u\n  expected: %s  got:      %s", expect_path, line,
+					gb ? b : "(end)\n", ga ? a : "(end)\n");
+			status = 1;
+			break;
+		}
+	}
+	fclose(want);
+	if(!status) fprintf(stderr, "record matches %s (%u lines)\n", expect_path, line - 1);
+	return status;
+}
+
+static int by_ms(const void* a, const void* b) {
+	double d = ((const latency_t*)a)->ms - ((const latency_t*)b)->ms;
+	return d < 0 ? -1 : d > 0;
+}
+
+//one histogram per signal, HIST_BUCKETS even buckets between the fastest and the slowest
+static void print_histograms(latency_t* all, uint32_t count, uint32_t runs) {
+	qsort(all, count, sizeof(all[0]), by_ms);
+	for(uint32_t i = 0; i < count; i++) {
+		if(!all[i].signal[0]) continue; //already printed
+
+		double* ms = malloc(count * sizeof(double));
+		uint32_t n = 0;
+		char signal[24];
+		snprintf(signal, sizeof(signal), "%s", all[i].signal);
+		for(uint32_t j = i; j < count; j++) {
+			if(strcmp(all[j].signal, signal)) continue;
+			ms[n++] = all[j].ms;
+			all[j].signal[0] = 0;
+		}
+
+		printf("\nmark -> %s: %u samples (in %u runs), min %.3fms, median %.3fms, p90 %.3fms, max %.3fms\n", signal,
+				n, runs, ms[0], ms[n / 2], ms[n * 9 / 10], ms[n - 1]);
+		double width = (ms[n - 1] - ms[0]) / HIST_BUCKETS;
+		if(width <= 0) {
+			free(ms);
+			continue;
+		}
+		uint32_t buckets[HIST_BUCKETS] = {0}, most = 0;
+		for(uint32_t j = 0; j < n; j++) {
+			uint32_t b = (uint32_t)((ms[j] - ms[0]) / width);
+			if(b >= HIST_BUCKETS) b = HIST_BUCKETS - 1;
+			if(++buckets[b] > most) most = buckets[b];
+		}
+		for(uint32_t b = 0; b < HIST_BUCKETS; b++) {
+			printf("  %9.3f - %9.3fms %5u ", ms[0] + b * width, ms[0] + (b + 1) * width, buckets[b]);
+			for(uint32_t w = 0; w < buckets[b] * HIST_WIDTH / most; w++) putchar('#');
+			putchar('\n');
+		}
+		free(ms);
+	}
+}
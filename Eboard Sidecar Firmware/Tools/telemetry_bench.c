@@ -0,0 +1,142 @@
+//host benchmark for the telemetry encoding (Core/Src/telemetry.c)
+//encodes a synthetic ride at the monitor rate, checks it decodes back exactly, and reports
+//the size against raw structs and the encode cost
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc Tools/telemetry_bench.c Core/Src/telemetry.c -o telemetry_bench
+//usage: ./telemetry_bench [ride minutes] [sample period ms]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "telemetry.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#define CYCLE_UNIT "TSC cycles"
+#else
+#define CYCLES() ((uint64_t)clock() * (1000000000ull / CLOCKS_PER_SEC))
+#define CYCLE_UNIT "ns"
+#endif
+
+#define RECORD_OVERHEAD 2 //datalog [type][len] per record
+#define DROP_EVERY 50 //blocks, for the resync check
+
+//what logging the samples naively would look like (floats straight out of the monitor)
+typedef struct {
+	uint32_t tick;
+	float voltage;
+	float soc;
+	uint8_t light_mode;
+	uint8_t flags;
+} raw_sample_t;
+
+//a ride: the pack sags from 33V to 25V with load noise, lights change every few minutes
+static void make_ride(telem_sample_t* s, uint32_t n, uint32_t period) {
+	uint32_t tick = 5000;
+	float mav = 33.0f;
+	uint8_t mode = 1;
+
+	for(uint32_t i = 0; i < n; i++) {
+		tick += (rand() % 20) ? period : period + 1; //osDelay() plus a bit of processing
+		float base = 33.0f - 8.0f * i / n;
+		float load = ((rand() % 100) < 2) ? -0.8f : 0; //hard acceleration
+		float noise = ((rand() % 7) - 3) * 0.01f;
+		float v = base + load + noise;
+		mav += (v - mav) * period / 2560; //256 sample average at 100Hz
+		if(rand() % (180000 / period) == 0) mode = (mode + 1) % 4;
+
+		s[i].tick = tick;
+		s[i].voltage = v * 100;
+		s[i].soc = (mav - 24.0f) / 9.6f * 1000;
+		s[i].light_mode = mode;
+		s[i].flags = (mav < 26.0f ? TELEM_FLAG_SOC_LOW : 0) | ((rand() % (30000 / period) == 0) ? TELEM_FLAG_BUTTON : 0);
+	}
+}
+
+typedef struct {
+	const telem_sample_t* expect;
+	uint32_t next;
+	uint32_t mismatches;
+} check_t;
+
+static void check_sample(const telem_sample_t* s, void* ctx) {
+	check_t* c = (check_t*)ctx;
+	//after a gap the decoder skips ahead, so find where we are by tick
+	while(c->expect[c->next].tick < s->tick) c->next++;
+	if(memcmp(&c->expect[c->next], s, sizeof(*s)) != 0) c->mismatches++;
+	c->next++;
+}
+
+int main(int argc, char** argv) {
+	uint32_t minutes = argc > 1 ? atoi(argv[1]) : 30;
+	uint32_t period = argc > 2 ? atoi(argv[2]) : 10;
+	uint32_t n = minutes * 60 * 1000 / period;
+	telem_sample_t* ride = malloc(n * sizeof(telem_sample_t));
+	uint8_t* blocks = malloc(n * TELEM_BLOCK_MAX); //way more than needed
+	uint8_t* lens = malloc(n);
+	uint32_t num_blocks = 0, encoded = 0;
+	uint64_t cycles = 0, worst = 0;
+
+	srand(1);
+	make_ride(ride, n, period);
+
+	telem_encoder_t enc;
+	telem_encoder_init(&enc);
+	for(uint32_t i = 0; i < n; i++) {
+		uint64_t start = CYCLES();
+		uint8_t len = telem_encode(&enc, &ride[i], &blocks[num_blocks * TELEM_BLOCK_MAX]);
+		uint64_t took = CYCLES() - start;
+		cycles += took;
+		if(took > worst) worst = took;
+		if(len) lens[num_blocks++] = len;
+	}
+	uint8_t len = telem_flush(&enc, &blocks[num_blocks * TELEM_BLOCK_MAX]);
+	if(len) lens[num_blocks++] = len;
+	for(uint32_t b = 0; b < num_blocks; b++) encoded += lens[b] + RECORD_OVERHEAD;
+
+	//everything back out again
+	telem_decoder_t dec;
+	check_t check = {.expect = ride};
+	uint32_t decoded = 0;
+	telem_decoder_init(&dec);
+	for(uint32_t b = 0; b < num_blocks; b++) {
+		int got = telem_decode_block(&dec, &blocks[b * TELEM_BLOCK_MAX], lens[b], check_sample, &check);
+		if(got < 0) check.mismatches++;
+		else decoded += got;
+	}
+
+	//and again with blocks going missing
+	telem_decoder_t lossy;
+	check_t lossy_check = {.expect = ride};
+	uint32_t lossy_decoded = 0;
+	telem_decoder_init(&lossy);
+	for(uint32_t b = 0; b < num_blocks; b++) {
+		if(b % DROP_EVERY == DROP_EVERY - 1) continue;
+		int got = telem_decode_block(&lossy, &blocks[b * TELEM_BLOCK_MAX], lens[b], check_sample, &lossy_check);
+		if(got > 0) lossy_decoded += got;
+	}
+
+	uint32_t raw = n * (sizeof(telem_sample_t) + RECORD_OVERHEAD);
+	uint32_t raw_float = n * (sizeof(raw_sample_t) + RECORD_OVERHEAD);
+	printf("ride: %lu min, %lu samples every %lums\n", (unsigned long)minutes, (unsigned long)n, (unsigned long)period);
+	printf("  raw structs     %lu bytes (%u+%d per sample), %lu bytes as floats\n", (unsigned long)raw,
+			(unsigned)sizeof(telem_sample_t), RECORD_OVERHEAD, (unsigned long)raw_float);
+	printf("  encoded         %lu bytes in %lu blocks, %.2f bytes/sample\n", (unsigned long)encoded,
+			(unsigned long)num_blocks, (double)encoded / n);
+	printf("  reduction       %.1fx vs raw structs, %.1fx vs floats\n", (double)raw / encoded, (double)raw_float / encoded);
+	printf("  flash per hour  %.1f KB (a 128K sector lasts %.0f min)\n", encoded / 1024.0 * 60 / minutes,
+			128.0 * 1024 * minutes / encoded);
+	printf("  encode cost     %.1f %s/sample mean, %lu worst (host)\n", (double)cycles / n, CYCLE_UNIT, (unsigned long)worst);
+	printf("  round trip      %lu/%lu samples, %lu mismatches\n", (unsigned long)decoded, (unsigned long)n,
+			(unsigned long)check.mismatches);
+	printf("  1 in %d blocks lost: %lu samples recovered, %lu skipped to resync, %lu mismatches\n", DROP_EVERY,
+			(unsigned long)lossy_decoded, (unsigned long)lossy.skipped, (unsigned long)lossy_check.mismatches);
+
+	int ok = decoded == n && check.mismatches == 0 && lossy_check.mismatches == 0;
+	free(ride);
+	free(blocks);
+	free(lens);
+	return ok ? 0 : 1;
+}
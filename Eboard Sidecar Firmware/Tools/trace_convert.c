@@ -0,0 +1,287 @@
+//turn the RTOS event trace (PROTO_TRACE, see trace.h) into a timeline on a Linux host
+//writes Chrome trace event JSON, which chrome://tracing and ui.perfetto.dev both open: one row per thread showing
+//when it ran, one row per interrupt, and queue, event flag, delay and mark events as instants on the thread that
+//did them
+//build from the project directory:
+//  gcc -O2 -std=gnu11 -ICore/Inc Tools/trace_convert.c Core/Src/protocol.c Core/Src/checksum.c -o trace_convert
+//usage: ./trace_convert /dev/ttyACM0 stream [seconds] > trace.json    (streams, then turns tracing back off)
+//       ./trace_convert /dev/ttyACM0 snapshot                       (start snapshot mode; black box triggers freeze it)
+//       ./trace_convert /dev/ttyACM0 dump > trace.json              (the snapshot ring, then re-arms it)
+//       ./trace_convert capture.bin > trace.json                    (PROTO_TRACE frames captured from the port)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include "protocol.h"
+#include "trace_format.h"
+
+#define DEFAULT_CPU_HZ 64000000 //until an info frame says otherwise
+#define REPLY_WAIT 2 //s to wait for the reply to a dump or snapshot command
+#define DRAIN_TIME 1 //s to let the last frames in flight arrive after turning the stream off
+
+#define THREAD_PID 1
+#define ISR_PID 2
+
+typedef struct {
+	uint64_t cycles; //unwrapped
+	uint8_t kind, arg;
+	uint16_t value;
+	uint32_t lost_before; //events dropped just before this one
+} event_t;
+
+static int port = -1;
+static event_t* events = NULL;
+static size_t num_events = 0, cap_events = 0;
+static uint64_t wrap = 0;
+static uint32_t last_cycles = 0;
+static uint32_t lost_pending = 0, lost_total = 0;
+static uint32_t cpu_hz = DEFAULT_CPU_HZ;
+static uint16_t cycles_per_event = 0;
+static char names[TRACE_NAME_ISR + 1][256][32];
+static bool done = false; //the command's final reply arrived
+
+static void send_command(uint8_t cmd, const uint8_t* args, uint16_t len) {
+	static uint8_t seq = 0;
+	uint8_t payload[PROTO_MAX_PAYLOAD];
+	uint8_t frame[PROTO_MAX_FRAME];
+	payload[0] = cmd;
+	payload[1] = seq++;
+	memcpy(payload + 2, args, len);
+	uint16_t n = proto_encode(payload, len + 2, frame);
+	if(write(port, frame, n) != n) perror("write");
+}
+
+static void add_event(const trace_event_t* e) {
+	if(num_events == cap_events) {
+		cap_events = cap_events ? cap_events * 2 : 4096;
+		events = realloc(events, cap_events * sizeof(event_t));
+		if(!events) { perror("realloc"); exit(1); }
+	}
+	//the cycle counter wraps every minute or so; events are in order, so any step backwards is a wrap
+	if(num_events > 0 && e->cycles < last_cycles) wrap += 1ull << 32;
+	last_cycles = e->cycles;
+	events[num_events++] = (event_t){.cycles = wrap + e->cycles, .kind = e->kind, .arg = e->arg, .value = e->value,
+			.lost_before = lost_pending};
+	lost_pending = 0;
+}
+
+static void on_frame(const uint8_t* payload, uint16_t len, void* ctx) {
+	if(len < 3 || payload[0] != (PROTO_TRACE | PROTO_REPLY)) return;
+	if(payload[2] == PROTO_OK && len >= 3 + sizeof(proto_trace_t)) {
+		proto_trace_t reply;
+		memcpy(&reply, payload + 3, sizeof(reply));
+		fprintf(stderr, "trace mode %u, %u cycles per event, %u events recorded, %u lost, %u in the dump\n",
+				reply.mode, reply.cycles_per_event, reply.events, reply.lost, reply.sent);
+		done = true;
+		return;
+	}
+	if(payload[2] != PROTO_MORE || len < 4) return;
+
+	const uint8_t* data = payload + 4;
+	uint16_t n = len - 4;
+	switch(payload[3]) {
+	case TRACE_FRAME_INFO: {
+		trace_info_t info;
+		if(n < sizeof(info)) break;
+		memcpy(&info, data, sizeof(info));
+		cpu_hz = info.cpu_hz;
+		cycles_per_event = info.cycles_per_event;
+		break;
+	}
+	case TRACE_FRAME_NAME:
+		if(n < 2 || data[0] > TRACE_NAME_ISR) break;
+		snprintf(names[data[0]][data[1]], sizeof(names[0][0]), "%.*s", n - 2, (const char*)data + 2);
+		break;
+	case TRACE_FRAME_EVENTS:
+		for(uint16_t i = 0; i + sizeof(trace_event_t) <= n; i += sizeof(trace_event_t)) {
+			trace_event_t e;
+			memcpy(&e, data + i, sizeof(e));
+			add_event(&e);
+		}
+		break;
+	case TRACE_FRAME_LOST: {
+		uint32_t lost;
+		if(n < sizeof(lost)) break;
+		memcpy(&lost, data, sizeof(lost));
+		lost_pending += lost;
+		lost_total += lost;
+		break;
+	}
+	}
+}
+
+static const char* name_of(uint8_t what, uint8_t number, const char* fallback, char* buf) {
+	if(names[what][number][0]) return names[what][number];
+	sprintf(buf, "%s %u", fallback, number);
+	return buf;
+}
+
+static double to_us(uint64_t cycles) {
+	return (double)(cycles - events[0].cycles) * 1e6 / cpu_hz;
+}
+
+static void write_json() {
+	char buf[48];
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	printf("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"threads\"}},\n", THREAD_PID);
+	printf("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"interrupts\"}}", ISR_PID);
+	for(int n = 0; n < 256; n++) {
+		if(names[TRACE_NAME_THREAD][n][0] || n == 0) {
+			printf(",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", THREAD_PID, n,
+					n ? names[TRACE_NAME_THREAD][n] : "unnumbered");
+		}
+		if(names[TRACE_NAME_ISR][n][0]) {
+			printf(",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", ISR_PID, n,
+					names[TRACE_NAME_ISR][n]);
+		}
+	}
+
+	int running = -1; //thread, unknown until the first switch
+	uint64_t since = 0;
+	for(size_t i = 0; i < num_events; i++) {
+		const event_t* e = &events[i];
+		double ts = to_us(e->cycles);
+		int tid = running < 0 ? 0 : running;
+
+		if(e->lost_before) {
+			//can't know who ran through the gap; end the slice and start over at the next switch
+			if(running >= 0) {
+				printf(",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+						name_of(TRACE_NAME_THREAD, running, "thread", buf), THREAD_PID, running, to_us(since), ts - to_us(since));
+			}
+			running = -1;
+			printf(",\n{\"ph\":\"i\",\"s\":\"g\",\"name\":\"%u events lost\",\"pid\":%d,\"tid\":0,\"ts\":%.3f}",
+					e->lost_before, THREAD_PID, ts);
+		}
+
+		switch(e->kind) {
+		case TRACE_SWITCH_IN:
+			if(running >= 0) {
+				printf(",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+						name_of(TRACE_NAME_THREAD, running, "thread", buf), THREAD_PID, running, to_us(since), ts - to_us(since));
+			}
+			running = e->arg;
+			since = e->cycles;
+			break;
+		case TRACE_ISR_ENTER:
+		case TRACE_ISR_EXIT:
+			printf(",\n{\"ph\":\"%s\",\"name\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f}", e->kind == TRACE_ISR_ENTER ? "B" : "E",
+					name_of(TRACE_NAME_ISR, e->arg, "exception", buf), ISR_PID, e->arg, ts);
+			break;
+		case TRACE_QUEUE_SEND:
+		case TRACE_QUEUE_RECEIVE:
+		case TRACE_QUEUE_BLOCK: {
+			const char* what = e->kind == TRACE_QUEUE_SEND ? "send" : e->kind == TRACE_QUEUE_RECEIVE ? "receive" : "wait on";
+			const char* queue = e->arg ? name_of(TRACE_NAME_QUEUE, e->arg, "queue", buf) : "semaphore";
+			printf(",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s %s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"waiting\":%u}}",
+					what, queue, THREAD_PID, tid, ts, e->value);
+			break;
+		}
+		case TRACE_FLAGS_SET:
+		case TRACE_FLAGS_BLOCK:
+			printf(",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s %s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"bits\":\"0x%04x\"}}",
+					e->kind == TRACE_FLAGS_SET ? "set" : "wait on", name_of(TRACE_NAME_FLAGS, e->arg, "flags", buf),
+					THREAD_PID, tid, ts, e->value);
+			break;
+		case TRACE_DELAY:
+			printf(",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"delay\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"ticks\":%u}}",
+					THREAD_PID, tid, ts, e->value);
+			break;
+		case TRACE_MARK:
+			printf(",\n{\"ph\":\"i\",\"s\":\"t\",\"name\":\"mark %u\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%u}}",
+					e->arg, THREAD_PID, tid, ts, e->value);
+			break;
+		}
+	}
+	printf("\n]}\n");
+}
+
+static bool elapsed(const struct timespec* start, double seconds) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9 >= seconds;
+}
+
+int main(int argc, char** argv) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s /dev/ttyACM0 stream [seconds] | dump > trace.json\n"
+				"       %s capture.bin > trace.json\n", argv[0], argv[0]);
+		return 1;
+	}
+	bool live = argc > 2;
+	bool dump = live && strcmp(argv[2], "dump") == 0;
+	bool arm = live && strcmp(argv[2], "snapshot") == 0;
+	if(live && !dump && !arm && strcmp(argv[2], "stream") != 0) {
+		fprintf(stderr, "%s: expected stream, snapshot or dump\n", argv[2]);
+		return 1;
+	}
+	double seconds = argc > 3 ? atof(argv[3]) : 5;
+
+	port = open(argv[1], (live ? O_RDWR : O_RDONLY) | O_NOCTTY);
+	if(port < 0) { perror(argv[1]); return 1; }
+	struct termios tio;
+	if(tcgetattr(port, &tio) == 0) { //not a tty when reading back a capture
+		cfmakeraw(&tio);
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 1; //reads give up after 100ms
+		tcsetattr(port, TCSANOW, &tio);
+	}
+
+	proto_rx_t rx;
+	proto_rx_init(&rx);
+	uint8_t buf[4096];
+	ssize_t n;
+
+	if(!live) {
+		while((n = read(port, buf, sizeof(buf))) > 0) proto_rx_feed(&rx, buf, n, on_frame, NULL);
+	}
+	else {
+		uint8_t mode = dump ? TRACE_DUMP : arm ? TRACE_SNAPSHOT : TRACE_STREAM;
+		send_command(PROTO_TRACE, &mode, 1);
+
+		//dump and snapshot just wait for the reply
+		bool until_reply = dump || arm;
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while(!(until_reply ? done || elapsed(&start, REPLY_WAIT) : elapsed(&start, seconds))) {
+			n = read(port, buf, sizeof(buf));
+			if(n > 0) proto_rx_feed(&rx, buf, n, on_frame, NULL);
+		}
+
+		if(arm) {
+			close(port);
+			return done ? 0 : 1;
+		}
+		if(!dump) {
+			mode = TRACE_OFF;
+			send_command(PROTO_TRACE, &mode, 1);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			while(!elapsed(&start, DRAIN_TIME)) {
+				n = read(port, buf, sizeof(buf));
+				if(n > 0) proto_rx_feed(&rx, buf, n, on_frame, NULL);
+			}
+		}
+	}
+	close(port);
+
+	if(num_events == 0) {
+		fprintf(stderr, "no events (is the trace on? a dump needs snapshot mode first)\n");
+		return 1;
+	}
+	write_json();
+
+	//what the recording itself cost, from the per-event cost the firmware measured at boot
+	double span = (double)(events[num_events - 1].cycles - events[0].cycles);
+	fprintf(stderr, "%zu events over %.3f s, %u lost, %u bad frames\n", num_events, span / cpu_hz, lost_total,
+			rx.crc_errors + rx.overflows);
+	if(cycles_per_event && span > 0) {
+		fprintf(stderr, "%u cycles per event, tracing took %.3f%% of the CPU\n", cycles_per_event,
+				100.0 * num_events * cycles_per_event / span);
+	}
+	free(events);
+	return 0;
+}
@@ -23,6 +23,8 @@
 #include "usbd_cdc_if.h"
 
 /* USER CODE BEGIN INCLUDE */
+#include "string.h"
+#include "usb_cmd.h"
 
 /* USER CODE END INCLUDE */
 
@@ -63,6 +65,14 @@
   */
 
 /* USER CODE BEGIN PRIVATE_DEFINES */
+//UserTxBufferFS doubles as the transmit ring; free-running indices need a power of two
+#define TX_RING_MASK (APP_TX_DATA_SIZE - 1)
+_Static_assert((APP_TX_DATA_SIZE & TX_RING_MASK) == 0, "APP_TX_DATA_SIZE must be a power of two");
+
+//UserRxBufferFS is split into one slot per full-speed packet
+#define RX_SLOT_SIZE CDC_DATA_FS_OUT_PACKET_SIZE
+#define RX_SLOTS (APP_RX_DATA_SIZE / RX_SLOT_SIZE)
+_Static_assert((RX_SLOTS & (RX_SLOTS - 1)) == 0, "RX_SLOTS must be a power of two");
 /* USER CODE END PRIVATE_DEFINES */
 
 /**
@@ -95,6 +105,29 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
+//writers claim space by moving tx_claimed and then copy into it; tx_head, the end of what the USB interrupt
+//may send, only catches up once no writer is still copying (tx_writers back to 0), so a writer that
+//interrupts another can't publish bytes the first one hasn't copied yet
+//the USB interrupt only moves tx_tail; tx_in_flight is the length of the chunk the endpoint is sending, 0 when idle
+static volatile uint32_t tx_head = 0;
+static volatile uint32_t tx_claimed = 0;
+static volatile uint8_t tx_writers = 0;
+static volatile uint32_t tx_tail = 0;
+static volatile uint16_t tx_in_flight = 0;
+static cdc_tx_stats_t tx_stats;
+
+//zero-copy block waiting behind the ring; it goes out once tx_tail reaches blk_at
+static const uint8_t* blk_buf;
+static uint32_t blk_at;
+static volatile uint16_t blk_len = 0; //0 when there's no block
+static volatile bool blk_sending = false;
+
+//single producer (the USB interrupt moves rx_head) and single consumer (the parser moves rx_tail)
+static uint16_t rx_len[RX_SLOTS];
+static volatile uint32_t rx_head = 0;
+static volatile uint32_t rx_tail = 0;
+static volatile bool rx_stalled = false; //every slot is full and the endpoint isn't armed
+static uint8_t rx_discard[RX_SLOT_SIZE]; //only used if the host reconnects while the slots are full
 
 /* USER CODE END PRIVATE_VARIABLES */
 
@@ -129,6 +162,20 @@ static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 static int8_t CDC_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
+//start sending the next contiguous piece of the ring if the endpoint is idle
+//called from the USB interrupt, or from a thread with interrupts masked
+static void CDC_Tx_Kick(void);
+
+//claim, copy and publish; the whole of Len or nothing if Whole, otherwise as much as fits
+static uint16_t CDC_Ring_Write(const uint8_t* Buf, uint16_t Len, bool Whole);
+
+//claim space and keep the stats, and publish once the copy is in; both with interrupts masked
+static uint16_t CDC_Ring_Claim(uint16_t Len, bool Whole);
+static void CDC_Ring_Publish(void);
+static void CDC_Ring_Copy(uint32_t At, const uint8_t* Buf, uint16_t Len);
+
+//point the OUT endpoint at the next free slot, or stall if there isn't one
+static void CDC_Rx_Arm(void);
 
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
@@ -155,7 +202,21 @@ static int8_t CDC_Init_FS(void)
   /* USER CODE BEGIN 3 */
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
-  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+
+  //the class arms reception right after this returns, so it needs somewhere to put a packet
+  //even if the parser has every slot; that one packet gets thrown away
+  if (rx_head - rx_tail >= RX_SLOTS){
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, rx_discard);
+  }
+  else{
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &UserRxBufferFS[(rx_head % RX_SLOTS) * RX_SLOT_SIZE]);
+  }
+  rx_stalled = false;
+
+  //a chunk that was in flight when the host went away never completes; send it again
+  tx_in_flight = 0;
+  blk_sending = false;
+  CDC_Tx_Kick();
   return (USBD_OK);
   /* USER CODE END 3 */
 }
@@ -167,6 +228,8 @@ static int8_t CDC_Init_FS(void)
 static int8_t CDC_DeInit_FS(void)
 {
   /* USER CODE BEGIN 4 */
+  tx_in_flight = 0; //whatever is queued waits for the next configuration
+  blk_sending = false;
   return (USBD_OK);
   /* USER CODE END 4 */
 }
@@ -262,8 +325,13 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  //hand the packet over where it landed, the parser reads it in place
+  if (Buf != rx_discard){
+    rx_len[rx_head % RX_SLOTS] = *Len;
+    rx_head++;
+    usb_cmd_rx_notify();
+  }
+  CDC_Rx_Arm();
   return (USBD_OK);
   /* USER CODE END 6 */
 }
@@ -283,12 +351,10 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
-  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
-  if (hcdc->TxState != 0){
-    return USBD_BUSY;
+  //goes through the ring so the caller's buffer is free as soon as this returns
+  if (CDC_Write_FS(Buf, Len) != Len){
+    result = USBD_BUSY;
   }
-  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
-  result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
   /* USER CODE END 7 */
   return result;
 }
@@ -310,13 +376,195 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 13 */
   UNUSED(Buf);
-  UNUSED(Len);
   UNUSED(epnum);
+  //retire the chunk that just went out and chain the next one straight away
+  UNUSED(Len);
+  if (blk_sending){
+    blk_sending = false;
+    blk_len = 0;
+    tx_stats.blocks++;
+  }
+  else{
+    tx_tail += tx_in_flight;
+    tx_in_flight = 0;
+  }
+  CDC_Tx_Kick();
   /* USER CODE END 13 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+uint16_t CDC_Write_FS(const uint8_t* Buf, uint16_t Len)
+{
+  return CDC_Ring_Write(Buf, Len, false);
+}
+
+bool CDC_Write_All(const uint8_t* Buf, uint16_t Len)
+{
+  return CDC_Ring_Write(Buf, Len, true) == Len;
+}
+
+bool CDC_Write_Block(const uint8_t* Header, uint16_t HeaderLen, const uint8_t* Block, uint16_t BlockLen)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t at = tx_claimed;
+  bool ok = (blk_len == 0) && (CDC_Tx_Space() >= HeaderLen);
+  if (ok){
+    CDC_Ring_Claim(HeaderLen, true);
+    //the interrupt can't get to blk_at before the header is published
+    blk_buf = Block;
+    blk_at = tx_claimed;
+    blk_len = BlockLen;
+  }
+  else{
+    tx_stats.blocks_dropped++;
+  }
+  __set_PRIMASK(primask);
+  if (!ok) return false;
+
+  CDC_Ring_Copy(at, Header, HeaderLen);
+
+  __disable_irq();
+  CDC_Ring_Publish();
+  __set_PRIMASK(primask);
+  return true;
+}
+
+bool CDC_Block_Busy(void)
+{
+  return blk_len != 0;
+}
+
+uint16_t CDC_Tx_Space(void)
+{
+  return APP_TX_DATA_SIZE - (tx_claimed - tx_tail);
+}
+
+bool CDC_Rx_Peek(const uint8_t** Buf, uint16_t* Len)
+{
+  if (rx_tail == rx_head) return false;
+  uint32_t slot = rx_tail % RX_SLOTS;
+  *Buf = &UserRxBufferFS[slot * RX_SLOT_SIZE];
+  *Len = rx_len[slot];
+  return true;
+}
+
+void CDC_Rx_Release(void)
+{
+  if (rx_tail == rx_head) return;
+  rx_tail++;
+
+  //restart reception if the interrupt had to stop for want of a slot
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (rx_stalled) CDC_Rx_Arm();
+  __set_PRIMASK(primask);
+}
+
+void CDC_Get_Tx_Stats(cdc_tx_stats_t* stats)
+{
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *stats = tx_stats;
+  __set_PRIMASK(primask);
+}
+
+static void CDC_Rx_Arm(void)
+{
+  if (rx_head - rx_tail >= RX_SLOTS){
+    rx_stalled = true;
+    return;
+  }
+  rx_stalled = false;
+  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &UserRxBufferFS[(rx_head % RX_SLOTS) * RX_SLOT_SIZE]);
+  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+}
+
+static uint16_t CDC_Ring_Write(const uint8_t* Buf, uint16_t Len, bool Whole)
+{
+  //safe from threads and interrupts alike, and under the kernel lock; only the index updates mask
+  //interrupts, the copy runs with them on since the USB interrupt outranks the RC pulse input
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  uint32_t at = tx_claimed;
+  uint16_t n = CDC_Ring_Claim(Len, Whole);
+  __set_PRIMASK(primask);
+
+  CDC_Ring_Copy(at, Buf, n);
+
+  __disable_irq();
+  CDC_Ring_Publish();
+  __set_PRIMASK(primask);
+  return n;
+}
+
+static uint16_t CDC_Ring_Claim(uint16_t Len, bool Whole)
+{
+  uint32_t space = APP_TX_DATA_SIZE - (tx_claimed - tx_tail);
+  uint16_t n = (Len < space) ? Len : space;
+  if (Whole && n < Len) n = 0;
+  tx_claimed += n;
+  tx_writers++;
+
+  tx_stats.queued += n;
+  if (n < Len){
+    tx_stats.dropped += Len - n;
+    tx_stats.drop_events++;
+  }
+  uint32_t fill = tx_claimed - tx_tail;
+  if (fill > tx_stats.max_fill) tx_stats.max_fill = fill;
+  return n;
+}
+
+static void CDC_Ring_Publish(void)
+{
+  if (--tx_writers == 0){
+    __DMB(); //data lands before the interrupt can see the new head
+    tx_head = tx_claimed;
+  }
+  CDC_Tx_Kick();
+}
+
+static void CDC_Ring_Copy(uint32_t At, const uint8_t* Buf, uint16_t Len)
+{
+  uint32_t start = At & TX_RING_MASK;
+  uint32_t first = APP_TX_DATA_SIZE - start;
+  if (first > Len) first = Len;
+  memcpy(&UserTxBufferFS[start], Buf, first);
+  memcpy(UserTxBufferFS, Buf + first, Len - first);
+}
+
+static void CDC_Tx_Kick(void)
+{
+  if (tx_in_flight != 0 || blk_sending) return;
+  if (hUsbDeviceFS.pClassData == NULL || hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED) return;
+
+  //the ring has drained up to the block, send it from where it sits
+  if (blk_len != 0 && tx_tail == blk_at){
+    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, (uint8_t*)blk_buf, blk_len);
+    blk_sending = true;
+    if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK) blk_sending = false;
+    return;
+  }
+  if (tx_head == tx_tail) return;
+
+  //one transfer per contiguous stretch, stopping short of a waiting block;
+  //the class adds the ZLP when it ends on a packet boundary
+  uint32_t start = tx_tail & TX_RING_MASK;
+  uint32_t len = tx_head - tx_tail;
+  if (len > APP_TX_DATA_SIZE - start) len = APP_TX_DATA_SIZE - start;
+  if (blk_len != 0 && len > blk_at - tx_tail) len = blk_at - tx_tail;
+
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, &UserTxBufferFS[start], len);
+  tx_in_flight = len;
+  if (USBD_CDC_TransmitPacket(&hUsbDeviceFS) == USBD_OK){
+    tx_stats.transfers++;
+  }
+  else{
+    tx_in_flight = 0;
+  }
+}
 
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
@@ -31,6 +31,7 @@
 #include "usbd_cdc.h"
 
 /* USER CODE BEGIN INCLUDE */
+#include "stdbool.h"
 
 /* USER CODE END INCLUDE */
 
@@ -66,6 +67,16 @@
   */
 
 /* USER CODE BEGIN EXPORTED_TYPES */
+//transmit ring statistics, see CDC_Write_FS()
+typedef struct {
+  uint32_t queued; //bytes accepted into the ring
+  uint32_t dropped; //bytes turned away because the ring was full
+  uint32_t drop_events; //writes that lost at least one byte
+  uint32_t transfers; //IN transfers started
+  uint16_t max_fill; //high-water mark of the ring, bytes
+  uint32_t blocks; //zero-copy blocks sent, see CDC_Write_Block()
+  uint32_t blocks_dropped; //turned away because the last one hadn't gone out yet
+} cdc_tx_stats_t;
 
 /* USER CODE END EXPORTED_TYPES */
 
@@ -110,6 +121,30 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+//copy data into the transmit ring and start sending if the endpoint is idle; never blocks, and can be
+//called from threads, interrupts or under the kernel lock. returns how many bytes fit, the rest are dropped and counted
+uint16_t CDC_Write_FS(const uint8_t* Buf, uint16_t Len);
+void CDC_Get_Tx_Stats(cdc_tx_stats_t* stats);
+
+//the same, but all of Len or nothing: the room is checked and claimed in one go, so another writer can't take it
+//in between. for frames, which are no use to the host cut short; false (and counted as dropped) if it didn't fit
+bool CDC_Write_All(const uint8_t* Buf, uint16_t Len);
+
+//queue a header through the ring and then send a block straight out of the caller's memory, no copy
+//the block goes out right after the header, in order with everything else written; the caller
+//must leave it alone until CDC_Block_Busy() goes false. one block at a time, returns false if
+//one is still waiting or the header doesn't fit
+bool CDC_Write_Block(const uint8_t* Header, uint16_t HeaderLen, const uint8_t* Block, uint16_t BlockLen);
+bool CDC_Block_Busy(void);
+
+//bytes that would fit in the transmit ring right now
+uint16_t CDC_Tx_Space(void);
+
+//received packets wait in UserRxBufferFS, one per slot, until the parser is done with them
+//peek at the oldest one in place (false if there isn't one), release it when finished
+//the OUT endpoint is NAKed while every slot is full, so nothing is lost
+bool CDC_Rx_Peek(const uint8_t** Buf, uint16_t* Len);
+void CDC_Rx_Release(void);
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 